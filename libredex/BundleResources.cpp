@@ -2239,9 +2239,12 @@ void BundleResources::obfuscate_xml_files(
       }
     }
   }
-  for (const auto& path : xml_paths) {
-    obfuscate_xml_attributes(path, do_not_obfuscate_elements);
-  }
+  run_on_resource_files(
+      "Obfuscate xml files",
+      std::vector<std::string>(xml_paths.begin(), xml_paths.end()),
+      [&](const std::string& path) {
+        obfuscate_xml_attributes(path, do_not_obfuscate_elements);
+      });
 }
 
 ResourcesPbFile::~ResourcesPbFile() {}
@@ -16,6 +16,7 @@
 #include <utility>
 
 #include "Debug.h"
+#include "FlatHashMap.h"
 
 // Forward declaration.
 namespace cc_impl {
@@ -426,33 +427,27 @@ using ConcurrentMap =
                            Identity,
                            n_slots>;
 
-template <typename Key,
+// A concurrent container with set semantics.
+template <typename SetContainer,
+          typename Key,
           typename Hash = std::hash<Key>,
-          typename Equal = std::equal_to<Key>,
           size_t n_slots = 31>
-class ConcurrentSet final
-    : public ConcurrentContainer<std::unordered_set<Key, Hash, Equal>,
-                                 Key,
-                                 Hash,
-                                 n_slots> {
+class ConcurrentSetContainer final
+    : public ConcurrentContainer<SetContainer, Key, Hash, n_slots> {
  public:
-  ConcurrentSet() = default;
+  ConcurrentSetContainer() = default;
 
-  ConcurrentSet(const ConcurrentSet& set)
-      : ConcurrentContainer<std::unordered_set<Key, Hash, Equal>,
-                            Key,
-                            Hash,
-                            n_slots>(set) {}
+  ConcurrentSetContainer(const ConcurrentSetContainer& set)
+      : ConcurrentContainer<SetContainer, Key, Hash, n_slots>(set) {}
 
-  ConcurrentSet(ConcurrentSet&& set) noexcept
-      : ConcurrentContainer<std::unordered_set<Key, Hash, Equal>,
-                            Key,
-                            Hash,
-                            n_slots>(std::move(set)) {}
+  ConcurrentSetContainer(ConcurrentSetContainer&& set) noexcept
+      : ConcurrentContainer<SetContainer, Key, Hash, n_slots>(std::move(set)) {}
 
-  ConcurrentSet& operator=(ConcurrentSet&&) noexcept = default;
+  ConcurrentSetContainer& operator=(ConcurrentSetContainer&&) noexcept =
+      default;
 
-  ConcurrentSet& operator=(const ConcurrentSet&) noexcept = default;
+  ConcurrentSetContainer& operator=(const ConcurrentSetContainer&) noexcept =
+      default;
 
   /*
    * The Boolean return value denotes whether the insertion took place.
@@ -497,6 +492,47 @@ class ConcurrentSet final
   }
 };
 
+template <typename Key,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          size_t n_slots = 31>
+using ConcurrentSet =
+    ConcurrentSetContainer<std::unordered_set<Key, Hash, Equal>,
+                           Key,
+                           Hash,
+                           n_slots>;
+
+/*
+ * Variants of ConcurrentMap and ConcurrentSet whose slots are flat
+ * open-addressing hash tables (see FlatHashMap.h) instead of node-based STL
+ * containers. They avoid an allocation per element and are more cache
+ * friendly, which matters most for small keys and values such as pointers.
+ *
+ * The API is the same. However, an insertion may move the elements of the
+ * slot it goes to, so references and pointers obtained through `at_unsafe()`,
+ * `find()`, iterators or `update()` must not be held across concurrent
+ * insertions.
+ */
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          size_t n_slots = 31>
+using ConcurrentFlatMap =
+    ConcurrentMapContainer<FlatHashMap<Key, Value, Hash, Equal>,
+                           Key,
+                           Value,
+                           Hash,
+                           Identity,
+                           n_slots>;
+
+template <typename Key,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          size_t n_slots = 31>
+using ConcurrentFlatSet =
+    ConcurrentSetContainer<FlatHashSet<Key, Hash, Equal>, Key, Hash, n_slots>;
+
 /**
 // A concurrent container with set semantics that only accepts insertions.
  *
@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Debug.h"
+
+/*
+ * A concurrent hash map for the interning tables of RedexContext, which are
+ * read far more often than they are written, and written from many threads
+ * at once.
+ *
+ * Lookups take no lock: the table is a set of shards, each an array of
+ * buckets holding chains of immutable nodes, which are published with release
+ * stores. Insertions and removals lock the shard of the key only, and there
+ * are many more shards than in a ConcurrentMap.
+ *
+ * When a shard grows, its nodes are relinked into a bucket array twice as
+ * large. Each shard has a sequence number that is odd while it is growing;
+ * a lookup that misses while the sequence number is odd or has changed
+ * retries under the lock of the shard.
+ *
+ * Nodes that are unlinked from a chain, and bucket arrays that are replaced
+ * when a shard grows, may still be traversed by concurrent lookups. They are
+ * freed by `reclaim()`, `clear()` and the destructor, which must not run
+ * concurrently with any other operation. A lookup that runs concurrently with
+ * an insertion or removal of the same key may or may not observe it.
+ */
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          size_t n_shards = 256>
+class ConcurrentInternMap {
+  static_assert((n_shards & (n_shards - 1)) == 0,
+                "The number of shards must be a power of two");
+
+ public:
+  ConcurrentInternMap() = default;
+  ConcurrentInternMap(const ConcurrentInternMap&) = delete;
+  ConcurrentInternMap& operator=(const ConcurrentInternMap&) = delete;
+
+  ~ConcurrentInternMap() { clear(); }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  Value get(const Key& key, Value default_value) const {
+    const Node* node = find_node(key);
+    return node == nullptr ? default_value : node->value;
+  }
+
+  /*
+   * This operation is always thread-safe.
+   */
+  size_t count(const Key& key) const { return find_node(key) != nullptr; }
+
+  /*
+   * This operation is always thread-safe. The key must be present.
+   */
+  Value at(const Key& key) const {
+    const Node* node = find_node(key);
+    always_assert(node != nullptr);
+    return node->value;
+  }
+
+  /*
+   * Returns whether the insertion took place, i.e. whether the key was not
+   * present yet. This operation is always thread-safe.
+   */
+  bool emplace(const Key& key, Value value) {
+    size_t hash = hash_of(key);
+    auto& shard = m_shards[shard_index(hash)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+    Buckets* buckets = shard.buckets.load(std::memory_order_relaxed);
+    if (buckets != nullptr &&
+        find_in_chain(buckets->head(hash), hash, key) != nullptr) {
+      return false;
+    }
+    if (buckets == nullptr || shard.size >= buckets->num_buckets()) {
+      buckets = grow(shard);
+    }
+    auto& head = buckets->head(hash);
+    head.store(new Node{key, value, hash, head.load(std::memory_order_relaxed)},
+               std::memory_order_release);
+    shard.size++;
+    return true;
+  }
+
+  /*
+   * Returns the number of removed elements. This operation is always
+   * thread-safe.
+   */
+  size_t erase(const Key& key) {
+    size_t hash = hash_of(key);
+    auto& shard = m_shards[shard_index(hash)];
+    std::lock_guard<std::mutex> lock(shard.lock);
+    Buckets* buckets = shard.buckets.load(std::memory_order_relaxed);
+    if (buckets == nullptr) {
+      return 0;
+    }
+    for (auto* link = &buckets->head(hash);;) {
+      Node* node = link->load(std::memory_order_relaxed);
+      if (node == nullptr) {
+        return 0;
+      }
+      if (node->hash == hash && Equal()(node->key, key)) {
+        // Concurrent lookups that are on the node continue with its successor.
+        link->store(node->next.load(std::memory_order_relaxed),
+                    std::memory_order_release);
+        node->retired_next = shard.retired_nodes;
+        shard.retired_nodes = node;
+        shard.size--;
+        return 1;
+      }
+      link = &node->next;
+    }
+  }
+
+  size_t size() const {
+    size_t size = 0;
+    for (const auto& shard : m_shards) {
+      std::lock_guard<std::mutex> lock(shard.lock);
+      size += shard.size;
+    }
+    return size;
+  }
+
+  /*
+   * Calls fn(key, value) for all elements. This operation is not thread-safe.
+   */
+  template <typename Fn>
+  void for_each(const Fn& fn) const {
+    for (const auto& shard : m_shards) {
+      const Buckets* buckets = shard.buckets.load(std::memory_order_acquire);
+      if (buckets == nullptr) {
+        continue;
+      }
+      for (size_t i = 0; i < buckets->num_buckets(); i++) {
+        for (const Node* node =
+                 buckets->heads[i].load(std::memory_order_acquire);
+             node != nullptr;
+             node = node->next.load(std::memory_order_acquire)) {
+          fn(node->key, node->value);
+        }
+      }
+    }
+  }
+
+  /*
+   * Frees the removed nodes and the replaced bucket arrays. This operation is
+   * not thread-safe: no lookup may be in flight, e.g. between passes.
+   */
+  void reclaim() {
+    for (auto& shard : m_shards) {
+      shard.retired_buckets.clear();
+      for (Node* node = shard.retired_nodes; node != nullptr;) {
+        Node* next = node->retired_next;
+        delete node;
+        node = next;
+      }
+      shard.retired_nodes = nullptr;
+    }
+  }
+
+  /*
+   * This operation is not thread-safe.
+   */
+  void clear() {
+    reclaim();
+    for (auto& shard : m_shards) {
+      std::unique_ptr<Buckets> buckets(shard.buckets.exchange(nullptr));
+      if (buckets != nullptr) {
+        for (size_t i = 0; i < buckets->num_buckets(); i++) {
+          delete_chain(buckets->heads[i].load(std::memory_order_relaxed));
+        }
+      }
+      shard.size = 0;
+    }
+  }
+
+ private:
+  struct Node {
+    const Key key;
+    const Value value;
+    const size_t hash;
+    std::atomic<Node*> next;
+    // Links the nodes that were removed from the table.
+    Node* retired_next{nullptr};
+
+    Node(const Key& key, Value value, size_t hash, Node* next)
+        : key(key), value(value), hash(hash), next(next) {}
+  };
+
+  struct Buckets {
+    // The lowest bits of the hash select the shard, the next ones the bucket.
+    size_t shift;
+    size_t mask;
+    std::unique_ptr<std::atomic<Node*>[]> heads;
+
+    explicit Buckets(size_t num_buckets)
+        : shift(__builtin_ctzll(n_shards)),
+          mask(num_buckets - 1),
+          heads(new std::atomic<Node*>[num_buckets]) {
+      for (size_t i = 0; i < num_buckets; i++) {
+        heads[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    size_t num_buckets() const { return mask + 1; }
+
+    std::atomic<Node*>& head(size_t hash) const {
+      return heads[(hash >> shift) & mask];
+    }
+  };
+
+  struct Shard {
+    mutable std::mutex lock;
+    std::atomic<Buckets*> buckets{nullptr};
+    // Odd while the shard is growing.
+    std::atomic<uint64_t> sequence{0};
+    size_t size{0};
+    // Replaced bucket arrays, whose nodes have been relinked into the current
+    // one.
+    std::vector<std::unique_ptr<Buckets>> retired_buckets;
+    Node* retired_nodes{nullptr};
+  };
+
+  static constexpr size_t kInitialBuckets = 16;
+
+  static size_t hash_of(const Key& key) {
+    // Spread the bits of weak hashes, such as those of pointers.
+    uint64_t h = Hash()(key) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 32);
+  }
+
+  static size_t shard_index(size_t hash) { return hash & (n_shards - 1); }
+
+  static const Node* find_in_chain(const std::atomic<Node*>& head,
+                                   size_t hash,
+                                   const Key& key) {
+    for (const Node* node = head.load(std::memory_order_acquire);
+         node != nullptr;
+         node = node->next.load(std::memory_order_acquire)) {
+      if (node->hash == hash && Equal()(node->key, key)) {
+        return node;
+      }
+    }
+    return nullptr;
+  }
+
+  const Node* find_node(const Key& key) const {
+    size_t hash = hash_of(key);
+    const auto& shard = m_shards[shard_index(hash)];
+    uint64_t sequence = shard.sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) == 0) {
+      const Buckets* buckets = shard.buckets.load(std::memory_order_acquire);
+      const Node* node = buckets == nullptr
+                             ? nullptr
+                             : find_in_chain(buckets->head(hash), hash, key);
+      if (node != nullptr) {
+        return node;
+      }
+      // A miss is only conclusive if no node was relinked meanwhile.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (shard.sequence.load(std::memory_order_relaxed) == sequence) {
+        return nullptr;
+      }
+    }
+    std::lock_guard<std::mutex> lock(shard.lock);
+    const Buckets* buckets = shard.buckets.load(std::memory_order_relaxed);
+    return buckets == nullptr ? nullptr
+                              : find_in_chain(buckets->head(hash), hash, key);
+  }
+
+  // Replaces the bucket array of the shard by one twice as large, and relinks
+  // the nodes into it. Each relinked node points to nodes that were relinked
+  // before it, so that concurrent lookups always reach the end of a chain,
+  // though they may miss nodes until the sequence number is even again.
+  static Buckets* grow(Shard& shard) {
+    Buckets* old_buckets = shard.buckets.load(std::memory_order_relaxed);
+    size_t num_buckets = old_buckets == nullptr
+                             ? kInitialBuckets
+                             : old_buckets->num_buckets() * 2;
+    auto* buckets = new Buckets(num_buckets);
+    if (old_buckets != nullptr) {
+      uint64_t sequence = shard.sequence.load(std::memory_order_relaxed);
+      shard.sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      for (size_t i = 0; i < old_buckets->num_buckets(); i++) {
+        for (Node* node =
+                 old_buckets->heads[i].load(std::memory_order_relaxed);
+             node != nullptr;) {
+          Node* next = node->next.load(std::memory_order_relaxed);
+          auto& head = buckets->head(node->hash);
+          node->next.store(head.load(std::memory_order_relaxed),
+                           std::memory_order_release);
+          head.store(node, std::memory_order_relaxed);
+          node = next;
+        }
+      }
+      shard.buckets.store(buckets, std::memory_order_release);
+      shard.retired_buckets.emplace_back(old_buckets);
+      shard.sequence.store(sequence + 2, std::memory_order_release);
+    } else {
+      shard.buckets.store(buckets, std::memory_order_release);
+    }
+    return buckets;
+  }
+
+  static void delete_chain(Node* node) {
+    while (node != nullptr) {
+      Node* next = node->next.load(std::memory_order_relaxed);
+      delete node;
+      node = next;
+    }
+  }
+
+  Shard m_shards[n_shards];
+};
@@ -221,6 +221,16 @@ void DexFieldRef::erase_field(DexFieldRef* f) {
   return g_redex->erase_field(f);
 }
 
+void DexFieldRef::delete_field_DO_NOT_USE(DexFieldRef* f) {
+  erase_field(f);
+  g_redex->erase_field_id(f);
+  delete f;
+}
+
+DexFieldRef* DexFieldRef::get_by_id(uint32_t id) {
+  return g_redex->get_field_by_id(id);
+}
+
 dex_member_refs::FieldDescriptorTokens DexFieldRef::get_descriptor_tokens()
     const {
   dex_member_refs::FieldDescriptorTokens res;
@@ -1071,6 +1081,12 @@ void DexMethodRef::change(const DexMethodSpec& ref, bool rename_on_collision) {
   g_redex->mutate_method(this, ref, rename_on_collision);
 }
 
+void DexMethodRef::change_all(
+    const std::vector<std::pair<DexMethodRef*, DexMethodSpec>>& changes,
+    bool rename_on_collision) {
+  g_redex->mutate_methods(changes, rename_on_collision);
+}
+
 void DexMethod::make_non_concrete() {
   m_access = static_cast<DexAccessFlags>(0);
   m_concrete = false;
@@ -2083,6 +2099,8 @@ DexType* DexType::make_type(const DexString* dstring) {
   return g_redex->make_type(dstring);
 }
 
+DexType* DexType::get_by_id(uint32_t id) { return g_redex->get_type_by_id(id); }
+
 DexType* DexType::get_type(const DexString* dstring) {
   return g_redex->get_type(dstring);
 }
@@ -2203,6 +2221,15 @@ std::string DexField::self_show() const { return show(this); }
 std::string DexMethod::self_show() const { return show(this); }
 std::string DexClass::self_show() const { return show(m_self); }
 
+DexMethodRef* DexMethodRef::get_by_id(uint32_t id) {
+  return g_redex->get_method_by_id(id);
+}
+
+void DexMethod::delete_method_DO_NOT_USE(DexMethod* method) {
+  g_redex->erase_method_id(method);
+  delete method;
+}
+
 void DexMethodRef::erase_method(DexMethodRef* mref) {
   g_redex->erase_method(mref);
   if (mref->is_def()) {
@@ -189,6 +189,7 @@ class DexType {
   friend struct RedexContext;
 
   const DexString* m_name;
+  uint32_t m_id;
 
   // See UNIQUENESS above for the rationale for the private constructor pattern.
   explicit DexType(const DexString* dstring) { m_name = dstring; }
@@ -225,9 +226,15 @@ class DexType {
     return get_type(DexString::get_string(str));
   }
 
+  // Return the type with the given id, or nullptr if there is none.
+  static DexType* get_by_id(uint32_t id);
+
  public:
   void set_name(const DexString* new_name);
 
+  // A dense id, unique among types, for side tables like IdMap.
+  uint32_t get_id() const { return m_id; }
+
   const DexString* get_name() const { return m_name; }
   const char* c_str() const { return get_name()->c_str(); }
   std::string_view str() const { return get_name()->str(); }
@@ -270,6 +277,7 @@ class DexFieldRef {
   DexFieldSpec m_spec;
   bool m_concrete;
   bool m_external;
+  uint32_t m_id;
 
   virtual ~DexFieldRef() {}
   DexFieldRef(DexType* container, const DexString* name, DexType* type) {
@@ -291,6 +299,11 @@ class DexFieldRef {
   const DexField* as_def() const;
   DexField* as_def();
 
+  // A dense id, unique among fields, for side tables like IdMap.
+  uint32_t get_id() const { return m_id; }
+  // Return the field with the given id, or nullptr if there is none.
+  static DexFieldRef* get_by_id(uint32_t id);
+
   DexType* get_class() const { return m_spec.cls; }
   const DexString* get_name() const { return m_spec.name; }
   const char* c_str() const { return get_name()->c_str(); }
@@ -319,10 +332,7 @@ class DexFieldRef {
   //
   // BE SURE YOU REALLY WANT TO DO THIS! Many Redex passes and structures
   // currently cache references and do not clean up, including global ones.
-  static void delete_field_DO_NOT_USE(DexFieldRef* f) {
-    erase_field(f);
-    delete f;
-  }
+  static void delete_field_DO_NOT_USE(DexFieldRef* f);
 };
 
 class DexField : public DexFieldRef {
@@ -804,6 +814,7 @@ class DexMethodRef {
   DexMethodSpec m_spec;
   bool m_concrete;
   bool m_external;
+  uint32_t m_id;
 
   ~DexMethodRef() {}
   DexMethodRef(DexType* type, const DexString* name, DexProto* proto)
@@ -823,6 +834,11 @@ class DexMethodRef {
   const DexMethod* as_def() const;
   DexMethod* as_def();
 
+  // A dense id, unique among methods, for side tables like IdMap.
+  uint32_t get_id() const { return m_id; }
+  // Return the method with the given id, or nullptr if there is none.
+  static DexMethodRef* get_by_id(uint32_t id);
+
   DexType* get_class() const { return m_spec.cls; }
   const DexString* get_name() const { return m_spec.name; }
   const char* c_str() const { return get_name()->c_str(); }
@@ -838,6 +854,12 @@ class DexMethodRef {
 
   void change(const DexMethodSpec& ref, bool rename_on_collision);
 
+  // Applies the changes at once, which is cheaper than changing the methods
+  // one by one, and lets methods swap their signatures.
+  static void change_all(
+      const std::vector<std::pair<DexMethodRef*, DexMethodSpec>>& changes,
+      bool rename_on_collision);
+
   DexMethod* make_concrete(DexAccessFlags,
                            std::unique_ptr<DexCode>,
                            bool is_virtual);
@@ -1094,7 +1116,7 @@ class DexMethod : public DexMethodRef {
   // BE SURE YOU REALLY WANT TO DO THIS! Many Redex passes and structures
   // currently cache references and do not clean up, including global ones like
   // `MethodProfiles` which maps `DexMethodRef`s to data.
-  static void delete_method_DO_NOT_USE(DexMethod* method) { delete method; }
+  static void delete_method_DO_NOT_USE(DexMethod* method);
 
   // This method currently does *NOT* free the `DexMethod`, as there may still
   // be references. This may will free most resources associated with the
@@ -9,7 +9,8 @@
  * This hashing functionality captures all details of a scope. By running this
  * after each pass, it makes it easy to find non-determinism build-over-build.
  * Look for the ~result~hash~ info that's added to each pass metrics.
- * We use boost hashes for performance.
+ * Classes are hashed in parallel with a fast multiply-fold mix, and their
+ * hashes are combined in a fixed tree order.
  *
  */
 
@@ -9,15 +9,18 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <cerrno>
 #include <boost/filesystem.hpp>
 #include <exception>
 #include <fcntl.h>
 #include <fstream>
 #include <functional>
 #include <inttypes.h>
+#include <limits>
 #include <list>
 #include <memory>
 #include <stdlib.h>
+#include <string_view>
 #include <sys/stat.h>
 #include <unordered_set>
 
@@ -34,6 +37,10 @@
 #define O_WRONLY _O_WRONLY
 #endif
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
 #include "Debug.h"
 #include "DexCallSite.h"
 #include "DexClass.h"
@@ -231,7 +238,14 @@ void GatheredTypes::sort_dexmethod_emitlist_method_similarity_order(
       OPUT, 2,
       "Skipping %zu perf sensitive methods, ordering %zu methods by similarity",
       perf_sensitive_methods.size(), remaining_methods.size());
-  MethodSimilarityOrderer method_similarity_orderer;
+  boost::optional<MethodSimilarityOrderer::MinHashOptions> minhash;
+  if (similarity_config != nullptr && similarity_config->use_minhash) {
+    minhash = MethodSimilarityOrderer::MinHashOptions{
+        similarity_config->minhash_error_tolerance,
+        similarity_config->minhash_rows_per_band,
+        similarity_config->minhash_max_candidates_per_bucket};
+  }
+  MethodSimilarityOrderer method_similarity_orderer(minhash);
   method_similarity_orderer.order(remaining_methods);
 
   lmeth.clear();
@@ -516,17 +530,66 @@ namespace {
 // Leave 250K empty as a margin to not overrun.
 constexpr uint32_t k_output_red_zone = 250000;
 
-constexpr uint32_t k_default_max_dex_size = 32 * 1024 * 1024;
+// Without an explicit size, a heap-allocated output buffer (see
+// DexOutputBuffer) is limited to this.
+constexpr size_t k_heap_max_dex_size = 32 * 1024 * 1024;
+
+#ifdef _WIN32
+constexpr size_t k_default_max_dex_size = k_heap_max_dex_size;
+#else
+// Only address space is reserved for the output (see DexOutputBuffer), so
+// this comfortably covers any dex without having to be configured.
+constexpr size_t k_default_max_dex_size = size_t(1) << 30;
+#endif
+
+// Dex offsets are 32 bits.
+constexpr size_t k_max_output_size = std::numeric_limits<uint32_t>::max();
 
-uint32_t get_dex_output_size(const ConfigFiles& conf) {
+size_t get_dex_output_size(const ConfigFiles& conf,
+                           DebugInfoKind debug_info_kind,
+                           size_t default_size) {
   size_t output_size;
-  conf.get_json_config().get("dex_output_buffer_size", k_default_max_dex_size,
+  conf.get_json_config().get("dex_output_buffer_size", default_size,
                              output_size);
-  return (uint32_t)output_size;
+  // Required because the BytecodeDebugger setting creates huge amounts
+  // of debug information (multiple dex debug entries per instruction)
+  if (debug_info_kind == DebugInfoKind::BytecodeDebugger) {
+    output_size *= 2;
+  }
+  return std::min(output_size + k_output_red_zone, k_max_output_size);
 }
 
 } // namespace
 
+DexOutputBuffer::DexOutputBuffer(size_t size, size_t heap_size)
+    : m_data(nullptr), m_size(size) {
+#ifndef _WIN32
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data != MAP_FAILED) {
+    m_data = static_cast<uint8_t*>(data);
+    m_mapped = true;
+    return;
+  }
+#endif
+  // Fall back to a zeroed heap allocation. All of it is committed, so it
+  // cannot be as generous as the reservation.
+  m_size = std::min(size, heap_size);
+  m_data = static_cast<uint8_t*>(calloc(m_size, 1));
+  always_assert_log(m_data != nullptr, "Could not allocate %zu bytes for dex",
+                    m_size);
+}
+
+DexOutputBuffer::~DexOutputBuffer() {
+#ifndef _WIN32
+  if (m_mapped) {
+    munmap(m_data, m_size);
+    return;
+  }
+#endif
+  free(m_data);
+}
+
 CodeItemEmit::CodeItemEmit(DexMethod* meth, DexCode* c, dex_code_item* ci)
     : method(meth), code(c), code_item(ci) {}
 
@@ -558,20 +621,14 @@ DexOutput::DexOutput(
     int min_sdk)
     : m_classes(classes),
       m_gtypes(std::move(gtypes)),
-      // Required because the BytecodeDebugger setting creates huge amounts
-      // of debug information (multiple dex debug entries per instruction)
-      m_output_size((debug_info_kind == DebugInfoKind::BytecodeDebugger
-                         ? get_dex_output_size(config_files) * 2
-                         : get_dex_output_size(config_files)) +
-                    k_output_red_zone),
-      m_output(std::make_unique<uint8_t[]>(m_output_size)),
+      m_output(get_dex_output_size(
+                   config_files, debug_info_kind, k_default_max_dex_size),
+               get_dex_output_size(
+                   config_files, debug_info_kind, k_heap_max_dex_size)),
       m_offset(0),
       m_iodi_metadata(iodi_metadata),
       m_config_files(config_files),
       m_min_sdk(min_sdk) {
-  // Ensure a clean slate.
-  memset(m_output.get(), 0, m_output_size);
-
   m_dodx = std::make_unique<DexOutputIdx>(*m_gtypes->get_dodx(m_output.get()));
 
   always_assert_log(
@@ -1231,6 +1288,21 @@ void DexOutput::generate_static_values() {
   }
 }
 
+template <typename T>
+static std::string_view as_string_view(const std::vector<T>& items) {
+  return std::string_view(reinterpret_cast<const char*>(items.data()),
+                          items.size() * sizeof(T));
+}
+
+template <typename T>
+std::string_view DexOutput::emit_bytes(const std::vector<T>& items) {
+  auto bytes = as_string_view(items);
+  uint8_t* out = m_output.get() + m_offset;
+  memcpy(out, bytes.data(), bytes.size());
+  inc_offset(bytes.size());
+  return std::string_view(reinterpret_cast<const char*>(out), bytes.size());
+}
+
 static bool annotation_cmp(const DexAnnotationDirectory* a,
                            const DexAnnotationDirectory* b) {
   return (a->viz_score() < b->viz_score());
@@ -1240,22 +1312,22 @@ void DexOutput::unique_annotations(annomap_t& annomap,
                                    std::vector<DexAnnotation*>& annolist) {
   int annocnt = 0;
   uint32_t mentry_offset = m_offset;
-  std::map<std::vector<uint8_t>, uint32_t> annotation_byte_offsets;
+  // Keyed by the bytes already written to the output.
+  std::unordered_map<std::string_view, uint32_t> annotation_byte_offsets;
+  std::vector<uint8_t> annotation_bytes;
   for (auto anno : annolist) {
     if (annomap.count(anno)) continue;
-    std::vector<uint8_t> annotation_bytes;
+    annotation_bytes.clear();
     anno->vencode(m_dodx.get(), annotation_bytes);
-    if (annotation_byte_offsets.count(annotation_bytes)) {
-      annomap[anno] = annotation_byte_offsets[annotation_bytes];
+    auto it = annotation_byte_offsets.find(as_string_view(annotation_bytes));
+    if (it != annotation_byte_offsets.end()) {
+      annomap[anno] = it->second;
       continue;
     }
-    /* Insert new annotation in tracking structs */
-    annotation_byte_offsets[annotation_bytes] = m_offset;
-    annomap[anno] = m_offset;
     /* Not a dupe, encode... */
-    uint8_t* annoout = (uint8_t*)(m_output.get() + m_offset);
-    memcpy(annoout, &annotation_bytes[0], annotation_bytes.size());
-    inc_offset(annotation_bytes.size());
+    annomap[anno] = m_offset;
+    annotation_byte_offsets.emplace(emit_bytes(annotation_bytes),
+                                    annomap[anno]);
     annocnt++;
   }
   if (annocnt) {
@@ -1270,23 +1342,21 @@ void DexOutput::unique_asets(annomap_t& annomap,
                              std::vector<DexAnnotationSet*>& asetlist) {
   int asetcnt = 0;
   uint32_t mentry_offset = align(m_offset);
-  std::map<std::vector<uint32_t>, uint32_t> aset_offsets;
+  std::unordered_map<std::string_view, uint32_t> aset_offsets;
+  std::vector<uint32_t> aset_bytes;
   for (auto aset : asetlist) {
     if (asetmap.count(aset)) continue;
-    std::vector<uint32_t> aset_bytes;
+    aset_bytes.clear();
     aset->vencode(m_dodx.get(), aset_bytes, annomap);
-    if (aset_offsets.count(aset_bytes)) {
-      asetmap[aset] = aset_offsets[aset_bytes];
+    auto it = aset_offsets.find(as_string_view(aset_bytes));
+    if (it != aset_offsets.end()) {
+      asetmap[aset] = it->second;
       continue;
     }
-    /* Insert new aset in tracking structs */
+    /* Not a dupe, encode... */
     align_output();
-    aset_offsets[aset_bytes] = m_offset;
     asetmap[aset] = m_offset;
-    /* Not a dupe, encode... */
-    uint8_t* asetout = (uint8_t*)(m_output.get() + m_offset);
-    memcpy(asetout, &aset_bytes[0], aset_bytes.size() * sizeof(uint32_t));
-    inc_offset(aset_bytes.size() * sizeof(uint32_t));
+    aset_offsets.emplace(emit_bytes(aset_bytes), asetmap[aset]);
     asetcnt++;
   }
   if (asetcnt) {
@@ -1300,10 +1370,11 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                              std::vector<ParamAnnotations*>& xreflist) {
   int xrefcnt = 0;
   uint32_t mentry_offset = align(m_offset);
-  std::map<std::vector<uint32_t>, uint32_t> xref_offsets;
+  std::unordered_map<std::string_view, uint32_t> xref_offsets;
+  std::vector<uint32_t> xref_bytes;
   for (auto xref : xreflist) {
     if (xrefmap.count(xref)) continue;
-    std::vector<uint32_t> xref_bytes;
+    xref_bytes.clear();
     xref_bytes.push_back((unsigned int)xref->size());
     for (auto& param : *xref) {
       auto& das = param.second;
@@ -1311,18 +1382,15 @@ void DexOutput::unique_xrefs(asetmap_t& asetmap,
                         "Uninitialized aset %p '%s'", das.get(), SHOW(das));
       xref_bytes.push_back(asetmap[das.get()]);
     }
-    if (xref_offsets.count(xref_bytes)) {
-      xrefmap[xref] = xref_offsets[xref_bytes];
+    auto it = xref_offsets.find(as_string_view(xref_bytes));
+    if (it != xref_offsets.end()) {
+      xrefmap[xref] = it->second;
       continue;
     }
-    /* Insert new xref in tracking structs */
+    /* Not a dupe, encode... */
     align_output();
-    xref_offsets[xref_bytes] = m_offset;
     xrefmap[xref] = m_offset;
-    /* Not a dupe, encode... */
-    uint8_t* xrefout = (uint8_t*)(m_output.get() + m_offset);
-    memcpy(xrefout, &xref_bytes[0], xref_bytes.size() * sizeof(uint32_t));
-    inc_offset(xref_bytes.size() * sizeof(uint32_t));
+    xref_offsets.emplace(emit_bytes(xref_bytes), xrefmap[xref]);
     xrefcnt++;
   }
   if (xrefcnt) {
@@ -1337,23 +1405,21 @@ void DexOutput::unique_adirs(asetmap_t& asetmap,
                              std::vector<DexAnnotationDirectory*>& adirlist) {
   int adircnt = 0;
   uint32_t mentry_offset = align(m_offset);
-  std::map<std::vector<uint32_t>, uint32_t> adir_offsets;
+  std::unordered_map<std::string_view, uint32_t> adir_offsets;
+  std::vector<uint32_t> adir_bytes;
   for (auto adir : adirlist) {
     if (adirmap.count(adir)) continue;
-    std::vector<uint32_t> adir_bytes;
+    adir_bytes.clear();
     adir->vencode(m_dodx.get(), adir_bytes, xrefmap, asetmap);
-    if (adir_offsets.count(adir_bytes)) {
-      adirmap[adir] = adir_offsets[adir_bytes];
+    auto it = adir_offsets.find(as_string_view(adir_bytes));
+    if (it != adir_offsets.end()) {
+      adirmap[adir] = it->second;
       continue;
     }
-    /* Insert new adir in tracking structs */
+    /* Not a dupe, encode... */
     align_output();
-    adir_offsets[adir_bytes] = m_offset;
     adirmap[adir] = m_offset;
-    /* Not a dupe, encode... */
-    uint8_t* adirout = (uint8_t*)(m_output.get() + m_offset);
-    memcpy(adirout, &adir_bytes[0], adir_bytes.size() * sizeof(uint32_t));
-    inc_offset(adir_bytes.size() * sizeof(uint32_t));
+    adir_offsets.emplace(emit_bytes(adir_bytes), adirmap[adir]);
     adircnt++;
   }
   if (adircnt) {
@@ -2952,7 +3018,21 @@ void DexOutput::write() {
     perror("Error writing dex");
     return;
   }
-  ::write(fd, m_output.get(), m_offset);
+  const uint8_t* data = m_output.get();
+  size_t remaining = m_offset;
+  while (remaining > 0) {
+    auto written = ::write(fd, data, remaining);
+    if (written <= 0) {
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      perror("Error writing dex");
+      close(fd);
+      return;
+    }
+    data += written;
+    remaining -= written;
+  }
   if (0 == fstat(fd, &st)) {
     m_stats.num_bytes = st.st_size;
   }
@@ -3161,13 +3241,15 @@ LocatorIndex make_locator_index(DexStoresVector& stores) {
 }
 
 void DexOutput::inc_offset(uint32_t v) {
+  uint64_t new_offset = uint64_t(m_offset) + v;
   // If this asserts hits, we already wrote out of bounds.
-  always_assert(m_offset + v < m_output_size);
+  always_assert(new_offset < m_output.size());
   // If this assert hits, we are too close.
   always_assert_log(
-      m_offset + v < m_output_size - k_output_red_zone,
-      "Running into output safety margin: %u of %zu(%zu). Increase the buffer "
-      "size with `-J dex_output_buffer_size=`.",
-      m_offset + v, m_output_size - k_output_red_zone, m_output_size);
+      new_offset < m_output.size() - k_output_red_zone,
+      "Running into output safety margin: %" PRIu64
+      " of %zu(%zu). Increase the buffer size with "
+      "`-J dex_output_buffer_size=`.",
+      new_offset, m_output.size() - k_output_red_zone, m_output.size());
   m_offset += v;
 }
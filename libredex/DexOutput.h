@@ -8,6 +8,7 @@
 #pragma once
 
 #include <memory>
+#include <string_view>
 #include <unordered_map>
 
 #include <boost/optional/optional.hpp>
@@ -295,6 +296,30 @@ struct CodeItemEmit {
 
 struct DexOutputTestHelper;
 
+/*
+ * The buffer a dex is written into. Where the platform allows, this only
+ * reserves address space, and memory is committed as the dex is written, so
+ * a generous size costs nothing. Otherwise it is allocated on the heap, and
+ * then only heap_size bytes are, so size() may be less than requested. The
+ * buffer is zero-initialized.
+ */
+class DexOutputBuffer {
+ public:
+  DexOutputBuffer(size_t size, size_t heap_size);
+  ~DexOutputBuffer();
+
+  DexOutputBuffer(const DexOutputBuffer&) = delete;
+  DexOutputBuffer& operator=(const DexOutputBuffer&) = delete;
+
+  uint8_t* get() const { return m_data; }
+  size_t size() const { return m_size; }
+
+ private:
+  uint8_t* m_data;
+  size_t m_size;
+  bool m_mapped{false};
+};
+
 class DexOutput {
   friend class DexOutputTest;
 
@@ -313,8 +338,7 @@ class DexOutput {
   DexClasses* m_classes;
   std::unique_ptr<DexOutputIdx> m_dodx;
   std::shared_ptr<GatheredTypes> m_gtypes;
-  const size_t m_output_size;
-  std::unique_ptr<uint8_t[]> m_output;
+  DexOutputBuffer m_output;
   uint32_t m_offset;
   const char* m_filename;
   size_t m_store_number;
@@ -391,6 +415,9 @@ class DexOutput {
       const DexString* descriptor);
 
   void inc_offset(uint32_t v);
+  // Copies the given items to the output, returning the bytes written.
+  template <typename T>
+  std::string_view emit_bytes(const std::vector<T>& items);
 
   friend struct DexOutputTestHelper;
 
@@ -0,0 +1,634 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/*
+ * Open-addressing hash tables that store their elements inline, in the style
+ * of Abseil's "Swiss tables".
+ *
+ * Each slot has a one-byte control word, which is either empty, deleted, or
+ * holds the low 7 bits of the hash of the element in the slot. Slots are
+ * arranged in groups of 16, and a lookup compares the control words of a whole
+ * group against the searched hash at once (with SSE2 where available), so
+ * that only actual candidates need to be compared with the key.
+ *
+ * Compared to std::unordered_map/set, there is no allocation per element and
+ * lookups touch far fewer cache lines. The interface is the subset of the
+ * standard containers that Redex needs. Unlike the standard containers,
+ * insertions may move existing elements, which invalidates all iterators,
+ * pointers and references into the table.
+ */
+
+namespace flat_hash_impl {
+
+using ctrl_t = int8_t;
+
+constexpr ctrl_t kEmpty = -128;
+constexpr ctrl_t kDeleted = -2;
+constexpr size_t kGroupWidth = 16;
+
+inline bool is_full(ctrl_t c) { return c >= 0; }
+
+/*
+ * Strengthens the given hash, so that the identity hashes of pointers and
+ * integers are spread over all bits.
+ */
+inline size_t mix(size_t h) {
+  uint64_t x = static_cast<uint64_t>(h) * UINT64_C(0x9E3779B97F4A7C15);
+  return static_cast<size_t>(x ^ (x >> 32));
+}
+
+inline size_t h1(size_t hash) { return hash >> 7; }
+
+inline ctrl_t h2(size_t hash) { return static_cast<ctrl_t>(hash & 0x7f); }
+
+// A bitmask over the slots of a group.
+class BitMask {
+ public:
+  explicit BitMask(uint32_t mask) : m_mask(mask) {}
+  explicit operator bool() const { return m_mask != 0; }
+  size_t lowest() const {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, m_mask);
+    return index;
+#else
+    return __builtin_ctz(m_mask);
+#endif
+  }
+  void clear_lowest() { m_mask &= m_mask - 1; }
+
+ private:
+  uint32_t m_mask;
+};
+
+struct Group {
+  explicit Group(const ctrl_t* ctrl) : ctrl(ctrl) {}
+
+#if defined(__SSE2__)
+  BitMask match(ctrl_t h) const {
+    auto group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return BitMask(static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h), group))));
+  }
+
+  BitMask match_empty() const { return match(kEmpty); }
+
+  // Empty and deleted slots are exactly those with the sign bit set.
+  BitMask match_empty_or_deleted() const {
+    auto group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return BitMask(static_cast<uint32_t>(_mm_movemask_epi8(group)));
+  }
+#else
+  BitMask match(ctrl_t h) const {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroupWidth; i++) {
+      mask |= static_cast<uint32_t>(ctrl[i] == h) << i;
+    }
+    return BitMask(mask);
+  }
+
+  BitMask match_empty() const { return match(kEmpty); }
+
+  BitMask match_empty_or_deleted() const {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroupWidth; i++) {
+      mask |= static_cast<uint32_t>(!is_full(ctrl[i])) << i;
+    }
+    return BitMask(mask);
+  }
+#endif
+
+  const ctrl_t* ctrl;
+};
+
+/*
+ * Visits the groups of a table in triangular order, which covers all groups
+ * when their number is a power of two.
+ */
+class ProbeSeq {
+ public:
+  ProbeSeq(size_t hash, size_t num_groups)
+      : m_mask(num_groups - 1), m_group(h1(hash) & m_mask) {}
+  size_t offset() const { return m_group * kGroupWidth; }
+  void next() {
+    m_index++;
+    m_group = (m_group + m_index) & m_mask;
+  }
+
+ private:
+  size_t m_mask;
+  size_t m_group;
+  size_t m_index{0};
+};
+
+template <typename Table, bool is_const>
+class Iterator {
+  using value_type_base = typename Table::value_type;
+
+ public:
+  using iterator_category = std::forward_iterator_tag;
+  using difference_type = std::ptrdiff_t;
+  using value_type = value_type_base;
+  using pointer =
+      std::conditional_t<is_const, const value_type_base*, value_type_base*>;
+  using reference =
+      std::conditional_t<is_const, const value_type_base&, value_type_base&>;
+
+  Iterator() = default;
+
+  Iterator(const ctrl_t* ctrl, const ctrl_t* ctrl_end, pointer slot)
+      : m_ctrl(ctrl), m_ctrl_end(ctrl_end), m_slot(slot) {
+    skip_empty_slots();
+  }
+
+  // Allow conversion from iterator to const_iterator.
+  template <bool other_const,
+            typename = std::enable_if_t<is_const && !other_const>>
+  // NOLINTNEXTLINE(google-explicit-constructor)
+  Iterator(const Iterator<Table, other_const>& other)
+      : m_ctrl(other.m_ctrl),
+        m_ctrl_end(other.m_ctrl_end),
+        m_slot(other.m_slot) {}
+
+  reference operator*() const { return *m_slot; }
+  pointer operator->() const { return m_slot; }
+
+  Iterator& operator++() {
+    ++m_ctrl;
+    ++m_slot;
+    skip_empty_slots();
+    return *this;
+  }
+
+  Iterator operator++(int) {
+    auto retval = *this;
+    ++(*this);
+    return retval;
+  }
+
+  bool operator==(const Iterator& other) const {
+    return m_ctrl == other.m_ctrl;
+  }
+  bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+ private:
+  template <typename, bool>
+  friend class Iterator;
+
+  void skip_empty_slots() {
+    while (m_ctrl != m_ctrl_end && !is_full(*m_ctrl)) {
+      ++m_ctrl;
+      ++m_slot;
+    }
+  }
+
+  const ctrl_t* m_ctrl{nullptr};
+  const ctrl_t* m_ctrl_end{nullptr};
+  pointer m_slot{nullptr};
+};
+
+/*
+ * The table proper. `Policy` describes the stored elements:
+ *
+ *   struct Policy {
+ *     using key_type = ...;
+ *     using value_type = ...;
+ *     static const key_type& key(const value_type&);
+ *   };
+ */
+template <typename Policy, typename Hash, typename Equal>
+class FlatHashTable {
+ public:
+  using key_type = typename Policy::key_type;
+  using value_type = typename Policy::value_type;
+  using size_type = size_t;
+  using hasher = Hash;
+  using key_equal = Equal;
+  using iterator = Iterator<FlatHashTable, false>;
+  using const_iterator = Iterator<FlatHashTable, true>;
+
+  FlatHashTable() = default;
+
+  FlatHashTable(const FlatHashTable& other) { copy_from(other); }
+
+  FlatHashTable(FlatHashTable&& other) noexcept { steal(other); }
+
+  FlatHashTable& operator=(const FlatHashTable& other) {
+    if (this != &other) {
+      destroy();
+      copy_from(other);
+    }
+    return *this;
+  }
+
+  FlatHashTable& operator=(FlatHashTable&& other) noexcept {
+    if (this != &other) {
+      destroy();
+      steal(other);
+    }
+    return *this;
+  }
+
+  ~FlatHashTable() { destroy(); }
+
+  iterator begin() {
+    return iterator(m_ctrl, m_ctrl + m_capacity, m_slots);
+  }
+  iterator end() {
+    return iterator(m_ctrl + m_capacity, m_ctrl + m_capacity,
+                    m_slots + m_capacity);
+  }
+  const_iterator begin() const {
+    return const_iterator(m_ctrl, m_ctrl + m_capacity, m_slots);
+  }
+  const_iterator end() const {
+    return const_iterator(m_ctrl + m_capacity, m_ctrl + m_capacity,
+                          m_slots + m_capacity);
+  }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  size_t capacity() const { return m_capacity; }
+
+  iterator find(const key_type& key) {
+    size_t index = find_index(key);
+    return index == npos ? end() : iterator_at(index);
+  }
+
+  const_iterator find(const key_type& key) const {
+    size_t index = find_index(key);
+    return index == npos ? end() : const_iterator_at(index);
+  }
+
+  size_t count(const key_type& key) const {
+    return find_index(key) == npos ? 0 : 1;
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) {
+    return emplace_with_key(Policy::key(value),
+                            [&](void* slot) { new (slot) value_type(value); });
+  }
+
+  std::pair<iterator, bool> insert(value_type&& value) {
+    return emplace_with_key(Policy::key(value), [&](void* slot) {
+      new (slot) value_type(std::move(value));
+    });
+  }
+
+  template <typename InputIt>
+  void insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    value_type value(std::forward<Args>(args)...);
+    return insert(std::move(value));
+  }
+
+  size_t erase(const key_type& key) {
+    size_t index = find_index(key);
+    if (index == npos) {
+      return 0;
+    }
+    erase_at(index);
+    return 1;
+  }
+
+  void clear() {
+    if (m_capacity == 0) {
+      return;
+    }
+    destroy_elements();
+    std::memset(m_ctrl, kEmpty, m_capacity);
+    m_size = 0;
+    m_growth_left = max_load(m_capacity);
+  }
+
+  void reserve(size_t count) {
+    if (count > max_load(m_capacity)) {
+      rehash(capacity_for(count));
+    }
+  }
+
+ protected:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  iterator iterator_at(size_t index) {
+    return iterator(m_ctrl + index, m_ctrl + m_capacity, m_slots + index);
+  }
+
+  const_iterator const_iterator_at(size_t index) const {
+    return const_iterator(m_ctrl + index, m_ctrl + m_capacity,
+                          m_slots + index);
+  }
+
+  size_t find_index(const key_type& key) const {
+    if (m_size == 0) {
+      return npos;
+    }
+    size_t hash = mix(Hash()(key));
+    ProbeSeq seq(hash, m_capacity / kGroupWidth);
+    while (true) {
+      Group group(m_ctrl + seq.offset());
+      for (auto match = group.match(h2(hash)); match; match.clear_lowest()) {
+        size_t index = seq.offset() + match.lowest();
+        if (Equal()(Policy::key(m_slots[index]), key)) {
+          return index;
+        }
+      }
+      if (group.match_empty()) {
+        return npos;
+      }
+      seq.next();
+    }
+  }
+
+  /*
+   * Finds the element with the given key, or constructs a new one through
+   * `construct(void* slot)`.
+   */
+  template <typename Construct>
+  std::pair<iterator, bool> emplace_with_key(const key_type& key,
+                                             const Construct& construct) {
+    size_t index = find_index(key);
+    if (index != npos) {
+      return {iterator_at(index), false};
+    }
+    if (m_capacity == 0) {
+      rehash(kGroupWidth);
+    }
+    size_t hash = mix(Hash()(key));
+    index = find_insert_index(hash);
+    if (m_growth_left == 0 && m_ctrl[index] != kDeleted) {
+      // Out of empty slots. Grow, unless the table is mostly tombstones.
+      rehash(m_size + 1 > max_load(m_capacity) / 2 ? grown_capacity()
+                                                   : m_capacity);
+      index = find_insert_index(hash);
+    }
+    construct(m_slots + index);
+    if (m_ctrl[index] == kEmpty) {
+      m_growth_left--;
+    }
+    m_ctrl[index] = h2(hash);
+    m_size++;
+    return {iterator_at(index), true};
+  }
+
+  void erase_at(size_t index) {
+    m_slots[index].~value_type();
+    m_size--;
+    // Lookups stop at the first group with an empty slot. If this group
+    // already has one, no probe sequence can go past it, and the slot can
+    // become empty again. Otherwise, leave a tombstone.
+    Group group(m_ctrl + index / kGroupWidth * kGroupWidth);
+    if (group.match_empty()) {
+      m_ctrl[index] = kEmpty;
+      m_growth_left++;
+    } else {
+      m_ctrl[index] = kDeleted;
+    }
+  }
+
+ private:
+  static size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+
+  static size_t capacity_for(size_t count) {
+    size_t capacity = kGroupWidth;
+    while (max_load(capacity) < count) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+
+  size_t grown_capacity() const { return m_capacity * 2; }
+
+  size_t find_insert_index(size_t hash) const {
+    ProbeSeq seq(hash, m_capacity / kGroupWidth);
+    while (true) {
+      auto match = Group(m_ctrl + seq.offset()).match_empty_or_deleted();
+      if (match) {
+        return seq.offset() + match.lowest();
+      }
+      seq.next();
+    }
+  }
+
+  void allocate(size_t capacity) {
+    m_capacity = capacity;
+    m_ctrl = new ctrl_t[capacity];
+    std::memset(m_ctrl, kEmpty, capacity);
+    m_slots = std::allocator<value_type>().allocate(capacity);
+    m_growth_left = max_load(capacity);
+  }
+
+  void rehash(size_t new_capacity) {
+    auto* old_ctrl = m_ctrl;
+    auto* old_slots = m_slots;
+    size_t old_capacity = m_capacity;
+    allocate(new_capacity);
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (!is_full(old_ctrl[i])) {
+        continue;
+      }
+      size_t hash = mix(Hash()(Policy::key(old_slots[i])));
+      size_t index = find_insert_index(hash);
+      new (m_slots + index) value_type(std::move(old_slots[i]));
+      old_slots[i].~value_type();
+      m_ctrl[index] = h2(hash);
+      m_growth_left--;
+    }
+    if (old_capacity > 0) {
+      delete[] old_ctrl;
+      std::allocator<value_type>().deallocate(old_slots, old_capacity);
+    }
+  }
+
+  void destroy_elements() {
+    if (!std::is_trivially_destructible<value_type>::value) {
+      for (size_t i = 0; i < m_capacity; i++) {
+        if (is_full(m_ctrl[i])) {
+          m_slots[i].~value_type();
+        }
+      }
+    }
+  }
+
+  void destroy() {
+    if (m_capacity == 0) {
+      return;
+    }
+    destroy_elements();
+    delete[] m_ctrl;
+    std::allocator<value_type>().deallocate(m_slots, m_capacity);
+    m_ctrl = nullptr;
+    m_slots = nullptr;
+    m_capacity = 0;
+    m_size = 0;
+    m_growth_left = 0;
+  }
+
+  void copy_from(const FlatHashTable& other) {
+    if (other.m_capacity == 0) {
+      return;
+    }
+    allocate(other.m_capacity);
+    for (size_t i = 0; i < m_capacity; i++) {
+      if (is_full(other.m_ctrl[i])) {
+        new (m_slots + i) value_type(other.m_slots[i]);
+      }
+    }
+    std::memcpy(m_ctrl, other.m_ctrl, m_capacity);
+    m_size = other.m_size;
+    m_growth_left = other.m_growth_left;
+  }
+
+  void steal(FlatHashTable& other) {
+    m_ctrl = other.m_ctrl;
+    m_slots = other.m_slots;
+    m_capacity = other.m_capacity;
+    m_size = other.m_size;
+    m_growth_left = other.m_growth_left;
+    other.m_ctrl = nullptr;
+    other.m_slots = nullptr;
+    other.m_capacity = 0;
+    other.m_size = 0;
+    other.m_growth_left = 0;
+  }
+
+  ctrl_t* m_ctrl{nullptr};
+  value_type* m_slots{nullptr};
+  size_t m_capacity{0};
+  size_t m_size{0};
+  size_t m_growth_left{0};
+};
+
+template <typename Key, typename Value>
+struct MapPolicy {
+  using key_type = Key;
+  using value_type = std::pair<const Key, Value>;
+  static const Key& key(const value_type& value) { return value.first; }
+};
+
+template <typename Key>
+struct SetPolicy {
+  using key_type = Key;
+  using value_type = Key;
+  static const Key& key(const value_type& value) { return value; }
+};
+
+} // namespace flat_hash_impl
+
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class FlatHashMap
+    : public flat_hash_impl::
+          FlatHashTable<flat_hash_impl::MapPolicy<Key, Value>, Hash, Equal> {
+  using Base = flat_hash_impl::
+      FlatHashTable<flat_hash_impl::MapPolicy<Key, Value>, Hash, Equal>;
+
+ public:
+  using mapped_type = Value;
+  using typename Base::const_iterator;
+  using typename Base::iterator;
+  using typename Base::value_type;
+
+  FlatHashMap() = default;
+
+  template <typename InputIt>
+  FlatHashMap(InputIt first, InputIt last) {
+    this->insert(first, last);
+  }
+
+  FlatHashMap(std::initializer_list<value_type> l) {
+    this->insert(l.begin(), l.end());
+  }
+
+  Value& operator[](const Key& key) {
+    return this
+        ->emplace_with_key(key,
+                           [&](void* slot) {
+                             new (slot) value_type(std::piecewise_construct,
+                                                   std::forward_as_tuple(key),
+                                                   std::forward_as_tuple());
+                           })
+        .first->second;
+  }
+
+  Value& at(const Key& key) {
+    auto it = this->find(key);
+    if (it == this->end()) {
+      throw std::out_of_range("FlatHashMap::at");
+    }
+    return it->second;
+  }
+
+  const Value& at(const Key& key) const {
+    auto it = this->find(key);
+    if (it == this->end()) {
+      throw std::out_of_range("FlatHashMap::at");
+    }
+    return it->second;
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    return this->emplace_with_key(key, [&](void* slot) {
+      new (slot) value_type(std::piecewise_construct,
+                            std::forward_as_tuple(key),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+    });
+  }
+};
+
+template <typename Key,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class FlatHashSet
+    : public flat_hash_impl::
+          FlatHashTable<flat_hash_impl::SetPolicy<Key>, Hash, Equal> {
+  using Base =
+      flat_hash_impl::FlatHashTable<flat_hash_impl::SetPolicy<Key>, Hash, Equal>;
+
+ public:
+  FlatHashSet() = default;
+
+  template <typename InputIt>
+  FlatHashSet(InputIt first, InputIt last) {
+    this->insert(first, last);
+  }
+
+  FlatHashSet(std::initializer_list<Key> l) {
+    this->insert(l.begin(), l.end());
+  }
+};
@@ -87,6 +87,16 @@ void MethodSimilarityOrderingConfig::bind_config() {
   bind("use_class_level_perf_sensitivity", use_class_level_perf_sensitivity,
        use_class_level_perf_sensitivity);
   bind("disable", disable, disable);
+  bind("use_minhash", use_minhash, use_minhash,
+       "Only score methods found to be similar by locality-sensitive hashing "
+       "instead of all pairs of methods. Scales to large dexes.");
+  bind("minhash_error_tolerance", minhash_error_tolerance,
+       minhash_error_tolerance,
+       "Tolerated error of the MinHash similarity estimates. Smaller values "
+       "are closer to the exact ordering but slower.");
+  bind("minhash_rows_per_band", minhash_rows_per_band, minhash_rows_per_band);
+  bind("minhash_max_candidates_per_bucket", minhash_max_candidates_per_bucket,
+       minhash_max_candidates_per_bucket);
 }
 
 void ProguardConfig::bind_config() {
@@ -147,6 +157,7 @@ void GlobalConfig::bind_config() {
   bind("keep_methods", {}, string_vector_param);
   bind("keep_packages", {}, string_vector_param);
   bind("legacy_reflection_reachability", false, bool_param);
+  bind("library_jar_cache_dir", "", string_param);
   bind("lower_with_cfg", {}, bool_param);
   bind("no_optimizations_annotations", {}, string_vector_param);
   bind("no_optimizations_blocklist", {}, string_vector_param);
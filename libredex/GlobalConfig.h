@@ -127,6 +127,10 @@ struct MethodSimilarityOrderingConfig : public Configurable {
 
   bool disable{true};
   bool use_class_level_perf_sensitivity{false};
+  bool use_minhash{false};
+  float minhash_error_tolerance{0.1f};
+  uint32_t minhash_rows_per_band{4};
+  uint32_t minhash_max_candidates_per_bucket{16};
 };
 
 struct ProguardConfig : public Configurable {
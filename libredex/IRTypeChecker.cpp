@@ -799,19 +799,24 @@ void IRTypeChecker::run() {
     return;
   }
 
-  m_type_inference = std::make_unique<TypeInference>(cfg);
+  // Only the entry state of each block is kept, as the instructions are
+  // checked block by block.
+  m_type_inference = std::make_unique<TypeInference>(
+      cfg, /* skip_check_cast_to_intf */ false,
+      /* lazy_type_environments */ true);
   m_type_inference->run(m_dex_method);
 
   // Finally, we use the inferred types to type-check each instruction in the
   // method. We stop at the first type error encountered.
-  auto& type_envs = m_type_inference->get_type_environments();
   for (const MethodItemEntry& mie : InstructionIterable(code)) {
     IRInstruction* insn = mie.insn;
     try {
-      auto it = type_envs.find(insn);
+      auto* type_env = m_type_inference->get_type_environment(insn);
       always_assert_log(
-          it != type_envs.end(), "%s in:\n%s", SHOW(mie), SHOW(code));
-      check_instruction(insn, &it->second);
+          type_env != nullptr, "%s in:\n%s", SHOW(mie), SHOW(code));
+      // Copying an environment is cheap, as its maps are shared.
+      auto env = *type_env;
+      check_instruction(insn, &env);
     } catch (const TypeCheckingException& e) {
       m_good = false;
       std::ostringstream out;
@@ -1451,27 +1456,25 @@ void IRTypeChecker::check_instruction(IRInstruction* insn,
 
 IRType IRTypeChecker::get_type(IRInstruction* insn, reg_t reg) const {
   check_completion();
-  auto& type_envs = m_type_inference->get_type_environments();
-  auto it = type_envs.find(insn);
-  if (it == type_envs.end()) {
+  auto* type_env = m_type_inference->get_type_environment(insn);
+  if (type_env == nullptr) {
     // The instruction doesn't belong to this method. We treat this as
     // unreachable code and return BOTTOM.
     return BOTTOM;
   }
-  return it->second.get_type(reg).element();
+  return type_env->get_type(reg).element();
 }
 
 boost::optional<const DexType*> IRTypeChecker::get_dex_type(IRInstruction* insn,
                                                             reg_t reg) const {
   check_completion();
-  auto& type_envs = m_type_inference->get_type_environments();
-  auto it = type_envs.find(insn);
-  if (it == type_envs.end()) {
+  auto* type_env = m_type_inference->get_type_environment(insn);
+  if (type_env == nullptr) {
     // The instruction doesn't belong to this method. We treat this as
     // unreachable code and return BOTTOM.
     return nullptr;
   }
-  return it->second.get_dex_type(reg);
+  return type_env->get_dex_type(reg);
 }
 
 std::ostream& operator<<(std::ostream& output, const IRTypeChecker& checker) {
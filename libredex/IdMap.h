@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+/*
+ * Side tables for types, fields and methods, indexed by the dense ids that
+ * RedexContext assigns to them when they are interned (see DexType::get_id(),
+ * DexFieldRef::get_id() and DexMethodRef::get_id()). A lookup is a few loads
+ * instead of hashing the pointer and probing a hash table.
+ *
+ * The slots live in chunks of geometrically increasing size that are
+ * allocated on first write, so that a table only takes memory up to the
+ * highest id written to it, and elements never move. Tables that only cover
+ * a small fraction of the entities are better off as hash maps.
+ *
+ * Distinct slots can be written concurrently. As with a std::vector,
+ * concurrent accesses to the same slot must be synchronized by the caller.
+ */
+namespace id_map_impl {
+
+template <typename Slot>
+class Chunks {
+ public:
+  // The first chunk holds kFirstChunkSize slots, and every following chunk
+  // twice as many as the previous one, which covers all 32-bit ids.
+  static constexpr uint32_t kFirstChunkBits = 10;
+  static constexpr uint64_t kFirstChunkSize = uint64_t(1) << kFirstChunkBits;
+  static constexpr size_t kNumChunks = 32 - kFirstChunkBits + 1;
+
+  Chunks() = default;
+  Chunks(const Chunks&) = delete;
+  Chunks& operator=(const Chunks&) = delete;
+
+  Chunks(Chunks&& other) noexcept {
+    for (size_t i = 0; i < kNumChunks; i++) {
+      m_chunks[i] = other.m_chunks[i].exchange(nullptr);
+    }
+  }
+
+  Chunks& operator=(Chunks&& other) noexcept {
+    if (this != &other) {
+      clear();
+      for (size_t i = 0; i < kNumChunks; i++) {
+        m_chunks[i] = other.m_chunks[i].exchange(nullptr);
+      }
+    }
+    return *this;
+  }
+
+  ~Chunks() { clear(); }
+
+  // The slot of the index, or nullptr if it was never written.
+  Slot* find(uint32_t index) const {
+    auto [chunk, offset] = locate(index);
+    Slot* slots = m_chunks[chunk].load(std::memory_order_acquire);
+    return slots == nullptr ? nullptr : slots + offset;
+  }
+
+  // The slot of the index, which is value-initialized when first accessed.
+  Slot& at(uint32_t index) {
+    auto [chunk, offset] = locate(index);
+    Slot* slots = m_chunks[chunk].load(std::memory_order_acquire);
+    if (slots == nullptr) {
+      slots = allocate(chunk);
+    }
+    return slots[offset];
+  }
+
+  // Calls fn(index, slot) for the slots of all allocated chunks, in order.
+  template <typename Fn>
+  void for_each(Fn fn) const {
+    for (size_t chunk = 0; chunk < kNumChunks; chunk++) {
+      Slot* slots = m_chunks[chunk].load(std::memory_order_acquire);
+      if (slots == nullptr) {
+        continue;
+      }
+      uint64_t base = chunk_base(chunk);
+      for (uint64_t i = 0; i < chunk_size(chunk); i++) {
+        fn(static_cast<uint32_t>(base + i), slots[i]);
+      }
+    }
+  }
+
+  void clear() {
+    for (auto& chunk : m_chunks) {
+      delete[] chunk.exchange(nullptr);
+    }
+  }
+
+ private:
+  static uint64_t chunk_size(size_t chunk) { return kFirstChunkSize << chunk; }
+
+  static uint64_t chunk_base(size_t chunk) {
+    return ((uint64_t(1) << chunk) - 1) << kFirstChunkBits;
+  }
+
+  // Chunk k holds the indices in [chunk_base(k), chunk_base(k + 1)), i.e.
+  // those for which (index / kFirstChunkSize + 1) has its top bit at k.
+  static std::pair<size_t, uint64_t> locate(uint32_t index) {
+    uint64_t biased = (uint64_t(index) >> kFirstChunkBits) + 1;
+    size_t chunk = 63 - __builtin_clzll(biased);
+    return {chunk, index - chunk_base(chunk)};
+  }
+
+  Slot* allocate(size_t chunk) {
+    Slot* slots = new Slot[chunk_size(chunk)]();
+    Slot* expected = nullptr;
+    if (!m_chunks[chunk].compare_exchange_strong(expected, slots,
+                                                 std::memory_order_acq_rel)) {
+      // Another thread allocated the chunk first.
+      delete[] slots;
+      return expected;
+    }
+    return slots;
+  }
+
+  std::array<std::atomic<Slot*>, kNumChunks> m_chunks{};
+};
+
+} // namespace id_map_impl
+
+/*
+ * A map from T (DexType, DexFieldRef, DexMethodRef or their subclasses) to V.
+ * Every key is implicitly mapped to a value-initialized V.
+ */
+template <typename T, typename V>
+class IdMap {
+ public:
+  // The value of the key, or V() if it was never written.
+  V get(const T* key) const {
+    const V* value = m_slots.find(key->get_id());
+    return value == nullptr ? V() : *value;
+  }
+
+  V& operator[](const T* key) { return m_slots.at(key->get_id()); }
+
+  void clear() { m_slots.clear(); }
+
+ private:
+  id_map_impl::Chunks<V> m_slots;
+};
+
+/*
+ * A set of T (DexType, DexFieldRef, DexMethodRef or their subclasses), as a
+ * bitset. Insertions and removals are atomic, so they can be done
+ * concurrently, also for the same element.
+ */
+template <typename T>
+class IdSet {
+ public:
+  // Returns whether the element was not in the set yet.
+  bool insert(const T* elem) {
+    auto [word, mask] = locate(elem);
+    return !(m_words.at(word).fetch_or(mask, std::memory_order_relaxed) &
+             mask);
+  }
+
+  // Returns whether the element was in the set.
+  bool erase(const T* elem) {
+    auto [word, mask] = locate(elem);
+    auto* bits = m_words.find(word);
+    return bits != nullptr &&
+           (bits->fetch_and(~mask, std::memory_order_relaxed) & mask);
+  }
+
+  bool contains(const T* elem) const {
+    auto [word, mask] = locate(elem);
+    auto* bits = m_words.find(word);
+    return bits != nullptr && (bits->load(std::memory_order_relaxed) & mask);
+  }
+
+  size_t count(const T* elem) const { return contains(elem) ? 1 : 0; }
+
+  size_t size() const {
+    size_t size = 0;
+    m_words.for_each([&](uint32_t, const std::atomic<uint64_t>& bits) {
+      size += __builtin_popcountll(bits.load(std::memory_order_relaxed));
+    });
+    return size;
+  }
+
+  bool empty() const { return size() == 0; }
+
+  // Calls fn(T*) for the elements, in the order of their ids. Ids are handed
+  // out by concurrent interning, so that order is not deterministic across
+  // runs: sort the elements where the order matters. Elements that have been
+  // deleted since they were inserted are skipped.
+  template <typename Fn>
+  void for_each(Fn fn) const {
+    m_words.for_each([&](uint32_t word, const std::atomic<uint64_t>& bits) {
+      uint64_t remaining = bits.load(std::memory_order_relaxed);
+      while (remaining != 0) {
+        uint32_t bit = __builtin_ctzll(remaining);
+        remaining &= remaining - 1;
+        auto* elem = T::get_by_id(word * 64 + bit);
+        if (elem != nullptr) {
+          fn(static_cast<T*>(elem));
+        }
+      }
+    });
+  }
+
+  void clear() { m_words.clear(); }
+
+ private:
+  static std::pair<uint32_t, uint64_t> locate(const T* elem) {
+    uint32_t id = elem->get_id();
+    return {id / 64, uint64_t(1) << (id % 64)};
+  }
+
+  id_map_impl::Chunks<std::atomic<uint64_t>> m_words;
+};
@@ -5,10 +5,16 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <boost/filesystem.hpp>
 #include <boost/iostreams/device/mapped_file.hpp>
 
+#include <atomic>
 #include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include <zlib.h>
@@ -26,9 +32,11 @@
 #include "DexClass.h"
 #include "DuplicateClasses.h"
 #include "JarLoader.h"
+#include "RedexMappedFile.h"
 #include "Show.h"
 #include "Trace.h"
 #include "Util.h"
+#include "WorkQueue.h"
 
 /******************
  * Begin Class Loading code.
@@ -168,31 +176,101 @@ static void skip_attributes(uint8_t*& buffer) {
   }
 }
 #define MAX_CLASS_NAMELEN (8 * 1024)
-static DexType* make_dextype_from_cref(std::vector<cp_entry>& cpool,
-                                       uint16_t cref) {
-  char nbuffer[MAX_CLASS_NAMELEN];
+
+namespace {
+
+struct MemberModel {
+  uint16_t access;
+  std::string_view name;
+  std::string_view desc;
+  // The member's attributes in the class file; null if read from a jar cache.
+  uint8_t* attributes{nullptr};
+
+  // Set by `intern_class_model`.
+  const DexString* dex_name{nullptr};
+  DexType* field_type{nullptr};
+  DexProto* method_proto{nullptr};
+};
+
+/*
+ * Everything we need from a class file to create an external DexClass. The
+ * string views point into the inflated class file or into a jar cache.
+ *
+ * Parsing a class file into a model and interning its names only creates
+ * types, strings and protos, none of which depend on the order of creation,
+ * so it can happen in parallel. Only `create_class` has to run in jar order.
+ */
+struct ClassModel {
+  bool is_module{false};
+  uint16_t access{0};
+  std::string_view name;
+  std::string_view super_name; // Empty if there is no super class.
+  std::vector<std::string_view> interfaces;
+  std::vector<MemberModel> fields;
+  std::vector<MemberModel> methods;
+  // Only needed to resolve attribute names for an attribute hook.
+  std::vector<cp_entry> cpool;
+  // Owns the strings once `compact_class_model` detached the model from its
+  // class file.
+  std::unique_ptr<char[]> strings;
+
+  // Set by `intern_class_model`.
+  bool interned{false};
+  DexType* type{nullptr};
+  DexType* super_type{nullptr};
+  std::vector<DexType*> interface_types;
+};
+} // namespace
+
+static bool get_class_name(const std::vector<cp_entry>& cpool,
+                           uint16_t cref,
+                           std::string_view* out) {
   if (cpool[cref].tag != CP_CONST_CLASS) {
     fprintf(stderr, "Non-class ref in get_class_name, Bailing\n");
-    return nullptr;
+    return false;
   }
   uint16_t utf8ref = cpool[cref].s0;
   const cp_entry& utf8cpe = cpool[utf8ref];
   if (utf8cpe.tag != CP_CONST_UTF8) {
     fprintf(stderr, "Non-utf8 ref in get_utf8, Bailing\n");
-    return nullptr;
+    return false;
   }
-  if (utf8cpe.len > (MAX_CLASS_NAMELEN + 3)) {
+  if (utf8cpe.len > (MAX_CLASS_NAMELEN - 3)) {
     fprintf(stderr, "classname is greater than max, bailing");
-    return nullptr;
+    return false;
   }
+  *out = std::string_view(reinterpret_cast<const char*>(utf8cpe.data),
+                          utf8cpe.len);
+  return true;
+}
+
+static DexType* make_dextype_from_class_name(std::string_view name) {
+  char nbuffer[MAX_CLASS_NAMELEN];
   nbuffer[0] = 'L';
-  memcpy(nbuffer + 1, utf8cpe.data, utf8cpe.len);
-  nbuffer[1 + utf8cpe.len] = ';';
-  nbuffer[2 + utf8cpe.len] = '\0';
-  return DexType::make_type(nbuffer);
+  memcpy(nbuffer + 1, name.data(), name.size());
+  nbuffer[1 + name.size()] = ';';
+  return DexType::make_type(std::string_view(nbuffer, name.size() + 2));
+}
+
+static bool get_utf8(const std::vector<cp_entry>& cpool,
+                     uint16_t utf8ref,
+                     std::string_view* out) {
+  const cp_entry& utf8cpe = cpool[utf8ref];
+  if (utf8cpe.tag != CP_CONST_UTF8) {
+    fprintf(stderr, "Non-utf8 ref in get_utf8, bailing\n");
+    return false;
+  }
+  if (utf8cpe.len > (MAX_CLASS_NAMELEN - 1)) {
+    fprintf(stderr, "Name is greater (%hu) than max (%u), bailing\n",
+            utf8cpe.len, MAX_CLASS_NAMELEN);
+    return false;
+  }
+  *out = std::string_view(reinterpret_cast<const char*>(utf8cpe.data),
+                          utf8cpe.len);
+  return true;
 }
 
-static bool extract_utf8(std::vector<cp_entry>& cpool,
+static bool extract_utf8(const std::vector<cp_entry>& cpool,
                          uint16_t utf8ref,
                          char* out,
                          uint32_t size) {
@@ -211,20 +289,10 @@ static bool extract_utf8(std::vector<cp_entry>& cpool,
   return true;
 }
 
-static DexField* make_dexfield(std::vector<cp_entry>& cpool,
-                               DexType* self,
-                               cp_field_info& finfo) {
-  char dbuffer[MAX_CLASS_NAMELEN];
-  char nbuffer[MAX_CLASS_NAMELEN];
-  if (!extract_utf8(cpool, finfo.nameNdx, nbuffer, MAX_CLASS_NAMELEN) ||
-      !extract_utf8(cpool, finfo.descNdx, dbuffer, MAX_CLASS_NAMELEN)) {
-    return nullptr;
-  }
-  auto name = DexString::make_string(nbuffer);
-  DexType* desc = DexType::make_type(dbuffer);
-  DexField* field =
-      static_cast<DexField*>(DexField::make_field(self, name, desc));
-  field->set_access((DexAccessFlags)finfo.aflags);
+static DexField* make_dexfield(DexType* self, const MemberModel& finfo) {
+  DexField* field = static_cast<DexField*>(
+      DexField::make_field(self, finfo.dex_name, finfo.field_type));
+  field->set_access((DexAccessFlags)finfo.access);
   field->set_external();
   return field;
 }
@@ -326,34 +394,31 @@ static DexTypeList* extract_arguments(const char*& buf) {
   return DexTypeList::make_type_list(std::move(args));
 }
 
-static DexMethod* make_dexmethod(std::vector<cp_entry>& cpool,
-                                 DexType* self,
-                                 cp_method_info& finfo) {
+static DexProto* make_proto_from_descriptor(std::string_view desc) {
   char dbuffer[MAX_CLASS_NAMELEN];
-  char nbuffer[MAX_CLASS_NAMELEN];
-  if (!extract_utf8(cpool, finfo.nameNdx, nbuffer, MAX_CLASS_NAMELEN) ||
-      !extract_utf8(cpool, finfo.descNdx, dbuffer, MAX_CLASS_NAMELEN)) {
-    return nullptr;
-  }
-  auto name = DexString::make_string(nbuffer);
+  memcpy(dbuffer, desc.data(), desc.size());
+  dbuffer[desc.size()] = '\0';
   const char* ptr = dbuffer;
   DexTypeList* tlist = extract_arguments(ptr);
   if (tlist == nullptr) return nullptr;
   DexType* rtype = parse_type(ptr);
   if (rtype == nullptr) return nullptr;
-  DexProto* proto = DexProto::make_proto(rtype, tlist);
-  DexMethod* method =
-      static_cast<DexMethod*>(DexMethod::make_method(self, name, proto));
+  return DexProto::make_proto(rtype, tlist);
+}
+
+static DexMethod* make_dexmethod(DexType* self, const MemberModel& minfo) {
+  DexMethod* method = static_cast<DexMethod*>(
+      DexMethod::make_method(self, minfo.dex_name, minfo.method_proto));
   if (method->is_concrete()) {
     fprintf(stderr, "Pre-concrete method attempted to load '%s', bailing\n",
             SHOW(method));
     return nullptr;
   }
-  uint32_t access = finfo.aflags;
+  uint32_t access = minfo.access;
   bool is_virt = true;
-  if (nbuffer[0] == '<') {
+  if (!minfo.name.empty() && minfo.name[0] == '<') {
     is_virt = false;
-    if (nbuffer[1] == 'i') {
+    if (minfo.name.size() > 1 && minfo.name[1] == 'i') {
       access |= ACC_CONSTRUCTOR;
     }
   } else if (access & (ACC_PRIVATE | ACC_STATIC))
@@ -364,10 +429,7 @@ static DexMethod* make_dexmethod(std::vector<cp_entry>& cpool,
   return method;
 }
 
-bool parse_class(uint8_t* buffer,
-                 Scope* classes,
-                 attribute_hook_t attr_hook,
-                 const DexLocation* jar_location) {
+static bool parse_class_model(uint8_t* buffer, ClassModel* model) {
   uint32_t magic = read32(buffer);
   uint16_t vminor DEBUG_ONLY = read16(buffer);
   uint16_t vmajor DEBUG_ONLY = read16(buffer);
@@ -376,7 +438,7 @@ bool parse_class(uint8_t* buffer,
     fprintf(stderr, "Bad class magic %08x, Bailing\n", magic);
     return false;
   }
-  std::vector<cp_entry> cpool;
+  auto& cpool = model->cpool;
   cpool.resize(cp_count);
   /* The zero'th entry is always empty.  Java is annoying. */
   for (int i = 1; i < cp_count; i++) {
@@ -386,21 +448,87 @@ bool parse_class(uint8_t* buffer,
       i++;
     }
   }
-  uint16_t aflags = read16(buffer);
+  model->access = read16(buffer);
   uint16_t clazz = read16(buffer);
   uint16_t super = read16(buffer);
   uint16_t ifcount = read16(buffer);
 
-  if (is_module((DexAccessFlags)aflags)) {
+  if (is_module((DexAccessFlags)model->access)) {
     // Classes with the ACC_MODULE access flag are special.  They contain
     // metadata for the module/package system and don't have a superclass.
     // Ignore them for now.
+    model->is_module = true;
+    return true;
+  }
+
+  if (!get_class_name(cpool, clazz, &model->name)) return false;
+  if (super != 0 && !get_class_name(cpool, super, &model->super_name)) {
+    return false;
+  }
+  model->interfaces.resize(ifcount);
+  for (auto& iface : model->interfaces) {
+    if (!get_class_name(cpool, read16(buffer), &iface)) return false;
+  }
+
+  auto parse_members = [&](std::vector<MemberModel>& members) {
+    members.resize(read16(buffer));
+    for (auto& member : members) {
+      member.access = read16(buffer);
+      uint16_t name_index = read16(buffer);
+      uint16_t desc_index = read16(buffer);
+      member.attributes = buffer;
+      skip_attributes(buffer);
+      if (!get_utf8(cpool, name_index, &member.name) ||
+          !get_utf8(cpool, desc_index, &member.desc)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  return parse_members(model->fields) && parse_members(model->methods);
+}
+
+/*
+ * Interns the types, strings and protos of the model. Returns false if a
+ * method descriptor is malformed; the class type is still interned so that
+ * duplicates can be detected.
+ */
+static bool intern_class_model(ClassModel* model) {
+  if (model->is_module) {
+    return true;
+  }
+  model->type = make_dextype_from_class_name(model->name);
+  if (!model->super_name.empty()) {
+    model->super_type = make_dextype_from_class_name(model->super_name);
+  }
+  model->interface_types.reserve(model->interfaces.size());
+  for (auto iface : model->interfaces) {
+    model->interface_types.push_back(make_dextype_from_class_name(iface));
+  }
+  for (auto& field : model->fields) {
+    field.dex_name = DexString::make_string(field.name);
+    field.field_type = DexType::make_type(field.desc);
+  }
+  for (auto& method : model->methods) {
+    method.dex_name = DexString::make_string(method.name);
+    method.method_proto = make_proto_from_descriptor(method.desc);
+    if (method.method_proto == nullptr) return false;
+  }
+  model->interned = true;
+  return true;
+}
+
+static bool create_class(const ClassModel& model,
+                         Scope* classes,
+                         const attribute_hook_t& attr_hook,
+                         const DexLocation* jar_location) {
+  if (model.is_module) {
     TRACE(MAIN, 5, "Warning: ignoring module-info class in jar '%s'",
           jar_location->get_file_name().c_str());
     return true;
   }
 
-  DexType* self = make_dextype_from_cref(cpool, clazz);
+  DexType* self = model.type;
   DexClass* cls = type_class(self);
   if (cls) {
     // We are seeing duplicate classes when parsing jar file
@@ -435,22 +563,19 @@ bool parse_class(uint8_t* buffer,
     }
     return true;
   }
+  if (!model.interned) {
+    return false;
+  }
 
   ClassCreator cc(self, jar_location);
   cc.set_external();
-  if (super != 0) {
-    DexType* sclazz = make_dextype_from_cref(cpool, super);
-    cc.set_super(sclazz);
+  if (model.super_type != nullptr) {
+    cc.set_super(model.super_type);
   }
-  cc.set_access((DexAccessFlags)aflags);
-  if (ifcount) {
-    for (int i = 0; i < ifcount; i++) {
-      uint16_t iface = read16(buffer);
-      DexType* iftype = make_dextype_from_cref(cpool, iface);
-      cc.add_interface(iftype);
-    }
+  cc.set_access((DexAccessFlags)model.access);
+  for (auto* iftype : model.interface_types) {
+    cc.add_interface(iftype);
   }
-  uint16_t fcount = read16(buffer);
 
   auto invoke_attr_hook =
       [&](const boost::variant<DexField*, DexMethod*>& field_or_method,
@@ -458,12 +583,15 @@ bool parse_class(uint8_t* buffer,
         if (attr_hook == nullptr) {
           return;
         }
+        always_assert_log(attrPtr != nullptr,
+                          "attribute hook was specified, but the class was "
+                          "not parsed from a class file");
         uint16_t attributes_count = read16(attrPtr);
         for (uint16_t j = 0; j < attributes_count; j++) {
           uint16_t attribute_name_index = read16(attrPtr);
           uint32_t attribute_length = read32(attrPtr);
           char attribute_name[MAX_CLASS_NAMELEN];
-          auto extract_res = extract_utf8(cpool, attribute_name_index,
+          auto extract_res = extract_utf8(model.cpool, attribute_name_index,
                                           attribute_name, MAX_CLASS_NAMELEN);
           always_assert_log(
               extract_res,
@@ -474,34 +602,17 @@ bool parse_class(uint8_t* buffer,
         }
       };
 
-  for (int i = 0; i < fcount; i++) {
-    cp_field_info cpfield;
-    cpfield.aflags = read16(buffer);
-    cpfield.nameNdx = read16(buffer);
-    cpfield.descNdx = read16(buffer);
-    uint8_t* attrPtr = buffer;
-    skip_attributes(buffer);
-    DexField* field = make_dexfield(cpool, self, cpfield);
-    if (field == nullptr) return false;
+  for (const auto& finfo : model.fields) {
+    DexField* field = make_dexfield(self, finfo);
     cc.add_field(field);
-    invoke_attr_hook({field}, attrPtr);
+    invoke_attr_hook({field}, finfo.attributes);
   }
 
-  uint16_t mcount = read16(buffer);
-  if (mcount) {
-    for (int i = 0; i < mcount; i++) {
-      cp_method_info cpmethod;
-      cpmethod.aflags = read16(buffer);
-      cpmethod.nameNdx = read16(buffer);
-      cpmethod.descNdx = read16(buffer);
-
-      uint8_t* attrPtr = buffer;
-      skip_attributes(buffer);
-      DexMethod* method = make_dexmethod(cpool, self, cpmethod);
-      if (method == nullptr) return false;
-      cc.add_method(method);
-      invoke_attr_hook({method}, attrPtr);
-    }
+  for (const auto& minfo : model.methods) {
+    DexMethod* method = make_dexmethod(self, minfo);
+    if (method == nullptr) return false;
+    cc.add_method(method);
+    invoke_attr_hook({method}, minfo.attributes);
   }
   DexClass* dc = cc.create();
   if (classes != nullptr) {
@@ -539,6 +650,20 @@ bool parse_class(uint8_t* buffer,
   return true;
 }
 
+bool parse_class(uint8_t* buffer,
+                 Scope* classes,
+                 attribute_hook_t attr_hook,
+                 const DexLocation* jar_location) {
+  ClassModel model;
+  if (!parse_class_model(buffer, &model)) {
+    return false;
+  }
+  // A malformed class is only an error if it is not a duplicate, which
+  // `create_class` checks first.
+  intern_class_model(&model);
+  return create_class(model, classes, attr_hook, jar_location);
+}
+
 bool load_class_file(const std::string& filename, Scope* classes) {
   // It's not exactly efficient to call init_basic_types repeatedly for each
   // class file that we load, but load_class_file should typically only be used
@@ -815,63 +940,349 @@ static bool decompress_class(jar_entry& file,
   return true;
 }
 
-static const int kStartBufferSize = 128 * 1024;
+namespace {
 
-static bool process_jar_entries(const DexLocation* location,
-                                std::vector<jar_entry>& files,
-                                const uint8_t* mapping,
-                                Scope* classes,
-                                const attribute_hook_t& attr_hook) {
-  ssize_t bufsize = kStartBufferSize;
-  uint8_t* outbuffer = (uint8_t*)malloc(bufsize);
-  static char classEndString[] = ".class";
-  static size_t classEndStringLen = strlen(classEndString);
-  init_basic_types();
-  for (auto& file : files) {
-    if (file.cd_entry.ucomp_size == 0) continue;
-    if (file.cd_entry.fname_len < (classEndStringLen + 1)) continue;
+constexpr char kJarCacheMagic[] = {'R', 'D', 'X', 'J', 'A', 'R', '0', '1'};
+
+/*
+ * The class files of a jar that is being loaded. Each class file is inflated
+ * into its own buffer so that they can be parsed in parallel. The buffers
+ * (or the jar cache mapping) must outlive the models that point into them,
+ * unless the models were compacted.
+ */
+struct JarContents {
+  const DexLocation* location{nullptr};
+  const uint8_t* mapping{nullptr};
+  std::vector<jar_entry> class_entries;
+  std::vector<std::unique_ptr<uint8_t[]>> class_files;
+  std::vector<ClassModel> models;
+  // Set if the models were read from a jar cache.
+  std::unique_ptr<RedexMappedFile> cache;
+  std::atomic<bool> failed{false};
+};
 
+/*
+ * Reads a jar cache file. The host byte order is used throughout since the
+ * cache is never shared between machines:
+ *
+ *   magic                 kJarCacheMagic
+ *   u32                   number of classes
+ *   per class:
+ *     u8                  is_module
+ *     u16                 access flags
+ *     str                 name
+ *     str                 super class name, or empty
+ *     u16, str*           interfaces
+ *     u16, member*        fields
+ *     u16, member*        methods
+ *
+ * where a member is a u16 access flags followed by its name and descriptor,
+ * and a str is a u16 length followed by the bytes.
+ */
+class JarCacheReader {
+ public:
+  JarCacheReader(const char* data, size_t size) : m_data(data), m_size(size) {}
+
+  template <typename T>
+  T read() {
+    T value{};
+    if (m_offset + sizeof(T) > m_size) {
+      m_ok = false;
+      return value;
+    }
+    memcpy(&value, m_data + m_offset, sizeof(T));
+    m_offset += sizeof(T);
+    return value;
+  }
+
+  // Strings longer than max_length are rejected like in class files, since
+  // they are copied into fixed size buffers when they are interned.
+  std::string_view read_string(size_t max_length) {
+    auto length = read<uint16_t>();
+    if (!m_ok || length > max_length || m_offset + length > m_size) {
+      m_ok = false;
+      return {};
+    }
+    std::string_view str(m_data + m_offset, length);
+    m_offset += length;
+    return str;
+  }
+
+  bool read_magic() {
+    if (m_size < sizeof(kJarCacheMagic) ||
+        memcmp(m_data, kJarCacheMagic, sizeof(kJarCacheMagic)) != 0) {
+      return m_ok = false;
+    }
+    m_offset = sizeof(kJarCacheMagic);
+    return true;
+  }
+
+  void read_members(std::vector<MemberModel>* members) {
+    members->resize(read<uint16_t>());
+    for (auto& member : *members) {
+      member.access = read<uint16_t>();
+      member.name = read_string(MAX_CLASS_NAMELEN - 1);
+      member.desc = read_string(MAX_CLASS_NAMELEN - 1);
+    }
+  }
+
+  bool ok() const { return m_ok; }
+  bool at_end() const { return m_offset == m_size; }
+  size_t remaining() const { return m_size - m_offset; }
+
+ private:
+  const char* m_data;
+  size_t m_size;
+  size_t m_offset{0};
+  bool m_ok{true};
+};
+
+class JarCacheWriter {
+ public:
+  JarCacheWriter() { m_out.append(kJarCacheMagic, sizeof(kJarCacheMagic)); }
+
+  template <typename T>
+  void write(T value) {
+    m_out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void write_string(std::string_view str) {
+    write<uint16_t>(str.size());
+    m_out.append(str.data(), str.size());
+  }
+
+  void write_members(const std::vector<MemberModel>& members) {
+    write<uint16_t>(members.size());
+    for (const auto& member : members) {
+      write<uint16_t>(member.access);
+      write_string(member.name);
+      write_string(member.desc);
+    }
+  }
+
+  const std::string& str() const { return m_out; }
+
+ private:
+  std::string m_out;
+};
+
+bool is_class_file(const jar_entry& file) {
+  static const char classEndString[] = ".class";
+  static const size_t classEndStringLen = strlen(classEndString);
+  if (file.cd_entry.ucomp_size == 0) return false;
+  if (file.cd_entry.fname_len < (classEndStringLen + 1)) return false;
+  const uint8_t* endcomp =
+      file.filename + (file.cd_entry.fname_len - classEndStringLen);
+  return memcmp(endcomp, classEndString, classEndStringLen) == 0;
+}
+} // namespace
+
+static bool read_class_entries(const uint8_t* mapping,
+                               ssize_t size,
+                               JarContents* jar) {
+  pk_cdir_end pce;
+  std::vector<jar_entry> files;
+  if (!find_central_directory(mapping, size, pce)) return false;
+  if (!validate_pce(pce, size)) return false;
+  if (!get_jar_entries(mapping, pce, files)) return false;
+  for (auto& file : files) {
     // Skip non-class files
-    uint8_t* endcomp =
-        file.filename + (file.cd_entry.fname_len - classEndStringLen);
-    if (memcmp(endcomp, classEndString, classEndStringLen) != 0) continue;
+    if (is_class_file(file)) {
+      jar->class_entries.push_back(std::move(file));
+    }
+  }
+  jar->mapping = mapping;
+  jar->class_files.resize(jar->class_entries.size());
+  jar->models.resize(jar->class_entries.size());
+  return true;
+}
+
+/*
+ * Copies the names and descriptors of the model out of its class file, and
+ * drops everything else that points into it, so that the class file can be
+ * released.
+ */
+static void compact_class_model(ClassModel* model) {
+  size_t size = model->name.size() + model->super_name.size();
+  for (auto iface : model->interfaces) {
+    size += iface.size();
+  }
+  for (const auto* members : {&model->fields, &model->methods}) {
+    for (const auto& member : *members) {
+      size += member.name.size() + member.desc.size();
+    }
+  }
+  model->strings = std::make_unique<char[]>(size);
+  char* next = model->strings.get();
+  auto copy = [&](std::string_view& str) {
+    memcpy(next, str.data(), str.size());
+    str = std::string_view(next, str.size());
+    next += str.size();
+  };
+  copy(model->name);
+  copy(model->super_name);
+  for (auto& iface : model->interfaces) {
+    copy(iface);
+  }
+  for (auto* members : {&model->fields, &model->methods}) {
+    for (auto& member : *members) {
+      copy(member.name);
+      copy(member.desc);
+      member.attributes = nullptr;
+    }
+  }
+  model->cpool = std::vector<cp_entry>();
+}
 
-    // Resize output if necessary.
-    if (bufsize < file.cd_entry.ucomp_size) {
-      while (bufsize < file.cd_entry.ucomp_size)
-        bufsize *= 2;
-      free(outbuffer);
-      outbuffer = (uint8_t*)malloc(bufsize);
+/*
+ * Inflates, parses and interns the classes of all given jars in parallel.
+ * Failures are recorded in `JarContents::failed`. Unless the attributes are
+ * needed for an attribute hook, every class file is released as soon as its
+ * model is built.
+ */
+static void parse_jars(const std::vector<JarContents*>& jars,
+                       bool keep_class_files) {
+  std::vector<std::pair<JarContents*, size_t>> items;
+  for (auto* jar : jars) {
+    for (size_t i = 0; i < jar->models.size(); ++i) {
+      items.emplace_back(jar, i);
     }
+  }
+  workqueue_run<std::pair<JarContents*, size_t>>(
+      [keep_class_files](const std::pair<JarContents*, size_t>& item) {
+        auto* jar = item.first;
+        auto& model = jar->models[item.second];
+        if (!jar->cache) {
+          auto& file = jar->class_entries[item.second];
+          auto& class_file = jar->class_files[item.second];
+          auto size = file.cd_entry.ucomp_size;
+          class_file = std::make_unique<uint8_t[]>(size);
+          if (!decompress_class(file, jar->mapping, class_file.get(), size) ||
+              !parse_class_model(class_file.get(), &model)) {
+            jar->failed = true;
+            return;
+          }
+        }
+        intern_class_model(&model);
+        if (!jar->cache && !keep_class_files) {
+          compact_class_model(&model);
+          jar->class_files[item.second].reset();
+        }
+      },
+      items);
+}
 
-    if (!decompress_class(file, mapping, outbuffer, bufsize)) {
-      free(outbuffer);
+static bool create_jar_classes(const JarContents& jar,
+                               Scope* classes,
+                               const attribute_hook_t& attr_hook) {
+  if (jar.failed) {
+    return false;
+  }
+  for (const auto& model : jar.models) {
+    if (!create_class(model, classes, attr_hook, jar.location)) {
       return false;
     }
+  }
+  return true;
+}
 
-    if (!parse_class(outbuffer, classes, attr_hook, location)) {
-      free(outbuffer);
+static std::string jar_cache_path(const std::string& cache_dir,
+                                  const uint8_t* mapping,
+                                  size_t size) {
+  auto hash = std::hash<std::string_view>()(
+      std::string_view(reinterpret_cast<const char*>(mapping), size));
+  std::ostringstream path;
+  path << cache_dir << "/" << std::hex << hash << "-" << std::dec << size
+       << ".jarcache";
+  return path.str();
+}
+
+static bool read_jar_cache(const std::string& path, JarContents* jar) {
+  if (!boost::filesystem::exists(path)) {
+    return false;
+  }
+  std::unique_ptr<RedexMappedFile> cache;
+  try {
+    cache = std::make_unique<RedexMappedFile>(RedexMappedFile::open(path));
+  } catch (const std::exception& e) {
+    return false;
+  }
+  JarCacheReader reader(cache->const_data(), cache->size());
+  if (!reader.read_magic()) {
+    return false;
+  }
+  auto count = reader.read<uint32_t>();
+  if (count > reader.remaining()) {
+    return false;
+  }
+  std::vector<ClassModel> models(count);
+  for (auto& model : models) {
+    model.is_module = reader.read<uint8_t>() != 0;
+    model.access = reader.read<uint16_t>();
+    model.name = reader.read_string(MAX_CLASS_NAMELEN - 3);
+    model.super_name = reader.read_string(MAX_CLASS_NAMELEN - 3);
+    model.interfaces.resize(reader.read<uint16_t>());
+    for (auto& iface : model.interfaces) {
+      iface = reader.read_string(MAX_CLASS_NAMELEN - 3);
+    }
+    reader.read_members(&model.fields);
+    reader.read_members(&model.methods);
+    if (!reader.ok()) {
       return false;
     }
   }
-  free(outbuffer);
+  if (!reader.at_end()) {
+    return false;
+  }
+  jar->models = std::move(models);
+  jar->cache = std::move(cache);
   return true;
 }
 
+static void write_jar_cache(const std::string& path, const JarContents& jar) {
+  JarCacheWriter writer;
+  writer.write<uint32_t>(jar.models.size());
+  for (const auto& model : jar.models) {
+    writer.write<uint8_t>(model.is_module);
+    writer.write<uint16_t>(model.access);
+    writer.write_string(model.name);
+    writer.write_string(model.super_name);
+    writer.write<uint16_t>(model.interfaces.size());
+    for (auto iface : model.interfaces) {
+      writer.write_string(iface);
+    }
+    writer.write_members(model.fields);
+    writer.write_members(model.methods);
+  }
+
+  // Write to a temporary file first so that concurrent builds never see a
+  // partial cache file.
+  auto tmp_path = path + "." + boost::filesystem::unique_path().string();
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(writer.str().data(), writer.str().size());
+    if (!out) {
+      fprintf(stderr, "Warning: cannot write jar cache %s\n", tmp_path.c_str());
+    }
+  }
+  boost::system::error_code ec;
+  boost::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    boost::filesystem::remove(tmp_path, ec);
+  }
+}
+
 bool process_jar(const DexLocation* location,
                  const uint8_t* mapping,
                  ssize_t size,
                  Scope* classes,
                  const attribute_hook_t& attr_hook) {
-  pk_cdir_end pce;
-  std::vector<jar_entry> files;
-  if (!find_central_directory(mapping, size, pce)) return false;
-  if (!validate_pce(pce, size)) return false;
-  if (!get_jar_entries(mapping, pce, files)) return false;
-  if (!process_jar_entries(location, files, mapping, classes, attr_hook)) {
-    return false;
-  }
-  return true;
+  JarContents jar;
+  jar.location = location;
+  if (!read_class_entries(mapping, size, &jar)) return false;
+  init_basic_types();
+  parse_jars({&jar}, /* keep_class_files */ attr_hook != nullptr);
+  return create_jar_classes(jar, classes, attr_hook);
 }
 
 bool load_jar_file(const DexLocation* location,
@@ -896,6 +1307,72 @@ bool load_jar_file(const DexLocation* location,
   return true;
 }
 
+bool load_jar_files(
+    const std::vector<std::pair<const DexLocation*, Scope*>>& jars,
+    const std::string& cache_dir) {
+  std::vector<boost::iostreams::mapped_file> files(jars.size());
+  std::vector<std::unique_ptr<JarContents>> contents;
+  std::vector<std::string> cache_paths(jars.size());
+  for (size_t i = 0; i < jars.size(); ++i) {
+    const auto* location = jars[i].first;
+    try {
+      files[i].open(location->get_file_name().c_str(),
+                    boost::iostreams::mapped_file::readonly);
+    } catch (const std::exception& e) {
+      fprintf(stderr, "error: cannot open jar file: %s\n",
+              location->get_file_name().c_str());
+      return false;
+    }
+
+    auto mapping = reinterpret_cast<const uint8_t*>(files[i].const_data());
+    auto jar = std::make_unique<JarContents>();
+    jar->location = location;
+    if (!cache_dir.empty()) {
+      cache_paths[i] = jar_cache_path(cache_dir, mapping, files[i].size());
+      if (read_jar_cache(cache_paths[i], jar.get())) {
+        TRACE(MAIN, 2, "Loading %s from jar cache %s",
+              location->get_file_name().c_str(), cache_paths[i].c_str());
+        contents.push_back(std::move(jar));
+        continue;
+      }
+    }
+    if (!read_class_entries(mapping, files[i].size(), jar.get())) {
+      fprintf(stderr, "error: cannot process jar: %s\n",
+              location->get_file_name().c_str());
+      return false;
+    }
+    contents.push_back(std::move(jar));
+  }
+
+  init_basic_types();
+  std::vector<JarContents*> jars_to_parse;
+  for (auto& jar : contents) {
+    jars_to_parse.push_back(jar.get());
+  }
+  parse_jars(jars_to_parse, /* keep_class_files */ false);
+
+  // Classes are created in jar order so that the first definition of a
+  // duplicate class wins, exactly as with `load_jar_file`.
+  for (size_t i = 0; i < jars.size(); ++i) {
+    if (!create_jar_classes(*contents[i], jars[i].second, nullptr)) {
+      fprintf(stderr, "error: cannot process jar: %s\n",
+              jars[i].first->get_file_name().c_str());
+      return false;
+    }
+  }
+
+  if (!cache_dir.empty()) {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(cache_dir, ec);
+    for (size_t i = 0; i < jars.size(); ++i) {
+      if (!contents[i]->cache) {
+        write_jar_cache(cache_paths[i], *contents[i]);
+      }
+    }
+  }
+  return true;
+}
+
 //#define LOCAL_MAIN
 #ifdef LOCAL_MAIN
 int main(int argc, char* argv[]) {
@@ -16,6 +16,9 @@ class DexMethod;
 #include "ConfigFiles.h"
 
 #include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace JarLoaderUtil {
 uint32_t read32(uint8_t*& buffer);
@@ -31,6 +34,19 @@ bool load_jar_file(const DexLocation* location,
                    Scope* classes = nullptr,
                    const attribute_hook_t& = nullptr);
 
+/*
+ * Loads the given jars as if by calling `load_jar_file` on each of them in
+ * order, adding the classes of each jar to its Scope unless that is null.
+ * The class files of all jars are inflated and parsed in parallel.
+ *
+ * If `cache_dir` is not empty, the parsed classes of each jar are cached
+ * there, keyed by a hash of the jar's content, and jars that did not change
+ * are read back from the cache instead of being inflated again.
+ */
+bool load_jar_files(
+    const std::vector<std::pair<const DexLocation*, Scope*>>& jars,
+    const std::string& cache_dir = "");
+
 bool load_class_file(const std::string& filename, Scope* classes = nullptr);
 
 void init_basic_types();
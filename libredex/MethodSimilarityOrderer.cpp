@@ -7,6 +7,9 @@
 
 #include "MethodSimilarityOrderer.h"
 
+#include <cmath>
+#include <limits>
+
 #include "DexInstruction.h"
 #include "Show.h"
 #include "Trace.h"
@@ -23,6 +26,35 @@ struct Score {
   int32_t value() const { return 2 * shared - missing - 2 * additional; }
 };
 
+constexpr uint64_t CALLEE_HASH_TAG = 1ULL << 63;
+
+// The splitmix64 finalizer.
+inline uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// The murmur3 32-bit finalizer.
+inline uint32_t mix32(uint32_t x) {
+  x = (x ^ (x >> 16)) * 0x85ebca6bU;
+  x = (x ^ (x >> 13)) * 0xc2b2ae35U;
+  return x ^ (x >> 16);
+}
+
+// Each of the k MinHash functions of a code hash id is derived as
+// mix32(a + k * b) from two independent hashes a and b of the id. The
+// derived values must be scrambled: a + k * b is an arithmetic progression,
+// so an element with small a and b would be the minimum for most k and make
+// the signatures of all methods that contain it identical. The seed keeps
+// id 0 from getting a = 0 and b = 1, since mix(0) == 0 and mix32(0) == 0.
+constexpr uint64_t kMinHashSeed = 0x9e3779b97f4a7c15ULL;
+
+inline std::pair<uint32_t, uint32_t> minhash_params(uint32_t code_hash_id) {
+  uint64_t h = mix(code_hash_id + kMinHashSeed);
+  return {static_cast<uint32_t>(h), static_cast<uint32_t>(h >> 32) | 1};
+}
+
 template <typename T>
 struct CountingFakeOutputIterator {
   uint32_t& counter;
@@ -61,7 +93,11 @@ void MethodSimilarityOrderer::gather_code_hash_ids(
     }
     if (insn->has_method()) {
       auto callee = ((DexOpcodeMethod*)insn)->get_method();
-      stable_hashes.insert(std::hash<std::string>{}(show(callee)));
+      auto callee_id =
+          m_callee_ids.emplace(callee, m_callee_ids.size()).first->second;
+      // Instruction hashes never reach the top bit, so callees get their own
+      // range of stable hashes.
+      stable_hashes.insert(CALLEE_HASH_TAG | callee_id);
     }
     stable_hashes.insert(code_hash);
   };
@@ -149,6 +185,112 @@ void MethodSimilarityOrderer::compute_score() {
       indices);
 }
 
+void MethodSimilarityOrderer::compute_minhash_candidates() {
+  const auto& options = *m_minhash;
+  size_t num_methods = m_id_to_method.size();
+  redex_assert(num_methods <= (1 << 16));
+  always_assert_log(options.error_tolerance > 0 && options.error_tolerance < 1,
+                    "MinHash error tolerance must be in (0, 1), got %f",
+                    options.error_tolerance);
+
+  // The standard error of a MinHash similarity estimate with k hash functions
+  // is at most 1 / sqrt(k).
+  uint32_t rows = std::max<uint32_t>(1, options.rows_per_band);
+  auto num_hashes = static_cast<uint32_t>(std::ceil(
+      1.0 / (options.error_tolerance * options.error_tolerance)));
+  uint32_t num_bands = std::max<uint32_t>(1, (num_hashes + rows - 1) / rows);
+  num_hashes = num_bands * rows;
+  size_t window = std::max<uint32_t>(1, options.max_candidates_per_bucket) / 2;
+
+  // Deriving the k hash functions from two independent ones is much cheaper
+  // than k full hashes (see minhash_params).
+  std::vector<uint32_t> signatures(num_methods * num_hashes);
+  workqueue_run_for<size_t>(0, num_methods, [&](size_t i) {
+    auto* signature = &signatures[i * num_hashes];
+    std::fill(signature, signature + num_hashes,
+              std::numeric_limits<uint32_t>::max());
+    for (auto code_hash_id : m_method_id_to_code_hash_ids.at(i)) {
+      auto [a, b] = minhash_params(code_hash_id);
+      for (uint32_t k = 0; k < num_hashes; k++) {
+        signature[k] = std::min(signature[k], mix32(a + k * b));
+      }
+    }
+  });
+
+  // For each band, the methods sorted by the hash of their band, and the
+  // position of each method in that order.
+  using Bucketed = std::pair<uint64_t, MethodId>;
+  std::vector<std::vector<Bucketed>> bands(num_bands);
+  std::vector<std::vector<uint32_t>> positions(num_bands);
+  workqueue_run_for<uint32_t>(0, num_bands, [&](uint32_t band) {
+    auto& bucketed = bands[band];
+    bucketed.reserve(num_methods);
+    for (size_t i = 0; i < num_methods; i++) {
+      // Methods without code never match anything.
+      if (m_method_id_to_code_hash_ids.at(i).empty()) {
+        continue;
+      }
+      uint64_t band_hash = band;
+      const auto* signature = &signatures[i * num_hashes + band * rows];
+      for (uint32_t r = 0; r < rows; r++) {
+        band_hash = mix(band_hash ^ signature[r]) + r;
+      }
+      bucketed.emplace_back(band_hash, static_cast<MethodId>(i));
+    }
+    std::sort(bucketed.begin(), bucketed.end());
+    auto& position = positions[band];
+    position.assign(num_methods, std::numeric_limits<uint32_t>::max());
+    for (uint32_t p = 0; p < bucketed.size(); p++) {
+      position[bucketed[p].second] = p;
+    }
+  });
+  signatures = std::vector<uint32_t>();
+
+  // Only the nearest neighbours (in source order) within each bucket are
+  // scored, which keeps the work linear even if many methods are alike.
+  m_candidates.clear();
+  m_candidates.resize(num_methods);
+  workqueue_run_for<size_t>(0, num_methods, [&](size_t i) {
+    std::vector<MethodId> neighbours;
+    for (uint32_t band = 0; band < num_bands; band++) {
+      auto p = positions[band][i];
+      if (p == std::numeric_limits<uint32_t>::max()) {
+        continue;
+      }
+      const auto& bucketed = bands[band];
+      auto band_hash = bucketed[p].first;
+      for (size_t q = p, n = 0; q > 0 && n < window; n++) {
+        if (bucketed[--q].first != band_hash) break;
+        neighbours.push_back(bucketed[q].second);
+      }
+      for (size_t q = p + 1, n = 0;
+           q < bucketed.size() && n < window &&
+           bucketed[q].first == band_hash;
+           q++, n++) {
+        neighbours.push_back(bucketed[q].second);
+      }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()),
+                     neighbours.end());
+
+    const auto& code_hash_ids_i = m_method_id_to_code_hash_ids.at(i);
+    auto& candidates = m_candidates[i];
+    for (auto j_id : neighbours) {
+      auto score =
+          get_score(code_hash_ids_i, m_method_id_to_code_hash_ids.at(j_id));
+      if (score.value() >= 0) {
+        candidates.emplace_back(score.value(), j_id);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const auto& a, const auto& b) {
+                return a.first != b.first ? a.first > b.first
+                                          : a.second < b.second;
+              });
+  });
+}
+
 void MethodSimilarityOrderer::insert(DexMethod* method) {
   always_assert(m_method_to_id.count(method) == 0);
   // While the number of methods can reach 65536 (2^16), at
@@ -173,7 +315,15 @@ MethodSimilarityOrderer::get_next() {
     return {};
   }
 
-  if (m_last_method_id != boost::none) {
+  if (m_last_method_id != boost::none && m_minhash) {
+    for (const auto& [score, meth_id] : m_candidates[*m_last_method_id]) {
+      if (m_id_to_method.count(meth_id)) {
+        TRACE(OPUT, 3, "[method-similarity-orderer] selected %s with score %d",
+              SHOW(m_id_to_method[meth_id]), score);
+        return meth_id;
+      }
+    }
+  } else if (m_last_method_id != boost::none) {
     // Iterate m_score_map from the highest score..
     for (const auto& [score, method_id_bitset] :
          m_score_map[*m_last_method_id]) {
@@ -207,6 +357,12 @@ void MethodSimilarityOrderer::remove_method(DexMethod* meth) {
   m_method_to_id.erase(meth);
 }
 
+uint32_t MethodSimilarityOrderer::minhash_value(CodeHashId code_hash_id,
+                                                uint32_t k) {
+  auto [a, b] = minhash_params(code_hash_id);
+  return mix32(a + k * b);
+}
+
 void MethodSimilarityOrderer::order(std::vector<DexMethod*>& methods) {
   Timer t("Reordering methods by similarity");
 
@@ -217,7 +373,11 @@ void MethodSimilarityOrderer::order(std::vector<DexMethod*>& methods) {
   methods.clear();
 
   // Compute scores among methods in parallel.
-  compute_score();
+  if (m_minhash) {
+    compute_minhash_candidates();
+  } else {
+    compute_score();
+  }
 
   m_last_method_id = boost::none;
   for (boost::optional<MethodId> best_method_id = get_next();
@@ -12,6 +12,7 @@
 #include <unordered_set>
 
 #include <boost/dynamic_bitset.hpp>
+#include <boost/optional.hpp>
 
 #include "DexClass.h"
 #include "Timer.h"
@@ -46,6 +47,28 @@ class MethodSimilarityOrderer {
 
   using ScoreValue = int32_t;
 
+  /*
+   * Instead of scoring every pair of methods, which is quadratic in the
+   * number of methods, only score the near neighbours of each method found
+   * by locality-sensitive hashing of MinHash signatures of its code hash ids.
+   */
+  struct MinHashOptions {
+    // Tolerated standard error of the estimated similarity of two methods.
+    // The signatures use 1 / error_tolerance^2 hash functions.
+    float error_tolerance{0.1f};
+    // Signatures are split into bands of this many hashes; methods that agree
+    // on all hashes of any band are candidates for each other.
+    uint32_t rows_per_band{4};
+    // How many of its neighbours in each band bucket a method is compared
+    // against. Bounds the work for large groups of near-identical methods.
+    uint32_t max_candidates_per_bucket{16};
+  };
+
+  MethodSimilarityOrderer() = default;
+
+  explicit MethodSimilarityOrderer(boost::optional<MinHashOptions> minhash)
+      : m_minhash(std::move(minhash)) {}
+
  private:
   // Mirrors the order in each the methods have been added to the orderer
   std::map<MethodId, DexMethod*> m_id_to_method;
@@ -63,6 +86,12 @@ class MethodSimilarityOrderer {
       std::map<ScoreValue, boost::dynamic_bitset<>, std::greater<ScoreValue>>>
       m_score_map;
 
+  // With MinHash, the scored candidates of each method, by decreasing score
+  // and then by Method Id. Replaces m_score_map.
+  std::vector<std::vector<std::pair<ScoreValue, MethodId>>> m_candidates;
+
+  boost::optional<MinHashOptions> m_minhash;
+
   // Last Method Id that is ordered.
   boost::optional<MethodId> m_last_method_id;
 
@@ -70,6 +99,10 @@ class MethodSimilarityOrderer {
   // space.
   std::unordered_map<StableHash, CodeHashId> m_stable_hash_to_code_hash_id;
 
+  // Callees are identified by the order in which they are first seen, which
+  // is deterministic, unlike their addresses.
+  std::unordered_map<const DexMethodRef*, uint32_t> m_callee_ids;
+
   void insert(DexMethod* method);
 
   void remove_method(DexMethod* meth);
@@ -83,6 +116,11 @@ class MethodSimilarityOrderer {
 
   void compute_score();
 
+  void compute_minhash_candidates();
+
  public:
   void order(std::vector<DexMethod*>& methods);
+
+  // The value of the k-th MinHash function for a code hash id.
+  static uint32_t minhash_value(CodeHashId code_hash_id, uint32_t k);
 };
@@ -61,6 +61,8 @@
 #include "Show.h"
 #include "SourceBlocks.h"
 #include "Timer.h"
+#include "TraceEventLog.h"
+#include "WalkerCosts.h"
 #include "Walkers.h"
 
 namespace {
@@ -563,6 +565,15 @@ void process_secondary_method_profiles(PassManager& mgr, ConfigFiles& conf) {
                  conf.get_secondary_method_profiles().unresolved_size());
 }
 
+// How much of the time of the parallel method and code walks of the pass was
+// spent with some threads out of work.
+void report_walker_stats(PassManager& mgr, const walker_costs::Stats& stats) {
+  mgr.set_metric("~walkers~count~", stats.walks);
+  mgr.set_metric("~walkers~wall~us~", stats.wall_nanos / 1000);
+  mgr.set_metric("~walkers~tail~us~", stats.tail_nanos / 1000);
+  mgr.set_metric("~walkers~max_tail~us~", stats.max_tail_nanos / 1000);
+}
+
 void maybe_write_hashes_incoming(const ConfigFiles& conf, const Scope& scope) {
   if (conf.emit_incoming_hashes()) {
     TRACE(PM, 1, "Writing incoming hashes...");
@@ -1305,6 +1316,7 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
     ScopedMemStats scoped_mem_stats{mem_pass_stats, hwm_per_pass};
     Timer t(pass->name() + " " + std::to_string(pass_run) + " (run)");
     m_current_pass_info = &m_pass_info[i];
+    trace_event_log::set_current_pass(pass->name());
 
     pre_pass_verifiers(pass, i);
 
@@ -1332,7 +1344,9 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
         ensure_editable_cfg(stores);
         TRACE(PM, 2, "%s Pass uses editable cfg.\n", SHOW(pass->name()));
       }
+      walker_costs::take_stats();
       pass->run_pass(stores, conf, *this);
+      report_walker_stats(*this, walker_costs::take_stats());
 
       // Ensure the CFG is clean, e.g., no unreachable blocks.
       if (pass->is_editable_cfg_friendly()) {
@@ -1357,6 +1371,8 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
 
     analysis_usage_helper.post_pass(pass);
 
+    g_redex->reclaim_member_tables();
+
     process_method_profiles(*this, conf);
     process_secondary_method_profiles(*this, conf);
 
@@ -1366,6 +1382,7 @@ void PassManager::run_passes(DexStoresVector& stores, ConfigFiles& conf) {
     }
 
     m_current_pass_info = nullptr;
+    trace_event_log::set_current_pass({});
   }
 
   after_pass_size.wait();
@@ -1454,12 +1471,20 @@ Pass* PassManager::find_pass(const std::string& pass_name) const {
 
 void PassManager::incr_metric(const std::string& key, int64_t value) {
   always_assert_log(m_current_pass_info != nullptr, "No current pass!");
+  if (trace_event_log::should_sample(PM)) {
+    trace_event_log::record(PM, trace_event_log::intern(key),
+                            trace_event_log::kNoString, value);
+  }
   std::unique_lock<std::mutex> lock{m_internal_fields->m_metrics_lock};
   (m_current_pass_info->metrics)[key] += value;
 }
 
 void PassManager::set_metric(const std::string& key, int64_t value) {
   always_assert_log(m_current_pass_info != nullptr, "No current pass!");
+  if (trace_event_log::should_sample(PM)) {
+    trace_event_log::record(PM, trace_event_log::intern(key),
+                            trace_event_log::kNoString, value);
+  }
   std::unique_lock<std::mutex> lock{m_internal_fields->m_metrics_lock};
   (m_current_pass_info->metrics)[key] = value;
 }
@@ -9,6 +9,7 @@
 
 #include <algorithm>
 #include <boost/functional/hash.hpp>
+#include <unordered_map>
 
 #include "StlUtil.h"
 
@@ -19,7 +20,10 @@ bool operator==(const MemberSpecification& lhs,
   return lhs.requiredSetAccessFlags == rhs.requiredSetAccessFlags &&
          lhs.requiredUnsetAccessFlags == rhs.requiredUnsetAccessFlags &&
          lhs.annotationType == rhs.annotationType && lhs.name == rhs.name &&
-         lhs.descriptor == rhs.descriptor;
+         lhs.descriptor == rhs.descriptor &&
+         lhs.return_value.value_type == rhs.return_value.value_type &&
+         (lhs.return_value.value_type == AssumeReturnValue::ValueNone ||
+          lhs.return_value.value.v == rhs.return_value.value.v);
 }
 
 size_t hash_value(const MemberSpecification& spec) {
@@ -93,4 +97,17 @@ void KeepSpecSet::erase_if(const std::function<bool(const KeepSpec&)>& pred) {
       m_ordered.end());
 }
 
+void KeepSpecSet::append(KeepSpecSet&& other) {
+  std::unordered_map<const KeepSpec*, std::unique_ptr<KeepSpec>> owned;
+  while (!other.m_unordered_set.empty()) {
+    auto node = other.m_unordered_set.extract(other.m_unordered_set.begin());
+    auto* spec = node.value().get();
+    owned.emplace(spec, std::move(node.value()));
+  }
+  for (auto* spec : other.m_ordered) {
+    emplace(std::move(owned.at(spec)));
+  }
+  other.m_ordered.clear();
+}
+
 } // namespace keep_rules
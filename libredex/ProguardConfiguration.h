@@ -144,10 +144,25 @@ class KeepSpecSet {
 
   void erase_if(const std::function<bool(const KeepSpec&)>&);
 
+  // Moves the elements of other to the end of this set, in order, dropping
+  // the ones that are already here.
+  void append(KeepSpecSet&& other);
+
  private:
+  // Rules are compared by value, including the kind of keep command, so
+  // that the same rule coming from several config files is matched once.
+  struct SameRule {
+    bool operator()(const std::unique_ptr<KeepSpec>& lhs,
+                    const std::unique_ptr<KeepSpec>& rhs) const {
+      return *lhs == *rhs && lhs->mark_classes == rhs->mark_classes &&
+             lhs->mark_conditionally == rhs->mark_conditionally;
+    }
+  };
+
   std::vector<KeepSpec*> m_ordered;
   std::unordered_set<std::unique_ptr<KeepSpec>,
-                     boost::hash<std::unique_ptr<KeepSpec>>>
+                     boost::hash<std::unique_ptr<KeepSpec>>,
+                     SameRule>
       m_unordered_set;
 };
 
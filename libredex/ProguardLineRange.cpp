@@ -7,15 +7,13 @@
 
 #include "ProguardLineRange.h"
 
-#include <utility>
-
 ProguardLineRange::ProguardLineRange(
-    uint32_t s, uint32_t e, uint32_t os, uint32_t oe, std::string ogn)
+    uint32_t s, uint32_t e, uint32_t os, uint32_t oe, std::string_view ogn)
     : start(s),
       end(e),
       original_start(os),
       original_end(oe),
-      original_name(std::move(ogn)) {}
+      original_name(ogn) {}
 
 bool ProguardLineRange::operator==(const ProguardLineRange& other) const {
   return this->start == other.start && this->end == other.end &&
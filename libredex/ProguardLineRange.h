@@ -9,7 +9,7 @@
 
 #include <memory>
 #include <stdint.h>
-#include <string>
+#include <string_view>
 #include <vector>
 /**
  * ProguardLineRange stores line number values parsed from a proguard mapping.
@@ -20,11 +20,12 @@ struct ProguardLineRange final {
   uint32_t end{0};
   uint32_t original_start{0};
   uint32_t original_end{0};
-  std::string original_name;
+  // Points into the names of the ProguardMap the range belongs to.
+  std::string_view original_name;
 
   ProguardLineRange() = default;
   ProguardLineRange(
-      uint32_t s, uint32_t e, uint32_t os, uint32_t oe, std::string ogn);
+      uint32_t s, uint32_t e, uint32_t os, uint32_t oe, std::string_view ogn);
   virtual ~ProguardLineRange() = default;
 
   bool operator==(const ProguardLineRange& other) const;
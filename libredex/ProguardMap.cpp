@@ -7,9 +7,13 @@
 
 #include "ProguardMap.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "DexPosition.h"
 #include "DexUtil.h"
 #include "IRCode.h"
+#include "ReadMaybeMapped.h"
 #include "Show.h"
 #include "Timer.h"
 #include "Trace.h"
@@ -17,12 +21,15 @@
 
 namespace {
 
+// Names are allocated in blocks of this size, unless they are bigger.
+constexpr size_t kNameBlockSize = 1 << 20;
+
 std::string find_or_same(
-    const std::string& key,
-    const std::unordered_map<std::string, std::string>& map) {
+    std::string_view key,
+    const std::unordered_map<std::string_view, std::string_view>& map) {
   auto it = map.find(key);
-  if (it == map.end()) return key;
-  return it->second;
+  if (it == map.end()) return std::string(key);
+  return std::string(it->second);
 }
 
 std::string convert_scalar_type(std::string_view type) {
@@ -37,44 +44,54 @@ std::string convert_scalar_type(std::string_view type) {
   return java_names::external_to_internal(type);
 }
 
-std::string convert_field(const std::string& cls,
-                          const std::string& type,
-                          const std::string& name) {
-  std::ostringstream ss;
-  ss << cls << "." << name;
+std::string convert_field(std::string_view cls,
+                          std::string_view type,
+                          std::string_view name) {
+  std::string s;
+  s.reserve(cls.size() + name.size() + type.size() + 2);
+  s.append(cls).append(".").append(name);
   if (!type.empty()) {
-    ss << ":" << type;
+    s.append(":").append(type);
   }
-  return ss.str();
+  return s;
 }
 
-std::string convert_method(const std::string& cls,
-                           const std::string& rtype,
-                           const std::string& methodname,
-                           const std::string& args) {
-  std::ostringstream ss;
-  ss << cls << "." << methodname << ":(" << args << ")" << rtype;
-  return ss.str();
+std::string convert_method(std::string_view cls,
+                           std::string_view rtype,
+                           std::string_view methodname,
+                           std::string_view args) {
+  std::string s;
+  s.reserve(cls.size() + methodname.size() + args.size() + rtype.size() + 4);
+  s.append(cls).append(".").append(methodname).append(":(");
+  s.append(args).append(")").append(rtype);
+  return s;
 }
 
-std::string translate_type(const std::string& type, const ProguardMap& pm) {
+std::string translate_type(std::string_view type, const ProguardMap& pm) {
   auto base_start = type.find_first_not_of('[');
-  auto array_prefix = type.substr(0, base_start);
-  auto base_type = type.substr(base_start);
-  array_prefix += pm.translate_class(base_type);
+  std::string array_prefix(type.substr(0, base_start));
+  array_prefix += pm.translate_class(std::string(type.substr(base_start)));
   return array_prefix;
 }
 
-void whitespace(const char*& p) {
-  while (isspace(*p)) {
-    ++p;
+/*
+ * The parsers below consume the front of a view of the current line. The end
+ * of the line acts as a separator for every token.
+ */
+
+void whitespace(std::string_view& p) {
+  while (!p.empty() && isspace(static_cast<unsigned char>(p.front()))) {
+    p.remove_prefix(1);
   }
 }
 
-uint32_t line_number(const char*& p) {
-  char* e;
-  uint32_t line = std::strtol(p, &e, 10);
-  p = e;
+uint32_t line_number(std::string_view& p) {
+  uint32_t line = 0;
+  size_t i = 0;
+  for (; i < p.size() && isdigit(static_cast<unsigned char>(p[i])); ++i) {
+    line = line * 10 + (p[i] - '0');
+  }
+  p.remove_prefix(i);
   return line;
 }
 
@@ -83,43 +100,48 @@ bool isseparator(uint32_t cp) {
          cp == '(' || cp == ')';
 }
 
+/*
+ * All separators are ASCII, and the bytes of multi-byte MUTF-8 code points
+ * never are, so we can look for separators byte by byte.
+ */
 template <typename F>
-bool id(const char*& p, std::string& s, F isseparator) {
-  auto b = p;
-  auto first = mutf8_next_code_point(p);
-  if (isdigit(first)) return false;
-  while (true) {
-    auto prev = p;
-    auto cp = mutf8_next_code_point(p);
-    if (isseparator(cp)) {
-      p = prev;
-      s = std::string(b, p - b);
-      return true;
-    }
+bool id(std::string_view& p, std::string_view& s, F isseparator) {
+  if (p.empty() || isdigit(static_cast<unsigned char>(p.front()))) {
+    return false;
+  }
+  size_t len = 1;
+  while (len < p.size() && !isseparator(static_cast<unsigned char>(p[len]))) {
+    ++len;
   }
+  s = p.substr(0, len);
+  p.remove_prefix(len);
+  return true;
 }
 
-bool id(const char*& p, std::string& s) { return id(p, s, isseparator); }
+bool id(std::string_view& p, std::string_view& s) {
+  return id(p, s, isseparator);
+}
 
-bool literal(const char*& p, const char* s) {
-  auto len = strlen(s);
-  bool rv = !strncmp(p, s, len);
-  p += len;
-  return rv;
+bool literal(std::string_view& p, std::string_view s) {
+  if (p.substr(0, s.size()) != s) {
+    return false;
+  }
+  p.remove_prefix(s.size());
+  return true;
 }
 
-bool literal(const char*& p, char s) {
-  if (*p == s) {
-    ++p;
+bool literal(std::string_view& p, char s) {
+  if (!p.empty() && p.front() == s) {
+    p.remove_prefix(1);
     return true;
   }
   return false;
 }
 
-bool field_full_format(const char*& p, std::string& s) {
-  std::string class_name;
-  std::string field_name;
-  std::string type;
+bool field_full_format(std::string_view& p, std::string& s) {
+  std::string_view class_name;
+  std::string_view field_name;
+  std::string_view type;
 
   if (!id(p, class_name, [](uint32_t s) { return s == ';'; })) {
     return false;
@@ -139,15 +161,17 @@ bool field_full_format(const char*& p, std::string& s) {
     return false;
   }
 
-  s = class_name + ";." + field_name + ":" + type;
+  s.clear();
+  s.append(class_name).append(";.").append(field_name).append(":");
+  s.append(type);
   return true;
 }
 
-bool method_full_format(const char*& p, std::string& s) {
-  std::string class_name;
-  std::string method_name;
-  std::string args;
-  std::string rtype;
+bool method_full_format(std::string_view& p, std::string& s) {
+  std::string_view class_name;
+  std::string_view method_name;
+  std::string_view args;
+  std::string_view rtype;
 
   if (!id(p, class_name, [](uint32_t s) { return s == ';'; })) {
     return false;
@@ -176,24 +200,45 @@ bool method_full_format(const char*& p, std::string& s) {
     return false;
   }
 
-  s = class_name + ";." + method_name + ":(" + args + ")" + rtype;
+  s.clear();
+  s.append(class_name).append(";.").append(method_name).append(":(");
+  s.append(args).append(")").append(rtype);
   return true;
 }
 
-bool comment(const std::string& line) {
-  auto p = line.c_str();
-  whitespace(p);
-  return literal(p, '#');
+bool comment(std::string_view line) {
+  whitespace(line);
+  return literal(line, '#');
 }
 
-void inlined_method(std::string& classname, std::string& methodname) {
+void inlined_method(std::string& storage,
+                    std::string_view& classname,
+                    std::string_view& methodname) {
   std::size_t found = methodname.find_last_of('.');
   if (found != std::string::npos) {
-    classname = convert_scalar_type(methodname.substr(0, found));
+    storage = convert_scalar_type(methodname.substr(0, found));
+    classname = storage;
     methodname = methodname.substr(found + 1);
   }
 }
 
+/*
+ * Calls fn on every line of the contents, without the line terminator, like
+ * std::getline does.
+ */
+template <typename Fn>
+void for_each_line(std::string_view contents, const Fn& fn) {
+  while (!contents.empty()) {
+    auto end = contents.find('\n');
+    if (end == std::string_view::npos) {
+      fn(contents);
+      return;
+    }
+    fn(contents.substr(0, end));
+    contents.remove_prefix(end + 1);
+  }
+}
+
 /**
  * Proguard would generate some special sequences when a coalesced interface is
  * used.
@@ -203,7 +248,7 @@ void inlined_method(std::string& classname, std::string& methodname) {
  * After:
  *   a_vcard.android.syncml.pim.VBuilder mExecutorSupplier$7ec36e13 -> b
  */
-bool is_maybe_proguard_generated_member(const std::string& s) {
+bool is_maybe_proguard_generated_member(std::string_view s) {
   unsigned int count = 0;
   for (auto it = s.rbegin(); it != s.rend(); ++it, ++count) {
     if (isxdigit(*it)) continue;
@@ -219,16 +264,29 @@ ProguardMap::ProguardMap(const std::string& filename, bool use_new_rename_map) {
     return;
   }
   Timer t("Parsing proguard map");
-  std::ifstream fp(filename);
-  always_assert_log(fp, "Can't open proguard map: %s\n", filename.c_str());
-
-  if (use_new_rename_map) {
-    parse_full_map(fp);
-  } else {
-    parse_proguard_map(fp);
+  // Mapping files can be hundreds of megabytes, so we parse them in place
+  // rather than copying them line by line.
+  try {
+    redex::read_file_with_contents(
+        filename, [&](const char* data, size_t size) {
+          std::string_view contents(data, size);
+          if (use_new_rename_map) {
+            parse_full_map(contents);
+          } else {
+            parse_proguard_map(contents);
+          }
+        });
+  } catch (const std::runtime_error& e) {
+    not_reached_log("Can't open proguard map: %s\n%s\n", filename.c_str(),
+                    e.what());
   }
 }
 
+ProguardMap::ProguardMap(std::istream& is) {
+  std::string contents(std::istreambuf_iterator<char>(is), {});
+  parse_proguard_map(contents);
+}
+
 std::string ProguardMap::translate_class(const std::string& cls) const {
   return find_or_same(cls, m_classMap);
 }
@@ -257,8 +315,8 @@ std::string ProguardMap::deobfuscate_method(const std::string& method) const {
 std::vector<ProguardMap::Frame> ProguardMap::deobfuscate_frame(
     const DexString* method_name, uint32_t line) const {
   std::vector<Frame> frames;
-  auto ranges_it = m_obfMethodLinesMap.find(
-      str_copy(pg_impl::lines_key(method_name->str())));
+  auto ranges_it =
+      m_obfMethodLinesMap.find(pg_impl::lines_key(method_name->str()));
   if (ranges_it != m_obfMethodLinesMap.end()) {
     for (const auto& range : ranges_it->second) {
       if (!range->matches(line)) {
@@ -283,80 +341,104 @@ std::vector<ProguardMap::Frame> ProguardMap::deobfuscate_frame(
 
 ProguardLineRangeVector& ProguardMap::method_lines(
     const std::string& obfuscated_method) {
-  return m_obfMethodLinesMap.at(
-      str_copy(pg_impl::lines_key(obfuscated_method)));
-}
-
-void ProguardMap::parse_proguard_map(std::istream& fp) {
-  std::string line;
-  while (std::getline(fp, line)) {
-    parse_class(line);
+  return m_obfMethodLinesMap.at(pg_impl::lines_key(obfuscated_method));
+}
+
+std::string_view ProguardMap::store(std::string_view name) {
+  if (name.size() > m_name_space) {
+    auto size = std::max(kNameBlockSize, name.size());
+    m_name_blocks.emplace_back(new char[size]);
+    m_name_cursor = m_name_blocks.back().get();
+    m_name_space = size;
+  }
+  memcpy(m_name_cursor, name.data(), name.size());
+  std::string_view stored(m_name_cursor, name.size());
+  m_name_cursor += name.size();
+  m_name_space -= name.size();
+  return stored;
+}
+
+void ProguardMap::parse_proguard_map(std::string_view contents) {
+  // Members refer to classes that may only be declared further down, so we
+  // need to know all the classes before we can translate their types. We also
+  // count the members, so that the maps never have to be rehashed.
+  size_t fields = 0;
+  size_t methods = 0;
+  for_each_line(contents, [&](std::string_view line) {
+    if (parse_class(line)) {
+      return;
+    }
+    if (line.find('(') != std::string_view::npos) {
+      ++methods;
+    } else {
+      ++fields;
+    }
+  });
+  for (auto* map : {&m_fieldMap, &m_obfFieldMap, &m_obfUntypedFieldMap}) {
+    map->reserve(fields);
   }
-  fp.clear();
-  fp.seekg(0);
-  assert_log(!fp.fail(), "Can't use ProguardMap with non-seekable stream");
-  while (std::getline(fp, line)) {
+  for (auto* map : {&m_methodMap, &m_obfMethodMap, &m_obfUntypedMethodMap}) {
+    map->reserve(methods);
+  }
+  m_obfMethodLinesMap.reserve(methods);
+  for_each_line(contents, [&](std::string_view line) {
     if (parse_class(line)) {
-      continue;
+      return;
     }
     if (parse_field(line)) {
-      continue;
+      return;
     }
     if (parse_method(line)) {
-      continue;
+      return;
     }
     if (comment(line)) {
-      continue;
+      return;
     }
-    not_reached_log("Bogus line encountered in proguard map: %s\n",
-                    line.c_str());
-  }
+    not_reached_log("Bogus line encountered in proguard map: %.*s\n",
+                    static_cast<int>(line.size()), line.data());
+  });
 }
 
-void ProguardMap::parse_full_map(std::istream& fp) {
-  std::string line;
-  fp.seekg(0);
-  assert_log(!fp.fail(),
-             "Can't use the full rename map with non-seekable stream");
-  while (std::getline(fp, line)) {
+void ProguardMap::parse_full_map(std::string_view contents) {
+  for_each_line(contents, [&](std::string_view line) {
     if (parse_class_full_format(line)) {
-      continue;
+      return;
     }
     if (parse_store_full_format(line)) {
-      continue;
+      return;
     }
     if (parse_field_full_format(line)) {
-      continue;
+      return;
     }
     if (parse_method_full_format(line)) {
-      continue;
+      return;
     }
     if (comment(line)) {
-      continue;
+      return;
     }
-    not_reached_log("Bogus line encountered in the full map: %s\n",
-                    line.c_str());
-  }
+    not_reached_log("Bogus line encountered in the full map: %.*s\n",
+                    static_cast<int>(line.size()), line.data());
+  });
 }
 
-bool ProguardMap::parse_class_full_format(const std::string& line) {
-  std::string old_class_name;
-  std::string new_class_name;
-  auto p = line.c_str();
+bool ProguardMap::parse_class_full_format(std::string_view line) {
+  std::string_view old_class_name;
+  std::string_view new_class_name;
+  auto p = line;
   if (!literal(p, "type ")) return false;
   if (!id(p, old_class_name)) return false;
   if (!literal(p, " -> ")) return false;
   if (!id(p, new_class_name)) return false;
 
-  m_currClass = old_class_name;
-  m_currNewClass = new_class_name;
+  m_currClass = store(old_class_name);
+  m_currNewClass = store(new_class_name);
   m_classMap[m_currClass] = m_currNewClass;
   m_obfClassMap[m_currNewClass] = m_currClass;
   return true;
 }
 
-bool ProguardMap::parse_store_full_format(const std::string& line) {
-  auto p = line.c_str();
+bool ProguardMap::parse_store_full_format(std::string_view line) {
+  auto p = line;
   if (!literal(p, "store` ")) {
     return false;
   }
@@ -366,14 +448,12 @@ bool ProguardMap::parse_store_full_format(const std::string& line) {
   return true;
 }
 
-bool ProguardMap::parse_field_full_format(const std::string& line) {
+bool ProguardMap::parse_field_full_format(std::string_view line) {
   std::string old_field_name;
   std::string new_field_name;
 
-  auto p = line.c_str();
+  auto p = line;
   if (!literal(p, "ifield ")) {
-    // Reset the field pointer.
-    p = line.c_str();
     if (!literal(p, "sfield ")) {
       return false;
     }
@@ -389,21 +469,18 @@ bool ProguardMap::parse_field_full_format(const std::string& line) {
     return false;
   }
 
-  auto pgnew = new_field_name;
-  auto pgold = old_field_name;
-
+  auto pgold = store(old_field_name);
+  auto pgnew = store(new_field_name);
   m_fieldMap[pgold] = pgnew;
   m_obfFieldMap[pgnew] = pgold;
   return true;
 }
 
-bool ProguardMap::parse_method_full_format(const std::string& line) {
+bool ProguardMap::parse_method_full_format(std::string_view line) {
   std::string old_method_name;
   std::string new_method_name;
-  auto p = line.c_str();
+  auto p = line;
   if (!literal(p, "dmethod ")) {
-    // Reset the method pointer.
-    p = line.c_str();
     if (!literal(p, "vmethod ")) {
       return false;
     }
@@ -419,33 +496,42 @@ bool ProguardMap::parse_method_full_format(const std::string& line) {
     return false;
   }
 
-  auto pgold = old_method_name;
-  auto pgnew = new_method_name;
+  auto pgold = store(old_method_name);
+  auto pgnew = store(new_method_name);
   m_methodMap[pgold] = pgnew;
   m_obfMethodMap[pgnew] = pgold;
   return true;
 }
 
-bool ProguardMap::parse_class(const std::string& line) {
-  std::string classname;
-  std::string newname;
-  auto p = line.c_str();
+bool ProguardMap::parse_class(std::string_view line) {
+  std::string_view classname;
+  std::string_view newname;
+  auto p = line;
   if (!id(p, classname)) return false;
   if (!literal(p, " -> ")) return false;
   if (!id(p, newname)) return false;
-  m_currClass = convert_type(classname);
-  m_currNewClass = convert_type(newname);
+  // The classes are parsed again in the second pass. Their names are stored
+  // the first time only.
+  auto cls = convert_type(classname);
+  auto it = m_classMap.find(cls);
+  if (it != m_classMap.end()) {
+    m_currClass = it->first;
+    m_currNewClass = it->second;
+    return true;
+  }
+  m_currClass = store(cls);
+  m_currNewClass = store(convert_type(newname));
   m_classMap[m_currClass] = m_currNewClass;
   m_obfClassMap[m_currNewClass] = m_currClass;
   return true;
 }
 
-bool ProguardMap::parse_field(const std::string& line) {
-  std::string type;
-  std::string fieldname;
-  std::string newname;
+bool ProguardMap::parse_field(std::string_view line) {
+  std::string_view type;
+  std::string_view fieldname;
+  std::string_view newname;
 
-  auto p = line.c_str();
+  auto p = line;
   whitespace(p);
   if (!id(p, type)) return false;
   whitespace(p);
@@ -455,16 +541,17 @@ bool ProguardMap::parse_field(const std::string& line) {
 
   auto ctype = convert_type(type);
   auto xtype = translate_type(ctype, *this);
-  auto pgnew = convert_field(m_currNewClass, xtype, newname);
-  auto pgnew_notype = convert_field(m_currNewClass, "", newname);
-  auto pgold = convert_field(m_currClass, ctype, fieldname);
+  auto pgnew = store(convert_field(m_currNewClass, xtype, newname));
+  auto pgnew_notype = pgnew.substr(0, pgnew.size() - xtype.size() - 1);
+  auto pgold = store(convert_field(m_currClass, ctype, fieldname));
   // Record interfaces that are coalesced by Proguard.
   if (ctype[0] == 'L' && is_maybe_proguard_generated_member(fieldname)) {
     fprintf(stderr,
-            "Type '%s' is touched by Proguard in '%s'\n",
+            "Type '%s' is touched by Proguard in '%.*s'\n",
             ctype.c_str(),
-            pgold.c_str());
-    m_pg_coalesced_interfaces.insert(ctype);
+            static_cast<int>(pgold.size()),
+            pgold.data());
+    m_pg_coalesced_interfaces.insert(pgold.substr(pgold.size() - ctype.size()));
   }
   m_fieldMap[pgold] = pgnew;
   m_obfFieldMap[pgnew] = pgold;
@@ -472,16 +559,18 @@ bool ProguardMap::parse_field(const std::string& line) {
   return true;
 }
 
-bool ProguardMap::parse_method(const std::string& line) {
-  std::string type;
-  std::string methodname;
-  std::string classname = m_currClass;
+bool ProguardMap::parse_method(std::string_view line) {
+  std::string_view type;
+  std::string_view methodname;
+  std::string_view newname;
   std::string old_args;
   std::string new_args;
-  std::string newname;
-  auto lines = std::make_unique<ProguardLineRange>();
-  auto p = line.c_str();
+  auto p = line;
   whitespace(p);
+  if (p.empty()) return false;
+  std::string inlined_class;
+  std::string_view classname = m_currClass;
+  auto lines = std::make_unique<ProguardLineRange>();
   lines->start = line_number(p);
   literal(p, ':');
   lines->end = line_number(p);
@@ -491,12 +580,13 @@ bool ProguardMap::parse_method(const std::string& line) {
   whitespace(p);
 
   if (!id(p, methodname)) return false;
-  inlined_method(classname, methodname);
+  inlined_method(inlined_class, classname, methodname);
 
   if (!literal(p, '(')) return false;
   while (true) {
-    std::string arg;
+    std::string_view arg;
     if (literal(p, ')')) break;
+    if (p.empty()) return false;
     id(p, arg);
     auto old_arg = convert_type(arg);
     auto new_arg = translate_type(old_arg, *this);
@@ -515,15 +605,16 @@ bool ProguardMap::parse_method(const std::string& line) {
 
   auto old_rtype = convert_type(type);
   auto new_rtype = translate_type(old_rtype, *this);
-  auto pgold = convert_method(classname, old_rtype, methodname, old_args);
-  auto pgnew = convert_method(m_currNewClass, new_rtype, newname, new_args);
-  auto pgnew_no_rtype = convert_method(m_currNewClass, "", newname, new_args);
+  auto pgold =
+      store(convert_method(classname, old_rtype, methodname, old_args));
+  auto pgnew =
+      store(convert_method(m_currNewClass, new_rtype, newname, new_args));
+  auto pgnew_no_rtype = pgnew.substr(0, pgnew.size() - new_rtype.size());
   m_methodMap[pgold] = pgnew;
-  m_obfMethodMap[pgnew] = pgold;
   m_obfUntypedMethodMap[pgnew_no_rtype] = pgold;
   lines->original_name = pgold;
-  m_obfMethodLinesMap[str_copy(pg_impl::lines_key(pgnew))].push_back(
-      std::move(lines));
+  m_obfMethodLinesMap[pg_impl::lines_key(pgnew)].push_back(std::move(lines));
+  m_obfMethodMap[pgnew] = pgold;
   return true;
 }
 
@@ -9,9 +9,12 @@
 
 #include <cstddef>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "DexClass.h"
 #include "ProguardLineRange.h"
@@ -37,6 +40,11 @@
  * For classes, this is the full descriptor.
  * For methods, it's <class descriptor>.<name>(<args descs>)<return desc> .
  * For fields,  it's <class descriptor>.<name>:<type desc> .
+ *
+ * Every converted name is copied once into blocks owned by the map, and the
+ * lookup tables only hold views of those copies. Untyped names and line-table
+ * keys are prefixes of the typed names and take no storage of their own. The
+ * file itself is only mapped while it is parsed.
  */
 struct ProguardMap {
   /**
@@ -53,7 +61,7 @@ struct ProguardMap {
   /**
    * Construct map from a given stream.
    */
-  explicit ProguardMap(std::istream& is) { parse_proguard_map(is); }
+  explicit ProguardMap(std::istream& is);
 
   /**
    * Translate un-obfuscated class name to obfuscated name.
@@ -112,44 +120,56 @@ struct ProguardMap {
   }
 
  private:
-  void parse_proguard_map(std::istream& fp);
-  void parse_full_map(std::istream& fp);
+  void parse_proguard_map(std::string_view contents);
+  void parse_full_map(std::string_view contents);
+
+  bool parse_class(std::string_view line);
+  bool parse_field(std::string_view line);
+  bool parse_method(std::string_view line);
 
-  bool parse_class(const std::string& line);
-  bool parse_field(const std::string& line);
-  bool parse_method(const std::string& line);
+  bool parse_class_full_format(std::string_view line);
+  bool parse_store_full_format(std::string_view line);
+  bool parse_field_full_format(std::string_view line);
+  bool parse_method_full_format(std::string_view line);
 
-  bool parse_class_full_format(const std::string& line);
-  bool parse_store_full_format(const std::string& line);
-  bool parse_field_full_format(const std::string& line);
-  bool parse_method_full_format(const std::string& line);
+  // Copies the name into the current block and returns a view of the copy.
+  std::string_view store(std::string_view name);
+
+  using NameMap = std::unordered_map<std::string_view, std::string_view>;
 
  private:
+  // Storage for all the names below. Blocks are never reallocated, so the
+  // views stay valid for as long as the map lives.
+  std::vector<std::unique_ptr<char[]>> m_name_blocks;
+  char* m_name_cursor{nullptr};
+  size_t m_name_space{0};
+
   // Unobfuscated to obfuscated maps
-  std::unordered_map<std::string, std::string> m_classMap;
-  std::unordered_map<std::string, std::string> m_fieldMap;
-  std::unordered_map<std::string, std::string> m_methodMap;
+  NameMap m_classMap;
+  NameMap m_fieldMap;
+  NameMap m_methodMap;
 
   // Obfuscated to unobfuscated maps from proguard
-  std::unordered_map<std::string, std::string> m_obfClassMap;
-  std::unordered_map<std::string, std::string> m_obfFieldMap;
-  std::unordered_map<std::string, std::string> m_obfMethodMap;
+  NameMap m_obfClassMap;
+  NameMap m_obfFieldMap;
+  NameMap m_obfMethodMap;
 
   // Field map for reflection analysis when type is unknown
   // Stores Lcom/facebook/Class;.field -> original name without class name
-  std::unordered_map<std::string, std::string> m_obfUntypedFieldMap;
+  NameMap m_obfUntypedFieldMap;
 
   // Method map for reflection analysis when return type is unknown
   // Stores Lcom/facebook/Class;.method(II) -> original name without class name
-  std::unordered_map<std::string, std::string> m_obfUntypedMethodMap;
+  NameMap m_obfUntypedMethodMap;
 
-  std::unordered_map<std::string, ProguardLineRangeVector> m_obfMethodLinesMap;
+  std::unordered_map<std::string_view, ProguardLineRangeVector>
+      m_obfMethodLinesMap;
 
   // Interfaces that are (most likely) coalesced by Proguard.
-  std::unordered_set<std::string> m_pg_coalesced_interfaces;
+  std::unordered_set<std::string_view> m_pg_coalesced_interfaces;
 
-  std::string m_currClass;
-  std::string m_currNewClass;
+  std::string_view m_currClass;
+  std::string_view m_currNewClass;
 };
 
 /**
@@ -5,8 +5,10 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 #include "Debug.h"
@@ -16,11 +18,18 @@
 #include "ProguardParser.h"
 #include "ProguardRegex.h"
 #include "ReadMaybeMapped.h"
+#include "WorkQueue.h"
 
 namespace keep_rules {
 namespace proguard_parser {
 namespace {
 
+// Where parse problems are reported. Files that are parsed concurrently
+// buffer their reports, which are then printed in the order of the files.
+thread_local std::ostream* t_diagnostics = &std::cerr;
+
+std::ostream& diagnostics() { return *t_diagnostics; }
+
 struct TokenIndex {
   const std::vector<Token>& vec;
   std::vector<Token>::const_iterator it;
@@ -126,7 +135,7 @@ bool parse_single_filepath_command(TokenIndex& idx,
     idx.next(); // Consume the command token.
     // Fail without consumption if this is an end of file token.
     if (idx.type() == TokenType::eof_token) {
-      std::cerr
+      diagnostics()
           << "Expecting at least one file as an argument but found end of "
              "file at line "
           << line_number << std::endl
@@ -135,16 +144,16 @@ bool parse_single_filepath_command(TokenIndex& idx,
     }
     // Fail without consumption if this is a command token.
     if (idx.it->is_command()) {
-      std::cerr << "Expecting a file path argument but got command "
-                << idx.show() << " at line  " << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expecting a file path argument but got command "
+                    << idx.show() << " at line  " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       return true;
     }
     // Parse the filename.
     if (idx.type() != TokenType::filepath) {
-      std::cerr << "Expected a filepath but got " << idx.show() << " at line "
-                << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expected a filepath but got " << idx.show()
+                    << " at line " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       return true;
     }
     *filepath = idx.str();
@@ -159,9 +168,9 @@ void parse_filepaths(TokenIndex& idx, std::vector<std::string>* into) {
   std::vector<std::string> filepaths;
   if (idx.type() != TokenType::filepath) {
     if (!kOptional) {
-      std::cerr << "Expected filepath but got " << idx.show() << " at line "
-                << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expected filepath but got " << idx.show() << " at line "
+                    << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
     }
     return;
   }
@@ -180,7 +189,7 @@ bool parse_filepath_command(TokenIndex& idx,
     idx.next(); // Consume the command token.
     // Fail without consumption if this is an end of file token.
     if (idx.type() == TokenType::eof_token) {
-      std::cerr
+      diagnostics()
           << "Expecting at least one file as an argument but found end of "
              "file at line "
           << line_number << std::endl;
@@ -188,16 +197,16 @@ bool parse_filepath_command(TokenIndex& idx,
     }
     // Fail without consumption if this is a command token.
     if (idx.it->is_command()) {
-      std::cerr << "Expecting a file path argument but got command "
-                << idx.show() << " at line  " << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expecting a file path argument but got command "
+                    << idx.show() << " at line  " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       return true;
     }
     // Parse the filename.
     if (idx.type() != TokenType::filepath) {
-      std::cerr << "Expected a filepath but got " << idx.show() << " at line "
-                << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expected a filepath but got " << idx.show()
+                    << " at line " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       return true;
     }
     parse_filepaths(idx, filepaths);
@@ -227,7 +236,7 @@ bool parse_jars(TokenIndex& idx,
     idx.next(); // Consume the jar token.
     // Fail without consumption if this is an end of file token.
     if (idx.type() == TokenType::eof_token) {
-      std::cerr
+      diagnostics()
           << "Expecting at least one file as an argument but found end of "
              "file at line "
           << line_number << std::endl
@@ -288,8 +297,8 @@ bool parse_repackageclasses(TokenIndex& idx) {
   // Ignore repackageclasses.
   idx.next();
   if (idx.type() == TokenType::identifier) {
-    std::cerr << "Ignoring -repackageclasses " << idx.data() << std::endl
-              << idx.show_context(2) << std::endl;
+    diagnostics() << "Ignoring -repackageclasses " << idx.data() << std::endl
+                  << idx.show_context(2) << std::endl;
     idx.next();
   }
   return true;
@@ -300,9 +309,9 @@ bool parse_target(TokenIndex& idx, std::string* target_version) {
     idx.next(); // Consume the target command token.
     // Check to make sure the next TokenType is a version token.
     if (idx.type() != TokenType::target_version_token) {
-      std::cerr << "Expected a target version but got " << idx.show()
-                << " at line " << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expected a target version but got " << idx.show()
+                    << " at line " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       return true;
     }
     *target_version = idx.str();
@@ -358,9 +367,10 @@ bool parse_modifiers(TokenIndex& idx, KeepSpec* keep) {
   while (idx.type() == TokenType::comma) {
     idx.next();
     if (!is_modifier(idx.type())) {
-      std::cerr << "Expected keep option modifier but found : " << idx.show()
-                << " at line number " << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expected keep option modifier but found : "
+                    << idx.show() << " at line number " << idx.line()
+                    << std::endl
+                    << idx.show_context(2) << std::endl;
       return false;
     }
     switch (idx.type()) {
@@ -438,9 +448,9 @@ std::string parse_annotation_type(TokenIndex& idx) {
   }
   idx.next();
   if (idx.type() != TokenType::identifier) {
-    std::cerr << "Expecting a class identifier after @ but got " << idx.show()
-              << " at line " << idx.line() << std::endl
-              << idx.show_context(2) << std::endl;
+    diagnostics() << "Expecting a class identifier after @ but got "
+                  << idx.show() << " at line " << idx.line() << std::endl
+                  << idx.show_context(2) << std::endl;
     return "";
   }
   const auto& typ = idx.data();
@@ -476,20 +486,20 @@ bool parse_access_flags(TokenIndex& idx,
       idx.it = ++access_it;
       if (negated) {
         if (is_access_flag_set(setFlags_, access_flag)) {
-          std::cerr << "Access flag " << idx.show()
-                    << " occurs with conflicting settings at line "
-                    << idx.line() << std::endl
-                    << idx.show_context(2) << std::endl;
+          diagnostics() << "Access flag " << idx.show()
+                        << " occurs with conflicting settings at line "
+                        << idx.line() << std::endl
+                        << idx.show_context(2) << std::endl;
           return false;
         }
         set_access_flag(unsetFlags_, access_flag);
         negated = false;
       } else {
         if (is_access_flag_set(unsetFlags_, access_flag)) {
-          std::cerr << "Access flag " << idx.show()
-                    << " occurs with conflicting settings at line "
-                    << idx.line() << std::endl
-                    << idx.show_context(2) << std::endl;
+          diagnostics() << "Access flag " << idx.show()
+                        << " occurs with conflicting settings at line "
+                        << idx.line() << std::endl
+                        << idx.show_context(2) << std::endl;
           return false;
         }
         set_access_flag(setFlags_, access_flag);
@@ -527,9 +537,9 @@ bool parse_class_token(TokenIndex& idx,
   case TokenType::classToken:
     break;
   default:
-    std::cerr << "Expected interface, class or enum but got " << idx.show()
-              << " at line number " << idx.line() << std::endl
-              << idx.show_context(2) << std::endl;
+    diagnostics() << "Expected interface, class or enum but got " << idx.show()
+                  << " at line number " << idx.line() << std::endl
+                  << idx.show_context(2) << std::endl;
     return false;
   }
   idx.next();
@@ -541,8 +551,8 @@ bool parse_class_token(TokenIndex& idx,
 // is returned.
 bool consume_token(TokenIndex& idx, const TokenType& tok) {
   if (idx.type() != tok) {
-    std::cerr << "Unexpected TokenType " << idx.show() << std::endl
-              << idx.show_context(2) << std::endl;
+    diagnostics() << "Unexpected TokenType " << idx.show() << std::endl
+                  << idx.show_context(2) << std::endl;
     return false;
   }
   idx.next();
@@ -553,9 +563,9 @@ bool consume_token(TokenIndex& idx, const TokenType& tok) {
 void gobble_semicolon(TokenIndex& idx, bool* ok) {
   *ok = consume_token(idx, TokenType::semiColon);
   if (!*ok) {
-    std::cerr << "Expecting a semicolon but found " << idx.show() << " at line "
-              << idx.line() << std::endl
-              << idx.show_context(2) << std::endl;
+    diagnostics() << "Expecting a semicolon but found " << idx.show()
+                  << " at line " << idx.line() << std::endl
+                  << idx.show_context(2) << std::endl;
     return;
   }
 }
@@ -581,16 +591,16 @@ void parse_member_specification(TokenIndex& idx,
                           member_specification.requiredUnsetAccessFlags)) {
     // There was a problem parsing the access flags. Return an empty class spec
     // for now.
-    std::cerr << "Problem parsing access flags for member specification.\n";
+    diagnostics() << "Problem parsing access flags for member specification.\n";
     *ok = false;
     skip_to_semicolon(idx);
     return;
   }
   // The next TokenType better be an identifier.
   if (idx.type() != TokenType::identifier) {
-    std::cerr << "Expecting field or member specification but got "
-              << idx.show() << " at line " << idx.line() << std::endl
-              << idx.show_context(2) << std::endl;
+    diagnostics() << "Expecting field or member specification but got "
+                  << idx.show() << " at line " << idx.line() << std::endl
+                  << idx.show_context(2) << std::endl;
     *ok = false;
     skip_to_semicolon(idx);
     return;
@@ -634,9 +644,9 @@ void parse_member_specification(TokenIndex& idx,
   } else {
     // This TokenType is the type for the member specification.
     if (idx.type() != TokenType::identifier) {
-      std::cerr << "Expecting type identifier but got " << idx.show()
-                << " at line " << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expecting type identifier but got " << idx.show()
+                    << " at line " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       *ok = false;
       skip_to_semicolon(idx);
       return;
@@ -645,9 +655,9 @@ void parse_member_specification(TokenIndex& idx,
     idx.next();
     member_specification.descriptor = convert_wildcard_type(typ);
     if (idx.type() != TokenType::identifier) {
-      std::cerr << "Expecting identifier name for class member but got "
-                << idx.show() << " at line " << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expecting identifier name for class member but got "
+                    << idx.show() << " at line " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       *ok = false;
       skip_to_semicolon(idx);
       return;
@@ -666,9 +676,9 @@ void parse_member_specification(TokenIndex& idx,
         break;
       }
       if (idx.type() != TokenType::identifier) {
-        std::cerr << "Expecting type identifier but got " << idx.show()
-                  << " at line " << idx.line() << std::endl
-                  << idx.show_context(2) << std::endl;
+        diagnostics() << "Expecting type identifier but got " << idx.show()
+                      << " at line " << idx.line() << std::endl
+                      << idx.show_context(2) << std::endl;
         *ok = false;
         return;
       }
@@ -678,9 +688,9 @@ void parse_member_specification(TokenIndex& idx,
       // The next TokenType better be a comma or a closing bracket.
       if (idx.type() != TokenType::comma &&
           idx.type() != TokenType::closeBracket) {
-        std::cerr << "Expecting comma or ) but got " << idx.show()
-                  << " at line " << idx.line() << std::endl
-                  << idx.show_context(2) << std::endl;
+        diagnostics() << "Expecting comma or ) but got " << idx.show()
+                      << " at line " << idx.line() << std::endl
+                      << idx.show_context(2) << std::endl;
         *ok = false;
         return;
       }
@@ -689,9 +699,9 @@ void parse_member_specification(TokenIndex& idx,
       if (idx.type() == TokenType::comma) {
         consume_token(idx, TokenType::comma);
         if (idx.type() != TokenType::identifier) {
-          std::cerr << "Expecting type identifier after comma but got "
-                    << idx.show() << " at line " << idx.line() << std::endl
-                    << idx.show_context(2) << std::endl;
+          diagnostics() << "Expecting type identifier after comma but got "
+                        << idx.show() << " at line " << idx.line() << std::endl
+                        << idx.show_context(2) << std::endl;
           *ok = false;
           return;
         }
@@ -757,9 +767,9 @@ bool member_comparison(const MemberSpecification& m1,
 
 std::string parse_class_name(TokenIndex& idx, bool* ok) {
   if (idx.type() != TokenType::identifier) {
-    std::cerr << "Expected class name but got " << idx.show() << " at line "
-              << idx.line() << std::endl
-              << idx.show_context(2) << std::endl;
+    diagnostics() << "Expected class name but got " << idx.show() << " at line "
+                  << idx.line() << std::endl
+                  << idx.show_context(2) << std::endl;
     *ok = false;
     return "";
   }
@@ -811,7 +821,7 @@ ClassSpecification parse_class_specification(TokenIndex& idx, bool* ok) {
           idx, class_spec.setAccessFlags, class_spec.unsetAccessFlags)) {
     // There was a problem parsing the access flags. Return an empty class spec
     // for now.
-    std::cerr << "Problem parsing access flags for class specification.\n";
+    diagnostics() << "Problem parsing access flags for class specification.\n";
     *ok = false;
     return class_spec;
   }
@@ -831,9 +841,10 @@ ClassSpecification parse_class_specification(TokenIndex& idx, bool* ok) {
     idx.next();
     class_spec.extendsAnnotationType = parse_annotation_type(idx);
     if (idx.type() != TokenType::identifier) {
-      std::cerr << "Expecting a class name after extends/implements but got "
-                << idx.show() << " at line " << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics()
+          << "Expecting a class name after extends/implements but got "
+          << idx.show() << " at line " << idx.line() << std::endl
+          << idx.show_context(2) << std::endl;
       *ok = false;
       class_spec.extendsClassName = "";
     } else {
@@ -897,9 +908,9 @@ void parse(const std::vector<Token>& vec,
     }
     uint32_t line = idx.line();
     if (!idx.it->is_command()) {
-      std::cerr << "Expecting command but found " << idx.show() << " at line "
-                << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Expecting command but found " << idx.show()
+                    << " at line " << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       idx.next();
       skip_to_next_command(idx);
       ++stats.unknown_commands;
@@ -1145,15 +1156,15 @@ void parse(const std::vector<Token>& vec,
       const auto& name = idx.data();
       // It is benign to drop -dontnote
       if (name != "dontnote") {
-        std::cerr << "Unimplemented command (skipping): " << idx.show()
-                  << " at line " << idx.line() << std::endl
-                  << idx.show_context(2) << std::endl;
+        diagnostics() << "Unimplemented command (skipping): " << idx.show()
+                      << " at line " << idx.line() << std::endl
+                      << idx.show_context(2) << std::endl;
         ++stats.unimplemented;
       }
     } else {
-      std::cerr << "Unexpected TokenType " << idx.show() << " at line "
-                << idx.line() << std::endl
-                << idx.show_context(2) << std::endl;
+      diagnostics() << "Unexpected TokenType " << idx.show() << " at line "
+                    << idx.line() << std::endl
+                    << idx.show_context(2) << std::endl;
       ++stats.parse_errors;
     }
     idx.next();
@@ -1179,8 +1190,8 @@ Stats parse(const std::string_view& config,
   }
 
   if (!ok) {
-    std::cerr << "Found " << ret.unknown_tokens << " unkown tokens in "
-              << filename << "\n";
+    diagnostics() << "Found " << ret.unknown_tokens << " unkown tokens in "
+                  << filename << "\n";
     pg_config->ok = false;
     return ret;
   }
@@ -1190,13 +1201,88 @@ Stats parse(const std::string_view& config,
     pg_config->ok = ok;
   } else {
     pg_config->ok = false;
-    std::cerr << "Found " << ret.parse_errors << " parse errors in " << filename
-              << "\n";
+    diagnostics() << "Found " << ret.parse_errors << " parse errors in "
+                  << filename << "\n";
   }
 
   return ret;
 }
 
+/*
+ * A config file parsed into a configuration of its own, so that the files
+ * included by a config can be parsed concurrently.
+ */
+struct ParsedFile {
+  // The base directory that the paths in the file were resolved against.
+  std::string basedirectory;
+  std::unique_ptr<ProguardConfiguration> config;
+  Stats stats;
+  std::string diagnostics;
+  std::exception_ptr error;
+};
+
+ParsedFile parse_file_separately(const std::string& filename,
+                                 const std::string& basedirectory) {
+  ParsedFile parsed;
+  parsed.basedirectory = basedirectory;
+  parsed.config = std::make_unique<ProguardConfiguration>();
+  parsed.config->basedirectory = basedirectory;
+  std::ostringstream buffer;
+  t_diagnostics = &buffer;
+  try {
+    redex::read_file_with_contents(filename, [&](const char* data, size_t s) {
+      parsed.stats =
+          parse(std::string_view(data, s), parsed.config.get(), filename);
+    });
+  } catch (...) {
+    parsed.error = std::current_exception();
+  }
+  t_diagnostics = &std::cerr;
+  parsed.diagnostics = buffer.str();
+  return parsed;
+}
+
+template <typename T>
+void append(std::vector<T>&& from, std::vector<T>* into) {
+  into->insert(into->end(), std::make_move_iterator(from.begin()),
+               std::make_move_iterator(from.end()));
+}
+
+// Appends a file's configuration to the accumulated one, with the same result
+// as if the file had been parsed directly into it.
+void merge(ProguardConfiguration&& from, ProguardConfiguration* into) {
+  into->ok = from.ok;
+  append(std::move(from.includes), &into->includes);
+  into->basedirectory = std::move(from.basedirectory);
+  append(std::move(from.injars), &into->injars);
+  append(std::move(from.outjars), &into->outjars);
+  append(std::move(from.libraryjars), &into->libraryjars);
+  append(std::move(from.printmapping), &into->printmapping);
+  append(std::move(from.printconfiguration), &into->printconfiguration);
+  append(std::move(from.printseeds), &into->printseeds);
+  append(std::move(from.printusage), &into->printusage);
+  append(std::move(from.keepdirectories), &into->keepdirectories);
+  // The commands only ever move these flags away from their defaults.
+  into->shrink &= from.shrink;
+  into->optimize &= from.optimize;
+  into->allowaccessmodification |= from.allowaccessmodification;
+  into->dontobfuscate |= from.dontobfuscate;
+  into->dontusemixedcaseclassnames |= from.dontusemixedcaseclassnames;
+  into->dontpreverify |= from.dontpreverify;
+  into->verbose |= from.verbose;
+  if (!from.target_version.empty()) {
+    into->target_version = std::move(from.target_version);
+  }
+  into->keep_rules.append(std::move(from.keep_rules));
+  into->assumenosideeffects_rules.append(
+      std::move(from.assumenosideeffects_rules));
+  into->whyareyoukeeping_rules.append(std::move(from.whyareyoukeeping_rules));
+  append(std::move(from.optimization_filters), &into->optimization_filters);
+  append(std::move(from.keepattributes), &into->keepattributes);
+  append(std::move(from.dontwarn), &into->dontwarn);
+  append(std::move(from.keeppackagenames), &into->keeppackagenames);
+}
+
 } // namespace
 
 Stats parse(std::istream& config,
@@ -1210,19 +1296,42 @@ Stats parse(std::istream& config,
 Stats parse_file(const std::string& filename,
                  ProguardConfiguration* pg_config) {
   Stats ret{};
+  size_t next_include = pg_config->includes.size();
   redex::read_file_with_contents(filename, [&](const char* data, size_t s) {
     std::string_view view(data, s);
     ret += parse(view, pg_config, filename);
-    // Parse the included files.
-    for (const auto& included_filename : pg_config->includes) {
-      if (pg_config->already_included.find(included_filename) !=
-          pg_config->already_included.end()) {
-        continue;
+  });
+
+  // Included files are visited breadth-first, in the order of their -include
+  // commands, and each is parsed once. All the files of one level of the
+  // inclusion tree are parsed concurrently, and then merged in that order.
+  while (next_include < pg_config->includes.size()) {
+    std::vector<std::string> level;
+    for (; next_include < pg_config->includes.size(); ++next_include) {
+      const auto& included_filename = pg_config->includes[next_include];
+      if (pg_config->already_included.emplace(included_filename).second) {
+        level.push_back(included_filename);
       }
-      pg_config->already_included.emplace(included_filename);
-      ret += parse_file(included_filename, pg_config);
     }
-  });
+    std::vector<ParsedFile> parsed(level.size());
+    const auto basedirectory = pg_config->basedirectory;
+    workqueue_run_for<size_t>(0, level.size(), [&](size_t i) {
+      parsed[i] = parse_file_separately(level[i], basedirectory);
+    });
+    for (size_t i = 0; i < level.size(); ++i) {
+      if (parsed[i].basedirectory != pg_config->basedirectory) {
+        // An earlier file of this level has set -basedirectory, which the
+        // paths in this one must be resolved against.
+        parsed[i] = parse_file_separately(level[i], pg_config->basedirectory);
+      }
+      std::cerr << parsed[i].diagnostics;
+      if (parsed[i].error) {
+        std::rethrow_exception(parsed[i].error);
+      }
+      ret += parsed[i].stats;
+      merge(std::move(*parsed[i].config), pg_config);
+    }
+  }
   return ret;
 }
 
@@ -7,9 +7,10 @@
 
 #include "Reachability.h"
 
+#include <atomic>
 #include <boost/bimap/bimap.hpp>
 #include <boost/bimap/unordered_set_of.hpp>
-#include <boost/range/adaptor/map.hpp>
+#include <limits>
 
 #include "BinarySerialization.h"
 #include "DexAnnotation.h"
@@ -32,6 +33,14 @@ namespace {
 
 static ReachableObject SEED_SINGLETON{};
 
+// An arbitrary total order, by identity.
+bool identity_less(const ReachableObject& lhs, const ReachableObject& rhs) {
+  if (lhs.type != rhs.type) {
+    return lhs.type < rhs.type;
+  }
+  return std::less<const void*>()(lhs.anno, rhs.anno);
+}
+
 } // namespace
 
 namespace reachability {
@@ -178,6 +187,28 @@ void RootSetMarker::mark_external_method_overriders() {
   }
 }
 
+void TransitiveClosureMarker::visit_batch(const ReachableObjectBatch& batch) {
+  for (const auto& obj : batch) {
+    visit(obj);
+  }
+  if (!m_pending.empty()) {
+    m_worker_state->push_task(m_pending);
+    m_pending.clear();
+  }
+  if (!m_edges.empty()) {
+    m_reachable_objects->add_edges(std::move(m_edges));
+    m_edges.clear();
+  }
+}
+
+void TransitiveClosureMarker::enqueue(const ReachableObject& obj) {
+  m_pending.add(obj);
+  if (m_pending.full()) {
+    m_worker_state->push_task(m_pending);
+    m_pending.clear();
+  }
+}
+
 /*
  * Marks :obj and pushes its immediately reachable neighbors onto the local
  * task queue of the current worker.
@@ -226,11 +257,10 @@ void TransitiveClosureMarker::push(const Parent* parent, const DexClass* cls) {
     return;
   }
   record_reachability(parent, cls);
-  if (m_reachable_objects->marked(cls)) {
+  if (!m_reachable_objects->mark(cls)) {
     return;
   }
-  m_reachable_objects->mark(cls);
-  m_worker_state->push_task(ReachableObject(cls));
+  enqueue(ReachableObject(cls));
 }
 
 template <class Parent>
@@ -240,15 +270,14 @@ void TransitiveClosureMarker::push(const Parent* parent,
     return;
   }
   record_reachability(parent, field);
-  if (m_reachable_objects->marked(field)) {
+  if (!m_reachable_objects->mark(field)) {
     return;
   }
   auto f = field->as_def();
   if (f) {
     gather_and_push(f);
   }
-  m_reachable_objects->mark(field);
-  m_worker_state->push_task(ReachableObject(field));
+  enqueue(ReachableObject(field));
 }
 
 template <class Parent>
@@ -259,11 +288,10 @@ void TransitiveClosureMarker::push(const Parent* parent,
   }
 
   record_reachability(parent, method);
-  if (m_reachable_objects->marked(method)) {
+  if (!m_reachable_objects->mark(method)) {
     return;
   }
-  m_reachable_objects->mark(method);
-  m_worker_state->push_task(ReachableObject(method));
+  enqueue(ReachableObject(method));
 }
 
 void TransitiveClosureMarker::push(const DexMethodRef* parent,
@@ -281,7 +309,8 @@ void TransitiveClosureMarker::push_cond(const DexMethod* method) {
   // to do it ourselves. Note that we must do this check after adding :method
   // to m_cond_marked to avoid a race condition where we add to m_cond_marked
   // after visit(DexClass*) has finished moving its contents over to
-  // m_reachable_objects.
+  // m_reachable_objects. Pairs with the fence in visit_cls().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
   if (m_reachable_objects->marked(clazz)) {
     push(clazz, method);
   }
@@ -410,6 +439,8 @@ void TransitiveClosureMarker::visit_cls(const DexClass* cls) {
       gather_and_push(anno.get());
     }
   }
+  // Pairs with the fence in push_cond().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
   for (auto const& m : cls->get_ifields()) {
     if (m_cond_marked->fields.count(m)) {
       push(cls, m);
@@ -507,7 +538,7 @@ void TransitiveClosureMarker::record_reachability(Parent* parent,
                                                   Object* object) {
   if (m_record_reachability) {
     redex_assert(parent != nullptr && object != nullptr);
-    m_reachable_objects->record_reachability(parent, object);
+    ReachableObjects::record_reachability(parent, object, &m_edges);
   }
 }
 
@@ -540,19 +571,16 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
 
   size_t num_threads = redex_parallel::default_num_threads();
   auto stats_arr = std::make_unique<Stats[]>(num_threads);
-  workqueue_run<ReachableObject>(
-      [&](MarkWorkerState* worker_state, const ReachableObject& obj) {
-        TransitiveClosureMarker transitive_closure_marker(
+  mark_transitive_closure(
+      root_set,
+      [&](MarkWorkerState* worker_state) {
+        return TransitiveClosureMarker(
             ignore_sets, *method_override_graph, record_reachability,
             &cond_marked, reachable_objects.get(), worker_state,
             &stats_arr[worker_state->worker_id()],
             remove_no_argument_constructors);
-        transitive_closure_marker.visit(obj);
-        return nullptr;
       },
-      root_set,
-      num_threads,
-      /*push_tasks_while_running=*/true);
+      reachable_objects.get(), record_reachability, num_threads);
 
   if (num_ignore_check_strings != nullptr) {
     for (size_t i = 0; i < num_threads; ++i) {
@@ -568,60 +596,125 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects(
 }
 
 void ReachableObjects::record_reachability(const DexMethodRef* member,
-                                           const DexClass* cls) {
+                                           const DexClass* cls,
+                                           Edges* edges) {
   // Each class member trivially retains its containing class; let's filter out
   // this uninteresting information from our diagnostics.
   if (member->get_class() == cls->get_type()) {
     return;
   }
-  m_retainers_of.update(ReachableObject(cls),
-                        [&](const ReachableObject&, ReachableObjectSet& set,
-                            bool /* exists */) { set.emplace(member); });
+  edges->emplace_back(ReachableObject(cls), ReachableObject(member));
 }
 
 void ReachableObjects::record_reachability(const DexFieldRef* member,
-                                           const DexClass* cls) {
+                                           const DexClass* cls,
+                                           Edges* edges) {
   if (member->get_class() == cls->get_type()) {
     return;
   }
-  m_retainers_of.update(ReachableObject(cls),
-                        [&](const ReachableObject&, ReachableObjectSet& set,
-                            bool /* exists */) { set.emplace(member); });
+  edges->emplace_back(ReachableObject(cls), ReachableObject(member));
 }
 
 template <class Object>
-void ReachableObjects::record_reachability(Object* parent, Object* object) {
+void ReachableObjects::record_reachability(Object* parent,
+                                           Object* object,
+                                           Edges* edges) {
   if (parent == object) {
     return;
   }
-  m_retainers_of.update(ReachableObject(object),
-                        [&](const ReachableObject&, ReachableObjectSet& set,
-                            bool /* exists */) { set.emplace(parent); });
+  edges->emplace_back(ReachableObject(object), ReachableObject(parent));
 }
 
 template <class Parent, class Object>
-void ReachableObjects::record_reachability(Parent* parent, Object* object) {
-  m_retainers_of.update(ReachableObject(object),
-                        [&](const ReachableObject&, ReachableObjectSet& set,
-                            bool /* exists */) { set.emplace(parent); });
+void ReachableObjects::record_reachability(Parent* parent,
+                                           Object* object,
+                                           Edges* edges) {
+  edges->emplace_back(ReachableObject(object), ReachableObject(parent));
 }
 
 template <class Seed>
 void ReachableObjects::record_is_seed(Seed* seed) {
   redex_assert(seed != nullptr);
   const auto& keep_reasons = seed->rstate.keep_reasons();
-  m_retainers_of.update(
-      ReachableObject(seed),
-      [&](const ReachableObject&, ReachableObjectSet& set, bool /* exists */) {
-        for (const auto& reason : keep_reasons) {
-          // -keepnames rules are irrelevant when analyzing reachability
-          if (reason->type == keep_reason::KEEP_RULE &&
-              reason->keep_rule->allowshrinking) {
-            continue;
-          }
-          set.emplace(reason);
-        }
-      });
+  Edges edges;
+  for (const auto& reason : keep_reasons) {
+    // -keepnames rules are irrelevant when analyzing reachability
+    if (reason->type == keep_reason::KEEP_RULE &&
+        reason->keep_rule->allowshrinking) {
+      continue;
+    }
+    edges.emplace_back(ReachableObject(seed), ReachableObject(reason));
+  }
+  std::lock_guard<std::mutex> lock(m_edges_lock);
+  // Seeds are part of the graph even without any relevant keep reasons.
+  m_seeds.emplace_back(seed);
+  m_edges.push_back(std::move(edges));
+}
+
+void ReachableObjects::add_edges(Edges edges) {
+  std::lock_guard<std::mutex> lock(m_edges_lock);
+  m_edges.push_back(std::move(edges));
+}
+
+void ReachableObjects::build_retainers_graph() {
+  size_t num_edges = 0;
+  for (const auto& edges : m_edges) {
+    num_edges += edges.size();
+  }
+  Edges all_edges;
+  all_edges.reserve(num_edges);
+  for (auto& edges : m_edges) {
+    all_edges.insert(all_edges.end(), edges.begin(), edges.end());
+    Edges().swap(edges);
+  }
+  m_edges.clear();
+  m_retainers_of =
+      ReachableObjectGraph(std::move(all_edges), std::move(m_seeds));
+  m_seeds.clear();
+}
+
+ReachableObjectGraph::ReachableObjectGraph(
+    std::vector<Edge> edges, std::vector<ReachableObject> objects) {
+  std::sort(edges.begin(), edges.end(), [](const Edge& lhs, const Edge& rhs) {
+    if (!(lhs.first == rhs.first)) {
+      return identity_less(lhs.first, rhs.first);
+    }
+    return identity_less(lhs.second, rhs.second);
+  });
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  for (const auto& edge : edges) {
+    objects.push_back(edge.first);
+  }
+  std::sort(objects.begin(), objects.end(), identity_less);
+  objects.erase(std::unique(objects.begin(), objects.end()), objects.end());
+
+  always_assert(edges.size() <= std::numeric_limits<uint32_t>::max());
+  m_offsets.reserve(objects.size() + 1);
+  m_retainers.reserve(edges.size());
+  auto edge_it = edges.begin();
+  for (const auto& obj : objects) {
+    m_offsets.push_back(m_retainers.size());
+    for (; edge_it != edges.end() && edge_it->first == obj; ++edge_it) {
+      m_retainers.push_back(edge_it->second);
+    }
+  }
+  m_offsets.push_back(m_retainers.size());
+  m_objects = std::move(objects);
+}
+
+size_t ReachableObjectGraph::count(const ReachableObject& obj) const {
+  return std::binary_search(m_objects.begin(), m_objects.end(), obj,
+                            identity_less);
+}
+
+ReachableObjectGraph::Retainers ReachableObjectGraph::at(
+    const ReachableObject& obj) const {
+  auto it =
+      std::lower_bound(m_objects.begin(), m_objects.end(), obj, identity_less);
+  always_assert(it != m_objects.end() && *it == obj);
+  size_t idx = it - m_objects.begin();
+  return Retainers(m_retainers.data() + m_offsets[idx],
+                   m_retainers.data() + m_offsets[idx + 1]);
 }
 
 /*
@@ -768,8 +861,7 @@ void dump_graph(std::ostream& os, const ReachableObjectGraph& retainers_of) {
       });
 
   // Gotta sort the keys or the output is nondeterministic.
-  auto key_adaptor = boost::adaptors::keys(retainers_of);
-  std::vector<ReachableObject> keys(key_adaptor.begin(), key_adaptor.end());
+  std::vector<ReachableObject> keys(retainers_of.objects());
   std::sort(keys.begin(), keys.end(), compare);
   gw.write(os, keys);
 }
@@ -7,16 +7,21 @@
 
 #pragma once
 
+#include <array>
+#include <boost/range/iterator_range.hpp>
+#include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 
 #include "ConcurrentContainers.h"
 #include "DexClass.h"
+#include "IdMap.h"
 #include "KeepReason.h"
 #include "MethodOverrideGraph.h"
 #include "Pass.h"
 #include "SpartaWorkQueue.h"
 #include "Thread.h"
+#include "WorkQueue.h"
 
 class DexAnnotation;
 
@@ -74,6 +79,33 @@ struct ReachableObjectHash {
   }
 };
 
+/*
+ * A batch of objects to visit. The marker pushes the objects it discovers in
+ * batches, as pushing a task onto the work queue is comparatively expensive.
+ */
+class ReachableObjectBatch {
+ public:
+  static constexpr size_t CAPACITY = 32;
+
+  ReachableObjectBatch() = default;
+
+  void add(const ReachableObject& obj) { m_objects[m_size++] = obj; }
+
+  bool empty() const { return m_size == 0; }
+
+  bool full() const { return m_size == CAPACITY; }
+
+  void clear() { m_size = 0; }
+
+  const ReachableObject* begin() const { return m_objects.data(); }
+
+  const ReachableObject* end() const { return m_objects.data() + m_size; }
+
+ private:
+  std::array<ReachableObject, CAPACITY> m_objects;
+  size_t m_size{0};
+};
+
 struct IgnoreSets {
   IgnoreSets() = default;
   std::unordered_set<const DexType*> string_literals;
@@ -82,46 +114,89 @@ struct IgnoreSets {
   bool keep_class_in_string{true};
 };
 
-// The ReachableObjectSet does not need to be a ConcurrentSet since it is nested
-// within the ReachableObjectGraph's ConcurrentMap, which ensures that all
-// updates to it are thread-safe. Using a plain unordered_set here is a
-// significant performance improvement.
-using ReachableObjectSet =
-    std::unordered_set<ReachableObject, ReachableObjectHash>;
-using ReachableObjectGraph =
-    ConcurrentMap<ReachableObject, ReachableObjectSet, ReachableObjectHash>;
+/*
+ * The retainers of the reachable objects, in compressed form: the objects are
+ * kept in a sorted array, and the retainers of all objects are stored
+ * contiguously, in the same order, so that every object refers to a range of
+ * them. The graph is built at once, from all its edges.
+ */
+class ReachableObjectGraph {
+ public:
+  // An object, and an object that retains it.
+  using Edge = std::pair<ReachableObject, ReachableObject>;
+  using Retainers = boost::iterator_range<const ReachableObject*>;
+
+  ReachableObjectGraph() = default;
+
+  /*
+   * Duplicate edges are ignored. The graph also contains the given objects,
+   * which may not have any retainers.
+   */
+  explicit ReachableObjectGraph(std::vector<Edge> edges,
+                                std::vector<ReachableObject> objects = {});
+
+  size_t size() const { return m_objects.size(); }
+
+  size_t count(const ReachableObject& obj) const;
+
+  /*
+   * The retainers of an object of the graph.
+   */
+  Retainers at(const ReachableObject& obj) const;
+
+  /*
+   * All objects of the graph, in no particular order.
+   */
+  const std::vector<ReachableObject>& objects() const { return m_objects; }
+
+ private:
+  std::vector<ReachableObject> m_objects;
+  // The retainers of m_objects[i] are m_retainers[m_offsets[i]] up to
+  // m_retainers[m_offsets[i + 1]].
+  std::vector<uint32_t> m_offsets;
+  std::vector<ReachableObject> m_retainers;
+};
 
 class ReachableObjects {
  public:
+  /*
+   * Only available after build_retainers_graph().
+   */
   const ReachableObjectGraph& retainers_of() const { return m_retainers_of; }
 
-  void mark(const DexClass* cls) { m_marked_classes.insert(cls); }
+  /*
+   * Returns whether the element was not marked yet. Marking is atomic: when
+   * several threads mark the same element, exactly one of them gets true.
+   */
+  bool mark(const DexClass* cls) {
+    return m_marked_classes.insert(cls->get_type());
+  }
 
-  void mark(const DexMethodRef* method) { m_marked_methods.insert(method); }
+  bool mark(const DexMethodRef* method) {
+    return m_marked_methods.insert(method);
+  }
 
-  void mark(const DexFieldRef* field) { m_marked_fields.insert(field); }
+  bool mark(const DexFieldRef* field) { return m_marked_fields.insert(field); }
 
-  bool marked(const DexClass* cls) const { return m_marked_classes.count(cls); }
+  bool marked(const DexClass* cls) const {
+    return m_marked_classes.contains(cls->get_type());
+  }
 
   bool marked(const DexMethodRef* method) const {
-    return m_marked_methods.count(method);
+    return m_marked_methods.contains(method);
   }
 
   bool marked(const DexFieldRef* field) const {
-    return m_marked_fields.count(field);
+    return m_marked_fields.contains(field);
   }
 
-  bool marked_unsafe(const DexClass* cls) const {
-    return m_marked_classes.count_unsafe(cls);
-  }
+  bool marked_unsafe(const DexClass* cls) const { return marked(cls); }
 
   bool marked_unsafe(const DexMethodRef* method) const {
-    return m_marked_methods.count_unsafe(method);
+    return marked(method);
   }
 
-  bool marked_unsafe(const DexFieldRef* field) const {
-    return m_marked_fields.count_unsafe(field);
-  }
+  bool marked_unsafe(const DexFieldRef* field) const { return marked(field); }
 
   size_t num_marked_classes() const { return m_marked_classes.size(); }
 
@@ -129,37 +204,45 @@ class ReachableObjects {
 
   size_t num_marked_methods() const { return m_marked_methods.size(); }
 
+  /*
+   * Builds the graph of the recorded reachability edges. Call this once
+   * marking is done.
+   */
+  void build_retainers_graph();
+
  private:
+  using Edges = std::vector<ReachableObjectGraph::Edge>;
+
   template <class Seed>
   void record_is_seed(Seed* seed);
 
   template <class Parent, class Object>
-  void record_reachability(Parent*, Object*);
+  static void record_reachability(Parent*, Object*, Edges* edges);
 
   template <class Object>
-  void record_reachability(Object* parent, Object* object);
-
-  void record_reachability(const DexFieldRef* member, const DexClass* cls);
-
-  void record_reachability(const DexMethodRef* member, const DexClass* cls);
-
-  static constexpr size_t MARK_SLOTS = 127;
-
-  ConcurrentSet<const DexClass*,
-                std::hash<const DexClass*>,
-                std::equal_to<const DexClass*>,
-                MARK_SLOTS>
-      m_marked_classes;
-  ConcurrentSet<const DexFieldRef*,
-                std::hash<const DexFieldRef*>,
-                std::equal_to<const DexFieldRef*>,
-                MARK_SLOTS>
-      m_marked_fields;
-  ConcurrentSet<const DexMethodRef*,
-                std::hash<const DexMethodRef*>,
-                std::equal_to<const DexMethodRef*>,
-                MARK_SLOTS>
-      m_marked_methods;
+  static void record_reachability(Object* parent,
+                                  Object* object,
+                                  Edges* edges);
+
+  static void record_reachability(const DexFieldRef* member,
+                                  const DexClass* cls,
+                                  Edges* edges);
+
+  static void record_reachability(const DexMethodRef* member,
+                                  const DexClass* cls,
+                                  Edges* edges);
+
+  void add_edges(Edges edges);
+
+  // Classes are identified by their types.
+  IdSet<DexType> m_marked_classes;
+  IdSet<DexFieldRef> m_marked_fields;
+  IdSet<DexMethodRef> m_marked_methods;
+
+  // The recorded edges, until the graph is built.
+  std::mutex m_edges_lock;
+  std::vector<Edges> m_edges;
+  std::vector<ReachableObject> m_seeds;
   ReachableObjectGraph m_retainers_of;
 
   friend class RootSetMarker;
@@ -167,8 +250,8 @@ class ReachableObjects {
 };
 
 struct ConditionallyMarked {
-  ConcurrentSet<const DexField*> fields;
-  ConcurrentSet<const DexMethod*> methods;
+  IdSet<DexFieldRef> fields;
+  IdSet<DexMethodRef> methods;
 };
 
 struct References {
@@ -187,7 +270,7 @@ struct alignas(CACHE_LINE_SIZE) Stats {
   int num_ignore_check_strings;
 };
 
-using MarkWorkerState = sparta::SpartaWorkerState<ReachableObject>;
+using MarkWorkerState = sparta::SpartaWorkerState<ReachableObjectBatch>;
 
 /*
  * These helper classes compute reachable objects by a DFS+marking algorithm.
@@ -288,6 +371,12 @@ class TransitiveClosureMarker {
    */
   virtual void visit(const ReachableObject& obj);
 
+  /*
+   * Visits all objects of the batch, then pushes the neighbors that are still
+   * pending and hands over the recorded reachability edges.
+   */
+  void visit_batch(const ReachableObjectBatch& batch);
+
   virtual void visit_cls(const DexClass* cls);
 
   virtual void visit_method_ref(const DexMethodRef* method);
@@ -336,6 +425,8 @@ class TransitiveClosureMarker {
   template <class Parent, class Object>
   void record_reachability(Parent* parent, Object* object);
 
+  void enqueue(const ReachableObject& obj);
+
   /*
    * Resolve the method reference more conservatively without the context of the
    * call, such as call instruction, target type and the caller method.
@@ -351,10 +442,51 @@ class TransitiveClosureMarker {
   MarkWorkerState* m_worker_state;
   Stats* m_stats;
   bool m_remove_no_argument_constructors;
+  // The neighbors that have not been pushed yet.
+  ReachableObjectBatch m_pending;
+  ReachableObjects::Edges m_edges;
 
   static DexMethodRef* s_class_forname;
 };
 
+/*
+ * Marks everything that is reachable from the root set, in parallel.
+ *   MakeMarkerFn should accept a `MarkWorkerState*` and return a
+ *   TransitiveClosureMarker for the current task.
+ */
+template <typename MakeMarkerFn>
+void mark_transitive_closure(
+    const ConcurrentSet<ReachableObject, ReachableObjectHash>& root_set,
+    const MakeMarkerFn& make_marker,
+    ReachableObjects* reachable_objects,
+    bool record_reachability,
+    size_t num_threads) {
+  // Spread the roots over at least a few tasks per thread.
+  size_t batch_size =
+      std::max<size_t>(1, std::min(ReachableObjectBatch::CAPACITY,
+                                   root_set.size() / (num_threads * 4)));
+  std::vector<ReachableObjectBatch> roots;
+  for (const auto& obj : root_set) {
+    if (roots.empty() ||
+        std::distance(roots.back().begin(), roots.back().end()) ==
+            static_cast<std::ptrdiff_t>(batch_size)) {
+      roots.emplace_back();
+    }
+    roots.back().add(obj);
+  }
+  workqueue_run<ReachableObjectBatch>(
+      [&](MarkWorkerState* worker_state, const ReachableObjectBatch& batch) {
+        auto marker = make_marker(worker_state);
+        marker.visit_batch(batch);
+      },
+      roots,
+      num_threads,
+      /*push_tasks_while_running=*/true);
+  if (record_reachability) {
+    reachable_objects->build_retainers_graph();
+  }
+}
+
 /*
  * Compute all reachable objects from the existing configurations
  * (e.g. proguard rules).
@@ -671,10 +671,8 @@ void init_reachable_classes(const Scope& scope,
       Timer t{"Computing native reachability"};
       // Classnames present in native libraries (lib/*/*.so)
       auto resources = create_resource_reader(config.apk_dir);
-      for (const std::string& classname : resources->get_native_classes()) {
-        auto type = DexType::get_type(classname.c_str());
-        if (type == nullptr) continue;
-        TRACE(PGR, 3, "native_lib: %s", classname.c_str());
+      for (auto* type : resources->get_native_classes()) {
+        TRACE(PGR, 3, "native_lib: %s", SHOW(type));
         mark_reachable_by_classname(type);
         mark_reachable_by_native(type);
       }
@@ -24,6 +24,7 @@
 #include "Show.h"
 #include "Timer.h"
 #include "Trace.h"
+#include "WalkerCosts.h"
 #include "WorkQueue.h"
 
 static_assert(std::is_same<DexTypeList::ContainerType,
@@ -40,6 +41,8 @@ RedexContext::RedexContext(bool allow_class_duplicates)
       m_allow_class_duplicates(allow_class_duplicates) {}
 
 RedexContext::~RedexContext() {
+  walker_costs::reset();
+
   // We parallelize destruction for efficiency.
   auto parallel_run = [](const std::vector<std::function<void()>>& fns,
                          const char* timer_name) {
@@ -82,9 +85,10 @@ RedexContext::~RedexContext() {
                 },
                 [&] {
                   Timer timer("Delete DexClasses", /* indent */ false);
-                  for (auto const& p : m_type_to_class) {
+                  for (auto const& p : m_type_classes) {
                     delete p.second;
                   }
+                  m_type_classes.clear();
                   m_type_to_class.clear();
                 },
                 [&] {
@@ -130,15 +134,16 @@ RedexContext::~RedexContext() {
           fns.push_back([bucket, this]() {
             // Delete DexMethods. Use set to prevent double freeing aliases
             std::unordered_set<DexMethod*> delete_methods;
-            for (auto const& it : s_method_map) {
-              auto method = static_cast<DexMethod*>(it.second);
+            s_method_map.for_each([&](const DexMethodSpec&,
+                                      DexMethodRef* ref) {
+              auto method = static_cast<DexMethod*>(ref);
               if ((reinterpret_cast<size_t>(method) >> 16) %
                           method_buckets_count ==
                       bucket &&
                   delete_methods.emplace(method).second) {
                 delete method;
               }
-            }
+            });
           });
         }
         return fns;
@@ -154,15 +159,15 @@ RedexContext::~RedexContext() {
           fns.push_back([bucket, this]() {
             // Delete DexFields. Use set to prevent double freeing aliases
             std::unordered_set<DexField*> delete_fields;
-            for (auto const& it : s_field_map) {
-              auto field = static_cast<DexField*>(it.second);
+            s_field_map.for_each([&](const DexFieldSpec&, DexFieldRef* ref) {
+              auto field = static_cast<DexField*>(ref);
               if ((reinterpret_cast<size_t>(field) >> 16) %
                           field_buckets_count ==
                       bucket &&
                   delete_fields.emplace(field).second) {
                 delete field;
               }
-            }
+            });
           });
         }
         return fns;
@@ -426,7 +431,13 @@ DexType* RedexContext::make_type(const DexString* dstring) {
     return rv;
   }
   std::unique_ptr<DexType> type(new DexType(dstring));
-  return try_insert(dstring, std::move(type), &s_type_map);
+  type->m_id = s_next_type_id.fetch_add(1, std::memory_order_relaxed);
+  auto* inserted = type.get();
+  rv = try_insert(dstring, std::move(type), &s_type_map);
+  if (rv == inserted) {
+    s_types_by_id.at(rv->m_id) = rv;
+  }
+  return rv;
 }
 
 DexType* RedexContext::get_type(const DexString* dstring) {
@@ -465,7 +476,19 @@ DexFieldRef* RedexContext::make_field(const DexType* container,
   }
   std::unique_ptr<DexField> field(new DexField(
       const_cast<DexType*>(container), name, const_cast<DexType*>(type)));
-  return try_insert<DexField, DexFieldRef>(r, std::move(field), &s_field_map);
+  field->m_id = s_next_field_id.fetch_add(1, std::memory_order_relaxed);
+  DexFieldRef* inserted = field.get();
+  rv = try_insert<DexField, DexFieldRef>(r, std::move(field), &s_field_map);
+  if (rv == inserted) {
+    s_fields_by_id.at(rv->m_id) = rv;
+  }
+  return rv;
+}
+
+void RedexContext::erase_field_id(const DexFieldRef* field) {
+  if (auto* slot = s_fields_by_id.find(field->m_id)) {
+    *slot = nullptr;
+  }
 }
 
 DexFieldRef* RedexContext::get_field(const DexType* container,
@@ -504,27 +527,24 @@ void RedexContext::erase_field(const DexType* container,
 void RedexContext::mutate_field(DexFieldRef* field,
                                 const DexFieldSpec& ref,
                                 bool rename_on_collision) {
-  std::lock_guard<std::mutex> lock(s_field_lock);
   DexFieldSpec& r = field->m_spec;
   s_field_map.erase(r);
   r.cls = ref.cls != nullptr ? ref.cls : field->m_spec.cls;
   r.name = ref.name != nullptr ? ref.name : field->m_spec.name;
   r.type = ref.type != nullptr ? ref.type : field->m_spec.type;
-  field->m_spec = r;
 
-  if (rename_on_collision && s_field_map.find(r) != s_field_map.end()) {
-    uint32_t i = 0;
-    while (true) {
+  // Another thread may take the name between the check and the insertion,
+  // in which case we look for the next free one.
+  uint32_t i = 0;
+  while (!s_field_map.emplace(r, field)) {
+    always_assert_log(
+        rename_on_collision,
+        "Another field with the same signature already exists %s",
+        SHOW(s_field_map.get(r, nullptr)));
+    do {
       r.name = DexString::make_string(("f$" + std::to_string(i++)).c_str());
-      if (s_field_map.find(r) == s_field_map.end()) {
-        break;
-      }
-    }
+    } while (s_field_map.count(r));
   }
-  always_assert_log(s_field_map.find(r) == s_field_map.end(),
-                    "Another field with the same signature already exists %s",
-                    SHOW(s_field_map.at(r)));
-  s_field_map.emplace(r, field);
 }
 
 DexTypeList* RedexContext::make_type_list(
@@ -594,8 +614,19 @@ DexMethodRef* RedexContext::make_method(const DexType* type_,
   }
   std::unique_ptr<DexMethod, DexMethod::Deleter> method(
       new DexMethod(type, name, proto));
-  return try_insert<DexMethod, DexMethodRef>(r, std::move(method),
-                                             &s_method_map);
+  method->m_id = s_next_method_id.fetch_add(1, std::memory_order_relaxed);
+  DexMethodRef* inserted = method.get();
+  rv = try_insert<DexMethod, DexMethodRef>(r, std::move(method), &s_method_map);
+  if (rv == inserted) {
+    s_methods_by_id.at(rv->m_id) = rv;
+  }
+  return rv;
+}
+
+void RedexContext::erase_method_id(const DexMethodRef* method) {
+  if (auto* slot = s_methods_by_id.find(method->m_id)) {
+    *slot = nullptr;
+  }
 }
 
 DexMethodRef* RedexContext::get_method(const DexType* type,
@@ -641,88 +672,165 @@ void RedexContext::erase_method(const DexType* type,
   s_method_map.erase(r);
 }
 
-// TODO: Need a better interface.
-void RedexContext::mutate_method(DexMethodRef* method,
-                                 const DexMethodSpec& new_spec,
-                                 bool rename_on_collision) {
-  std::lock_guard<std::mutex> lock(s_method_lock);
-  DexMethodSpec old_spec = method->m_spec;
-  s_method_map.erase(method->m_spec);
-
-  DexMethodSpec& r = method->m_spec;
-  r.cls = new_spec.cls != nullptr ? new_spec.cls : method->m_spec.cls;
-  r.name = new_spec.name != nullptr ? new_spec.name : method->m_spec.name;
-  r.proto = new_spec.proto != nullptr ? new_spec.proto : method->m_spec.proto;
+namespace {
 
-  if (s_method_map.count(r) && rename_on_collision) {
-    // Never rename constructors, which causes runtime verification error:
-    // "Method 42(Foo;.$init$$0) is marked constructor, but doesn't match name"
-    always_assert_log(
-        show(r.name) != "<init>" && show(r.name) != "<clinit>",
-        "you should not rename constructor on a collision, %s.%s:%s exists",
-        SHOW(r.cls), SHOW(r.name), SHOW(r.proto));
-    if (new_spec.cls == nullptr || new_spec.cls == old_spec.cls) {
-      // Either method prototype or name is going to be changed, and we hit a
-      // collision. Make an unique name: "name$[0-9]+". But in case of <clinit>,
-      // libdex rejects a name like "<clinit>$1". See:
-      // http://androidxref.com/9.0.0_r3/xref/dalvik/libdex/DexUtf.cpp#115
-      // Valid characters can be found here: [_a-zA-Z0-9$\-]
-      // http://androidxref.com/9.0.0_r3/xref/dalvik/libdex/DexUtf.cpp#50
-      // If a method name begins with "<", it must end with ">". We generate a
-      // name like "$clinit$$42" by replacing <, > with $.
-      uint32_t i = 0;
-      std::string prefix;
-      if (r.name->str().front() == '<') {
-        redex_assert(r.name->str().back() == '>');
-        prefix =
-            "$" + r.name->str().substr(1, r.name->str().length() - 2) + "$$";
-      } else {
-        prefix = r.name->str() + "$";
-      }
-      do {
-        r.name = DexString::make_string((prefix + std::to_string(i++)).c_str());
-      } while (s_method_map.count(r));
+// Picks a new name for the method that is being changed from old_spec to r
+// as requested by new_spec, such that is_taken(r) is false if possible.
+template <typename IsTaken>
+void rename_on_method_collision(const DexMethodSpec& old_spec,
+                                const DexMethodSpec& new_spec,
+                                DexMethodSpec& r,
+                                const IsTaken& is_taken) {
+  // Never rename constructors, which causes runtime verification error:
+  // "Method 42(Foo;.$init$$0) is marked constructor, but doesn't match name"
+  always_assert_log(
+      show(r.name) != "<init>" && show(r.name) != "<clinit>",
+      "you should not rename constructor on a collision, %s.%s:%s exists",
+      SHOW(r.cls), SHOW(r.name), SHOW(r.proto));
+  if (new_spec.cls == nullptr || new_spec.cls == old_spec.cls) {
+    // Either method prototype or name is going to be changed, and we hit a
+    // collision. Make an unique name: "name$[0-9]+". But in case of <clinit>,
+    // libdex rejects a name like "<clinit>$1". See:
+    // http://androidxref.com/9.0.0_r3/xref/dalvik/libdex/DexUtf.cpp#115
+    // Valid characters can be found here: [_a-zA-Z0-9$\-]
+    // http://androidxref.com/9.0.0_r3/xref/dalvik/libdex/DexUtf.cpp#50
+    // If a method name begins with "<", it must end with ">". We generate a
+    // name like "$clinit$$42" by replacing <, > with $.
+    uint32_t i = 0;
+    std::string prefix;
+    if (r.name->str().front() == '<') {
+      redex_assert(r.name->str().back() == '>');
+      prefix =
+          "$" + r.name->str().substr(1, r.name->str().length() - 2) + "$$";
     } else {
-      // We are about to change its class. Use a better name to remember its
-      // original source class on a collision. Tokenize the class name into
-      // parts, and use them until no more collison.
-      //
-      // "com/facebook/foo/Bar;" => {"com", "facebook", "foo", "Bar"}
-      std::string cls_name = show_deobfuscated(old_spec.cls);
-      std::regex separator{"[/;]"};
-      std::vector<std::string> parts;
-      std::copy(std::sregex_token_iterator(cls_name.begin(), cls_name.end(),
-                                           separator, -1),
-                std::sregex_token_iterator(),
-                std::back_inserter(parts));
-
-      // Make a name like "name$Bar$foo", or "$clinit$$Bar$foo".
-      std::stringstream ss;
-      if (old_spec.name->str().front() == '<') {
-        ss << "$"
-           << old_spec.name->str().substr(1, old_spec.name->str().length() - 2)
-           << "$";
-      } else {
-        ss << *old_spec.name;
+      prefix = r.name->str() + "$";
+    }
+    do {
+      r.name = DexString::make_string((prefix + std::to_string(i++)).c_str());
+    } while (is_taken(r));
+  } else {
+    // We are about to change its class. Use a better name to remember its
+    // original source class on a collision. Tokenize the class name into
+    // parts, and use them until no more collison.
+    //
+    // "com/facebook/foo/Bar;" => {"com", "facebook", "foo", "Bar"}
+    std::string cls_name = show_deobfuscated(old_spec.cls);
+    std::regex separator{"[/;]"};
+    std::vector<std::string> parts;
+    std::copy(std::sregex_token_iterator(cls_name.begin(), cls_name.end(),
+                                         separator, -1),
+              std::sregex_token_iterator(),
+              std::back_inserter(parts));
+
+    // Make a name like "name$Bar$foo", or "$clinit$$Bar$foo".
+    std::stringstream ss;
+    if (old_spec.name->str().front() == '<') {
+      ss << "$"
+         << old_spec.name->str().substr(1, old_spec.name->str().length() - 2)
+         << "$";
+    } else {
+      ss << *old_spec.name;
+    }
+    for (auto part = parts.rbegin(); part != parts.rend(); ++part) {
+      ss << "$" << *part;
+      r.name = DexString::make_string(ss.str());
+      if (!is_taken(r)) {
+        break;
       }
-      for (auto part = parts.rbegin(); part != parts.rend(); ++part) {
-        ss << "$" << *part;
-        r.name = DexString::make_string(ss.str());
-        if (!s_method_map.count(r)) {
-          break;
-        }
+    }
+  }
+}
+
+} // namespace
+
+void RedexContext::mutate_method(DexMethodRef* method,
+                                 const DexMethodSpec& new_spec,
+                                 bool rename_on_collision) {
+  mutate_methods({{method, new_spec}}, rename_on_collision);
+}
+
+void RedexContext::mutate_methods(
+    const std::vector<std::pair<DexMethodRef*, DexMethodSpec>>& all_changes,
+    bool rename_on_collision) {
+  // A method that is changed more than once gets the combination of its
+  // changes, with the later ones taking precedence.
+  std::vector<std::pair<DexMethodRef*, DexMethodSpec>> merged_changes;
+  std::unordered_map<DexMethodRef*, size_t> change_index;
+  if (all_changes.size() > 1) {
+    for (const auto& [method, spec] : all_changes) {
+      auto [it, inserted] =
+          change_index.emplace(method, merged_changes.size());
+      if (inserted) {
+        merged_changes.emplace_back(method, spec);
+        continue;
       }
+      auto& merged = merged_changes[it->second].second;
+      merged.cls = spec.cls != nullptr ? spec.cls : merged.cls;
+      merged.name = spec.name != nullptr ? spec.name : merged.name;
+      merged.proto = spec.proto != nullptr ? spec.proto : merged.proto;
     }
   }
+  const auto& changes =
+      merged_changes.size() < all_changes.size() ? merged_changes : all_changes;
+
+  std::vector<DexMethodSpec> old_specs;
+  old_specs.reserve(changes.size());
+  for (const auto& [method, _] : changes) {
+    old_specs.push_back(method->m_spec);
+    s_method_map.erase(method->m_spec);
+  }
 
-  // We might still miss name collision cases. As of now, let's just assert.
-  if (s_method_map.count(r)) {
-    always_assert_log(!s_method_map.count(r),
+  // The signatures given to the earlier changes of the batch, which are not
+  // in the table yet.
+  std::unordered_set<DexMethodSpec> claimed;
+  auto is_taken = [&](const DexMethodSpec& r) {
+    return s_method_map.count(r) || claimed.count(r);
+  };
+  auto resolve = [&](size_t i) {
+    const auto& old_spec = old_specs[i];
+    const auto& new_spec = changes[i].second;
+    DexMethodSpec r;
+    r.cls = new_spec.cls != nullptr ? new_spec.cls : old_spec.cls;
+    r.name = new_spec.name != nullptr ? new_spec.name : old_spec.name;
+    r.proto = new_spec.proto != nullptr ? new_spec.proto : old_spec.proto;
+    if (rename_on_collision && is_taken(r)) {
+      rename_on_method_collision(old_spec, new_spec, r, is_taken);
+    }
+    // We might still miss name collision cases. As of now, let's just assert.
+    always_assert_log(!is_taken(r),
                       "Another method of the same signature already exists %s"
                       " %s %s",
                       SHOW(r.cls), SHOW(r.name), SHOW(r.proto));
+    return r;
+  };
+
+  std::vector<DexMethodSpec> new_specs;
+  new_specs.reserve(changes.size());
+  for (size_t i = 0; i < changes.size(); i++) {
+    new_specs.push_back(resolve(i));
+    if (changes.size() > 1) {
+      claimed.insert(new_specs.back());
+    }
+  }
+
+  // The claimed signatures stay reserved until the whole batch is committed,
+  // so that re-resolving a change does not pick one of a later change.
+  for (size_t i = 0; i < changes.size(); i++) {
+    auto* method = changes[i].first;
+    method->m_spec = new_specs[i];
+    // Another thread may have taken the signature since we resolved it.
+    while (!s_method_map.emplace(method->m_spec, method)) {
+      method->m_spec = resolve(i);
+      if (changes.size() > 1) {
+        claimed.insert(method->m_spec);
+      }
+    }
   }
-  s_method_map.emplace(r, method);
+}
+
+void RedexContext::reclaim_member_tables() {
+  s_field_map.reclaim();
+  s_method_map.reclaim();
 }
 
 DexLocation* RedexContext::make_location(std::string_view store_name,
@@ -761,11 +869,11 @@ RedexContext::get_position_pattern_switch_manager() {
 bool RedexContext::class_already_loaded(DexClass* cls) {
   std::lock_guard<std::mutex> l(m_type_system_mutex);
   const DexType* type = cls->get_type();
-  const auto& it = m_type_to_class.find(type);
-  if (it == m_type_to_class.end()) {
+  const DexClass* prev = m_type_to_class.get(type);
+  if (prev == nullptr) {
     return false;
   } else {
-    const auto& prev_loc = it->second->get_location()->get_file_name();
+    const auto& prev_loc = prev->get_location()->get_file_name();
     const auto& cur_loc = cls->get_location()->get_file_name();
     if (prev_loc == cur_loc || dup_classes::is_known_dup(cls)) {
       // benign duplicates
@@ -794,20 +902,25 @@ bool RedexContext::class_already_loaded(DexClass* cls) {
 void RedexContext::publish_class(DexClass* cls) {
   std::lock_guard<std::mutex> l(m_type_system_mutex);
   const DexType* type = cls->get_type();
-  const auto& pair = m_type_to_class.emplace(type, cls);
-  bool insertion_took_place = pair.second;
-  always_assert_log(insertion_took_place,
+  auto& slot = m_type_to_class[type];
+  always_assert_log(slot == nullptr,
                     "No insertion for class: %s with deobfuscated name: %s",
                     cls->get_name()->c_str(),
                     cls->get_deobfuscated_name().c_str());
+  slot = cls;
+  m_type_classes.emplace_back(type, cls);
   if (cls->is_external()) {
     m_external_classes.emplace_back(cls);
   }
 }
 
 DexClass* RedexContext::type_class(const DexType* t) {
-  auto it = m_type_to_class.find(t);
-  return it != m_type_to_class.end() ? it->second : nullptr;
+  // Callers walk up hierarchies and pass the missing super class of
+  // java.lang.Object.
+  if (t == nullptr) {
+    return nullptr;
+  }
+  return m_type_to_class.get(t);
 }
 
 void RedexContext::set_field_value(DexField* field,
@@ -23,9 +23,11 @@
 #include <vector>
 
 #include "ConcurrentContainers.h"
+#include "ConcurrentInternMap.h"
 #include "Debug.h"
 #include "DexMemberRefs.h"
 #include "FrequentlyUsedPointersCache.h"
+#include "IdMap.h"
 
 class DexCallSite;
 class DexClass;
@@ -132,6 +134,23 @@ struct RedexContext {
   void mutate_method(DexMethodRef* method,
                      const DexMethodSpec& new_spec,
                      bool rename_on_collision);
+  /**
+   * Applies the changes of many methods at once, as if by mutate_method. All
+   * the methods are taken out of the table before any of them is put back,
+   * so methods can take over each other's signatures, and collisions are
+   * resolved in the order of the changes. Several changes of the same method
+   * are combined.
+   */
+  void mutate_methods(
+      const std::vector<std::pair<DexMethodRef*, DexMethodSpec>>& changes,
+      bool rename_on_collision);
+
+  /**
+   * Frees the field and method table entries that were erased or replaced
+   * since the last call. This must not run concurrently with any other use of
+   * the context, e.g. it runs between passes.
+   */
+  void reclaim_member_tables();
 
   DexLocation* make_location(std::string_view store_name,
                              std::string_view file_name);
@@ -148,13 +167,28 @@ struct RedexContext {
   void publish_class(DexClass* cls);
 
   DexClass* type_class(const DexType* t);
+  // Walks the classes in the order in which they were published.
   template <class TypeClassWalkerFn = void(const DexType*, const DexClass*)>
   void walk_type_class(TypeClassWalkerFn walker) {
-    for (const auto& type_cls : m_type_to_class) {
+    for (const auto& type_cls : m_type_classes) {
       walker(type_cls.first, type_cls.second);
     }
   }
 
+  // Types, fields and methods by their ids. Ids that lost a race to be
+  // interned, and those of deleted fields and methods, map to nullptr.
+  DexType* get_type_by_id(uint32_t id) const {
+    return get_by_id(s_types_by_id, id);
+  }
+  DexFieldRef* get_field_by_id(uint32_t id) const {
+    return get_by_id(s_fields_by_id, id);
+  }
+  DexMethodRef* get_method_by_id(uint32_t id) const {
+    return get_by_id(s_methods_by_id, id);
+  }
+  void erase_field_id(const DexFieldRef* field);
+  void erase_method_id(const DexMethodRef* method);
+
   const std::vector<DexClass*>& external_classes() const {
     return m_external_classes;
   }
@@ -372,8 +406,7 @@ struct RedexContext {
   ConcurrentMap<const DexString*, DexType*> s_type_map;
 
   // DexFieldRef
-  ConcurrentMap<DexFieldSpec, DexFieldRef*> s_field_map;
-  std::mutex s_field_lock;
+  ConcurrentInternMap<DexFieldSpec, DexFieldRef*> s_field_map;
 
   // DexTypeList
   struct DexTypeListContainerTypePtrHash {
@@ -404,8 +437,7 @@ struct RedexContext {
       s_proto_set;
 
   // DexMethod
-  ConcurrentMap<DexMethodSpec, DexMethodRef*> s_method_map;
-  std::mutex s_method_lock;
+  ConcurrentInternMap<DexMethodSpec, DexMethodRef*> s_method_map;
 
   // DexLocation
   using ClassLocationKey = std::pair<std::string_view, std::string_view>;
@@ -420,9 +452,25 @@ struct RedexContext {
   // DexPositionSwitch and DexPositionPattern
   PositionPatternSwitchManager* m_position_pattern_switch_manager{nullptr};
 
+  // Dense ids, assigned when types, fields and methods are created, and the
+  // entities that were interned with them.
+  std::atomic<uint32_t> s_next_type_id{0};
+  std::atomic<uint32_t> s_next_field_id{0};
+  std::atomic<uint32_t> s_next_method_id{0};
+  id_map_impl::Chunks<DexType*> s_types_by_id;
+  id_map_impl::Chunks<DexFieldRef*> s_fields_by_id;
+  id_map_impl::Chunks<DexMethodRef*> s_methods_by_id;
+
+  template <typename T>
+  static T* get_by_id(const id_map_impl::Chunks<T*>& by_id, uint32_t id) {
+    auto* slot = by_id.find(id);
+    return slot == nullptr ? nullptr : *slot;
+  }
+
   // Type-to-class map
   std::mutex m_type_system_mutex;
-  std::unordered_map<const DexType*, DexClass*> m_type_to_class;
+  IdMap<DexType, DexClass*> m_type_to_class;
+  std::vector<std::pair<const DexType*, DexClass*>> m_type_classes;
   std::vector<DexClass*> m_external_classes;
 
   const std::vector<const DexType*> m_empty_types;
@@ -10,9 +10,11 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/operations.hpp>
+#include <cstring>
 #include <map>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -26,6 +28,7 @@
 #include "Macros.h"
 #include "ReadMaybeMapped.h"
 #include "StringUtil.h"
+#include "Timer.h"
 #include "Trace.h"
 #include "WorkQueue.h"
 
@@ -35,15 +38,15 @@
 #undef NO_ERROR
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace {
 
 constexpr size_t MIN_CLASSNAME_LENGTH = 10;
 constexpr size_t MAX_CLASSNAME_LENGTH = 500;
 
-constexpr decltype(redex_parallel::default_num_threads()) kReadXMLThreads = 4u;
-constexpr decltype(redex_parallel::default_num_threads()) kReadNativeThreads =
-    2u;
-
 using path_t = boost::filesystem::path;
 using dir_iterator = boost::filesystem::directory_iterator;
 using rdir_iterator = boost::filesystem::recursive_directory_iterator;
@@ -65,52 +68,242 @@ std::unique_ptr<AndroidResources> create_resource_reader(
 }
 
 namespace {
+
+// Byte classes used when scanning native libraries for class names.
+constexpr uint8_t kClassNameChar = 1 << 0; // [a-zA-Z0-9/_$]
+constexpr uint8_t kClassNameStart = 1 << 1; // [a-zL]
+
+struct ClassNameCharTable {
+  uint8_t classes[256]{};
+  constexpr ClassNameCharTable() {
+    for (int c = 'a'; c <= 'z'; c++) {
+      classes[c] = kClassNameChar | kClassNameStart;
+    }
+    for (int c = 'A'; c <= 'Z'; c++) {
+      classes[c] = kClassNameChar;
+    }
+    for (int c = '0'; c <= '9'; c++) {
+      classes[c] = kClassNameChar;
+    }
+    classes[static_cast<uint8_t>('L')] |= kClassNameStart;
+    classes[static_cast<uint8_t>('/')] = kClassNameChar;
+    classes[static_cast<uint8_t>('_')] = kClassNameChar;
+    classes[static_cast<uint8_t>('$')] = kClassNameChar;
+  }
+  bool is(char c, uint8_t cls) const {
+    return (classes[static_cast<uint8_t>(c)] & cls) != 0;
+  }
+};
+
+constexpr ClassNameCharTable kClassNameChars;
+
+// Large string ranges of a library are split into chunks of about this size,
+// so that a few big libraries do not serialize the scan.
+constexpr size_t kNativeScanChunkSize = 1u << 20;
+
+struct NativeLibRange {
+  const char* begin;
+  const char* end;
+};
+
 /*
- * Returns all strings that look like java class names from a native library.
+ * Returns the first byte in [inptr, end) that may start a class name, or end.
+ */
+const char* skip_to_class_name_start(const char* inptr, const char* end) {
+#if defined(__SSE2__)
+  // Classify 16 bytes at a time. Bytes >= 0x80 compare as negative and are
+  // thus rejected by the signed range check, as they should.
+  const __m128i lower_bound = _mm_set1_epi8('a' - 1);
+  const __m128i upper_bound = _mm_set1_epi8('z' + 1);
+  const __m128i l_char = _mm_set1_epi8('L');
+  while (end - inptr >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(inptr));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, lower_bound),
+                                  _mm_cmplt_epi8(v, upper_bound));
+    int mask = _mm_movemask_epi8(_mm_or_si128(lower, _mm_cmpeq_epi8(v, l_char)));
+    if (mask != 0) {
+      return inptr + __builtin_ctz(mask);
+    }
+    inptr += 16;
+  }
+#endif
+  while (inptr < end && !kClassNameChars.is(*inptr, kClassNameStart)) {
+    inptr++;
+  }
+  return inptr;
+}
+
+/*
+ * Calls `fn` with every string in [data, end) that looks like a java class
+ * name.
  *
- * Return values will be formatted the way that the dex spec formats class
- * names:
+ * Values will be formatted the way that the dex spec formats class names:
  *
  *   "Ljava/lang/String;"
  *
  */
-std::unordered_set<std::string> extract_classes_from_native_lib(
-    const char* data, size_t size) {
-  std::unordered_set<std::string> classes;
+template <typename Fn>
+void scan_class_names(const char* data, const char* end, const Fn& fn) {
   char buffer[MAX_CLASSNAME_LENGTH + 2]; // +2 for the trailing ";\0"
   const char* inptr = data;
-  const char* end = inptr + size;
 
-  while (inptr < end) {
+  while ((inptr = skip_to_class_name_start(inptr, end)) < end) {
     char* outptr = buffer;
     size_t length = 0;
     // All classnames start with a package, which starts with a lowercase
     // letter. Some of them are preceded by an 'L' and followed by a ';' in
     // native libraries while others are not.
-    if ((*inptr >= 'a' && *inptr <= 'z') || *inptr == 'L') {
-
-      if (*inptr != 'L') {
-        *outptr++ = 'L';
-        length++;
-      }
+    if (*inptr != 'L') {
+      *outptr++ = 'L';
+      length++;
+    }
 
-      while (inptr < end &&
-             ((*inptr >= 'a' && *inptr <= 'z') ||
-              (*inptr >= 'A' && *inptr <= 'Z') ||
-              (*inptr >= '0' && *inptr <= '9') || *inptr == '/' ||
-              *inptr == '_' || *inptr == '$') &&
-             length < MAX_CLASSNAME_LENGTH) {
-        *outptr++ = *inptr++;
-        length++;
-      }
-      if (length >= MIN_CLASSNAME_LENGTH) {
-        *outptr++ = ';';
-        *outptr = '\0';
-        classes.insert(std::string(buffer));
-      }
+    while (inptr < end && kClassNameChars.is(*inptr, kClassNameChar) &&
+           length < MAX_CLASSNAME_LENGTH) {
+      *outptr++ = *inptr++;
+      length++;
+    }
+    if (length >= MIN_CLASSNAME_LENGTH) {
+      *outptr = ';';
+      fn(std::string_view(buffer, length + 1));
     }
     inptr++;
   }
+}
+
+template <typename UInt>
+UInt read_le(const char* data) {
+  UInt value = 0;
+  for (size_t i = 0; i < sizeof(UInt); i++) {
+    value |= static_cast<UInt>(static_cast<uint8_t>(data[i])) << (8 * i);
+  }
+  return value;
+}
+
+/*
+ * Returns the ranges of a native library that may hold class name strings.
+ * For well-formed little-endian ELF files these are the string tables (e.g.
+ * .dynstr) and the read-only data sections (.rodata*). Anything else is
+ * scanned as a whole.
+ */
+std::vector<NativeLibRange> find_native_lib_string_ranges(const char* data,
+                                                          size_t size) {
+  constexpr uint32_t SHT_PROGBITS = 1;
+  constexpr uint32_t SHT_STRTAB = 3;
+  constexpr uint64_t SHF_EXECINSTR = 0x4;
+  constexpr char kElfMagic[] = {0x7f, 'E', 'L', 'F'};
+  constexpr size_t kElfClassOffset = 4;
+  constexpr size_t kElfDataOffset = 5;
+
+  std::vector<NativeLibRange> whole{{data, data + size}};
+  if (size < 0x40 || memcmp(data, kElfMagic, sizeof(kElfMagic)) != 0 ||
+      data[kElfDataOffset] != 1 /* ELFDATA2LSB */) {
+    return whole;
+  }
+  bool is_64 = data[kElfClassOffset] == 2 /* ELFCLASS64 */;
+  uint64_t shoff = is_64 ? read_le<uint64_t>(data + 0x28)
+                         : read_le<uint32_t>(data + 0x20);
+  uint16_t shentsize = read_le<uint16_t>(data + (is_64 ? 0x3A : 0x2E));
+  uint16_t shnum = read_le<uint16_t>(data + (is_64 ? 0x3C : 0x30));
+  uint16_t shstrndx = read_le<uint16_t>(data + (is_64 ? 0x3E : 0x32));
+  if (shnum == 0 || shstrndx >= shnum ||
+      shentsize < (is_64 ? 0x40 : 0x28) || shoff > size ||
+      (size - shoff) / shentsize < shnum) {
+    return whole;
+  }
+
+  struct Section {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t offset;
+    uint64_t size;
+  };
+  auto read_section = [&](uint16_t index) {
+    const char* sh = data + shoff + static_cast<size_t>(index) * shentsize;
+    Section s;
+    s.name = read_le<uint32_t>(sh);
+    s.type = read_le<uint32_t>(sh + 4);
+    if (is_64) {
+      s.flags = read_le<uint64_t>(sh + 8);
+      s.offset = read_le<uint64_t>(sh + 24);
+      s.size = read_le<uint64_t>(sh + 32);
+    } else {
+      s.flags = read_le<uint32_t>(sh + 8);
+      s.offset = read_le<uint32_t>(sh + 16);
+      s.size = read_le<uint32_t>(sh + 20);
+    }
+    return s;
+  };
+  auto in_bounds = [&](const Section& s) {
+    return s.offset <= size && s.size <= size - s.offset;
+  };
+
+  auto names = read_section(shstrndx);
+  if (!in_bounds(names)) {
+    return whole;
+  }
+  std::string_view names_table(data + names.offset, names.size);
+
+  std::vector<NativeLibRange> ranges;
+  for (uint16_t i = 0; i < shnum; i++) {
+    auto s = read_section(i);
+    if (i == shstrndx || s.size == 0 || !in_bounds(s) ||
+        s.name >= names_table.size()) {
+      continue;
+    }
+    auto name = names_table.substr(s.name);
+    name = name.substr(0, name.find('\0'));
+    bool is_rodata = s.type == SHT_PROGBITS && !(s.flags & SHF_EXECINSTR) &&
+                     boost::starts_with(name, ".rodata");
+    if (s.type == SHT_STRTAB || is_rodata) {
+      ranges.push_back({data + s.offset, data + s.offset + s.size});
+    }
+  }
+  return ranges.empty() ? whole : ranges;
+}
+
+/*
+ * Splits a range into chunks of roughly kNativeScanChunkSize. Each chunk ends
+ * right after a byte that cannot be part of a class name, so that scanning the
+ * chunks separately yields exactly the class names of the whole range.
+ */
+void split_native_lib_range(const NativeLibRange& range,
+                            std::vector<NativeLibRange>* out) {
+  const char* start = range.begin;
+  while (start < range.end) {
+    if (static_cast<size_t>(range.end - start) <= kNativeScanChunkSize) {
+      out->push_back({start, range.end});
+      return;
+    }
+    const char* split = start + kNativeScanChunkSize;
+    while (split < range.end && kClassNameChars.is(*split, kClassNameChar)) {
+      split++;
+    }
+    if (split == range.end) {
+      out->push_back({start, range.end});
+      return;
+    }
+    out->push_back({start, split + 1});
+    start = split + 1;
+  }
+}
+
+/*
+ * Returns all strings that look like java class names from a native library.
+ */
+std::unordered_set<std::string> extract_classes_from_native_lib(
+    const char* data, size_t size) {
+  std::unordered_set<std::string> classes;
+  std::vector<NativeLibRange> chunks;
+  for (const auto& range : find_native_lib_string_ranges(data, size)) {
+    split_native_lib_range(range, &chunks);
+  }
+  for (const auto& chunk : chunks) {
+    scan_class_names(chunk.begin, chunk.end, [&](std::string_view name) {
+      classes.emplace(name);
+    });
+  }
   return classes;
 }
 } // namespace
@@ -165,6 +358,20 @@ std::unordered_set<std::string> get_xml_files(const std::string& directory) {
   return get_files_by_suffix(directory, ".xml");
 }
 
+void run_on_resource_files(const std::string& phase,
+                           const std::vector<std::string>& files,
+                           const std::function<void(const std::string&)>& fn) {
+  Timer t{phase};
+  if (files.empty()) {
+    return;
+  }
+  auto num_threads =
+      std::min(redex_parallel::default_num_threads(), files.size());
+  TRACE(RES, 2, "%s: %zu files on %zu threads", phase.c_str(), files.size(),
+        num_threads);
+  workqueue_run<std::string>(fn, files, num_threads);
+}
+
 bool is_raw_resource(const std::string& filename) {
   return filename.find("/res/raw/") != std::string::npos ||
          filename.find("/res/raw-") != std::string::npos;
@@ -260,7 +467,7 @@ void AndroidResources::collect_layout_classes_and_attributes(
           }
         },
         std::vector<std::string>{""},
-        std::min(redex_parallel::default_num_threads(), kReadXMLThreads),
+        redex_parallel::default_num_threads(),
         /*push_tasks_while_running=*/true);
   };
 
@@ -324,7 +531,7 @@ void AndroidResources::collect_xml_attribute_string_values(
         }
       },
       std::vector<std::string>{""},
-      std::min(redex_parallel::default_num_threads(), kReadXMLThreads),
+      redex_parallel::default_num_threads(),
       /*push_tasks_while_running=*/true);
 }
 
@@ -353,7 +560,7 @@ void AndroidResources::rename_classes_in_layouts(
               (result ? "" : "FAILED: "), num_renamed, input.c_str());
       },
       std::vector<std::string>{""},
-      std::min(redex_parallel::default_num_threads(), kReadXMLThreads),
+      redex_parallel::default_num_threads(),
       /*push_tasks_while_running=*/true);
 }
 
@@ -395,44 +602,57 @@ void find_native_library_files(const std::string& lib_root, Fn handler) {
 } // namespace
 
 /**
- * Return all potential java class names located in native libraries.
+ * Return all types whose names are found in native libraries.
+ *
+ * Libraries are mapped and their string-bearing sections are split into
+ * chunks that are scanned in parallel. Candidates are only looked up in the
+ * existing type table, so names that do not denote a known type never get
+ * materialized.
  */
-std::unordered_set<std::string> AndroidResources::get_native_classes() {
+std::unordered_set<DexType*> AndroidResources::get_native_classes() {
+  std::vector<std::string> files;
+  for (const auto& dir : find_lib_directories()) {
+    TRACE(RES, 9, "Scanning %s for so files for class names", dir.c_str());
+    find_native_library_files(
+        dir, [&](const std::string& file) { files.push_back(file); });
+  }
+
+  // Keep all libraries mapped until the scan is done.
+  std::vector<RedexMappedFile> mapped_files;
+  mapped_files.reserve(files.size());
+  std::vector<NativeLibRange> chunks;
+  for (const auto& file : files) {
+    if (boost::filesystem::file_size(file) == 0) {
+      continue;
+    }
+    mapped_files.emplace_back(RedexMappedFile::open(file));
+    const auto& mapped = mapped_files.back();
+    for (const auto& range :
+         find_native_lib_string_ranges(mapped.const_data(), mapped.size())) {
+      split_native_lib_range(range, &chunks);
+    }
+  }
+  TRACE(RES, 2, "Scanning %zu native libraries in %zu chunks", files.size(),
+        chunks.size());
+
   std::mutex out_mutex;
-  std::unordered_set<std::string> all_classes;
-  workqueue_run<std::string>(
-      [&](sparta::SpartaWorkerState<std::string>* worker_state,
-          const std::string& input) {
-        if (input.empty()) {
-          // Dispatcher, find files and create tasks.
-          auto directories = find_lib_directories();
-          for (const auto& dir : directories) {
-            TRACE(RES, 9, "Scanning %s for so files for class names",
-                  dir.c_str());
-            find_native_library_files(dir, [&](const std::string& file) {
-              worker_state->push_task(file);
-            });
+  std::unordered_set<DexType*> all_classes;
+  workqueue_run<NativeLibRange>(
+      [&](const NativeLibRange& chunk) {
+        std::unordered_set<DexType*> classes_from_native;
+        scan_class_names(chunk.begin, chunk.end, [&](std::string_view name) {
+          auto* type = DexType::get_type(name);
+          if (type != nullptr) {
+            classes_from_native.insert(type);
           }
-          return;
+        });
+        if (!classes_from_native.empty()) {
+          std::unique_lock<std::mutex> lock(out_mutex);
+          all_classes.insert(classes_from_native.begin(),
+                             classes_from_native.end());
         }
-
-        redex::read_file_with_contents(
-            input,
-            [&](const char* data, size_t size) {
-              std::unordered_set<std::string> classes_from_native =
-                  extract_classes_from_native_lib(data, size);
-              if (!classes_from_native.empty()) {
-                std::unique_lock<std::mutex> lock(out_mutex);
-                // C++17: use merge to avoid copies.
-                all_classes.insert(classes_from_native.begin(),
-                                   classes_from_native.end());
-              }
-            },
-            64 * 1024);
       },
-      std::vector<std::string>{""},
-      std::min(redex_parallel::default_num_threads(), kReadNativeThreads),
-      /*push_tasks_while_running=*/true);
+      chunks);
   return all_classes;
 }
 
@@ -13,6 +13,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/optional.hpp>
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -27,6 +28,8 @@
 #include "Debug.h"
 #include "RedexMappedFile.h"
 
+class DexType;
+
 const char* const ONCLICK_ATTRIBUTE = "android:onClick";
 const char* const RES_DIRECTORY = "res";
 const char* const OBFUSCATED_RES_DIRECTORY = "r";
@@ -290,8 +293,8 @@ class AndroidResources {
   bool can_obfuscate_xml_file(
       const std::unordered_set<std::string>& allowed_types,
       const std::string& dirname);
-  // Classnames present in native libraries (lib/*/*.so)
-  std::unordered_set<std::string> get_native_classes();
+  // Known types whose names are present in native libraries (lib/*/*.so)
+  std::unordered_set<DexType*> get_native_classes();
 
   const std::string& get_directory() { return m_directory; }
 
@@ -324,6 +327,11 @@ std::unordered_set<std::string> extract_classes_from_native_lib(
 std::unordered_set<std::string> get_files_by_suffix(
     const std::string& directory, const std::string& suffix);
 std::unordered_set<std::string> get_xml_files(const std::string& directory);
+// Runs fn over every file in parallel, on no more threads than there are
+// files. The elapsed time is reported as a Timer named after phase.
+void run_on_resource_files(const std::string& phase,
+                           const std::vector<std::string>& files,
+                           const std::function<void(const std::string&)>& fn);
 // Checks if the file is in a res/raw folder. Such a file won't be considered
 // for resource remapping, class name extraction, etc. These files don't follow
 // binary XML format, and thus are out of scope for many optimizations.
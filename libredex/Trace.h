@@ -241,6 +241,8 @@ class TraceContext {
   const DexType* type{nullptr};
   const std::string* string_value{nullptr};
   mutable std::string string_value_cache;
+  // The interned name of `method` in the trace event log, once needed.
+  mutable uint32_t trace_event_method{0};
 #endif
 
   friend struct TraceContextAccess;
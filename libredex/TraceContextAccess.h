@@ -15,5 +15,8 @@
 
 struct TraceContextAccess {
   static const TraceContext* get_s_context() { return TraceContext::s_context; }
+  static uint32_t& get_trace_event_method(const TraceContext* context) {
+    return context->trace_event_method;
+  }
 };
 #endif
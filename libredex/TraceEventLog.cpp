@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "TraceEventLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "ConcurrentContainers.h"
+#include "Debug.h"
+#include "Show.h"
+#include "TraceContextAccess.h"
+
+/*
+ * File format, in host byte order:
+ *
+ *   magic                               8 bytes, kMagic
+ *   chunk*
+ *
+ * where each chunk starts with a one-byte tag:
+ *
+ *   'S' u32 id, u32 length, bytes       an interned string
+ *   'M' u16 module, u32 length, bytes   the name of a trace module
+ *   'E' u32 count, Event[count]         a batch of events
+ *
+ * Strings are written when they are interned, so they may appear after the
+ * events that reference them.
+ */
+
+namespace trace_event_log {
+
+namespace detail {
+std::array<std::atomic<uint32_t>, N_TRACE_MODULES> g_sample_rates{};
+
+thread_local std::array<uint32_t, N_TRACE_MODULES> t_sample_counters{};
+
+bool sample_slow(TraceModule module, uint32_t rate) {
+  return t_sample_counters[module]++ % rate == 0;
+}
+} // namespace detail
+
+namespace {
+
+constexpr char kStringTag = 'S';
+constexpr char kModuleTag = 'M';
+constexpr char kEventsTag = 'E';
+
+// Must be a power of two.
+constexpr size_t kRingCapacity = 1024;
+
+uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/*
+ * A single-producer ring buffer. Only the owning thread appends; draining is
+ * serialized by `drain_mutex` and may happen on any thread.
+ */
+struct RingBuffer {
+  std::array<Event, kRingCapacity> events;
+  std::atomic<size_t> head{0};
+  std::atomic<size_t> tail{0};
+  std::mutex drain_mutex;
+  uint32_t thread{0};
+};
+
+class EventLog {
+ public:
+  EventLog() {
+    const char* path = getenv("TRACE_EVENT_FILE");
+    const char* spec = getenv("TRACE_EVENTS");
+    if (path == nullptr || spec == nullptr) {
+      return;
+    }
+    open(path, parse_sample_rates(spec));
+  }
+
+  ~EventLog() { close(); }
+
+  void open(const std::string& path,
+            const std::array<uint32_t, N_TRACE_MODULES>& sample_rates) {
+    close();
+    {
+      std::lock_guard<std::mutex> strings_lock(m_strings_mutex);
+      std::lock_guard<std::mutex> file_lock(m_file_mutex);
+      m_file = fopen(path.c_str(), "wb");
+      if (m_file == nullptr) {
+        fprintf(stderr, "Unable to open TRACE_EVENT_FILE %s\n", path.c_str());
+        return;
+      }
+      fwrite(kMagic, sizeof(kMagic), 1, m_file);
+#define TM(x) write_module_locked(x, #x);
+      TMS
+#undef TM
+      // Strings interned while a previous log was open are still referenced
+      // by cached ids, so they need to be in this file, too.
+      for (size_t id = 1; id < m_string_values.size(); ++id) {
+        write_string_locked(id, *m_string_values[id]);
+      }
+    }
+    for (size_t i = 0; i < N_TRACE_MODULES; ++i) {
+      detail::g_sample_rates[i].store(sample_rates[i]);
+    }
+  }
+
+  void close() {
+    for (auto& rate : detail::g_sample_rates) {
+      rate.store(0);
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_buffers_mutex);
+      for (auto& buffer : m_buffers) {
+        drain(*buffer);
+      }
+    }
+    std::lock_guard<std::mutex> file_lock(m_file_mutex);
+    if (m_file != nullptr) {
+      fclose(m_file);
+      m_file = nullptr;
+    }
+  }
+
+  StringId intern(std::string_view str) {
+    std::lock_guard<std::mutex> lock(m_strings_mutex);
+    auto it = m_string_ids.find(str);
+    if (it != m_string_ids.end()) {
+      return it->second;
+    }
+    StringId id = m_string_values.size();
+    auto value = std::make_unique<std::string>(str);
+    m_string_ids.emplace(*value, id);
+    {
+      std::lock_guard<std::mutex> file_lock(m_file_mutex);
+      if (m_file != nullptr) {
+        write_string_locked(id, *value);
+      }
+    }
+    m_string_values.push_back(std::move(value));
+    return id;
+  }
+
+  StringId intern(const DexMethodRef* method) {
+    if (method == nullptr) {
+      return kNoString;
+    }
+    auto id = m_method_ids.get(method, kNoString);
+    if (id != kNoString) {
+      return id;
+    }
+    id = intern(show_deobfuscated(method));
+    m_method_ids.emplace(method, id);
+    return id;
+  }
+
+  void record(TraceModule module,
+              StringId name,
+              StringId method,
+              int64_t payload) {
+#if !IS_WINDOWS
+    if (method == kNoString) {
+      // The context caches the interned name, so that only its first event
+      // takes the string table lock.
+      const auto* context = TraceContextAccess::get_s_context();
+      if (context != nullptr) {
+        auto& cached = TraceContextAccess::get_trace_event_method(context);
+        if (cached == kNoString) {
+          cached = intern(context->get_dex_method_ref());
+        }
+        method = cached;
+      }
+    }
+#endif
+    auto& buffer = local_buffer();
+    auto head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) == kRingCapacity) {
+      drain(buffer);
+    }
+    auto& event = buffer.events[head & (kRingCapacity - 1)];
+    event.timestamp_ns = now_ns();
+    event.payload = payload;
+    event.name = name;
+    event.method = method;
+    event.pass = m_current_pass.load(std::memory_order_relaxed);
+    event.thread = buffer.thread;
+    event.module = static_cast<uint16_t>(module);
+    buffer.head.store(head + 1, std::memory_order_release);
+  }
+
+  void set_current_pass(std::string_view pass_name) {
+    m_current_pass.store(pass_name.empty() ? kNoString : intern(pass_name));
+  }
+
+ private:
+  struct ThreadBuffer {
+    EventLog* log{nullptr};
+    std::shared_ptr<RingBuffer> buffer;
+
+    ~ThreadBuffer() {
+      if (buffer) {
+        log->release(buffer);
+      }
+    }
+  };
+
+  static std::array<uint32_t, N_TRACE_MODULES> parse_sample_rates(
+      const char* spec) {
+    std::unordered_map<std::string, int> module_id_map{{
+#define TM(x) {std::string(#x), x},
+        TMS
+#undef TM
+    }};
+
+    std::array<uint32_t, N_TRACE_MODULES> rates{};
+    char* tracespec = strdup(spec);
+    const char* sep = ",: ";
+    const char* module = nullptr;
+    for (const char* tok = strtok(tracespec, sep); tok != nullptr;
+         tok = strtok(nullptr, sep)) {
+      auto rate = strtol(tok, nullptr, 10);
+      if (rate > 0 && module != nullptr) {
+        auto it = module_id_map.find(module);
+        if (it == module_id_map.end()) {
+          fprintf(stderr, "Unknown trace event module %s\n", module);
+          abort();
+        }
+        rates[it->second] = rate;
+        module = nullptr;
+      } else {
+        module = tok;
+      }
+    }
+    free(tracespec);
+    return rates;
+  }
+
+  RingBuffer& local_buffer() {
+    thread_local ThreadBuffer t_buffer;
+    if (!t_buffer.buffer) {
+      t_buffer.log = this;
+      t_buffer.buffer = std::make_shared<RingBuffer>();
+      std::lock_guard<std::mutex> lock(m_buffers_mutex);
+      t_buffer.buffer->thread = m_next_thread++;
+      m_buffers.push_back(t_buffer.buffer);
+    }
+    return *t_buffer.buffer;
+  }
+
+  // Called when a thread exits.
+  void release(const std::shared_ptr<RingBuffer>& buffer) {
+    drain(*buffer);
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    m_buffers.erase(std::remove(m_buffers.begin(), m_buffers.end(), buffer),
+                    m_buffers.end());
+  }
+
+  void drain(RingBuffer& buffer) {
+    std::lock_guard<std::mutex> drain_lock(buffer.drain_mutex);
+    auto tail = buffer.tail.load(std::memory_order_relaxed);
+    auto head = buffer.head.load(std::memory_order_acquire);
+    if (tail == head) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> file_lock(m_file_mutex);
+      if (m_file != nullptr) {
+        // The pending events wrap around at most once.
+        auto begin = tail & (kRingCapacity - 1);
+        auto count = head - tail;
+        auto first = std::min(count, kRingCapacity - begin);
+        write_events_locked(&buffer.events[begin], first);
+        write_events_locked(&buffer.events[0], count - first);
+      }
+    }
+    buffer.tail.store(head, std::memory_order_release);
+  }
+
+  void write_events_locked(const Event* events, uint32_t count) {
+    if (count == 0) {
+      return;
+    }
+    fputc(kEventsTag, m_file);
+    fwrite(&count, sizeof(count), 1, m_file);
+    fwrite(events, sizeof(Event), count, m_file);
+  }
+
+  void write_string_locked(StringId id, const std::string& str) {
+    uint32_t length = str.size();
+    fputc(kStringTag, m_file);
+    fwrite(&id, sizeof(id), 1, m_file);
+    fwrite(&length, sizeof(length), 1, m_file);
+    fwrite(str.data(), 1, length, m_file);
+  }
+
+  void write_module_locked(TraceModule module, const char* name) {
+    uint16_t id = module;
+    uint32_t length = strlen(name);
+    fputc(kModuleTag, m_file);
+    fwrite(&id, sizeof(id), 1, m_file);
+    fwrite(&length, sizeof(length), 1, m_file);
+    fwrite(name, 1, length, m_file);
+  }
+
+  std::mutex m_file_mutex;
+  FILE* m_file{nullptr};
+
+  // Lock order: m_strings_mutex before m_file_mutex.
+  std::mutex m_strings_mutex;
+  std::unordered_map<std::string_view, StringId> m_string_ids;
+  std::vector<std::unique_ptr<std::string>> m_string_values{1};
+  ConcurrentMap<const DexMethodRef*, StringId> m_method_ids;
+
+  std::mutex m_buffers_mutex;
+  std::vector<std::shared_ptr<RingBuffer>> m_buffers;
+  uint32_t m_next_thread{0};
+
+  std::atomic<StringId> m_current_pass{kNoString};
+};
+
+EventLog& event_log() {
+  static EventLog log;
+  return log;
+}
+
+// Make sure the environment is read at startup rather than on first use.
+struct EventLogInitializer {
+  EventLogInitializer() { event_log(); }
+} s_initializer;
+
+template <typename T>
+T read_value(const std::vector<char>& data, size_t* offset) {
+  always_assert_log(*offset + sizeof(T) <= data.size(),
+                    "Truncated trace event log");
+  T value;
+  memcpy(&value, data.data() + *offset, sizeof(T));
+  *offset += sizeof(T);
+  return value;
+}
+
+std::string read_string(const std::vector<char>& data, size_t* offset) {
+  auto length = read_value<uint32_t>(data, offset);
+  always_assert_log(*offset + length <= data.size(),
+                    "Truncated trace event log");
+  std::string str(data.data() + *offset, length);
+  *offset += length;
+  return str;
+}
+
+} // namespace
+
+StringId intern(std::string_view str) { return event_log().intern(str); }
+
+StringId intern(const DexMethodRef* method) {
+  return event_log().intern(method);
+}
+
+void record(TraceModule module,
+            StringId name,
+            StringId method,
+            int64_t payload) {
+  event_log().record(module, name, method, payload);
+}
+
+void set_current_pass(std::string_view pass_name) {
+  event_log().set_current_pass(pass_name);
+}
+
+void open(const std::string& path,
+          const std::array<uint32_t, N_TRACE_MODULES>& sample_rates) {
+  event_log().open(path, sample_rates);
+}
+
+void close() { event_log().close(); }
+
+Log read(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  always_assert_log(in.good(), "Unable to open %s", path.c_str());
+  std::vector<char> data((std::istreambuf_iterator<char>(in)),
+                         std::istreambuf_iterator<char>());
+  always_assert_log(data.size() >= sizeof(kMagic) &&
+                        memcmp(data.data(), kMagic, sizeof(kMagic)) == 0,
+                    "%s is not a trace event log", path.c_str());
+
+  Log log;
+  log.strings.emplace_back();
+  size_t offset = sizeof(kMagic);
+  while (offset < data.size()) {
+    char tag = data[offset++];
+    switch (tag) {
+    case kStringTag: {
+      auto id = read_value<StringId>(data, &offset);
+      if (id >= log.strings.size()) {
+        log.strings.resize(id + 1);
+      }
+      log.strings[id] = read_string(data, &offset);
+      break;
+    }
+    case kModuleTag: {
+      auto id = read_value<uint16_t>(data, &offset);
+      if (id >= log.modules.size()) {
+        log.modules.resize(id + 1);
+      }
+      log.modules[id] = read_string(data, &offset);
+      break;
+    }
+    case kEventsTag: {
+      auto count = read_value<uint32_t>(data, &offset);
+      always_assert_log(offset + size_t(count) * sizeof(Event) <= data.size(),
+                        "Truncated trace event log");
+      auto first = log.events.size();
+      log.events.resize(first + count);
+      memcpy(&log.events[first], data.data() + offset, count * sizeof(Event));
+      offset += count * sizeof(Event);
+      break;
+    }
+    default:
+      not_reached_log("Unknown chunk tag %d in trace event log", tag);
+    }
+  }
+  return log;
+}
+
+} // namespace trace_event_log
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Trace.h"
+
+class DexMethodRef;
+
+/*
+ * A low-overhead binary backend for fine-grained tracing that, unlike TRACE,
+ * stays available in release builds.
+ *
+ * Events are compact fixed-size records (timestamp, module, pass, method,
+ * name and an integer payload). Each thread appends to its own ring buffer
+ * without taking a lock; full buffers are drained to the log file by their
+ * owner, and all buffers are drained when the process exits. All strings
+ * (event names, method names, pass names) are interned once into a string
+ * table that is written alongside the events, so formatting happens offline
+ * (see `redex-tool trace-events`).
+ *
+ * The log is configured through environment variables:
+ *
+ *   TRACE_EVENT_FILE=/path/to/log.bin
+ *   TRACE_EVENTS=INL:1,CSE:100,PM:1
+ *
+ * where the number after each module is a sampling rate: one in N events of
+ * that module is recorded on each thread. Modules that are not listed are
+ * not recorded. Metrics set through the PassManager are recorded under PM.
+ */
+namespace trace_event_log {
+
+constexpr char kMagic[8] = {'R', 'D', 'X', 'E', 'V', 'T', '0', '2'};
+
+// Ids into the string table. 0 is reserved for "none".
+using StringId = uint32_t;
+constexpr StringId kNoString = 0;
+
+struct Event {
+  uint64_t timestamp_ns;
+  int64_t payload;
+  StringId name;
+  StringId method;
+  StringId pass;
+  uint32_t thread;
+  uint16_t module;
+  // Always zero; keeps the record free of uninitialized padding.
+  uint16_t reserved[3];
+};
+static_assert(sizeof(Event) == 40, "Event records are written as-is");
+
+namespace detail {
+// Per-module sampling rate; 0 means disabled.
+extern std::array<std::atomic<uint32_t>, N_TRACE_MODULES> g_sample_rates;
+
+bool sample_slow(TraceModule module, uint32_t rate);
+} // namespace detail
+
+inline bool enabled(TraceModule module) {
+  return detail::g_sample_rates[module].load(std::memory_order_relaxed) != 0;
+}
+
+// Whether the next event of `module` on this thread should be recorded.
+inline bool should_sample(TraceModule module) {
+  auto rate = detail::g_sample_rates[module].load(std::memory_order_relaxed);
+  return rate != 0 && (rate == 1 || detail::sample_slow(module, rate));
+}
+
+StringId intern(std::string_view str);
+
+StringId intern(const DexMethodRef* method);
+
+void record(TraceModule module,
+            StringId name,
+            StringId method,
+            int64_t payload);
+
+// Attributes all subsequently recorded events to the given pass.
+void set_current_pass(std::string_view pass_name);
+
+/*
+ * Starts recording into `path` with the given per-module sampling rates.
+ * Normally driven by the environment; exposed for tests and tools.
+ */
+void open(const std::string& path,
+          const std::array<uint32_t, N_TRACE_MODULES>& sample_rates);
+
+// Drains all thread buffers and closes the log.
+void close();
+
+struct Log {
+  std::vector<std::string> strings; // Indexed by StringId.
+  std::vector<std::string> modules; // Indexed by TraceModule.
+  std::vector<Event> events;
+};
+
+// Fails with an assertion on malformed input.
+Log read(const std::string& path);
+
+} // namespace trace_event_log
+
+/*
+ * Records `payload` under the call-site constant `name` for the method of
+ * the innermost TraceContext, if any.
+ */
+#define TRACE_EVENT(module, name, payload)                                   \
+  do {                                                                       \
+    if (trace_event_log::should_sample(module)) {                            \
+      static const trace_event_log::StringId trace_event_name =              \
+          trace_event_log::intern(name);                                     \
+      trace_event_log::record(module, trace_event_name,                      \
+                              trace_event_log::kNoString, (payload));        \
+    }                                                                        \
+  } while (0)
+
+#define TRACE_METHOD_EVENT(module, name, method, payload)                    \
+  do {                                                                       \
+    if (trace_event_log::should_sample(module)) {                            \
+      static const trace_event_log::StringId trace_event_name =              \
+          trace_event_log::intern(name);                                     \
+      trace_event_log::record(module, trace_event_name,                      \
+                              trace_event_log::intern(method), (payload));   \
+    }                                                                        \
+  } while (0)
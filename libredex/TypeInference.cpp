@@ -7,6 +7,7 @@
 
 #include "TypeInference.h"
 
+#include <algorithm>
 #include <numeric>
 #include <ostream>
 #include <sstream>
@@ -400,7 +401,16 @@ void TypeInference::run(bool is_static,
     }
   }
   MonotonicFixpointIterator::run(init_state);
-  populate_type_environments();
+  m_type_envs.clear();
+  m_type_envs_populated = false;
+  m_block_cache.clear();
+  m_next_block = 0;
+  if (m_lazy_type_environments) {
+    m_blocks = m_cfg.blocks();
+  } else {
+    m_blocks.clear();
+    populate_type_environments();
+  }
 }
 
 // This method analyzes an instruction and updates the type environment
@@ -1110,9 +1120,9 @@ void TypeInference::print(std::ostream& output) const {
   for (cfg::Block* block : m_cfg.blocks()) {
     for (auto& mie : InstructionIterable(block)) {
       IRInstruction* insn = mie.insn;
-      auto it = m_type_envs.find(insn);
-      always_assert(it != m_type_envs.end());
-      output << SHOW(insn) << " -- " << it->second << std::endl;
+      auto* env = get_type_environment(insn);
+      always_assert(env != nullptr);
+      output << SHOW(insn) << " -- " << *env << std::endl;
     }
   }
 }
@@ -1126,7 +1136,11 @@ void TypeInference::traceState(TypeEnvironment* state) const {
   TRACE(TYPE, 9, "%s", out.str().c_str());
 }
 
-void TypeInference::populate_type_environments() {
+void TypeInference::populate_type_environments() const {
+  if (m_type_envs_populated) {
+    return;
+  }
+  m_type_envs_populated = true;
   // We reserve enough space for the map in order to avoid repeated rehashing
   // during the computation.
   m_type_envs.reserve(m_cfg.num_blocks() * 16);
@@ -1140,4 +1154,60 @@ void TypeInference::populate_type_environments() {
   }
 }
 
+const TypeEnvironment* TypeInference::get_type_environment(
+    const IRInstruction* insn) const {
+  if (!m_lazy_type_environments || m_type_envs_populated) {
+    auto it = m_type_envs.find(insn);
+    return it == m_type_envs.end() ? nullptr : &it->second;
+  }
+
+  // The cached blocks are searched starting at the last queried instruction,
+  // so that walking a block in order finds each instruction right away.
+  for (auto it = m_block_cache.begin(); it != m_block_cache.end(); ++it) {
+    auto& envs = it->envs;
+    for (size_t i = 0; i < envs.size(); i++) {
+      size_t index = (it->last_index + i) % envs.size();
+      if (envs[index].first == insn) {
+        it->last_index = index;
+        m_block_cache.splice(m_block_cache.begin(), m_block_cache, it);
+        return &envs[index].second;
+      }
+    }
+  }
+
+  // Otherwise the blocks are searched starting after the block of the last
+  // miss, which is the next block for in-order walks.
+  for (size_t i = 0; i < m_blocks.size(); i++) {
+    size_t b = (m_next_block + i) % m_blocks.size();
+    cfg::Block* block = m_blocks[b];
+    bool contains = false;
+    for (auto& mie : InstructionIterable(block)) {
+      if (mie.insn == insn) {
+        contains = true;
+        break;
+      }
+    }
+    if (!contains) {
+      continue;
+    }
+    m_next_block = (b + 1) % m_blocks.size();
+    if (m_block_cache.size() == m_block_cache_size) {
+      m_block_cache.pop_back();
+    }
+    CachedBlock cached;
+    TypeEnvironment current_state = get_entry_state_at(block);
+    for (auto& mie : InstructionIterable(block)) {
+      if (mie.insn == insn) {
+        cached.last_index = cached.envs.size();
+      }
+      cached.envs.emplace_back(mie.insn, current_state);
+      analyze_instruction(mie.insn, &current_state, block);
+    }
+    m_block_cache.push_front(std::move(cached));
+    auto& front = m_block_cache.front();
+    return &front.envs[front.last_index].second;
+  }
+  return nullptr;
+}
+
 } // namespace type_inference
@@ -7,7 +7,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <boost/optional/optional_io.hpp>
+#include <list>
 #include <ostream>
 
 #include "BaseIRAnalyzer.h"
@@ -196,11 +198,26 @@ class TypeEnvironment final
 class TypeInference final
     : public ir_analyzer::BaseIRAnalyzer<TypeEnvironment> {
  public:
+  /*
+   * By default, the type environment at each instruction is materialized
+   * after the analysis. With lazy_type_environments, only the entry state of
+   * each block is kept, and the environments at the instructions of a block
+   * are recomputed from it when first queried via get_type_environment. The
+   * environments of the block_cache_size most recently queried blocks are
+   * cached, so that walking the instructions in order replays each block once.
+   *
+   * The environments are computed lazily by the const accessors, too, so a
+   * TypeInference must not be queried from several threads at once.
+   */
   explicit TypeInference(const cfg::ControlFlowGraph& cfg,
-                         bool skip_check_cast_to_intf = false)
+                         bool skip_check_cast_to_intf = false,
+                         bool lazy_type_environments = false,
+                         size_t block_cache_size = 1)
       : ir_analyzer::BaseIRAnalyzer<TypeEnvironment>(cfg),
         m_cfg(cfg),
-        m_skip_check_cast_to_intf(skip_check_cast_to_intf) {}
+        m_skip_check_cast_to_intf(skip_check_cast_to_intf),
+        m_lazy_type_environments(lazy_type_environments),
+        m_block_cache_size(std::max<size_t>(1, block_cache_size)) {}
 
   void run(const DexMethod* dex_method);
 
@@ -227,23 +244,49 @@ class TypeInference final
 
   void traceState(TypeEnvironment* state) const;
 
+  // In lazy mode, this materializes the environments of all instructions.
   const std::unordered_map<const IRInstruction*, TypeEnvironment>&
   get_type_environments() const {
+    populate_type_environments();
     return m_type_envs;
   }
 
   std::unordered_map<const IRInstruction*, TypeEnvironment>&
   get_type_environments() {
+    populate_type_environments();
     return m_type_envs;
   }
 
+  // The type environment right before the given instruction, or nullptr if the
+  // instruction is not part of the analyzed method. In lazy mode, the result
+  // is only valid until the next call. Lazy lookups are fastest when the
+  // instructions are queried block by block.
+  const TypeEnvironment* get_type_environment(const IRInstruction* insn) const;
+
  private:
-  void populate_type_environments();
+  void populate_type_environments() const;
 
   const cfg::ControlFlowGraph& m_cfg;
-  std::unordered_map<const IRInstruction*, TypeEnvironment> m_type_envs;
+  mutable std::unordered_map<const IRInstruction*, TypeEnvironment> m_type_envs;
+  mutable bool m_type_envs_populated{false};
   const bool m_skip_check_cast_to_intf;
 
+  // The environments at the instructions of a block, and the index of the
+  // last queried one.
+  struct CachedBlock {
+    std::vector<std::pair<const IRInstruction*, TypeEnvironment>> envs;
+    size_t last_index{0};
+  };
+
+  // Only used in lazy mode: the blocks, which are searched for a queried
+  // instruction starting after the block of the previous miss, and the most
+  // recently used blocks, most recent first.
+  const bool m_lazy_type_environments;
+  const size_t m_block_cache_size;
+  std::vector<cfg::Block*> m_blocks;
+  mutable size_t m_next_block{0};
+  mutable std::list<CachedBlock> m_block_cache;
+
   TypeDomain refine_type(const TypeDomain& type,
                          IRType expected,
                          IRType const_type,
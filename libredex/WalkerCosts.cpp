@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "WalkerCosts.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include "DexClass.h"
+#include "IRCode.h"
+#include "IdMap.h"
+
+namespace walker_costs {
+
+namespace {
+
+// The cost of every method in nanoseconds, shifted left by one. The low bit
+// is set if the cost was measured, and clear if it is an estimate based on
+// the number of instructions. 0 if neither is known yet.
+id_map_impl::Chunks<std::atomic<uint64_t>> s_costs;
+
+std::mutex s_stats_lock;
+Stats s_stats;
+
+thread_local bool s_split_large_classes = false;
+
+constexpr uint64_t kMeasured = 1;
+
+} // namespace
+
+uint64_t estimate(const DexMethod* method) {
+  auto& slot = s_costs.at(method->get_id());
+  uint64_t cost = slot.load(std::memory_order_relaxed);
+  if (cost != 0) {
+    return cost >> 1;
+  }
+  // Counting the instructions is linear in the size of the method, so the
+  // estimate is only computed once. Racing threads compute the same value.
+  auto* code = method->get_code();
+  size_t insns = code == nullptr ? 0 : code->count_opcodes();
+  uint64_t estimated = (insns + 1) * kNanosPerUntimedInstruction;
+  uint64_t expected = 0;
+  slot.compare_exchange_strong(expected, estimated << 1,
+                               std::memory_order_relaxed);
+  return estimated;
+}
+
+std::vector<WorkUnit> schedule(std::vector<DexClass*> classes,
+                               size_t num_threads) {
+  std::vector<std::pair<WorkUnit, uint64_t>> units;
+  units.reserve(classes.size());
+  std::vector<uint64_t> class_costs;
+  class_costs.reserve(classes.size());
+  uint64_t total = 0;
+  for (auto* cls : classes) {
+    uint64_t cost = 0;
+    for (auto* m : cls->get_dmethods()) {
+      cost += estimate(m);
+    }
+    for (auto* m : cls->get_vmethods()) {
+      cost += estimate(m);
+    }
+    class_costs.push_back(cost);
+    total += cost;
+  }
+
+  // A class that costs more than its share of a thread would leave the
+  // other threads idle if it was started last.
+  bool split = s_split_large_classes && num_threads > 1;
+  uint64_t share = total / std::max<size_t>(num_threads, 1);
+  for (size_t i = 0; i < classes.size(); i++) {
+    auto* cls = classes[i];
+    if (!split || class_costs[i] <= share) {
+      units.emplace_back(WorkUnit{cls, nullptr}, class_costs[i]);
+      continue;
+    }
+    for (auto* m : cls->get_dmethods()) {
+      units.emplace_back(WorkUnit{cls, m}, estimate(m));
+    }
+    for (auto* m : cls->get_vmethods()) {
+      units.emplace_back(WorkUnit{cls, m}, estimate(m));
+    }
+  }
+
+  std::stable_sort(units.begin(), units.end(),
+                   [](const auto& a, const auto& b) {
+                     return a.second > b.second;
+                   });
+  std::vector<WorkUnit> result;
+  result.reserve(units.size());
+  for (const auto& [unit, _] : units) {
+    result.push_back(unit);
+  }
+  return result;
+}
+
+SplitLargeClasses::SplitLargeClasses() : m_previous(s_split_large_classes) {
+  s_split_large_classes = true;
+}
+
+SplitLargeClasses::~SplitLargeClasses() {
+  s_split_large_classes = m_previous;
+}
+
+WalkRecorder::WalkRecorder(size_t num_threads)
+    : m_start(Clock::now()), m_workers(std::max<size_t>(num_threads, 1)) {
+  for (auto& worker : m_workers) {
+    worker.last_finish = m_start;
+  }
+}
+
+void WalkRecorder::commit() {
+  auto end = Clock::now();
+  auto first_idle = end;
+  uint64_t total = 0;
+  for (const auto& worker : m_workers) {
+    first_idle = std::min(first_idle, worker.last_finish);
+    for (const auto& [_, nanos] : worker.costs) {
+      total += nanos;
+    }
+  }
+
+  if (total >= kMinRecordedWalkNanos) {
+    for (const auto& worker : m_workers) {
+      for (const auto& [method, nanos] : worker.costs) {
+        // Keep the maximum over all walks, so that a cheap walk does not
+        // hide which methods are expensive to walk.
+        uint64_t measured = (std::max<uint64_t>(nanos, 1) << 1) | kMeasured;
+        auto& slot = s_costs.at(method->get_id());
+        uint64_t cost = slot.load(std::memory_order_relaxed);
+        while ((!(cost & kMeasured) || cost < measured) &&
+               !slot.compare_exchange_weak(cost, measured,
+                                           std::memory_order_relaxed)) {
+        }
+      }
+    }
+  }
+
+  auto to_nanos = [](Clock::duration d) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+  };
+  uint64_t tail = to_nanos(end - first_idle);
+  std::lock_guard<std::mutex> lock(s_stats_lock);
+  s_stats.walks++;
+  s_stats.wall_nanos += to_nanos(end - m_start);
+  s_stats.tail_nanos += tail;
+  s_stats.max_tail_nanos = std::max(s_stats.max_tail_nanos, tail);
+}
+
+Stats take_stats() {
+  std::lock_guard<std::mutex> lock(s_stats_lock);
+  Stats stats = s_stats;
+  s_stats = Stats();
+  return stats;
+}
+
+void reset() { s_costs.clear(); }
+
+} // namespace walker_costs
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Thread.h"
+
+class DexClass;
+class DexMethod;
+
+/*
+ * Cost-based scheduling for the parallel method and code walkers.
+ *
+ * The walkers hand out classes to the threads of a work queue. When a few
+ * classes are much more expensive than the others, e.g. because of huge
+ * generated methods, the order matters: if they are started last, all other
+ * threads idle while they finish. The walkers therefore start the most
+ * expensive classes first.
+ *
+ * The cost of a method is the longest time that walking it took in a walk
+ * that was not trivially cheap, or, if it was never timed, an estimate based
+ * on its number of instructions when it was first scheduled. All functions
+ * are thread-safe.
+ */
+namespace walker_costs {
+
+// The estimated cost of a method that was never timed, per instruction.
+constexpr uint64_t kNanosPerUntimedInstruction = 100;
+
+// Walks that took less than this, summed over all threads, are too cheap for
+// their timings to be representative, and do not update the costs.
+constexpr uint64_t kMinRecordedWalkNanos = 10 * 1000 * 1000;
+
+/*
+ * A unit of work of a walk: either all the methods of a class, or, when the
+ * class is split, a single one of them.
+ */
+struct WorkUnit {
+  DexClass* cls;
+  DexMethod* method;
+};
+
+/*
+ * The estimated cost of walking a method, in nanoseconds.
+ */
+uint64_t estimate(const DexMethod* method);
+
+/*
+ * Turns the classes into units of work, ordered by decreasing estimated cost.
+ * When the calling thread is in the scope of a SplitLargeClasses object, the
+ * classes that cost more than an equal share of the whole walk are split into
+ * one unit per method.
+ */
+std::vector<WorkUnit> schedule(std::vector<DexClass*> classes,
+                               size_t num_threads);
+
+/*
+ * Allows the walks that the current thread starts while this object is alive
+ * to run the methods of the same class concurrently. Only use this when the
+ * walker does not rely on visiting all the methods of a class on one thread.
+ */
+class SplitLargeClasses {
+ public:
+  SplitLargeClasses();
+  ~SplitLargeClasses();
+
+  SplitLargeClasses(const SplitLargeClasses&) = delete;
+  SplitLargeClasses& operator=(const SplitLargeClasses&) = delete;
+
+ private:
+  bool m_previous;
+};
+
+/*
+ * Collects the timings of a walk. Every worker only touches its own slot, so
+ * the recording methods can be called concurrently by distinct workers.
+ */
+class WalkRecorder {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit WalkRecorder(size_t num_threads);
+
+  void add(size_t worker_id, const DexMethod* method, Clock::duration time) {
+    m_workers[worker_id].costs.emplace_back(
+        method,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+  }
+
+  // Marks the end of a unit of work.
+  void finish_unit(size_t worker_id) {
+    m_workers[worker_id].last_finish = Clock::now();
+  }
+
+  // Updates the recorded costs and the walk statistics. Call this once, after
+  // the walk.
+  void commit();
+
+ private:
+  struct alignas(CACHE_LINE_SIZE) Worker {
+    std::vector<std::pair<const DexMethod*, uint64_t>> costs;
+    Clock::time_point last_finish;
+  };
+
+  Clock::time_point m_start;
+  std::vector<Worker> m_workers;
+};
+
+/*
+ * How the parallel walks went since the last call to take_stats(). The tail
+ * of a walk is the time between the moment the first thread ran out of work
+ * and the end of the walk.
+ */
+struct Stats {
+  uint64_t walks{0};
+  uint64_t wall_nanos{0};
+  uint64_t tail_nanos{0};
+  uint64_t max_tail_nanos{0};
+};
+
+Stats take_stats();
+
+/*
+ * Forgets the recorded costs. The costs are indexed by method ids, which are
+ * only meaningful within one RedexContext.
+ */
+void reset();
+
+} // namespace walker_costs
@@ -21,6 +21,7 @@
 #include "Thread.h"
 #include "Trace.h"
 #include "VirtualScope.h"
+#include "WalkerCosts.h"
 #include "WorkQueue.h"
 
 /**
@@ -406,6 +407,8 @@ class walk {
    * sequential counterparts.
    * The unit of parallelization is a DexClass. The reason is that we don't want
    * to create too many tasks on the WorkQueue, paying the overhead for each.
+   * The method and code walkers start with the most expensive classes, and
+   * may split them up; see WalkerCosts.h.
    */
   class parallel {
    public:
@@ -461,9 +464,8 @@ class walk {
         const Classes& classes,
         const WalkerFn& walker,
         size_t num_threads = redex_parallel::default_num_threads()) {
-      workqueue_run<DexClass*>(
-          [&walker](DexClass* cls) { walk::iterate_methods(cls, walker); },
-          classes,
+      scheduled_methods(
+          classes, all_methods, [&walker](size_t, DexMethod* m) { walker(m); },
           num_threads);
     }
 
@@ -487,19 +489,13 @@ class walk {
         Accumulator init = Accumulator()) {
       std::vector<CacheAligned<Accumulator>> acc_vec(num_threads, init);
 
-      workqueue_run<DexClass*>(
-          [&](sparta::SpartaWorkerState<DexClass*>* state, DexClass* cls) {
-            Accumulator& acc = acc_vec[state->worker_id()];
-            for (auto dmethod : cls->get_dmethods()) {
-              TraceContext context(dmethod);
-              walker(dmethod, &acc);
-            }
-            for (auto vmethod : cls->get_vmethods()) {
-              TraceContext context(vmethod);
-              walker(vmethod, &acc);
-            }
-          },
+      scheduled_methods(
           classes,
+          all_methods,
+          [&](size_t worker_id, DexMethod* m) {
+            Accumulator& acc = acc_vec[worker_id];
+            walker(m, &acc);
+          },
           num_threads);
 
       auto reduce = Reduce();
@@ -587,11 +583,12 @@ class walk {
         const FilterFn& filter,
         const WalkerFn& walker,
         size_t num_threads = redex_parallel::default_num_threads()) {
-      workqueue_run<DexClass*>(
-          [&filter, &walker](DexClass* cls) {
-            walk::iterate_code(cls, filter, walker);
-          },
+      scheduled_methods(
           classes,
+          [&filter](DexMethod* m) {
+            return filter(m) && m->get_code() != nullptr;
+          },
+          [&walker](size_t, DexMethod* m) { walker(m, *m->get_code()); },
           num_threads);
     }
 
@@ -697,5 +694,49 @@ class walk {
         size_t num_threads = redex_parallel::default_num_threads()) {
       workqueue_run<const VirtualScope*>(walker, virtual_scopes, num_threads);
     }
+
+   private:
+    // Call `walker` on all methods approved by `filter` in `classes` in
+    // parallel, starting with the most expensive classes, and time them.
+    //   FilterFn should accept a `DexMethod*` and return a bool.
+    //   WalkerFn should accept `(size_t worker_id, DexMethod*)`.
+    template <class Classes, typename FilterFn, typename WalkerFn>
+    static void scheduled_methods(const Classes& classes,
+                                  const FilterFn& filter,
+                                  const WalkerFn& walker,
+                                  size_t num_threads) {
+      auto units = walker_costs::schedule(
+          std::vector<DexClass*>(classes.begin(), classes.end()), num_threads);
+      walker_costs::WalkRecorder recorder(num_threads);
+      auto walk_method = [&](size_t worker_id, DexMethod* m) {
+        TraceContext context(m);
+        if (!filter(m)) {
+          return;
+        }
+        auto start = walker_costs::WalkRecorder::Clock::now();
+        walker(worker_id, m);
+        recorder.add(worker_id, m,
+                     walker_costs::WalkRecorder::Clock::now() - start);
+      };
+      workqueue_run<walker_costs::WorkUnit>(
+          [&](sparta::SpartaWorkerState<walker_costs::WorkUnit>* state,
+              walker_costs::WorkUnit unit) {
+            size_t worker_id = state->worker_id();
+            if (unit.method != nullptr) {
+              walk_method(worker_id, unit.method);
+            } else {
+              for (auto dmethod : unit.cls->get_dmethods()) {
+                walk_method(worker_id, dmethod);
+              }
+              for (auto vmethod : unit.cls->get_vmethods()) {
+                walk_method(worker_id, vmethod);
+              }
+            }
+            recorder.finish_unit(worker_id);
+          },
+          units,
+          num_threads);
+      recorder.commit();
+    }
   };
 };
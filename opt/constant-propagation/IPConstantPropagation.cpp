@@ -159,6 +159,11 @@ std::unique_ptr<FixpointIterator> PassImpl::analyze(
           stats.method_cache_misses - last_stats.method_cache_misses);
     last_stats = stats;
   };
+  // Remembering what each method contributed to the WholeProgramState only
+  // pays off if we refine it more than once.
+  fp_iter->set_cache_wps_contributions(
+      m_config.incremental_heap_analysis &&
+      m_config.max_heap_analysis_iterations > 1);
   // Run the bootstrap. All field value and method return values are
   // represented by Top.
   fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
@@ -184,6 +189,11 @@ std::unique_ptr<FixpointIterator> PassImpl::analyze(
     fp_iter->set_whole_program_state(std::move(wps));
     fp_iter->run({{CURRENT_PARTITION_LABEL, ArgumentDomain()}});
   }
+  m_stats.fp_iter = fp_iter->get_stats();
+  TRACE(ICONSTP, 1,
+        "%zu/%zu whole program state contribution cache hits / misses",
+        m_stats.fp_iter.wps_contribution_cache_hits,
+        m_stats.fp_iter.wps_contribution_cache_misses);
   compute_analysis_stats(fp_iter->get_whole_program_state(),
                          definitely_assigned_ifields);
   return fp_iter;
@@ -236,6 +246,8 @@ void PassImpl::optimize(
     const ImmutableAttributeAnalyzerState* immut_analyzer_state) {
   Transform::RuntimeCache runtime_cache{};
   const auto& pure_methods = ::get_pure_methods();
+  // Methods are transformed independently of each other.
+  walker_costs::SplitLargeClasses split_large_classes;
   m_transform_stats =
       walk::parallel::methods<Transform::Stats>(scope, [&](DexMethod* method) {
         if (method->get_code() == nullptr ||
@@ -321,6 +333,10 @@ void PassImpl::run_pass(DexStoresVector& stores,
                   m_stats.fp_iter.method_cache_hits);
   mgr.incr_metric("fp_iter.method_cache_misses",
                   m_stats.fp_iter.method_cache_misses);
+  mgr.incr_metric("fp_iter.wps_contribution_cache_hits",
+                  m_stats.fp_iter.wps_contribution_cache_hits);
+  mgr.incr_metric("fp_iter.wps_contribution_cache_misses",
+                  m_stats.fp_iter.wps_contribution_cache_misses);
 }
 
 static PassImpl s_pass;
@@ -29,6 +29,9 @@ class PassImpl : public Pass {
     // Setting this to zero means that all field values and return values will
     // be treated as Top.
     uint64_t max_heap_analysis_iterations{0};
+    // Whether to only re-analyze the methods whose arguments, or whose read
+    // field and return values, changed when refining the WholeProgramState.
+    bool incremental_heap_analysis{false};
     uint32_t big_override_threshold{5};
     std::unordered_set<const DexType*> field_blocklist;
     bool compute_definitely_assigned_ifields{true};
@@ -58,6 +61,11 @@ class PassImpl : public Pass {
     bind("max_heap_analysis_iterations",
          UINT64_C(0),
          m_config.max_heap_analysis_iterations);
+    bind("incremental_heap_analysis", false,
+         m_config.incremental_heap_analysis,
+         "Whether refinements of the whole program state only re-analyze "
+         "methods depending on field or return values that changed in the "
+         "previous iteration. Converges to the same result.");
     bind("field_blocklist",
          {},
          m_config.field_blocklist,
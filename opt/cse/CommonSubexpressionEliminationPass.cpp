@@ -80,6 +80,8 @@ void CommonSubexpressionEliminationPass::run_pass(DexStoresVector& stores,
   copy_prop_config.eliminate_const_classes = false;
   copy_prop_config.eliminate_const_strings = false;
   copy_prop_config.static_finals = false;
+  // Methods are rewritten independently of each other.
+  walker_costs::SplitLargeClasses split_large_classes;
   const auto stats = walk::parallel::methods<Stats>(
       scope,
       [&](DexMethod* method) {
@@ -11,7 +11,6 @@
 
 #include "ABExperimentContext.h"
 #include "CFGMutation.h"
-#include "ConcurrentContainers.h"
 #include "Creators.h"
 #include "DexAccess.h"
 #include "DexClass.h"
@@ -23,6 +22,7 @@
 #include "ScopedCFG.h"
 #include "Show.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 #include "locator.h"
 
 namespace {
@@ -57,40 +57,24 @@ void DedupStrings::run(
   // For now, we are only trying to optimize strings in the first store.
   // (It should be possible to generalize in the future.)
   DexClassesVector& dexen = stores[0].get_dexen();
-  const auto scope = build_class_scope(dexen);
-
-  // For each method, remember which dex it's defined in.
-  std::unordered_map<const DexMethod*, size_t> methods_to_dex =
-      get_methods_to_dex(dexen);
 
   // Gather set of methods that must not be touched because they are
   // in the primary dex or perf sensitive
   std::unordered_set<const DexMethod*> perf_sensitive_methods =
       get_perf_sensitive_methods(dexen);
 
-  // Compute set of non-load strings in each dex
-  std::unordered_set<const DexString*> non_load_strings[dexen.size()];
-  workqueue_run_for<size_t>(0, dexen.size(), [&](size_t i) {
-    auto& strings = non_load_strings[i];
-    gather_non_load_strings(dexen[i], &strings);
-  });
-
-  // For each string, figure out how many times it's loaded per dex
-  ConcurrentMap<const DexString*, std::unordered_map<size_t, size_t>>
-      occurrences = get_occurrences(scope, methods_to_dex,
-                                    perf_sensitive_methods, non_load_strings);
+  // For each string, figure out how many times it's loaded per dex, and
+  // which dexes reference it anyway
+  auto occurrences = get_occurrences(dexen, perf_sensitive_methods);
 
   // Use heuristics to determine which strings to dedup,
   // and figure out factory method details
-  std::unordered_map<const DexString*, DedupStrings::DedupStringInfo>
-      strings_to_dedup =
-          get_strings_to_dedup(dexen, occurrences, methods_to_dex,
-                               perf_sensitive_methods, non_load_strings);
+  auto strings_to_dedup =
+      get_strings_to_dedup(dexen, occurrences, perf_sensitive_methods);
 
   // Rewrite const-string instructions
-  rewrite_const_string_instructions(scope, methods_to_dex,
-                                    perf_sensitive_methods, strings_to_dedup,
-                                    ab_experiment_context);
+  rewrite_const_string_instructions(dexen, perf_sensitive_methods,
+                                    strings_to_dedup, ab_experiment_context);
 }
 
 std::unordered_set<const DexMethod*> DedupStrings::get_perf_sensitive_methods(
@@ -148,30 +132,6 @@ std::unordered_set<const DexMethod*> DedupStrings::get_perf_sensitive_methods(
   return perf_sensitive_methods;
 }
 
-std::unordered_map<const DexMethod*, size_t> DedupStrings::get_methods_to_dex(
-    const DexClassesVector& dexen) {
-  // Let's build a mapping that tells us for each method which dex it is
-  // defined in.
-
-  std::unordered_map<const DexMethod*, size_t> methods_to_dex;
-  for (size_t dexnr = 0; dexnr < dexen.size(); dexnr++) {
-    auto& classes = dexen[dexnr];
-    for (auto cls : classes) {
-      for (auto method : cls->get_dmethods()) {
-        if (method->get_code() != nullptr) {
-          methods_to_dex.emplace(method, dexnr);
-        }
-      }
-      for (auto method : cls->get_vmethods()) {
-        if (method->get_code() != nullptr) {
-          methods_to_dex.emplace(method, dexnr);
-        }
-      }
-    }
-  }
-  return methods_to_dex;
-}
-
 DexMethod* DedupStrings::make_const_string_loader_method(
     DexClasses& dex,
     size_t dex_id,
@@ -232,8 +192,8 @@ DexMethod* DedupStrings::make_const_string_loader_method(
   return method;
 }
 
-void DedupStrings::gather_non_load_strings(
-    DexClasses& classes, std::unordered_set<const DexString*>* strings) {
+std::vector<const DexString*> DedupStrings::gather_non_load_strings(
+    DexClasses& classes) {
   // Let's figure out the set of "non-load" strings, i.e. the strings which
   // are referenced by some metadata (and not just const-string instructions)
   std::vector<const DexString*> lstring;
@@ -246,101 +206,164 @@ void DedupStrings::gather_non_load_strings(
                     classes,
                     /* exclude_loads */ true);
 
-  strings->insert(lstring.begin(), lstring.end());
-  strings->insert(m_ignore_strings.begin(), m_ignore_strings.end());
+  lstring.insert(lstring.end(), m_ignore_strings.begin(),
+                 m_ignore_strings.end());
+  return lstring;
 }
 
-ConcurrentMap<const DexString*, std::unordered_map<size_t, size_t>>
-DedupStrings::get_occurrences(
-    const Scope& scope,
-    const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
-    const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
-    std::unordered_set<const DexString*> non_load_strings[]) {
-  // For each string, figure out how many times it's loaded per dex
-  ConcurrentMap<const DexString*, std::unordered_map<size_t, size_t>>
-      occurrences;
-  ConcurrentMap<const DexString*, std::unordered_set<size_t>>
-      perf_sensitive_strings;
-  walk::parallel::code(
-      scope, [&occurrences, &perf_sensitive_strings, &methods_to_dex,
-              &perf_sensitive_methods](DexMethod* method, IRCode& code) {
-        const auto dexnr = methods_to_dex.at(method);
-        const auto perf_sensitive = perf_sensitive_methods.count(method) != 0;
-        for (auto& mie : InstructionIterable(code)) {
-          const auto insn = mie.insn;
-          if (insn->opcode() == OPCODE_CONST_STRING) {
-            const auto str = insn->get_string();
-            if (perf_sensitive) {
-              perf_sensitive_strings.update(
-                  str,
-                  [dexnr](const DexString*,
-                          std::unordered_set<size_t>& s,
-                          bool /* exists */) { s.emplace(dexnr); });
-            } else {
-              occurrences.update(str,
-                                 [dexnr](const DexString*,
-                                         std::unordered_map<size_t, size_t>& m,
-                                         bool /* exists */) { ++m[dexnr]; });
-            }
+DedupStrings::Occurrences DedupStrings::get_occurrences(
+    DexClassesVector& dexen,
+    const std::unordered_set<const DexMethod*>& perf_sensitive_methods) {
+  // First, each dex counts its own const-string loads, separately for perf
+  // sensitive methods, whose strings we won't attempt to dedup.
+  struct DexLoads {
+    std::unordered_map<const DexString*, uint32_t> loads;
+    std::unordered_set<const DexString*> perf_sensitive_loads;
+    std::vector<const DexString*> non_load_strings;
+  };
+  std::vector<DexLoads> dex_loads(dexen.size());
+  workqueue_run_for<size_t>(0, dexen.size(), [&](size_t dexnr) {
+    auto& dl = dex_loads[dexnr];
+    dl.non_load_strings = gather_non_load_strings(dexen[dexnr]);
+    walk::code(dexen[dexnr], [&](DexMethod* method, IRCode& code) {
+      const auto perf_sensitive = perf_sensitive_methods.count(method) != 0;
+      for (auto& mie : InstructionIterable(code)) {
+        const auto insn = mie.insn;
+        if (insn->opcode() == OPCODE_CONST_STRING) {
+          const auto str = insn->get_string();
+          if (perf_sensitive) {
+            dl.perf_sensitive_loads.insert(str);
+          } else {
+            ++dl.loads[str];
           }
         }
-      });
-
-  // Also, add all the strings that occurred in perf-sensitive methods
-  // to the non_load_strings datastructure, as we won't attempt to dedup them.
-  for (const auto& it : perf_sensitive_strings) {
-    const auto str = it.first;
-    TRACE(DS, 3, "[dedup strings] perf sensitive string: {%s}", SHOW(str));
-
-    const auto& dexes = it.second;
-    for (const auto dexnr : dexes) {
-      auto& strings = non_load_strings[dexnr];
-      strings.emplace(str);
+      }
+    });
+  });
+
+  // Then we number all loaded strings.
+  Occurrences occurrences;
+  std::unordered_map<const DexString*, StringId> string_ids;
+  auto get_id = [&](const DexString* str) {
+    auto [it, emplaced] =
+        string_ids.emplace(str, occurrences.strings.size());
+    if (emplaced) {
+      occurrences.strings.push_back(str);
+    }
+    return it->second;
+  };
+  for (auto& dl : dex_loads) {
+    for (const auto& [str, count] : dl.loads) {
+      get_id(str);
+    }
+    for (const auto* str : dl.perf_sensitive_loads) {
+      get_id(str);
+    }
+  }
+  always_assert(occurrences.strings.size() < 0xFFFFFFFF);
+  const size_t num_strings = occurrences.strings.size();
+
+  // Now each dex can turn its strings into bitsets.
+  occurrences.non_load_strings.resize(dexen.size());
+  std::vector<boost::dynamic_bitset<>> perf_sensitive_strings(dexen.size());
+  workqueue_run_for<size_t>(0, dexen.size(), [&](size_t dexnr) {
+    const auto& dl = dex_loads[dexnr];
+    auto& non_load_strings = occurrences.non_load_strings[dexnr];
+    non_load_strings.resize(num_strings);
+    for (const auto* str : dl.non_load_strings) {
+      auto it = string_ids.find(str);
+      if (it != string_ids.end()) {
+        non_load_strings.set(it->second);
+      }
+    }
+    // Also, add all the strings that occurred in perf-sensitive methods
+    // to the non-load strings, as we won't attempt to dedup them.
+    auto& perf_sensitive = perf_sensitive_strings[dexnr];
+    perf_sensitive.resize(num_strings);
+    for (const auto* str : dl.perf_sensitive_loads) {
+      TRACE(DS, 3, "[dedup strings] perf sensitive string: {%s}", SHOW(str));
+      perf_sensitive.set(string_ids.at(str));
+    }
+    non_load_strings |= perf_sensitive;
+  });
+
+  // Finally, we group the loads by string.
+  occurrences.offsets.assign(num_strings + 1, 0);
+  for (const auto& dl : dex_loads) {
+    for (const auto& [str, count] : dl.loads) {
+      ++occurrences.offsets[string_ids.at(str) + 1];
+    }
+  }
+  for (size_t id = 0; id < num_strings; ++id) {
+    occurrences.offsets[id + 1] += occurrences.offsets[id];
+  }
+  occurrences.loads.resize(occurrences.offsets.back());
+  std::vector<uint32_t> next(occurrences.offsets.begin(),
+                             occurrences.offsets.end() - 1);
+  for (size_t dexnr = 0; dexnr < dexen.size(); ++dexnr) {
+    for (const auto& [str, count] : dex_loads[dexnr].loads) {
+      occurrences.loads[next[string_ids.at(str)]++] = {dexnr, count};
     }
   }
 
-  m_stats.perf_sensitive_strings = perf_sensitive_strings.size();
-  m_stats.non_perf_sensitive_strings = occurrences.size();
+  boost::dynamic_bitset<> any_perf_sensitive(num_strings);
+  for (const auto& perf_sensitive : perf_sensitive_strings) {
+    any_perf_sensitive |= perf_sensitive;
+  }
+  m_stats.perf_sensitive_strings = any_perf_sensitive.count();
+  size_t non_perf_sensitive_strings = 0;
+  for (size_t id = 0; id < num_strings; ++id) {
+    if (occurrences.offsets[id] != occurrences.offsets[id + 1]) {
+      ++non_perf_sensitive_strings;
+    }
+  }
+  m_stats.non_perf_sensitive_strings = non_perf_sensitive_strings;
   return occurrences;
 }
 
-std::unordered_map<const DexString*, DedupStrings::DedupStringInfo>
-DedupStrings::get_strings_to_dedup(
+DedupStrings::StringsToDedup DedupStrings::get_strings_to_dedup(
     DexClassesVector& dexen,
-    const ConcurrentMap<const DexString*, std::unordered_map<size_t, size_t>>&
-        occurrences,
-    std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
-    std::unordered_set<const DexMethod*>& perf_sensitive_methods,
-    const std::unordered_set<const DexString*> non_load_strings[]) {
+    const Occurrences& occurrences,
+    std::unordered_set<const DexMethod*>& perf_sensitive_methods) {
   // Use heuristics to determine which strings to dedup, create factory
   // methods as appropriate, and persist relevant information to aid the later
   // rewriting of all const-string instructions.
 
-  std::unordered_map<const DexString*, DedupStrings::DedupStringInfo>
-      strings_to_dedup;
+  StringsToDedup strings_to_dedup;
+  auto& infos = strings_to_dedup.infos;
+  strings_to_dedup.dexes_to_dedup.assign(
+      dexen.size(), boost::dynamic_bitset<>(occurrences.strings.size()));
+  const auto& non_load_strings = occurrences.non_load_strings;
 
   // Do a cost/benefit analysis to figure out which strings to access via
   // factory methods, and where to put to the factory method
   std::vector<const DexString*> strings_in_dexes[dexen.size()];
   std::unordered_set<size_t> hosting_dexnrs;
-  std::vector<const DexString*> ordered_strings;
-  ordered_strings.reserve(occurrences.size());
-  for (auto& p : occurrences) {
-    const auto& m = p.second;
-    always_assert(!m.empty());
-    if (m.size() == 1) continue;
-    ordered_strings.push_back(p.first);
+  std::vector<StringId> ordered_strings;
+  for (StringId id = 0; id < occurrences.strings.size(); ++id) {
+    if (occurrences.offsets[id + 1] - occurrences.offsets[id] > 1) {
+      ordered_strings.push_back(id);
+    }
   }
-  std::sort(ordered_strings.begin(), ordered_strings.end(), compare_dexstrings);
-  for (auto* s : ordered_strings) {
+  std::sort(ordered_strings.begin(), ordered_strings.end(),
+            [&](StringId a, StringId b) {
+              return compare_dexstrings(occurrences.strings[a],
+                                        occurrences.strings[b]);
+            });
+  // The loads of the current string in each dex.
+  std::vector<size_t> loads_by_dex(dexen.size(), 0);
+  for (auto id : ordered_strings) {
     // We are going to look at the situation of a particular string here
-    const auto& m = occurrences.at_unsafe(s);
-    always_assert(m.size() > 1);
+    const auto* s = occurrences.strings[id];
+    const auto* m_begin = occurrences.loads.data() + occurrences.offsets[id];
+    const auto* m_end = occurrences.loads.data() + occurrences.offsets[id + 1];
+    for (const auto* q = m_begin; q != m_end; ++q) {
+      loads_by_dex[q->first] = q->second;
+    }
     const auto entry_size = s->get_entry_size();
-    const auto get_size_reduction = [entry_size, non_load_strings](
-                                        const DexString* str, size_t dexnr,
-                                        size_t loads) -> size_t {
-      const auto has_non_load_string = non_load_strings[dexnr].count(str) != 0;
+    const auto get_size_reduction = [entry_size, id, &non_load_strings](
+                                        size_t dexnr, size_t loads) -> size_t {
+      const auto has_non_load_string = non_load_strings[dexnr].test(id);
       if (has_non_load_string) {
         // If there's a non-load string, there's nothing to gain
         return 0;
@@ -381,12 +404,11 @@ DedupStrings::get_strings_to_dedup(
       }
 
       // So this dex could host the current string s
-      const auto mit = m.find(dexnr);
-      const auto loads = mit == m.end() ? 0 : mit->second;
+      const auto loads = loads_by_dex[dexnr];
       // Figure out what the size reduction would be if this dex would *not*
       // be hosting string s, also considering whether we'd keep around a copy
       // of the string in this dex anyway
-      const auto size_reduction = get_size_reduction(s, dexnr, loads);
+      const auto size_reduction = get_size_reduction(dexnr, loads);
       if (!host_info || size_reduction < host_info->size_reduction) {
         TRACE(DS, 4,
               "[dedup strings] non perf sensitive string: {%s} dex #%zu can "
@@ -401,6 +423,10 @@ DedupStrings::get_strings_to_dedup(
       }
     }
 
+    for (const auto* q = m_begin; q != m_end; ++q) {
+      loads_by_dex[q->first] = 0;
+    }
+
     // We have a zero max_cost if and only if we didn't find any suitable
     // hosting_dexnr
     if (!host_info) {
@@ -414,17 +440,17 @@ DedupStrings::get_strings_to_dedup(
     // instructions rewritten
     size_t total_size_reduction = 0;
     size_t duplicate_string_loads = 0;
-    std::unordered_set<size_t> dexes_to_dedup;
-    for (const auto& q : m) {
-      const auto dexnr = q.first;
-      const auto loads = q.second;
+    std::vector<size_t> dexes_to_dedup;
+    for (const auto* q = m_begin; q != m_end; ++q) {
+      const auto dexnr = q->first;
+      const auto loads = q->second;
       if (dexnr == hosting_dexnr) {
         continue;
       }
 
-      const auto size_reduction = get_size_reduction(s, dexnr, loads);
+      const auto size_reduction = get_size_reduction(dexnr, loads);
 
-      if (non_load_strings[dexnr].count(s) != 0) {
+      if (non_load_strings[dexnr].test(id)) {
         always_assert(size_reduction == 0);
         TRACE(DS, 4,
               "[dedup strings] non perf sensitive string: {%s}*%zu is a "
@@ -439,7 +465,7 @@ DedupStrings::get_strings_to_dedup(
       if (size_reduction > 0) {
         duplicate_string_loads += loads;
         total_size_reduction += size_reduction;
-        dexes_to_dedup.emplace(dexnr);
+        dexes_to_dedup.push_back(dexnr);
       }
     }
 
@@ -475,9 +501,12 @@ DedupStrings::get_strings_to_dedup(
     m_stats.expected_size_reduction +=
         total_size_reduction - hosting_code_size_increase;
     DedupStringInfo dedup_string_info;
+    dedup_string_info.id = id;
     dedup_string_info.duplicate_string_loads = duplicate_string_loads;
-    dedup_string_info.dexes_to_dedup = dexes_to_dedup;
-    strings_to_dedup.emplace(s, std::move(dedup_string_info));
+    for (auto dexnr : dexes_to_dedup) {
+      strings_to_dedup.dexes_to_dedup[dexnr].set(id);
+    }
+    infos.emplace(s, dedup_string_info);
     strings_in_dexes[hosting_dexnr].push_back(s);
 
     TRACE(DS, 3,
@@ -498,9 +527,9 @@ DedupStrings::get_strings_to_dedup(
     }
     std::sort(
         strings.begin(), strings.end(),
-        [&strings_to_dedup](const DexString* a, const DexString* b) -> bool {
-          auto a_loads = strings_to_dedup[a].duplicate_string_loads;
-          auto b_loads = strings_to_dedup[b].duplicate_string_loads;
+        [&infos](const DexString* a, const DexString* b) -> bool {
+          auto a_loads = infos.at(a).duplicate_string_loads;
+          auto b_loads = infos.at(b).duplicate_string_loads;
           if (a_loads != b_loads) {
             return a_loads > b_loads;
           }
@@ -511,7 +540,7 @@ DedupStrings::get_strings_to_dedup(
     always_assert(strings.size() < 0xFFFFFFFF);
     for (uint32_t i = 0; i < strings.size(); i++) {
       auto const s = strings[i];
-      auto& info = strings_to_dedup[s];
+      auto& info = infos.at(s);
 
       TRACE(
           DS, 2,
@@ -523,7 +552,6 @@ DedupStrings::get_strings_to_dedup(
       info.index = i;
       info.const_string_method = const_string_method;
     }
-    methods_to_dex.insert({const_string_method, dexnr});
     perf_sensitive_methods.emplace(const_string_method);
     m_stats.factory_methods++;
   }
@@ -532,27 +560,37 @@ DedupStrings::get_strings_to_dedup(
 }
 
 void DedupStrings::rewrite_const_string_instructions(
-    const Scope& scope,
-    const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
+    const DexClassesVector& dexen,
     const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
-    const std::unordered_map<const DexString*, DedupStrings::DedupStringInfo>&
-        strings_to_dedup,
+    const StringsToDedup& strings_to_dedup,
     std::unique_ptr<ab_test::ABExperimentContext>& ab_experiment_context) {
+  // Only the methods of dexes in which some strings get deduped need to be
+  // looked at.
+  std::vector<std::pair<DexMethod*, size_t>> methods;
+  for (size_t dexnr = 0; dexnr < dexen.size(); ++dexnr) {
+    if (strings_to_dedup.dexes_to_dedup[dexnr].none()) {
+      continue;
+    }
+    walk::code(dexen[dexnr], [&](DexMethod* method, IRCode&) {
+      // We don't rewrite methods in the primary dex or other perf-sensitive
+      // methods.
+      if (perf_sensitive_methods.count(method) == 0) {
+        methods.emplace_back(method, dexnr);
+      }
+    });
+  }
 
-  walk::parallel::code(
-      scope, [&methods_to_dex, &strings_to_dedup, &perf_sensitive_methods,
-              &ab_experiment_context](DexMethod* method, IRCode& code) {
-        if (perf_sensitive_methods.count(method) != 0) {
-          // We don't rewrite methods in the primary dex or other perf-sensitive
-          // methods.
-          return;
-        }
-
-        const auto dexnr = methods_to_dex.at(method);
+  const auto& infos = strings_to_dedup.infos;
+  workqueue_run<std::pair<DexMethod*, size_t>>(
+      [&infos, &strings_to_dedup,
+       &ab_experiment_context](const std::pair<DexMethod*, size_t>& p) {
+        auto* method = p.first;
+        const auto dexnr = p.second;
+        const auto& dexes_to_dedup = strings_to_dedup.dexes_to_dedup[dexnr];
 
         // First, we collect all const-string instructions that we want to
         // rewrite
-        cfg::ScopedCFG cfg(&code);
+        cfg::ScopedCFG cfg(method->get_code());
         auto ii = cfg::InstructionIterable(*cfg);
         std::vector<std::pair<cfg::InstructionIterator, const DedupStringInfo*>>
             const_strings;
@@ -564,13 +602,13 @@ void DedupStrings::rewrite_const_string_instructions(
           }
 
           // We we rewrite this particular instruction?
-          const auto it2 = strings_to_dedup.find(insn->get_string());
-          if (it2 == strings_to_dedup.end()) {
+          const auto it2 = infos.find(insn->get_string());
+          if (it2 == infos.end()) {
             continue;
           }
 
           const auto& info = it2->second;
-          if (info.dexes_to_dedup.count(dexnr) == 0) {
+          if (!dexes_to_dedup.test(info.id)) {
             continue;
           }
 
@@ -628,7 +666,8 @@ void DedupStrings::rewrite_const_string_instructions(
           cfg_mut.replace(const_string_it, replacements);
         }
         cfg_mut.flush();
-      });
+      },
+      methods);
 }
 
 // In each dex, we might introduce as many new method refs and type refs as we
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <boost/dynamic_bitset.hpp>
+
 #include "ABExperimentContext.h"
 #include "InterDexPass.h"
 #include "Pass.h"
@@ -50,43 +52,55 @@ class DedupStrings {
       std::unique_ptr<ab_test::ABExperimentContext>& ab_experiment_context);
 
  private:
+  // Strings loaded by const-string instructions are identified by dense ids,
+  // so that per-dex sets of them can be bitsets.
+  using StringId = uint32_t;
+
   struct DedupStringInfo {
+    StringId id;
     size_t duplicate_string_loads;
-    std::unordered_set<size_t> dexes_to_dedup;
 
     uint32_t index{0xFFFFFFFF};
     DexMethod* const_string_method{nullptr};
   };
 
-  std::unordered_map<const DexMethod*, size_t> get_methods_to_dex(
-      const DexClassesVector& dexen);
+  struct Occurrences {
+    // All strings loaded in some dex, by id.
+    std::vector<const DexString*> strings;
+    // The loads of string `id` outside of perf sensitive methods are the
+    // (dexnr, count) pairs in loads[offsets[id]] to loads[offsets[id + 1]],
+    // in increasing dex order.
+    std::vector<uint32_t> offsets;
+    std::vector<std::pair<uint32_t, uint32_t>> loads;
+    // For each dex, the strings that it references anyway, other than by
+    // const-string instructions in non perf sensitive methods.
+    std::vector<boost::dynamic_bitset<>> non_load_strings;
+  };
+
+  struct StringsToDedup {
+    std::unordered_map<const DexString*, DedupStringInfo> infos;
+    // For each dex, the strings whose loads get rewritten there.
+    std::vector<boost::dynamic_bitset<>> dexes_to_dedup;
+  };
+
   std::unordered_set<const DexMethod*> get_perf_sensitive_methods(
       const DexClassesVector& dexen);
   DexMethod* make_const_string_loader_method(
       DexClasses& dex,
       size_t dex_id,
       const std::vector<const DexString*>& strings);
-  void gather_non_load_strings(DexClasses& classes,
-                               std::unordered_set<const DexString*>* strings);
-  ConcurrentMap<const DexString*, std::unordered_map<size_t, size_t>>
-  get_occurrences(
-      const Scope& scope,
-      const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
-      const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
-      std::unordered_set<const DexString*> non_load_strings[]);
-  std::unordered_map<const DexString*, DedupStringInfo> get_strings_to_dedup(
+  std::vector<const DexString*> gather_non_load_strings(DexClasses& classes);
+  Occurrences get_occurrences(
+      DexClassesVector& dexen,
+      const std::unordered_set<const DexMethod*>& perf_sensitive_methods);
+  StringsToDedup get_strings_to_dedup(
       DexClassesVector& dexen,
-      const ConcurrentMap<const DexString*, std::unordered_map<size_t, size_t>>&
-          occurrences,
-      std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
-      std::unordered_set<const DexMethod*>& perf_sensitive_methods,
-      const std::unordered_set<const DexString*> non_load_strings[]);
+      const Occurrences& occurrences,
+      std::unordered_set<const DexMethod*>& perf_sensitive_methods);
   void rewrite_const_string_instructions(
-      const Scope& scope,
-      const std::unordered_map<const DexMethod*, size_t>& methods_to_dex,
+      const DexClassesVector& dexen,
       const std::unordered_set<const DexMethod*>& perf_sensitive_methods,
-      const std::unordered_map<const DexString*, DedupStringInfo>&
-          strings_to_dedup,
+      const StringsToDedup& strings_to_dedup,
       std::unique_ptr<ab_test::ABExperimentContext>& ab_experiment_context);
 
   mutable Stats m_stats;
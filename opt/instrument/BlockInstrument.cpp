@@ -20,6 +20,7 @@
 #include "SourceBlocks.h"
 #include "TypeSystem.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 #include <boost/algorithm/string/join.hpp>
 #include <fstream>
@@ -1122,8 +1123,44 @@ std::vector<IRInstruction*> insert_hit_count_insts(
   return invokes;
 }
 
+// The blocks of a method to instrument. They determine how much space the
+// method takes in the stats arrays, and so the offsets of the next methods.
+struct MethodBlocks {
+  std::vector<BlockInfo> blocks;
+  size_t num_to_instrument{0};
+  size_t num_instrument_hit_blocks{0};
+  bool too_many_blocks{false};
+  std::string before_cfg;
+
+  size_t num_vectors() const {
+    return std::ceil(num_to_instrument / double(BIT_VECTOR_SIZE));
+  }
+};
+
+// Step 1: Get sorted basic blocks to instrument with their information.
+//
+// The blocks are sorted in RPO. We don't instrument entry blocks. If too many
+// blocks, it falls back to empty blocks, which is method tracing.
+//
+// This builds the CFG of the method, which instrument_basic_blocks clears.
+MethodBlocks get_method_blocks(IRCode& code,
+                               const DexMethod* method,
+                               const size_t max_num_blocks,
+                               const InstrumentPass::Options& options) {
+  code.build_cfg(/*editable*/ true);
+  const auto& cfg = code.cfg();
+
+  MethodBlocks res;
+  res.before_cfg = traceEnabled(INSTRUMENT, 7) ? show(cfg) : std::string("");
+  std::tie(res.blocks, res.num_to_instrument, res.num_instrument_hit_blocks,
+           res.too_many_blocks) =
+      get_blocks_to_instrument(method, cfg, max_num_blocks, options);
+  return res;
+}
+
 MethodInfo instrument_basic_blocks(IRCode& code,
                                    DexMethod* method,
+                                   MethodBlocks method_blocks,
                                    DexMethod* onMethodBegin,
                                    const OnMethodExitMap& onMethodExit_map,
                                    DexMethod* onBlockHit,
@@ -1132,7 +1169,6 @@ MethodInfo instrument_basic_blocks(IRCode& code,
                                    const size_t max_vector_arity_hit,
                                    const size_t method_offset,
                                    const size_t hit_offset,
-                                   const size_t max_num_blocks,
                                    MultiMethodInliner& inliner,
                                    const InstrumentPass::Options& options) {
   MethodInfo info;
@@ -1140,24 +1176,15 @@ MethodInfo instrument_basic_blocks(IRCode& code,
 
   using namespace cfg;
 
-  code.build_cfg(/*editable*/ true);
   ControlFlowGraph& cfg = code.cfg();
 
-  std::string before_cfg =
-      traceEnabled(INSTRUMENT, 7) ? show(cfg) : std::string("");
-
-  // Step 1: Get sorted basic blocks to instrument with their information.
-  //
-  // The blocks are sorted in RPO. We don't instrument entry blocks. If too many
-  // blocks, it falls back to empty blocks, which is method tracing.
-  std::vector<BlockInfo> blocks;
-  size_t num_to_instrument;
-  size_t num_instrument_hit_blocks;
+  auto& blocks = method_blocks.blocks;
+  const std::string& before_cfg = method_blocks.before_cfg;
+  const size_t num_to_instrument = method_blocks.num_to_instrument;
+  const size_t num_instrument_hit_blocks =
+      method_blocks.num_instrument_hit_blocks;
+  const bool too_many_blocks = method_blocks.too_many_blocks;
   size_t num_instrument_loop_blocks = 0;
-  bool too_many_blocks;
-  std::tie(blocks, num_to_instrument, num_instrument_hit_blocks,
-           too_many_blocks) =
-      get_blocks_to_instrument(method, cfg, max_num_blocks, options);
 
   TRACE(INSTRUMENT, DEBUG_CFG ? 0 : 10, "BEFORE: %s, %s\n%s",
         show_deobfuscated(method).c_str(), SHOW(method), SHOW(cfg));
@@ -1202,8 +1229,7 @@ MethodInfo instrument_basic_blocks(IRCode& code,
   //         allocation code in its method entry point.
   //
   const size_t origin_num_non_entry_blocks = cfg.num_blocks() - 1;
-  const size_t num_vectors =
-      std::ceil(num_to_instrument / double(BIT_VECTOR_SIZE));
+  const size_t num_vectors = method_blocks.num_vectors();
 
   std::vector<reg_t> reg_vectors;
   std::vector<short> loop_shorts(num_vectors);
@@ -1849,9 +1875,10 @@ void BlockInstrumentHelper::do_basic_block_tracing(
     inliner.inline_callees(en.second, insns);
   }
 
+  // Select the methods to instrument in walk order, which determines their
+  // offsets in the stats arrays.
+  std::vector<std::pair<DexMethod*, IRCode*>> to_instrument;
   walk::code(scope, [&](DexMethod* method, IRCode& code) {
-    TraceContext trace_context(method);
-
     all_methods++;
     if (method == analysis_cls->get_clinit() || method == onMethodBegin ||
         method == onBlockHit || method == binaryIncrementer) {
@@ -1895,23 +1922,47 @@ void BlockInstrumentHelper::do_basic_block_tracing(
       return;
     }
 
-    instrumented_methods.emplace_back(instrument_basic_blocks(
-        code, method, onMethodBegin, onMethodExit_map, onBlockHit,
-        onNonLoopBlockHit_map, max_vector_arity, max_vector_arity_other,
-        method_offset, hit_offset, max_num_blocks, inliner, options));
+    to_instrument.emplace_back(method, &code);
+  });
+
+  // The blocks to instrument are found in parallel. Then the offsets are
+  // assigned in walk order, and the methods are rewritten in parallel.
+  std::vector<MethodBlocks> method_blocks(to_instrument.size());
+  workqueue_run_for<size_t>(0, to_instrument.size(), [&](size_t i) {
+    auto [method, code] = to_instrument[i];
+    TraceContext trace_context(method);
+    method_blocks[i] =
+        get_method_blocks(*code, method, max_num_blocks, options);
+  });
+
+  std::vector<std::pair<size_t, size_t>> offsets;
+  offsets.reserve(to_instrument.size());
+  for (const auto& mb : method_blocks) {
+    offsets.emplace_back(method_offset, hit_offset);
+    // Update method offset for next method. 2 shorts are for method stats.
+    method_offset += 2 + mb.num_vectors();
+    hit_offset += mb.num_instrument_hit_blocks;
+  }
+
+  instrumented_methods.resize(to_instrument.size());
+  workqueue_run_for<size_t>(0, to_instrument.size(), [&](size_t i) {
+    auto [method, code] = to_instrument[i];
+    TraceContext trace_context(method);
+    instrumented_methods[i] = instrument_basic_blocks(
+        *code, method, std::move(method_blocks[i]), onMethodBegin,
+        onMethodExit_map, onBlockHit, onNonLoopBlockHit_map, max_vector_arity,
+        max_vector_arity_other, offsets[i].first, offsets[i].second, inliner,
+        options);
+  });
 
-    const auto& method_info = instrumented_methods.back();
+  for (const auto& method_info : instrumented_methods) {
     if (method_info.too_many_blocks) {
       TRACE(INSTRUMENT, 7, "Too many blocks: %s",
-            SHOW(show_deobfuscated(method)));
+            SHOW(show_deobfuscated(method_info.method)));
     } else {
       block_instrumented++;
     }
-
-    // Update method offset for next method. 2 shorts are for method stats.
-    method_offset += 2 + method_info.num_vectors;
-    hit_offset += method_info.num_hit_blocks;
-  });
+  }
 
   // Destroy the CFG because we are done Instrumenting
   if (options.inline_onBlockHit) {
@@ -8,6 +8,7 @@
 #include <list>
 
 #include "ClassHierarchy.h"
+#include "ConcurrentContainers.h"
 #include "DexClass.h"
 #include "DexUtil.h"
 #include "IRCode.h"
@@ -73,57 +74,65 @@ void debug_logging(std::vector<DexClass*>& classes) {
   TRACE(OBFUSCATE, 3, "Finished applying new names to defs");
 }
 
-template <typename DexMember,
-          typename DexMemberRef,
-          typename DexMemberSpec,
-          typename K>
-DexMember* find_renamable_ref(
-    DexMemberRef* ref,
-    std::unordered_map<DexMemberRef*, DexMember*>& ref_def_cache,
-    DexElemManager<DexMember*, DexMemberRef*, DexMemberSpec, K>& name_mapping) {
-  TRACE(OBFUSCATE, 4, "Found a ref opcode");
-  DexMember* def = nullptr;
-  auto member_itr = ref_def_cache.find(ref);
-  if (member_itr != ref_def_cache.end()) {
-    def = member_itr->second;
-  } else {
-    def = name_mapping.def_of_ref(ref);
-  }
-  ref_def_cache[ref] = def;
-  return def;
+// We only check invoke-direct and invoke-static because the method defs we
+// rename are `dmethod`s, not `vmethod`s.
+//
+// If we attempted to resolve invoke-virtual refs here, we would conflate this
+// virtual ref with a direct def that happens to have the same name but isn't
+// actually inherited.
+bool may_refer_to_renamed_dmethod(const IRInstruction* instr) {
+  auto op = instr->opcode();
+  return instr->has_method() &&
+         (opcode::is_invoke_direct(op) || opcode::is_invoke_static(op));
 }
 
 void update_refs(Scope& scope,
                  DexFieldManager& field_name_mapping,
                  DexMethodManager& method_name_mapping) {
-  std::unordered_map<DexFieldRef*, DexField*> f_ref_def_cache;
-  std::unordered_map<DexMethodRef*, DexMethod*> m_ref_def_cache;
-  walk::opcodes(scope, [&](DexMethod*, IRInstruction* instr) {
-    auto op = instr->opcode();
+  // Collect the refs in parallel, and resolve each of them once. The name
+  // managers are not safe for concurrent lookups.
+  ConcurrentSet<DexFieldRef*> field_refs;
+  ConcurrentSet<DexMethodRef*> method_refs;
+  walk::parallel::opcodes(scope, [&](DexMethod*, IRInstruction* instr) {
+    if (instr->has_field()) {
+      if (!instr->get_field()->is_def()) {
+        field_refs.insert(instr->get_field());
+      }
+    } else if (may_refer_to_renamed_dmethod(instr)) {
+      if (!instr->get_method()->is_def()) {
+        method_refs.insert(instr->get_method());
+      }
+    }
+  });
+
+  std::unordered_map<DexFieldRef*, DexField*> field_defs;
+  for (auto* field_ref : field_refs) {
+    if (auto* field_def = field_name_mapping.def_of_ref(field_ref)) {
+      TRACE(OBFUSCATE, 4, "Found a ref to fixup %s", SHOW(field_ref));
+      field_defs.emplace(field_ref, field_def);
+    }
+  }
+  std::unordered_map<DexMethodRef*, DexMethod*> method_defs;
+  for (auto* method_ref : method_refs) {
+    if (auto* method_def = method_name_mapping.def_of_ref(method_ref)) {
+      TRACE(OBFUSCATE, 4, "Found a ref to fixup %s", SHOW(method_ref));
+      method_defs.emplace(method_ref, method_def);
+    }
+  }
+  if (field_defs.empty() && method_defs.empty()) {
+    return;
+  }
+
+  walk::parallel::opcodes(scope, [&](DexMethod*, IRInstruction* instr) {
     if (instr->has_field()) {
-      DexFieldRef* field_ref = instr->get_field();
-      if (field_ref->is_def()) return;
-      DexField* field_def =
-          find_renamable_ref(field_ref, f_ref_def_cache, field_name_mapping);
-      if (field_def != nullptr) {
-        TRACE(OBFUSCATE, 4, "Found a ref to fixup %s", SHOW(field_ref));
-        instr->set_field(field_def);
+      auto it = field_defs.find(instr->get_field());
+      if (it != field_defs.end()) {
+        instr->set_field(it->second);
       }
-    } else if (instr->has_method() &&
-               (opcode::is_invoke_direct(op) || opcode::is_invoke_static(op))) {
-      // We only check invoke-direct and invoke-static because the method def
-      // we've renamed is a `dmethod`, not a `vmethod`.
-      //
-      // If we attempted to resolve invoke-virtual refs here, we would
-      // conflate this virtual ref with a direct def that happens to have the
-      // same name but isn't actually inherited.
-      DexMethodRef* method_ref = instr->get_method();
-      if (method_ref->is_def()) return;
-      DexMethod* method_def =
-          find_renamable_ref(method_ref, m_ref_def_cache, method_name_mapping);
-      if (method_def != nullptr) {
-        TRACE(OBFUSCATE, 4, "Found a ref to fixup %s", SHOW(method_ref));
-        instr->set_method(method_def);
+    } else if (may_refer_to_renamed_dmethod(instr)) {
+      auto it = method_defs.find(instr->get_method());
+      if (it != method_defs.end()) {
+        instr->set_method(it->second);
       }
     }
   });
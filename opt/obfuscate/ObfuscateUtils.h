@@ -562,6 +562,8 @@ class DexElemManager {
   // of elements renamed
   int commit_renamings_to_dex() {
     std::unordered_set<T> renamed_elems;
+    // Methods are renamed at once, which is cheaper than one by one.
+    std::vector<std::pair<DexMethodRef*, DexMethodSpec>> method_changes;
     int renamings = 0;
     for (auto& class_itr : this->elements) {
       for (auto& type_itr : class_itr.second) {
@@ -587,12 +589,17 @@ class DexElemManager {
                   SHOW(elem));
           }
           renamed_elems.insert(elem);
-          elem->change(ref_getter_fn(wrap->get_name()),
-                       false /* rename on collision */);
+          if constexpr (std::is_same_v<T, DexMethod*>) {
+            method_changes.emplace_back(elem, ref_getter_fn(wrap->get_name()));
+          } else {
+            elem->change(ref_getter_fn(wrap->get_name()),
+                         false /* rename on collision */);
+          }
           renamings++;
         }
       }
     }
+    DexMethodRef::change_all(method_changes, false /* rename on collision */);
     return renamings;
   }
 
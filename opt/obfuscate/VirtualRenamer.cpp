@@ -6,6 +6,7 @@
  */
 
 #include "VirtualRenamer.h"
+#include "ConcurrentContainers.h"
 #include "DexAccess.h"
 #include "DexClass.h"
 #include "DexUtil.h"
@@ -15,6 +16,7 @@
 #include "Trace.h"
 #include "VirtualScope.h"
 #include "Walkers.h"
+#include "WorkQueue.h"
 
 #include <map>
 #include <set>
@@ -102,9 +104,50 @@ DexMethod* find_method(const DexClass* cls,
 };
 
 // keep a map from defs to all refs resolving to that def
-using RefsMap =
-    std::unordered_map<DexMethod*,
-                       std::set<DexMethodRef*, dexmethods_comparator>>;
+using RefSet = std::set<DexMethodRef*, dexmethods_comparator>;
+using RefsMap = std::unordered_map<DexMethod*, RefSet>;
+
+// Maps a fully qualified method name (sans parameters) to its ref count, see
+// VirtualRenamer::stack_trace_elements. Entries whose count dropped to 0 are
+// kept, as ConcurrentMap::update cannot remove them, and count as absent.
+using StackTraceElements = ConcurrentMap<std::string, uint32_t>;
+
+/**
+ * The renamings that have been decided on but not applied yet. Renaming all
+ * the methods at once is much cheaper than one at a time. Until then, the
+ * methods keep their old names.
+ */
+class PendingRenames {
+ public:
+  void add(DexMethodRef* meth, const DexString* name) {
+    DexMethodSpec spec;
+    spec.cls = meth->get_class();
+    spec.name = name;
+    spec.proto = meth->get_proto();
+    auto [it, inserted] = m_index.emplace(meth, m_changes.size());
+    if (inserted) {
+      m_changes.emplace_back(meth, spec);
+    } else {
+      m_changes[it->second].second = spec;
+    }
+  }
+
+  void append(const PendingRenames& other) {
+    for (const auto& [meth, spec] : other.m_changes) {
+      add(meth, spec.name);
+    }
+  }
+
+  void apply() {
+    DexMethodRef::change_all(m_changes, false /* rename on collision */);
+    m_changes.clear();
+    m_index.clear();
+  }
+
+ private:
+  std::vector<std::pair<DexMethodRef*, DexMethodSpec>> m_changes;
+  std::unordered_map<DexMethodRef*, size_t> m_index;
+};
 
 // Uncomment and use this as a prefix for virtual method
 // names for debugging
@@ -124,7 +167,7 @@ struct VirtualRenamer {
   VirtualRenamer(
       const ClassScopes& class_scopes,
       const RefsMap& def_refs,
-      std::unordered_map<std::string, uint32_t>* elms,
+      StackTraceElements* elms,
       std::unordered_map<const DexType*, std::string>* cache,
       const std::unordered_map<const DexClass*, int>& next_dmethod_seeds)
       : class_scopes(class_scopes),
@@ -133,8 +176,13 @@ struct VirtualRenamer {
         external_name_cache(cache),
         next_dmethod_seeds(next_dmethod_seeds) {}
 
-  int rename_virtual_scopes(const DexType* type, int& seed);
-  int rename_interface_scopes(int& seed);
+  int rename_virtual_scopes(const DexType* type,
+                            int& seed,
+                            PendingRenames& renames) const;
+  int rename_virtual_scopes_in_parallel(const DexType* type,
+                                        int& seed,
+                                        PendingRenames& renames) const;
+  int rename_interface_scopes(int& seed, PendingRenames& renames) const;
 
  private:
   const ClassScopes& class_scopes;
@@ -145,12 +193,13 @@ struct VirtualRenamer {
   // in ART this is called a stack trace element). As methods are renamed
   // their ref counts get updated, and if the ref count drops to 0 then its
   // entry is erased. When avoid_stack_trace_collision is false then this is
-  // null and collision avoidance is disabled.
-  std::unordered_map<std::string, uint32_t>* stack_trace_elements;
+  // null and collision avoidance is disabled. Disjoint hierarchies, which are
+  // renamed in parallel, have disjoint stack trace elements.
+  StackTraceElements* stack_trace_elements;
   // Note these entries contain trailing periods
   std::unordered_map<const DexType*, std::string>* external_name_cache;
   const std::unordered_map<const DexClass*, int>& next_dmethod_seeds;
-  mutable std::unordered_map<const VirtualScope*, int> next_virtualscope_seeds;
+  mutable ConcurrentMap<const VirtualScope*, int> next_virtualscope_seeds;
 
  private:
   const std::string& get_prefix(const DexType* type) const {
@@ -163,9 +212,9 @@ struct VirtualRenamer {
   // Retrieves the next seed that won't overlap with dmethods, considering all
   // classes participating in the given virtual scope
   int get_next_virtualscope_seeds(const VirtualScope* scope) const {
-    auto it = next_virtualscope_seeds.find(scope);
-    if (it != next_virtualscope_seeds.end()) {
-      return it->second;
+    int cached = next_virtualscope_seeds.get(scope, -1);
+    if (cached != -1) {
+      return cached;
     }
     int seed = 0;
     for (auto& m : scope->methods) {
@@ -178,9 +227,19 @@ struct VirtualRenamer {
     return seed;
   }
 
-  void rename(DexMethodRef* meth, const DexString* name);
-  int rename_scope_ref(DexMethod* meth, const DexString* name);
-  int rename_scope(const VirtualScope* scope, const DexString* name);
+  void rename(DexMethodRef* meth,
+              const DexString* name,
+              PendingRenames& renames) const;
+  int rename_scope_ref(DexMethod* meth,
+                       const DexString* name,
+                       PendingRenames& renames) const;
+  int rename_scope(const VirtualScope* scope,
+                   const DexString* name,
+                   PendingRenames& renames) const;
+
+  int rename_type_scopes(const DexType* type,
+                         int& seed,
+                         PendingRenames& renames) const;
 
   const DexString* get_unescaped_name(
       const std::vector<const VirtualScope*>& scopes, int& seed) const;
@@ -192,47 +251,50 @@ struct VirtualRenamer {
 /**
  * Rename a given method with the given name.
  */
-void VirtualRenamer::rename(DexMethodRef* meth, const DexString* name) {
+void VirtualRenamer::rename(DexMethodRef* meth,
+                            const DexString* name,
+                            PendingRenames& renames) const {
   // redex_assert(meth->is_concrete() && !meth->is_external());
-  DexMethodSpec spec;
-  spec.cls = meth->get_class();
-  spec.name = name;
-  spec.proto = meth->get_proto();
   if (stack_trace_elements) {
     std::string ste = get_prefix(meth->get_class()) + meth->str();
-    auto iter = stack_trace_elements->find(ste);
-    // We don't find this ste if it's a miranda method
-    if (iter != stack_trace_elements->end()) {
-      // We've found this ste, so let's decrement its ref count, and if it
-      // reaches 0 then remove it so we don't have any empty entries
-      iter->second -= 1;
-      if (iter->second == 0) {
-        stack_trace_elements->erase(iter);
-      }
-    }
+    // We don't find this ste if it's a miranda method. If we find it, let's
+    // decrement its ref count in a single atomic update.
+    stack_trace_elements->update(
+        ste, [](const std::string&, uint32_t& count, bool) {
+          if (count > 0) {
+            count--;
+          }
+        });
   }
-  meth->change(spec, false /* rename on collision */);
+  renames.add(meth, name);
 
   if (stack_trace_elements) {
     std::string ste = get_prefix(meth->get_class()) + name->str();
-    auto res = stack_trace_elements->emplace(std::move(ste), 1);
+    bool inserted = false;
+    stack_trace_elements->update(
+        ste, [&](const std::string&, uint32_t& count, bool) {
+          inserted = count == 0;
+          count++;
+        });
     // Ideally we've picked a new name that doesn't collide with any other
     // method, so this assert should never fire. We leave this here in case
     // my human brain foobarred the logic (or in a refactor some other
     // assumption e.g. thread safety are changed)
-    always_assert(res.second);
+    always_assert(inserted);
   }
 }
 
 /**
  * Rename all refs to the given method.
  */
-int VirtualRenamer::rename_scope_ref(DexMethod* meth, const DexString* name) {
+int VirtualRenamer::rename_scope_ref(DexMethod* meth,
+                                     const DexString* name,
+                                     PendingRenames& renames) const {
   int renamed = 0;
   const auto& refs = def_refs.find(meth);
   if (refs == def_refs.end()) return renamed;
   for (auto& ref : refs->second) {
-    rename(ref, name);
+    rename(ref, name, renames);
     renamed++;
   }
   return renamed;
@@ -242,10 +304,11 @@ int VirtualRenamer::rename_scope_ref(DexMethod* meth, const DexString* name) {
  * Rename an entire virtual scope.
  */
 int VirtualRenamer::rename_scope(const VirtualScope* scope,
-                                 const DexString* name) {
+                                 const DexString* name,
+                                 PendingRenames& renames) const {
   int renamed = 0;
   for (auto& vmeth : scope->methods) {
-    rename(vmeth.first, name);
+    rename(vmeth.first, name, renames);
     if (vmeth.first->is_concrete())
       renamed++;
     else {
@@ -253,7 +316,7 @@ int VirtualRenamer::rename_scope(const VirtualScope* scope,
     }
   }
   redex_assert(!scope->methods.empty());
-  rename_scope_ref(scope->methods[0].first, name);
+  rename_scope_ref(scope->methods[0].first, name, renames);
   return renamed;
 }
 
@@ -275,7 +338,7 @@ bool VirtualRenamer::usable_name(const DexString* name,
     }
     if (has_ste) {
       auto ste = get_prefix(type) + name->str();
-      if (stack_trace_elements->find(ste) != stack_trace_elements->end()) {
+      if (stack_trace_elements->get(ste, 0) != 0) {
         return false;
       }
     }
@@ -324,7 +387,8 @@ const DexString* VirtualRenamer::get_unescaped_name(
   }
 }
 
-int VirtualRenamer::rename_interface_scopes(int& seed) {
+int VirtualRenamer::rename_interface_scopes(int& seed,
+                                            PendingRenames& renames) const {
   int renamed = 0;
   class_scopes.walk_all_intf_scopes(
       [&](const DexString* name,
@@ -375,7 +439,7 @@ int VirtualRenamer::rename_interface_scopes(int& seed) {
         TRACE(OBFUSCATE, 5, "New name %s for %s%s", SHOW(new_name), SHOW(name),
               SHOW(proto));
         for (const auto& scope : scopes) {
-          renamed += rename_scope(scope, new_name);
+          renamed += rename_scope(scope, new_name, renames);
         }
         // rename interface method only
         for (const auto& intf : intfs) {
@@ -387,8 +451,8 @@ int VirtualRenamer::rename_interface_scopes(int& seed) {
                             SHOW(proto));
           TRACE(OBFUSCATE, 5, "New name %s for %s", SHOW(new_name),
                 SHOW(intf_meth));
-          rename(intf_meth, new_name);
-          rename_scope_ref(intf_meth, new_name);
+          rename(intf_meth, new_name, renames);
+          rename_scope_ref(intf_meth, new_name, renames);
           renamed++;
         }
       });
@@ -396,9 +460,12 @@ int VirtualRenamer::rename_interface_scopes(int& seed) {
 }
 
 /**
- * Rename only scopes that are not interface and can_rename.
+ * Rename the scopes rooted at the given type that are not interface and
+ * can_rename.
  */
-int VirtualRenamer::rename_virtual_scopes(const DexType* type, int& seed) {
+int VirtualRenamer::rename_type_scopes(const DexType* type,
+                                       int& seed,
+                                       PendingRenames& renames) const {
   int renamed = 0;
   const auto cls = type_class(type);
   TRACE(OBFUSCATE, 5, "Attempting to rename %s", SHOW(type));
@@ -446,9 +513,19 @@ int VirtualRenamer::rename_virtual_scopes(const DexType* type, int& seed) {
       auto name = get_unescaped_name(scope, seed);
       TRACE(OBFUSCATE, 5, "New name %s for %s", SHOW(name),
             SHOW(scope->methods[0].first));
-      renamed += rename_scope(scope, name);
+      renamed += rename_scope(scope, name, renames);
     }
   }
+  return renamed;
+}
+
+/**
+ * Rename only scopes that are not interface and can_rename.
+ */
+int VirtualRenamer::rename_virtual_scopes(const DexType* type,
+                                          int& seed,
+                                          PendingRenames& renames) const {
+  int renamed = rename_type_scopes(type, seed, renames);
 
   // will be used for interface renaming, effectively this
   // gets the last name (seed) for all virtual scopes and
@@ -460,18 +537,48 @@ int VirtualRenamer::rename_virtual_scopes(const DexType* type, int& seed) {
   for (const auto& child :
        get_children(class_scopes.get_class_hierarchy(), type)) {
     int base_seed = seed;
-    renamed += rename_virtual_scopes(child, base_seed);
+    renamed += rename_virtual_scopes(child, base_seed, renames);
     max_seed = std::max(max_seed, base_seed);
   }
   seed = max_seed;
   return renamed;
 }
 
+/**
+ * Same as rename_virtual_scopes, but the hierarchies of the children of the
+ * type are renamed in parallel. They are independent: the names of a scope
+ * only have to be unique in the hierarchy below its root, and every child
+ * starts from the same seed. The result does not depend on the scheduling.
+ */
+int VirtualRenamer::rename_virtual_scopes_in_parallel(
+    const DexType* type, int& seed, PendingRenames& renames) const {
+  int renamed = rename_type_scopes(type, seed, renames);
+
+  const auto& children = get_children(class_scopes.get_class_hierarchy(), type);
+  std::vector<const DexType*> ordered(children.begin(), children.end());
+  std::vector<int> seeds(ordered.size(), seed);
+  std::vector<int> counts(ordered.size(), 0);
+  std::vector<PendingRenames> child_renames(ordered.size());
+  workqueue_run_for<size_t>(0, ordered.size(), [&](size_t i) {
+    counts[i] = rename_virtual_scopes(ordered[i], seeds[i], child_renames[i]);
+  });
+  // Merge in the order of the serial traversal.
+  int max_seed = seed;
+  for (size_t i = 0; i < ordered.size(); i++) {
+    renamed += counts[i];
+    max_seed = std::max(max_seed, seeds[i]);
+    renames.append(child_renames[i]);
+  }
+  seed = max_seed;
+  return renamed;
+}
+
 /**
  * Collect all method refs to concrete methods (definitions).
  */
 void collect_refs(Scope& scope, RefsMap& def_refs) {
-  walk::opcodes(
+  ConcurrentMap<DexMethod*, RefSet> concurrent_def_refs;
+  walk::parallel::opcodes(
       scope, [](DexMethod*) { return true; },
       [&](DexMethod*, IRInstruction* insn) {
         if (!insn->has_method()) return;
@@ -498,8 +605,14 @@ void collect_refs(Scope& scope, RefsMap& def_refs) {
         redex_assert(type_class(top->get_class()) != nullptr);
         if (type_class(top->get_class())->is_external()) return;
         // it's a top definition on an internal class, save it
-        def_refs[top].insert(callee);
+        concurrent_def_refs.update(
+            top, [callee](DexMethod*, RefSet& refs, bool) {
+              refs.insert(callee);
+            });
       });
+  for (auto& [top, refs] : concurrent_def_refs) {
+    def_refs.emplace(top, std::move(refs));
+  }
 }
 
 } // namespace
@@ -516,7 +629,7 @@ size_t rename_virtuals(
   scope_info(class_scopes);
   RefsMap def_refs;
   collect_refs(scope, def_refs);
-  std::unordered_map<std::string, uint32_t> stack_trace_elements;
+  StackTraceElements stack_trace_elements;
   std::unordered_map<const DexType*, std::string> external_cache;
   if (avoid_stack_trace_collision) {
     for (const auto& cls : scope) {
@@ -529,7 +642,8 @@ size_t rename_virtuals(
           // We're 100% ok with the default construction of an entry here, since
           // after this line that would give said entry the correct ref count
           // of 1.
-          stack_trace_elements[ste] += 1;
+          stack_trace_elements.update(
+              ste, [](const std::string&, uint32_t& count, bool) { count++; });
         }
       };
       meths_visitor(cls->get_dmethods());
@@ -543,15 +657,18 @@ size_t rename_virtuals(
                     avoid_stack_trace_collision ? &external_cache : nullptr,
                     next_dmethod_seeds);
 
-  // rename virtual only first
+  // rename virtual only first, the hierarchies below java.lang.Object in
+  // parallel
   const auto obj_t = type::java_lang_Object();
   int seed = 0;
-  size_t renamed = vr.rename_virtual_scopes(obj_t, seed);
+  PendingRenames renames;
+  size_t renamed = vr.rename_virtual_scopes_in_parallel(obj_t, seed, renames);
+  renames.apply();
   TRACE(OBFUSCATE, 2, "Virtual renamed: %ld", renamed);
 
   // rename interfaces
-  std::unordered_set<const VirtualScope*> visited;
-  size_t intf_renamed = vr.rename_interface_scopes(seed);
+  size_t intf_renamed = vr.rename_interface_scopes(seed, renames);
+  renames.apply();
   TRACE(OBFUSCATE, 2, "Interface renamed: %ld", intf_renamed);
   TRACE(OBFUSCATE, 2, "MAX seed: %d", seed);
   return renamed + intf_renamed;
@@ -11,6 +11,7 @@
 #include <cinttypes>
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <unordered_map>
 #include <unordered_set>
@@ -1685,11 +1686,102 @@ bool contains(const std::vector<T>& vec, const T& value) {
   return std::find(vec.begin(), vec.end(), value) != vec.end();
 }
 
+/*
+ * Finds, in a single scan of a block, all the patterns whose opcodes occur in
+ * it as a run of consecutive instructions. A Matcher only advances on
+ * consecutive instructions, so this is necessary for it to match, and the
+ * matchers only need to run on the blocks found here.
+ *
+ * The patterns are compiled into one bit-parallel (shift-and) automaton, with
+ * a bit per position of each pattern, which handles the opcode sets of the
+ * positions directly. Per instruction, the state is shifted by one position,
+ * the pattern starts are added, and the positions whose opcode sets do not
+ * contain the instruction's opcode are cleared.
+ */
+class OpcodeSequenceAutomaton {
+ public:
+  explicit OpcodeSequenceAutomaton(const std::vector<Matcher>& matchers) {
+    size_t num_positions = 0;
+    uint16_t max_opcode = 0;
+    for (const auto& matcher : matchers) {
+      always_assert(!matcher.pattern.match.empty());
+      for (const auto& dex_pattern : matcher.pattern.match) {
+        for (auto op : dex_pattern.opcodes) {
+          max_opcode = std::max(max_opcode, op);
+        }
+        ++num_positions;
+      }
+    }
+    m_num_words = (num_positions + 63) / 64;
+    m_num_opcodes = max_opcode + 1;
+    m_start.assign(m_num_words, 0);
+    m_final.assign(m_num_words, 0);
+    m_masks.assign(m_num_opcodes * m_num_words, 0);
+    m_pattern_at.resize(num_positions);
+
+    auto set = [](uint64_t* words, size_t position) {
+      words[position / 64] |= uint64_t(1) << (position % 64);
+    };
+    size_t position = 0;
+    for (size_t i = 0; i < matchers.size(); ++i) {
+      set(m_start.data(), position);
+      for (const auto& dex_pattern : matchers[i].pattern.match) {
+        for (auto op : dex_pattern.opcodes) {
+          set(&m_masks[op * m_num_words], position);
+        }
+        m_pattern_at[position++] = i;
+      }
+      set(m_final.data(), position - 1);
+    }
+  }
+
+  // Calls on_match(pattern index) whenever a pattern's opcodes end at the
+  // current instruction of the block.
+  template <typename Fn>
+  void scan(cfg::Block* block,
+            std::vector<uint64_t>& state,
+            const Fn& on_match) const {
+    state.assign(m_num_words, 0);
+    for (auto& mie : InstructionIterable(block)) {
+      size_t op = mie.insn->opcode();
+      if (op >= m_num_opcodes) {
+        std::fill(state.begin(), state.end(), 0);
+        continue;
+      }
+      const uint64_t* mask = &m_masks[op * m_num_words];
+      uint64_t carry = 0;
+      for (size_t w = 0; w < m_num_words; ++w) {
+        uint64_t word = state[w];
+        state[w] = ((word << 1) | carry | m_start[w]) & mask[w];
+        carry = word >> 63;
+        for (uint64_t hits = state[w] & m_final[w]; hits != 0;
+             hits &= hits - 1) {
+          on_match(m_pattern_at[w * 64 + __builtin_ctzll(hits)]);
+        }
+      }
+    }
+  }
+
+ private:
+  size_t m_num_words;
+  size_t m_num_opcodes;
+  std::vector<uint64_t> m_start;
+  std::vector<uint64_t> m_final;
+  // The positions that accept each opcode, m_num_words per opcode.
+  std::vector<uint64_t> m_masks;
+  std::vector<size_t> m_pattern_at;
+};
+
 // Each thread will have its own instance of PeepholeOptimizer, so align it in
 // order to avoid false sharing.
 class alignas(CACHE_LINE_SIZE) PeepholeOptimizer {
  private:
   std::vector<Matcher> m_matchers;
+  std::unique_ptr<OpcodeSequenceAutomaton> m_automaton;
+  // For each matcher, the blocks of the current method where it may match,
+  // in CFG order.
+  std::vector<std::vector<cfg::Block*>> m_candidate_blocks;
+  std::vector<uint64_t> m_automaton_state;
   std::vector<size_t> m_stats;
   PassManager& m_mgr;
   int m_stats_removed = 0;
@@ -1724,6 +1816,8 @@ class alignas(CACHE_LINE_SIZE) PeepholeOptimizer {
       }
     }
     m_stats.resize(m_matchers.size(), 0);
+    m_automaton = std::make_unique<OpcodeSequenceAutomaton>(m_matchers);
+    m_candidate_blocks.resize(m_matchers.size());
   }
 
   PeepholeOptimizer(const PeepholeOptimizer&) = delete;
@@ -1734,15 +1828,33 @@ class alignas(CACHE_LINE_SIZE) PeepholeOptimizer {
     code->build_cfg(/* editable */ true);
     auto& cfg = code->cfg();
 
+    auto find_candidate_blocks = [&]() {
+      for (auto& blocks : m_candidate_blocks) {
+        blocks.clear();
+      }
+      for (auto* block : cfg.blocks()) {
+        m_automaton->scan(block, m_automaton_state, [&](size_t i) {
+          auto& blocks = m_candidate_blocks[i];
+          if (blocks.empty() || blocks.back() != block) {
+            blocks.push_back(block);
+          }
+        });
+      }
+    };
+    find_candidate_blocks();
+
     // do optimizations one at a time
     // so they can match on the same pattern without interfering
     for (size_t i = 0; i < m_matchers.size(); ++i) {
       auto& matcher = m_matchers[i];
+      if (m_candidate_blocks[i].empty()) {
+        continue;
+      }
 
-      const auto& blocks = cfg.blocks();
       cfg::CFGMutation mutator(cfg);
+      bool changed = false;
 
-      for (const auto& block : blocks) {
+      for (auto* block : m_candidate_blocks[i]) {
         // Currently, all patterns do not span over multiple basic blocks. So
         // reset all matching states on visiting every basic block.
         matcher.reset();
@@ -1789,11 +1901,16 @@ class alignas(CACHE_LINE_SIZE) PeepholeOptimizer {
                                matcher.matched_instructions.end());
           m_stats_removed += matcher.match_index;
           matcher.reset();
+          changed = true;
         }
       }
 
       // Apply the mutator.
       mutator.flush();
+      if (changed) {
+        // The later patterns see the rewritten code.
+        find_candidate_blocks();
+      }
     }
 
     code->clear_cfg();
@@ -33,6 +33,8 @@ void RegAllocPass::run_pass(DexStoresVector& stores,
       mgr.get_redex_options().no_overwrite_this();
 
   auto scope = build_class_scope(stores);
+  // Methods are allocated independently of each other.
+  walker_costs::SplitLargeClasses split_large_classes;
   auto stats = walk::parallel::methods<Stats>(scope, [&](DexMethod* m) {
     return graph_coloring::allocate(allocator_config, m);
   });
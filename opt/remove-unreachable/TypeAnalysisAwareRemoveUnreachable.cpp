@@ -248,18 +248,15 @@ std::unique_ptr<ReachableObjects> compute_reachable_objects_with_type_anaysis(
 
   size_t num_threads = redex_parallel::default_num_threads();
   auto stats_arr = std::make_unique<Stats[]>(num_threads);
-  workqueue_run<ReachableObject>(
-      [&](MarkWorkerState* worker_state, const ReachableObject& obj) {
-        TypeAnaysisAwareClosureMarker transitive_closure_marker(
+  mark_transitive_closure(
+      root_set,
+      [&](MarkWorkerState* worker_state) {
+        return TypeAnaysisAwareClosureMarker(
             ignore_sets, *method_override_graph, record_reachability,
             &cond_marked, reachable_objects.get(), worker_state,
             &stats_arr[worker_state->worker_id()], gta);
-        transitive_closure_marker.visit(obj);
-        return nullptr;
       },
-      root_set,
-      num_threads,
-      /*push_tasks_while_running=*/true);
+      reachable_objects.get(), record_reachability, num_threads);
 
   if (num_ignore_check_strings != nullptr) {
     for (size_t i = 0; i < num_threads; ++i) {
@@ -16,6 +16,7 @@
 #include <unordered_set>
 #include <vector>
 
+#include "ConcurrentContainers.h"
 #include "ConfigFiles.h"
 #include "DexClass.h"
 #include "DexUtil.h"
@@ -28,6 +29,7 @@
 #include "TypeStringRewriter.h"
 #include "Walkers.h"
 #include "Warning.h"
+#include "WorkQueue.h"
 
 #include "Trace.h"
 #include <locator.h>
@@ -130,25 +132,27 @@ RenameClassesPassV2::build_dont_rename_class_name_literals(Scope& scope) {
   for (auto clazz : scope) {
     clazz->gather_strings(all_strings);
   }
-  std::unordered_set<std::string> result;
-  boost::regex external_name_regex{
+  ConcurrentSet<std::string> result;
+  const boost::regex external_name_regex{
       "((org)|(com)|(android(x|\\.support)))\\."
       "([a-zA-Z][a-zA-Z\\d_$]*\\.)*"
       "[a-zA-Z][a-zA-Z\\d_$]*"};
-  for (auto dex_str : all_strings) {
-    const std::string_view s = dex_str->str();
-    if (!ends_with(s, ".java") &&
-        boost::regex_match(dex_str->c_str(), external_name_regex)) {
-      std::string internal_name = java_names::external_to_internal(s);
-      auto cls = type_class(DexType::get_type(internal_name));
-      if (cls != nullptr && !cls->is_external()) {
-        result.insert(std::move(internal_name));
-        TRACE(RENAME, 4, "Found %s in string pool before renaming",
-              str_copy(s).c_str());
-      }
-    }
-  }
-  return result;
+  workqueue_run<const DexString*>(
+      [&](const DexString* dex_str) {
+        const std::string_view s = dex_str->str();
+        if (!ends_with(s, ".java") &&
+            boost::regex_match(dex_str->c_str(), external_name_regex)) {
+          std::string internal_name = java_names::external_to_internal(s);
+          auto cls = type_class(DexType::get_type(internal_name));
+          if (cls != nullptr && !cls->is_external()) {
+            result.insert(std::move(internal_name));
+            TRACE(RENAME, 4, "Found %s in string pool before renaming",
+                  str_copy(s).c_str());
+          }
+        }
+      },
+      all_strings);
+  return std::unordered_set<std::string>(result.begin(), result.end());
 }
 
 std::unordered_set<std::string>
@@ -173,7 +177,8 @@ RenameClassesPassV2::build_dont_rename_for_types_with_reflection(
     }
   }
 
-  walk::opcodes(
+  ConcurrentSet<std::string> dont_rename;
+  walk::parallel::opcodes(
       scope,
       [](DexMethod*) { return true; },
       [&](DexMethod* m, IRInstruction* insn) {
@@ -186,10 +191,11 @@ RenameClassesPassV2::build_dont_rename_for_types_with_reflection(
           TRACE(RENAME, 4,
                 "Found %s with known reflection usage. marking reachable",
                 classname.c_str());
-          dont_rename_class_for_types_with_reflection.insert(
-              std::move(classname));
+          dont_rename.insert(std::move(classname));
         }
       });
+  dont_rename_class_for_types_with_reflection.insert(dont_rename.begin(),
+                                                     dont_rename.end());
   return dont_rename_class_for_types_with_reflection;
 }
 
@@ -822,19 +822,40 @@ def create_dex_jar(
         ZipReset.reset_file(jarpath)
 
 
+# The exit code of `redex-tool repackage` for archives that need Zip64.
+REPACKAGE_ZIP64_REQUIRED = 3
+
+
 class ZipManager:
     """
     __enter__: Unzips input_apk into extracted_apk_dir
     __exit__: Zips extracted_apk_dir into output_apk
+
+    With a redex_tool, the output is zipped by its native `repackage` command,
+    which compresses in parallel, copies unchanged entries without
+    recompressing them, and aligns the output, so that it does not need to go
+    through zipalign (see `aligned`). Archives that need Zip64 are still zipped
+    with zipfile.
     """
 
     per_file_compression: typing.Dict[str, int] = {}
     renamed_files_to_original: typing.Dict[str, str] = {}
 
-    def __init__(self, input_apk: str, extracted_apk_dir: str, output_apk: str) -> None:
+    def __init__(
+        self,
+        input_apk: str,
+        extracted_apk_dir: str,
+        output_apk: str,
+        redex_tool: typing.Optional[str] = None,
+        page_align: bool = False,
+    ) -> None:
         self.input_apk = input_apk
         self.extracted_apk_dir = extracted_apk_dir
         self.output_apk = output_apk
+        self.redex_tool = redex_tool
+        self.page_align = page_align
+        self.resource_file_mapping: typing.Optional[str] = None
+        self.aligned = False
 
     def __enter__(self) -> None:
         log("Extracting apk...")
@@ -844,6 +865,7 @@ class ZipManager:
             z.extractall(self.extracted_apk_dir)
 
     def set_resource_file_mapping(self, path: str) -> None:
+        self.resource_file_mapping = path
         with open(path) as f:
             mapping = json.load(f)
             for k, v in mapping.items():
@@ -854,6 +876,11 @@ class ZipManager:
         if isfile(self.output_apk):
             os.remove(self.output_apk)
 
+        if self.redex_tool is not None and self._repackage_natively(
+            self.redex_tool
+        ):
+            return
+
         log("Creating output apk")
         with zipfile.ZipFile(self.output_apk, "w") as new_apk:
             # Need sorted output for deterministic zip file. Sorting `dirnames` will
@@ -874,6 +901,34 @@ class ZipManager:
                         compress = zipfile.ZIP_DEFLATED
                     new_apk.write(filepath, archivepath, compress_type=compress)
 
+    def _repackage_natively(self, redex_tool: str) -> bool:
+        log("Creating output apk with " + redex_tool)
+        args = [
+            redex_tool,
+            "repackage",
+            "--input",
+            self.input_apk,
+            "--dir",
+            self.extracted_apk_dir,
+            "--output",
+            self.output_apk,
+        ]
+        if self.resource_file_mapping is not None:
+            args += ["--renamed-files", self.resource_file_mapping]
+        if self.page_align:
+            args.append("--page-align")
+        returncode = subprocess.call(args)
+        if returncode == REPACKAGE_ZIP64_REQUIRED:
+            # zipfile supports Zip64, the native command does not.
+            log("The output apk needs Zip64, creating it with zipfile instead")
+            if isfile(self.output_apk):
+                os.remove(self.output_apk)
+            return False
+        if returncode != 0:
+            raise subprocess.CalledProcessError(returncode, args)
+        self.aligned = True
+        return True
+
 
 class UnpackManager:
     """
@@ -235,6 +235,43 @@ class RedexRunException(Exception):
         return self.msg
 
 
+def has_repackage_command(redex_tool: str) -> bool:
+    try:
+        result = subprocess.run(
+            [redex_tool, "--help"],
+            stdout=subprocess.PIPE,
+            stderr=subprocess.DEVNULL,
+            universal_newlines=True,
+            timeout=60,
+        )
+    except (OSError, subprocess.SubprocessError):
+        return False
+    # The help lists one tool per line, followed by its description.
+    return any(
+        line.split()[:1] == ["repackage"] for line in result.stdout.splitlines()
+    )
+
+
+def find_redex_tool(args: argparse.Namespace) -> typing.Optional[str]:
+    if args.redex_tool is not None:
+        return args.redex_tool
+    candidates = []
+    if args.redex_binary is not None:
+        candidate = join(dirname(abspath(args.redex_binary)), "redex-tool")
+        if isfile(candidate) and os.access(candidate, os.X_OK):
+            candidates.append(candidate)
+    on_path = shutil.which("redex-tool")
+    if on_path is not None:
+        candidates.append(on_path)
+    # A redex-tool that was found implicitly may predate the repackage
+    # command, in which case the output is zipped in Python.
+    for candidate in candidates:
+        if has_repackage_command(candidate):
+            return candidate
+        logging.debug("%s has no repackage command, ignoring it", candidate)
+    return None
+
+
 def run_redex_binary(
     state: State,
     exception_formatter: ExceptionMessageFormatter,
@@ -452,6 +489,7 @@ def align_and_sign_output_apk(
     key_password: str,
     ignore_zipalign: bool,
     page_align: bool,
+    already_aligned: bool = False,
 ) -> None:
     if isfile(output_apk_path):
         os.remove(output_apk_path)
@@ -462,7 +500,10 @@ def align_and_sign_output_apk(
         if e.errno != errno.EEXIST:
             raise
 
-    zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align)
+    if already_aligned:
+        shutil.move(unaligned_apk_path, output_apk_path)
+    else:
+        zipalign(unaligned_apk_path, output_apk_path, ignore_zipalign, page_align)
 
     if reset_timestamps:
         ZipReset.reset_file(output_apk_path)
@@ -544,6 +585,15 @@ Given an APK, produce a better APK!
         "--redex-binary", nargs="?", default=binary, help="Path to redex binary"
     )
 
+    parser.add_argument(
+        "--redex-tool",
+        nargs="?",
+        help="Path to the redex-tool binary used to repackage the output. "
+        "Defaults to the one next to the redex binary or on the PATH if it has "
+        "a repackage command; without one the output is zipped in Python and "
+        "aligned with zipalign",
+    )
+
     parser.add_argument("-c", "--config", default=config, help="Configuration file")
 
     argparse_yes_no_flag(parser, "sign", help="Sign the apk after optimizing it")
@@ -1035,7 +1085,13 @@ def prepare_redex(args: argparse.Namespace) -> State:
 
         directory = make_temp_dir(".redex_unaligned", False)
         unaligned_apk_path = join(directory, "redex-unaligned." + file_ext)
-        zip_manager = ZipManager(args.input_apk, extracted_apk_dir, unaligned_apk_path)
+        zip_manager = ZipManager(
+            args.input_apk,
+            extracted_apk_dir,
+            unaligned_apk_path,
+            redex_tool=find_redex_tool(args),
+            page_align=args.page_align_libs,
+        )
         zip_manager.__enter__()
 
         if not dex_dir:
@@ -1164,6 +1220,7 @@ def finalize_redex(state: State) -> None:
         state.args.keypass,
         state.args.ignore_zipalign,
         state.args.page_align_libs,
+        _assert_val(state.zip_manager).aligned,
     )
 
     logging.debug(
@@ -178,6 +178,10 @@ WholeProgramState::WholeProgramState(
 /*
  * Walk over the entire program, doing a join over the values written to each
  * field, as well as a join over the values returned by each method.
+ *
+ * If the fixpoint iterator caches contributions, methods whose entry arguments
+ * and whole-program dependencies did not change since the previous round
+ * reuse their previous contribution instead of being re-analyzed.
  */
 void WholeProgramState::collect(
     const Scope& scope,
@@ -191,9 +195,48 @@ void WholeProgramState::collect(
     if (code == nullptr) {
       return;
     }
+    auto add_contribution = [&](const Contribution& contribution) {
+      for (auto& [field, value] : contribution.field_values) {
+        fields_value_tmp.update(
+            field, [&value](const DexField*, ConstantValue& current_value,
+                            bool exists) {
+              if (exists) {
+                current_value.join_with(value);
+              } else {
+                current_value = value;
+              }
+            });
+      }
+      if (contribution.return_value) {
+        const auto& value = *contribution.return_value;
+        methods_value_tmp.update(
+            method, [&value](const DexMethod*, ConstantValue& current_value,
+                             bool exists) {
+              if (exists) {
+                current_value.join_with(value);
+              } else {
+                current_value = value;
+              }
+            });
+      }
+    };
+    bool use_cache = fp_iter.caches_wps_contributions();
+    if (use_cache) {
+      auto cached = fp_iter.find_wps_contribution(method);
+      if (cached) {
+        add_contribution(*cached);
+        return;
+      }
+    }
+
     auto& cfg = code->cfg();
     auto ipa = fp_iter.get_intraprocedural_analysis(method);
     auto& intra_cp = ipa->fp_iter;
+    WholeProgramStateAccessorRecord record;
+    if (use_cache && ipa->wps_accessor) {
+      ipa->wps_accessor->start_recording(&record);
+    }
+    Contribution contribution;
     for (cfg::Block* b : cfg.blocks()) {
       auto env = intra_cp.get_entry_state_at(b);
       auto last_insn = b->get_last_insn();
@@ -203,10 +246,18 @@ void WholeProgramState::collect(
         collect_field_values(insn, env,
                              method::is_clinit(method) ? method->get_class()
                                                        : nullptr,
-                             &fields_value_tmp);
-        collect_return_values(insn, env, method, &methods_value_tmp);
+                             &contribution);
+        collect_return_values(insn, env, &contribution);
       }
     }
+    if (ipa->wps_accessor) {
+      ipa->wps_accessor->stop_recording();
+    }
+    add_contribution(contribution);
+    if (use_cache) {
+      fp_iter.record_wps_contribution(method, std::move(record),
+                                      std::move(contribution));
+    }
   });
   for (const auto& pair : fields_value_tmp) {
     m_field_partition.update(pair.first, [&pair](auto* current_value) {
@@ -229,11 +280,10 @@ void WholeProgramState::collect(
  * visible to other methods if it remains unchanged up until the end of the
  * <clinit>. In that case, analyze_clinits() will record it.
  */
-void WholeProgramState::collect_field_values(
-    const IRInstruction* insn,
-    const ConstantEnvironment& env,
-    const DexType* clinit_cls,
-    ConcurrentMap<const DexField*, ConstantValue>* fields_value_tmp) {
+void WholeProgramState::collect_field_values(const IRInstruction* insn,
+                                             const ConstantEnvironment& env,
+                                             const DexType* clinit_cls,
+                                             Contribution* contribution) {
   if (!opcode::is_an_sput(insn->opcode()) &&
       !opcode::is_an_iput(insn->opcode())) {
     return;
@@ -245,15 +295,13 @@ void WholeProgramState::collect_field_values(
       return;
     }
     auto value = env.get(insn->src(0));
-    fields_value_tmp->update(
-        field,
-        [&value](const DexField*, ConstantValue& current_value, bool exists) {
-          if (exists) {
-            current_value.join_with(value);
-          } else {
-            current_value = std::move(value);
-          }
-        });
+    auto& field_values = contribution->field_values;
+    auto it = field_values.find(field);
+    if (it != field_values.end()) {
+      it->second.join_with(value);
+    } else {
+      field_values.emplace(field, std::move(value));
+    }
   }
 }
 
@@ -263,37 +311,28 @@ void WholeProgramState::collect_field_values(
  * If there are no reachable return opcodes in the method, then it never
  * returns. Its return value will be represented by Bottom in our analysis.
  */
-void WholeProgramState::collect_return_values(
-    const IRInstruction* insn,
-    const ConstantEnvironment& env,
-    const DexMethod* method,
-    ConcurrentMap<const DexMethod*, ConstantValue>* methods_value_tmp) {
+void WholeProgramState::collect_return_values(const IRInstruction* insn,
+                                              const ConstantEnvironment& env,
+                                              Contribution* contribution) {
   auto op = insn->opcode();
   if (!opcode::is_a_return(op)) {
     return;
   }
+  auto& return_value = contribution->return_value;
   if (op == OPCODE_RETURN_VOID) {
     // We must set the binding to Top here to record the fact that this method
     // does indeed return -- even though `void` is not actually a return value,
     // this tells us that the code following any invoke of this method is
     // reachable.
-    methods_value_tmp->update(
-        method,
-        [](const DexMethod*, ConstantValue& current_value, bool /* exists */) {
-          current_value = ConstantValue::top();
-        });
+    return_value = ConstantValue::top();
     return;
   }
   auto value = env.get(insn->src(0));
-  methods_value_tmp->update(
-      method,
-      [&value](const DexMethod*, ConstantValue& current_value, bool exists) {
-        if (exists) {
-          current_value.join_with(value);
-        } else {
-          current_value = std::move(value);
-        }
-      });
+  if (return_value) {
+    return_value->join_with(value);
+  } else {
+    return_value = std::move(value);
+  }
 }
 
 void WholeProgramState::collect_static_finals(const DexClass* cls,
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <boost/optional.hpp>
+
 #include "CallGraph.h"
 #include "ConstantEnvironment.h"
 #include "HashedAbstractPartition.h"
@@ -30,6 +32,16 @@ using ConstantFieldPartition =
 using ConstantMethodPartition =
     sparta::HashedAbstractPartition<const DexMethod*, ConstantValue>;
 
+/*
+ * The values that a single method contributes to a WholeProgramState: the join
+ * of the values it writes to each field, and the join of the values it
+ * returns, if it returns at all.
+ */
+struct WholeProgramStateContribution {
+  std::unordered_map<const DexField*, ConstantValue> field_values;
+  boost::optional<ConstantValue> return_value;
+};
+
 /*
  * This class contains flow-insensitive information about fields and method
  * return values, i.e. it can tells us if a field or a return value is constant
@@ -131,17 +143,16 @@ class WholeProgramState {
       const interprocedural::FixpointIterator& fp_iter,
       const std::unordered_set<const DexField*>& definitely_assigned_ifields);
 
-  void collect_field_values(
-      const IRInstruction* insn,
-      const ConstantEnvironment& env,
-      const DexType* clinit_cls,
-      ConcurrentMap<const DexField*, ConstantValue>* fields_value_tmp);
+  using Contribution = WholeProgramStateContribution;
 
-  void collect_return_values(
-      const IRInstruction* insn,
-      const ConstantEnvironment& env,
-      const DexMethod* method,
-      ConcurrentMap<const DexMethod*, ConstantValue>* methods_value_tmp);
+  void collect_field_values(const IRInstruction* insn,
+                            const ConstantEnvironment& env,
+                            const DexType* clinit_cls,
+                            Contribution* contribution);
+
+  void collect_return_values(const IRInstruction* insn,
+                             const ConstantEnvironment& env,
+                             Contribution* contribution);
 
   std::shared_ptr<const call_graph::Graph> m_call_graph;
 
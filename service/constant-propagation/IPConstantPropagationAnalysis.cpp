@@ -178,23 +178,26 @@ FixpointIterator::MethodCache& FixpointIterator::get_method_cache(
 
 bool FixpointIterator::method_cache_entry_matches(
     const MethodCacheEntry& mce, const ArgumentDomain& args) const {
-  if (!mce.args.equals(args)) {
-    return false;
-  }
+  return mce.args.equals(args) &&
+         wps_accessor_record_matches(mce.wps_accessor_record);
+}
+
+bool FixpointIterator::wps_accessor_record_matches(
+    const WholeProgramStateAccessorRecord& record) const {
   if (m_wps->has_call_graph()) {
-    for (auto&& [method, val] : mce.wps_accessor_record.method_dependencies) {
+    for (auto&& [method, val] : record.method_dependencies) {
       if (!m_wps->get_method_partition().get(method).equals(val)) {
         return false;
       }
     }
   } else {
-    for (auto&& [method, val] : mce.wps_accessor_record.method_dependencies) {
+    for (auto&& [method, val] : record.method_dependencies) {
       if (!m_wps->get_return_value(method).equals(val)) {
         return false;
       }
     }
   }
-  for (auto&& [field, val] : mce.wps_accessor_record.field_dependencies) {
+  for (auto&& [field, val] : record.field_dependencies) {
     if (!m_wps->get_field_value(field).equals(val)) {
       return false;
     }
@@ -202,6 +205,33 @@ bool FixpointIterator::method_cache_entry_matches(
   return true;
 }
 
+std::shared_ptr<const WholeProgramStateContribution>
+FixpointIterator::find_wps_contribution(const DexMethod* method) const {
+  auto entry = m_wps_contributions.get(method, nullptr);
+  bool matches = entry != nullptr &&
+                 entry->args.equals(get_entry_args(method)) &&
+                 wps_accessor_record_matches(entry->wps_accessor_record);
+  std::lock_guard<std::mutex> lock_guard(m_stats_mutex);
+  if (matches) {
+    m_stats.wps_contribution_cache_hits++;
+    return std::shared_ptr<const WholeProgramStateContribution>(
+        entry, &entry->contribution);
+  }
+  m_stats.wps_contribution_cache_misses++;
+  return nullptr;
+}
+
+void FixpointIterator::record_wps_contribution(
+    const DexMethod* method,
+    WholeProgramStateAccessorRecord record,
+    WholeProgramStateContribution contribution) const {
+  m_wps_contributions.insert_or_assign(std::make_pair(
+      method,
+      std::make_shared<const WpsContributionCacheEntry>(
+          WpsContributionCacheEntry{get_entry_args(method), std::move(record),
+                                    std::move(contribution)})));
+}
+
 const FixpointIterator::MethodCacheEntry*
 FixpointIterator::find_matching_method_cache_entry(
     MethodCache& method_cache, const ArgumentDomain& args) const {
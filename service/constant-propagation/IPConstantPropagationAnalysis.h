@@ -81,7 +81,10 @@ class FixpointIterator : public sparta::ParallelMonotonicFixpointIterator<
   struct Stats {
     size_t method_cache_hits{0};
     size_t method_cache_misses{0};
+    size_t wps_contribution_cache_hits{0};
+    size_t wps_contribution_cache_misses{0};
   };
+
   FixpointIterator(
       std::shared_ptr<const call_graph::Graph> call_graph,
       const IntraproceduralAnalysisFactory& proc_analysis_factory,
@@ -115,6 +118,31 @@ class FixpointIterator : public sparta::ParallelMonotonicFixpointIterator<
 
   const Stats& get_stats() const { return m_stats; }
 
+  /*
+   * When enabled, the contribution of each method to a WholeProgramState is
+   * remembered together with the entry arguments and the whole-program values
+   * it was derived from. Building the next WholeProgramState then only
+   * re-analyzes the methods whose arguments or dependencies have changed.
+   */
+  void set_cache_wps_contributions(bool enabled) {
+    m_cache_wps_contributions = enabled;
+  }
+
+  bool caches_wps_contributions() const { return m_cache_wps_contributions; }
+
+  /*
+   * Returns the contribution recorded for the method, if its entry arguments
+   * and all the values it read from the current WholeProgramState are still
+   * the same.
+   */
+  std::shared_ptr<const WholeProgramStateContribution>
+  find_wps_contribution(const DexMethod* method) const;
+
+  void record_wps_contribution(
+      const DexMethod* method,
+      WholeProgramStateAccessorRecord record,
+      WholeProgramStateContribution contribution) const;
+
  private:
   const ArgumentDomain& get_entry_args(const DexMethod* method) const;
 
@@ -134,9 +162,22 @@ class FixpointIterator : public sparta::ParallelMonotonicFixpointIterator<
   bool method_cache_entry_matches(const MethodCacheEntry& mce,
                                   const ArgumentDomain& args) const;
 
+  bool wps_accessor_record_matches(
+      const WholeProgramStateAccessorRecord& record) const;
+
   const MethodCacheEntry* find_matching_method_cache_entry(
       MethodCache& method_cache, const ArgumentDomain& args) const;
 
+  struct WpsContributionCacheEntry {
+    ArgumentDomain args;
+    WholeProgramStateAccessorRecord wps_accessor_record;
+    WholeProgramStateContribution contribution;
+  };
+  bool m_cache_wps_contributions{false};
+  mutable ConcurrentMap<const DexMethod*,
+                        std::shared_ptr<const WpsContributionCacheEntry>>
+      m_wps_contributions;
+
   mutable Stats m_stats;
   mutable std::mutex m_stats_mutex;
 };
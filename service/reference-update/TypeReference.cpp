@@ -187,6 +187,7 @@ void update_vmethods_group_one_type_ref(const VMethodGroup& group,
     spec.name = group.possible_new_name;
   }
   spec.proto = new_proto;
+  std::vector<std::pair<DexMethodRef*, DexMethodSpec>> changes;
   for (auto method : group.methods) {
     TRACE(REFU,
           8,
@@ -194,8 +195,9 @@ void update_vmethods_group_one_type_ref(const VMethodGroup& group,
           SHOW(method),
           SHOW(spec.name),
           SHOW(spec.proto));
-    method->change(spec, false /* rename on collision */);
+    changes.emplace_back(method, spec);
   }
+  DexMethodRef::change_all(changes, false /* rename on collision */);
 }
 } // namespace
 
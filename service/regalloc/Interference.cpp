@@ -7,10 +7,14 @@
 
 #include "Interference.h"
 
+#include <atomic>
+
+#include "CppUtil.h"
 #include "DexOpcode.h"
 #include "DexUtil.h"
 #include "MonotonicFixpointIterator.h"
 #include "Show.h"
+#include "WorkQueue.h"
 
 namespace regalloc {
 
@@ -70,7 +74,8 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   if (u == v) {
     return;
   }
-  if (!is_adjacent(u, v)) {
+  auto [edge, inserted] = m_adj_matrix.emplace(build_edge(u, v), false);
+  if (inserted) {
     auto& u_node = m_nodes.at(u);
     auto& v_node = m_nodes.at(v);
     u_node.m_adjacent.push_back(v);
@@ -87,8 +92,7 @@ void Graph::add_edge(reg_t u, reg_t v, bool can_coalesce) {
   //
   // then the final state of the edge between s0 and s1 must be
   // non-coalesceable.
-  m_adj_matrix[build_edge(u, v)] =
-      m_adj_matrix[build_edge(u, v)] || !can_coalesce;
+  edge->second = edge->second || !can_coalesce;
 }
 
 uint32_t Node::colorable_limit() const {
@@ -235,6 +239,151 @@ void GraphBuilder::update_node_constraints(const cfg::InstructionIterator& it,
   }
 }
 
+namespace {
+
+/*
+ * Methods with at least this many instructions get the edges of their blocks
+ * collected in parallel. Below that, starting the threads costs more than it
+ * saves.
+ */
+constexpr uint32_t kMinOpcodesForParallelBuild = 10000;
+
+/*
+ * Each thread of a parallel build gets at least this many blocks.
+ */
+constexpr size_t kMinBlocksPerBuildThread = 16;
+
+/*
+ * The threads currently used by parallel builds. Builds run on the workers of
+ * the method-parallel register allocation, so together they may not use more
+ * threads than it has. When those are taken, builds run sequentially.
+ */
+std::atomic<unsigned> s_build_threads_in_use{0};
+
+/*
+ * Call add_edge(u, v, can_coalesce) for every interference edge and
+ * add_containment_edge(u, v) for every containment edge that the instructions
+ * of the block induce, in the order in which the sequential build adds them.
+ */
+template <typename AddEdge, typename AddContainmentEdge>
+void visit_block(const LivenessFixpointIterator& fixpoint_iter,
+                 cfg::ControlFlowGraph& cfg,
+                 cfg::Block* block,
+                 bool containment_edges,
+                 const AddEdge& add_edge,
+                 const AddContainmentEdge& add_containment_edge) {
+  LivenessDomain live_out = fixpoint_iter.get_live_out_vars_at(block);
+  for (auto it = block->rbegin(); it != block->rend(); ++it) {
+    if (it->type != MFLOW_OPCODE) {
+      continue;
+    }
+    auto insn = it->insn;
+    auto op = insn->opcode();
+    if (insn->has_dest()) {
+      for (auto reg : live_out.elements()) {
+        if (opcode::is_a_move(op) && reg == insn->src(0)) {
+          continue;
+        }
+        add_edge(insn->dest(), reg, false);
+      }
+      // We add interference edges between the dest and wide src operands of
+      // an instruction even if the srcs are not live-out. This avoids
+      // allocations like `xor-long v1, v0, v9`, where v1 and v0 overlap --
+      // even though this is not a verification error, we have observed bugs
+      // in the ART interpreter when handling these sorts of instructions.
+      // However, we still want to be able to coalesce these symregs if they
+      // don't actually interfere based on liveness information, so that we
+      // can remove move-wide opcodes and/or use /2addr encodings.  As such,
+      // we insert a specially marked edge that coalescing ignores but
+      // coloring respects.
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        if (insn->src_is_wide(i)) {
+          add_edge(insn->dest(), insn->src(i), true);
+        }
+      }
+    }
+    if (op == OPCODE_CHECK_CAST) {
+      auto move_result =
+          cfg.move_result_of(block->to_cfg_instruction_iterator(*it));
+      always_assert(!move_result.is_end());
+      IRInstruction* move_result_pseudo = move_result->insn;
+      for (auto reg : live_out.elements()) {
+        add_edge(move_result_pseudo->dest(), reg, false);
+      }
+    }
+    // adding containment edge between liverange defined in insn and elements
+    // in live-out set of insn
+    if (containment_edges && insn->has_dest()) {
+      for (auto reg : live_out.elements()) {
+        add_containment_edge(insn->dest(), reg);
+      }
+    }
+    fixpoint_iter.analyze_instruction(it->insn, &live_out);
+    // adding containment edge between liverange used in insn and elements
+    // in live-in set of insn
+    if (containment_edges) {
+      for (size_t i = 0; i < insn->srcs_size(); ++i) {
+        for (auto reg : live_out.elements()) {
+          add_containment_edge(insn->src(i), reg);
+        }
+      }
+    }
+  }
+}
+
+/*
+ * The edges induced by one block, without duplicates. The interference edges
+ * keep the order of their first occurrence, so that replaying them yields the
+ * same adjacency lists as adding them one by one.
+ */
+struct BlockEdges {
+  struct Edge {
+    reg_t u;
+    reg_t v;
+    bool can_coalesce;
+  };
+  std::vector<Edge> edges;
+  std::unordered_map<reg_pair_t, size_t> edge_indices;
+  std::unordered_set<reg_pair_t> containment_edges;
+
+  void add_edge(reg_t u, reg_t v, bool can_coalesce) {
+    if (u == v) {
+      return;
+    }
+    auto [it, inserted] = edge_indices.emplace(build_edge(u, v), edges.size());
+    if (inserted) {
+      edges.push_back(Edge{u, v, can_coalesce});
+    } else {
+      // An edge is only coalesceable if all of its occurrences are.
+      edges[it->second].can_coalesce &= can_coalesce;
+    }
+  }
+
+  void add_containment_edge(reg_t u, reg_t v) {
+    if (u != v) {
+      containment_edges.emplace(build_containment_edge(u, v));
+    }
+  }
+};
+
+} // namespace
+
+namespace impl {
+
+unsigned build_threads(uint32_t num_opcodes,
+                       size_t num_blocks,
+                       unsigned available_threads) {
+  if (num_opcodes < kMinOpcodesForParallelBuild) {
+    return 1;
+  }
+  return std::max<size_t>(
+      1,
+      std::min<size_t>(num_blocks / kMinBlocksPerBuildThread,
+                       available_threads));
+}
+
+} // namespace impl
+
 /*
  * Build the interference graph by adding edges between nodes that are
  * simultaneously live.
@@ -277,77 +426,93 @@ void GraphBuilder::update_node_constraints(const cfg::InstructionIterator& it,
  * The solution is to have the interference graph make check-cast's dest
  * register interfere with the live registers in both B0 and B1, so that when
  * the move gets inserted, it does not clobber any live registers.
+ *
+ * The blocks only read the liveness information, so for large methods, we
+ * walk them in parallel and then add their edges to the graph in block order.
+ * This produces the same graph as the sequential walk. The threads come out
+ * of a budget shared by all builds (see s_build_threads_in_use).
  */
 Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
                           cfg::ControlFlowGraph& cfg,
                           reg_t initial_regs,
                           const RangeSet& range_set,
                           bool containment_edges) {
+  unsigned max_threads = redex_parallel::default_num_threads();
+  unsigned in_use = s_build_threads_in_use.load();
+  unsigned num_threads;
+  do {
+    num_threads =
+        build_threads(cfg.num_opcodes(), cfg.num_blocks(),
+                      max_threads > in_use ? max_threads - in_use : 0);
+    if (num_threads <= 1) {
+      return build(fixpoint_iter, cfg, initial_regs, range_set,
+                   containment_edges, /* num_threads */ 1);
+    }
+  } while (!s_build_threads_in_use.compare_exchange_weak(
+      in_use, in_use + num_threads));
+  auto release =
+      at_scope_exit([num_threads] { s_build_threads_in_use -= num_threads; });
+  return build(fixpoint_iter, cfg, initial_regs, range_set, containment_edges,
+               num_threads);
+}
+
+Graph GraphBuilder::build_in_parallel(
+    const LivenessFixpointIterator& fixpoint_iter,
+    cfg::ControlFlowGraph& cfg,
+    reg_t initial_regs,
+    const RangeSet& range_set,
+    bool containment_edges) {
+  return build(fixpoint_iter, cfg, initial_regs, range_set, containment_edges,
+               /* num_threads */ 2);
+}
+
+Graph GraphBuilder::build(const LivenessFixpointIterator& fixpoint_iter,
+                          cfg::ControlFlowGraph& cfg,
+                          reg_t initial_regs,
+                          const RangeSet& range_set,
+                          bool containment_edges,
+                          unsigned num_threads) {
   Graph graph;
   auto ii = cfg::InstructionIterable(cfg);
   for (auto it = ii.begin(); it != ii.end(); ++it) {
     GraphBuilder::update_node_constraints(it, range_set, &graph);
   }
 
-  for (cfg::Block* block : cfg.blocks()) {
-    LivenessDomain live_out = fixpoint_iter.get_live_out_vars_at(block);
-    for (auto it = block->rbegin(); it != block->rend(); ++it) {
-      if (it->type != MFLOW_OPCODE) {
-        continue;
-      }
-      auto insn = it->insn;
-      auto op = insn->opcode();
-      if (insn->has_dest()) {
-        for (auto reg : live_out.elements()) {
-          if (opcode::is_a_move(op) && reg == insn->src(0)) {
-            continue;
-          }
-          graph.add_edge(insn->dest(), reg);
-        }
-        // We add interference edges between the dest and wide src operands of
-        // an instruction even if the srcs are not live-out. This avoids
-        // allocations like `xor-long v1, v0, v9`, where v1 and v0 overlap --
-        // even though this is not a verification error, we have observed bugs
-        // in the ART interpreter when handling these sorts of instructions.
-        // However, we still want to be able to coalesce these symregs if they
-        // don't actually interfere based on liveness information, so that we
-        // can remove move-wide opcodes and/or use /2addr encodings.  As such,
-        // we insert a specially marked edge that coalescing ignores but
-        // coloring respects.
-        for (size_t i = 0; i < insn->srcs_size(); ++i) {
-          if (insn->src_is_wide(i)) {
-            graph.add_coalesceable_edge(insn->dest(), insn->src(i));
-          }
-        }
-      }
-      if (op == OPCODE_CHECK_CAST) {
-        auto move_result =
-            cfg.move_result_of(block->to_cfg_instruction_iterator(*it));
-        always_assert(!move_result.is_end());
-        IRInstruction* move_result_pseudo = move_result->insn;
-        for (auto reg : live_out.elements()) {
-          graph.add_edge(move_result_pseudo->dest(), reg);
-        }
-      }
-      // adding containment edge between liverange defined in insn and elements
-      // in live-out set of insn
-      if (containment_edges && insn->has_dest()) {
-        for (auto reg : live_out.elements()) {
-          graph.add_containment_edge(insn->dest(), reg);
-        }
-      }
-      fixpoint_iter.analyze_instruction(it->insn, &live_out);
-      // adding containment edge between liverange used in insn and elements
-      // in live-in set of insn
-      if (containment_edges) {
-        for (size_t i = 0; i < insn->srcs_size(); ++i) {
-          for (auto reg : live_out.elements()) {
-            graph.add_containment_edge(insn->src(i), reg);
-          }
-        }
+  auto blocks = cfg.blocks();
+  if (num_threads > 1 && blocks.size() > 1) {
+    std::vector<BlockEdges> block_edges(blocks.size());
+    workqueue_run_for<size_t>(
+        0,
+        blocks.size(),
+        [&](size_t i) {
+          auto& edges = block_edges[i];
+          visit_block(
+              fixpoint_iter, cfg, blocks[i], containment_edges,
+              [&](reg_t u, reg_t v, bool can_coalesce) {
+                edges.add_edge(u, v, can_coalesce);
+              },
+              [&](reg_t u, reg_t v) { edges.add_containment_edge(u, v); });
+        },
+        num_threads);
+    for (auto& edges : block_edges) {
+      for (const auto& edge : edges.edges) {
+        graph.add_edge(edge.u, edge.v, edge.can_coalesce);
       }
+      graph.m_containment_graph.insert(edges.containment_edges.begin(),
+                                       edges.containment_edges.end());
+      edges = BlockEdges();
+    }
+  } else {
+    for (cfg::Block* block : blocks) {
+      visit_block(
+          fixpoint_iter, cfg, block, containment_edges,
+          [&](reg_t u, reg_t v, bool can_coalesce) {
+            graph.add_edge(u, v, can_coalesce);
+          },
+          [&](reg_t u, reg_t v) { graph.add_containment_edge(u, v); });
     }
   }
+
   for (auto& pair : graph.nodes()) {
     auto reg = pair.first;
     auto& node = pair.second;
@@ -264,6 +264,13 @@ class GraphBuilder {
                                       const RangeSet&,
                                       Graph*);
 
+  static Graph build(const LivenessFixpointIterator&,
+                     cfg::ControlFlowGraph&,
+                     reg_t initial_regs,
+                     const RangeSet&,
+                     bool containment_edges,
+                     unsigned num_threads);
+
  public:
   static Graph build(const LivenessFixpointIterator&,
                      cfg::ControlFlowGraph&,
@@ -272,6 +279,11 @@ class GraphBuilder {
                      bool containment_edges = true);
 
   // For unit tests
+  static Graph build_in_parallel(const LivenessFixpointIterator&,
+                                 cfg::ControlFlowGraph&,
+                                 reg_t initial_regs,
+                                 const RangeSet&,
+                                 bool containment_edges = true);
   static Graph create_empty() { return Graph(); }
   static void make_node(Graph*, reg_t, RegisterType, vreg_t max_vreg);
   static void add_edge(Graph*, reg_t, reg_t);
@@ -279,6 +291,14 @@ class GraphBuilder {
 
 uint32_t edge_weight_helper(uint8_t, uint8_t);
 
+/*
+ * The number of threads to build the graph of a method with, given how many
+ * threads are still available, or 1 to build it sequentially.
+ */
+unsigned build_threads(uint32_t num_opcodes,
+                       size_t num_blocks,
+                       unsigned available_threads);
+
 } // namespace impl
 
 inline Graph build_graph(const LivenessFixpointIterator& fixpoint_iter,
@@ -12,10 +12,13 @@
 #include <cstdint>
 #include <iterator>
 #include <limits>
+#include <mutex>
 #include <stack>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <boost/functional/hash.hpp>
 #include <boost/intrusive_ptr.hpp>
@@ -85,12 +88,40 @@ struct EmptyValue {
   static bool equals(const type&, const type&) { return true; }
 };
 
+/*
+ * A Value may opt into hash-consing by declaring
+ *
+ *   static constexpr bool hash_consed = true;
+ *
+ *   // A hash function consistent with Value::equals().
+ *   static size_t hash(const type& x);
+ *
+ * All the nodes of such trees are then interned in a global table, so that
+ * structurally equal trees are represented by the same node. Equality tests
+ * reduce to a pointer comparison, and the operations that already
+ * short-circuit on shared subtrees (leq, union, intersection...) benefit from
+ * the increased sharing. The price is a table lookup under a lock for every
+ * node created.
+ */
+template <typename Value, typename = void>
+struct is_hash_consed : std::false_type {};
+
+template <typename Value>
+struct is_hash_consed<Value, std::void_t<decltype(Value::hash_consed)>>
+    : std::bool_constant<Value::hash_consed> {};
+
+template <typename Value>
+constexpr bool is_hash_consed_v = is_hash_consed<Value>::value;
+
 template <typename IntegerType, typename Value>
 class PatriciaTreeLeaf;
 
 template <typename IntegerType, typename Value>
 class PatriciaTreeBranch;
 
+template <typename IntegerType, typename Value>
+class PatriciaTreeInternTable;
+
 /*
  * Base node common to branches and leafs.
  */
@@ -184,10 +215,30 @@ class PatriciaTreeNode {
         p->m_reference_count.fetch_sub(1, std::memory_order_release);
     const bool is_unique = (prev_reference_count & ~LEAF_MASK) == 1;
     if (is_unique) {
+      if constexpr (is_hash_consed_v<Value>) {
+        PatriciaTreeInternTable<IntegerType, Value>::get().erase(p);
+      }
       intrusive_ptr_delete(p);
     }
   }
 
+  // Takes a new reference unless the node is already being destroyed. This
+  // is how the intern table resurrects a node that it looked up.
+  bool try_add_ref() const {
+    size_t reference_count =
+        m_reference_count.load(std::memory_order_relaxed);
+    while ((reference_count & ~LEAF_MASK) != 0) {
+      if (m_reference_count.compare_exchange_weak(reference_count,
+                                                  reference_count + 1,
+                                                  std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  friend class PatriciaTreeInternTable<IntegerType, Value>;
+
   // We are stealing the highest bit of our reference counter to indicate
   // whether this tree is a leaf (or, otherwise, branch).
   static constexpr size_t LEAF_MASK = ~(static_cast<size_t>(-1) >> 1);
@@ -195,9 +246,12 @@ class PatriciaTreeNode {
 };
 
 /*
- * The base of leaf nodes optionally storing a value.
+ * The base of leaf nodes optionally storing a value, and a hash of both key
+ * and value when hash-consed.
  */
-template <typename IntegerType, typename Value>
+template <typename IntegerType,
+          typename Value,
+          bool HashConsed = is_hash_consed_v<Value>>
 class PatriciaTreeLeafBase {
  public:
   using ValueType = typename Value::type;
@@ -219,8 +273,39 @@ class PatriciaTreeLeafBase {
   StorageType m_pair;
 };
 
+template <typename IntegerType, typename Value>
+class PatriciaTreeLeafBase<IntegerType, Value, /* HashConsed */ true> {
+ public:
+  using ValueType = typename Value::type;
+  using StorageType = std::pair<IntegerType, ValueType>;
+
+  const StorageType& data() const { return m_pair; }
+
+  const IntegerType& key() const { return m_pair.first; }
+
+  const ValueType& value() const { return m_pair.second; }
+
+  size_t hash() const { return m_hash; }
+
+  static size_t hash_of(IntegerType key, const ValueType& value) {
+    size_t hash = 0;
+    boost::hash_combine(hash, key);
+    boost::hash_combine(hash, Value::hash(value));
+    return hash;
+  }
+
+ protected:
+  PatriciaTreeLeafBase(IntegerType key, ValueType value)
+      : m_pair(key, std::move(value)), m_hash(hash_of(key, m_pair.second)) {}
+
+ private:
+  StorageType m_pair;
+  size_t m_hash;
+};
+
 template <typename IntegerType>
-class PatriciaTreeLeafBase<IntegerType, EmptyValue> : private EmptyValue {
+class PatriciaTreeLeafBase<IntegerType, EmptyValue, /* HashConsed */ false>
+    : private EmptyValue {
  public:
   using ValueType = EmptyValue;
   using StorageType = IntegerType;
@@ -259,6 +344,10 @@ class PatriciaTreeLeaf final : public PatriciaTreeNode<IntegerType, Value>,
 
   static inline boost::intrusive_ptr<PatriciaTreeLeaf> make(IntegerType key,
                                                             ValueType value) {
+    if constexpr (is_hash_consed_v<Value>) {
+      return PatriciaTreeInternTable<IntegerType, Value>::get().make_leaf(
+          key, std::move(value));
+    }
     return boost::intrusive_ptr<PatriciaTreeLeaf>(
         new PatriciaTreeLeaf(key, std::move(value)), /* add_ref */ false);
   }
@@ -275,18 +364,27 @@ class PatriciaTreeBranchBase</* HashHash */ true> {
  public:
   size_t hash() const { return m_hash; }
 
+  template <typename IntegerType, typename Value>
+  static size_t hash_of(IntegerType prefix,
+                        IntegerType branching_bit,
+                        const PatriciaTreeNode<IntegerType, Value>& left_tree,
+                        const PatriciaTreeNode<IntegerType, Value>& right_tree) {
+    size_t hash = 0;
+    boost::hash_combine(hash, prefix);
+    boost::hash_combine(hash, branching_bit);
+    boost::hash_combine(hash, left_tree.hash());
+    boost::hash_combine(hash, right_tree.hash());
+    return hash;
+  }
+
  protected:
   template <typename IntegerType, typename Value>
   PatriciaTreeBranchBase(
       IntegerType prefix,
       IntegerType branching_bit,
       const PatriciaTreeNode<IntegerType, Value>& left_tree,
-      const PatriciaTreeNode<IntegerType, Value>& right_tree) {
-    boost::hash_combine(m_hash, prefix);
-    boost::hash_combine(m_hash, branching_bit);
-    boost::hash_combine(m_hash, left_tree.hash());
-    boost::hash_combine(m_hash, right_tree.hash());
-  }
+      const PatriciaTreeNode<IntegerType, Value>& right_tree)
+      : m_hash(hash_of(prefix, branching_bit, left_tree, right_tree)) {}
 
  private:
   size_t m_hash{0};
@@ -311,9 +409,12 @@ class PatriciaTreeBranchBase</* HasHash */ false> {
 template <typename IntegerType, typename Value>
 class PatriciaTreeBranch final
     : public PatriciaTreeNode<IntegerType, Value>,
-      public PatriciaTreeBranchBase<std::is_same_v<Value, EmptyValue>> {
+      public PatriciaTreeBranchBase<std::is_same_v<Value, EmptyValue> ||
+                                    is_hash_consed_v<Value>> {
   using Base = PatriciaTreeNode<IntegerType, Value>;
-  using BranchBase = PatriciaTreeBranchBase<std::is_same_v<Value, EmptyValue>>;
+  using BranchBase =
+      PatriciaTreeBranchBase<std::is_same_v<Value, EmptyValue> ||
+                             is_hash_consed_v<Value>>;
 
  public:
   PatriciaTreeBranch(IntegerType prefix,
@@ -342,6 +443,10 @@ class PatriciaTreeBranch final
       IntegerType branching_bit,
       boost::intrusive_ptr<Base> left_tree,
       boost::intrusive_ptr<Base> right_tree) {
+    if constexpr (is_hash_consed_v<Value>) {
+      return PatriciaTreeInternTable<IntegerType, Value>::get().make_branch(
+          prefix, branching_bit, std::move(left_tree), std::move(right_tree));
+    }
     return boost::intrusive_ptr<PatriciaTreeBranch>(
         new PatriciaTreeBranch(prefix, branching_bit, std::move(left_tree),
                                std::move(right_tree)),
@@ -353,6 +458,158 @@ class PatriciaTreeBranch final
   boost::intrusive_ptr<Base> m_left_tree, m_right_tree;
 };
 
+/*
+ * The table of all live nodes of hash-consed trees with a given Value. Nodes
+ * are looked up by their hash and their shallow structure: the children of a
+ * branch are themselves interned, so comparing them by address is enough.
+ *
+ * A node is removed from the table when its reference count drops to zero.
+ * Until then, a lookup may still find it, but cannot take a reference to it
+ * any more; a fresh node is interned instead.
+ */
+template <typename IntegerType, typename Value>
+class PatriciaTreeInternTable final {
+ public:
+  using NodeType = PatriciaTreeNode<IntegerType, Value>;
+  using LeafType = typename NodeType::LeafType;
+  using BranchType = typename NodeType::BranchType;
+  using ValueType = typename Value::type;
+
+  static PatriciaTreeInternTable& get() {
+    // Never destroyed, since trees held in static variables may be released
+    // after it would be.
+    static auto* table = new PatriciaTreeInternTable();
+    return *table;
+  }
+
+  boost::intrusive_ptr<LeafType> make_leaf(IntegerType key, ValueType value) {
+    size_t hash = LeafType::hash_of(key, value);
+    auto& shard = get_shard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      const auto* leaf = it->second->as_leaf();
+      if (leaf != nullptr && leaf->key() == key &&
+          Value::equals(leaf->value(), value) && leaf->try_add_ref()) {
+        return boost::intrusive_ptr<LeafType>(const_cast<LeafType*>(leaf),
+                                              /* add_ref */ false);
+      }
+    }
+    auto* leaf = new LeafType(key, std::move(value));
+    shard.nodes.emplace(hash, leaf);
+    return boost::intrusive_ptr<LeafType>(leaf, /* add_ref */ false);
+  }
+
+  boost::intrusive_ptr<BranchType> make_branch(
+      IntegerType prefix,
+      IntegerType branching_bit,
+      boost::intrusive_ptr<NodeType> left_tree,
+      boost::intrusive_ptr<NodeType> right_tree) {
+    size_t hash =
+        BranchType::hash_of(prefix, branching_bit, *left_tree, *right_tree);
+    auto& shard = get_shard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      const auto* branch = it->second->as_branch();
+      if (branch != nullptr && branch->prefix() == prefix &&
+          branch->branching_bit() == branching_bit &&
+          branch->left_tree() == left_tree &&
+          branch->right_tree() == right_tree && branch->try_add_ref()) {
+        return boost::intrusive_ptr<BranchType>(
+            const_cast<BranchType*>(branch), /* add_ref */ false);
+      }
+    }
+    auto* branch = new BranchType(prefix, branching_bit, std::move(left_tree),
+                                  std::move(right_tree));
+    shard.nodes.emplace(hash, branch);
+    return boost::intrusive_ptr<BranchType>(branch, /* add_ref */ false);
+  }
+
+  void erase(const NodeType* node) {
+    size_t hash = node->hash();
+    auto& shard = get_shard(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto range = shard.nodes.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == node) {
+        shard.nodes.erase(it);
+        return;
+      }
+    }
+    SPARTA_THROW_EXCEPTION(internal_error()
+                           << error_msg("Node is not interned"));
+  }
+
+  // The number of live nodes.
+  size_t size() const {
+    size_t size = 0;
+    for (auto& shard : m_shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      size += shard.nodes.size();
+    }
+    return size;
+  }
+
+ private:
+  static constexpr size_t kNumShards = 64;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    std::unordered_multimap<size_t, const NodeType*> nodes;
+  };
+
+  PatriciaTreeInternTable() = default;
+
+  Shard& get_shard(size_t hash) { return m_shards[hash % kNumShards]; }
+
+  Shard m_shards[kNumShards];
+};
+
+/*
+ * A fixed-size cache of the results of a binary tree operation, keyed by the
+ * identity of its operands. Entries hold references to the operands, so an
+ * address is never reused while it is cached; a colliding entry simply
+ * replaces the previous one. A cache must only ever be used for one
+ * operation. It is most effective on hash-consed trees, where equal subtrees
+ * are the same node.
+ */
+template <typename IntegerType, typename Value>
+class PatriciaTreeOperationCache final {
+ public:
+  using NodePtr = boost::intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>;
+
+  explicit PatriciaTreeOperationCache(size_t size = 1024) : m_entries(size) {}
+
+  // Both operands must be non-null.
+  const NodePtr* find(const NodePtr& s, const NodePtr& t) const {
+    const auto& entry = m_entries[index(s, t)];
+    return entry.s == s && entry.t == t ? &entry.result : nullptr;
+  }
+
+  void insert(NodePtr s, NodePtr t, NodePtr result) {
+    auto& entry = m_entries[index(s, t)];
+    entry.s = std::move(s);
+    entry.t = std::move(t);
+    entry.result = std::move(result);
+  }
+
+ private:
+  struct Entry {
+    NodePtr s;
+    NodePtr t;
+    NodePtr result;
+  };
+
+  size_t index(const NodePtr& s, const NodePtr& t) const {
+    size_t hash = s->hash();
+    boost::hash_combine(hash, t->hash());
+    return hash % m_entries.size();
+  }
+
+  std::vector<Entry> m_entries;
+};
+
 // Advances over each leaf in the tree in post-order.
 //
 // This is the central core that iterators use to iterate,
@@ -695,6 +952,10 @@ template <typename IntegerType, typename Value>
 inline bool is_tree_equal(
     const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& tree1,
     const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& tree2) {
+  if constexpr (is_hash_consed_v<Value>) {
+    // Equal trees are the same node.
+    return tree1 == tree2;
+  }
   if (tree1 == tree2) {
     // This conditions allows the equality test to run in sublinear time
     // when comparing Patricia trees that share some structure.
@@ -1096,11 +1357,21 @@ inline intrusive_ptr<PatriciaTreeLeaf<IntegerType, Value>> use_available_leaf(
   }
 }
 
+template <typename IntegerType, typename Value, typename LeafCombine>
+inline intrusive_ptr<PatriciaTreeNode<IntegerType, Value>> intersect_branches(
+    LeafCombine&& leaf_combine,
+    const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& s,
+    const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& t,
+    PatriciaTreeOperationCache<IntegerType, Value>* cache);
+
+// If a cache is given, the intersections of pairs of branches are looked up
+// in and recorded into it.
 template <typename IntegerType, typename Value, typename LeafCombine>
 inline intrusive_ptr<PatriciaTreeNode<IntegerType, Value>> intersect_trees(
     LeafCombine&& leaf_combine,
     const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& s,
-    const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& t) {
+    const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& t,
+    PatriciaTreeOperationCache<IntegerType, Value>* cache = nullptr) {
   if (s == t) {
     // This conditional is what allows the intersection operation to complete in
     // sublinear time when the operands share some structure.
@@ -1127,6 +1398,23 @@ inline intrusive_ptr<PatriciaTreeNode<IntegerType, Value>> intersect_trees(
           boost::static_pointer_cast<PatriciaTreeLeaf<IntegerType, Value>>(t));
     }
   }
+  if (cache == nullptr) {
+    return intersect_branches(leaf_combine, s, t, cache);
+  }
+  if (const auto* result = cache->find(s, t)) {
+    return *result;
+  }
+  auto result = intersect_branches(leaf_combine, s, t, cache);
+  cache->insert(s, t, result);
+  return result;
+}
+
+template <typename IntegerType, typename Value, typename LeafCombine>
+inline intrusive_ptr<PatriciaTreeNode<IntegerType, Value>> intersect_branches(
+    LeafCombine&& leaf_combine,
+    const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& s,
+    const intrusive_ptr<PatriciaTreeNode<IntegerType, Value>>& t,
+    PatriciaTreeOperationCache<IntegerType, Value>* cache) {
   const auto* s_branch = s->as_branch();
   const auto* t_branch = t->as_branch();
   IntegerType m = s_branch->branching_bit();
@@ -1140,8 +1428,8 @@ inline intrusive_ptr<PatriciaTreeNode<IntegerType, Value>> intersect_trees(
   if (m == n && p == q) {
     // The two trees have the same prefix. We merge the intersection of the
     // corresponding subtrees.
-    auto new_left = intersect_trees(leaf_combine, s0, t0);
-    auto new_right = intersect_trees(leaf_combine, s1, t1);
+    auto new_left = intersect_trees(leaf_combine, s0, t0, cache);
+    auto new_right = intersect_trees(leaf_combine, s1, t1, cache);
     if (new_left == s0 && new_right == s1) {
       return s;
     } else {
@@ -1149,10 +1437,12 @@ inline intrusive_ptr<PatriciaTreeNode<IntegerType, Value>> intersect_trees(
     }
   } else if (m < n && match_prefix(q, p, m)) {
     // q contains p. Intersect t with a subtree of s.
-    return intersect_trees(leaf_combine, is_zero_bit(q, m) ? s0 : s1, t);
+    return intersect_trees(leaf_combine, is_zero_bit(q, m) ? s0 : s1, t,
+                           cache);
   } else if (m > n && match_prefix(p, q, n)) {
     // p contains q. Intersect s with a subtree of t.
-    return intersect_trees(leaf_combine, s, is_zero_bit(p, n) ? t0 : t1);
+    return intersect_trees(leaf_combine, s, is_zero_bit(p, n) ? t0 : t1,
+                           cache);
   }
   // The prefixes disagree.
   return nullptr;
@@ -1305,6 +1595,7 @@ class PatriciaTreeCore {
   using IntegerType = typename Codec::IntegerType;
   using ValueType = typename Value::type;
   using IteratorType = PatriciaTreeIterator<Key, Value>;
+  using OperationCache = PatriciaTreeOperationCache<IntegerType, Value>;
 
   static_assert(std::is_same_v<decltype(Value::default_value()), ValueType>,
                 "Value::default_value() does not exist");
@@ -1393,9 +1684,10 @@ class PatriciaTreeCore {
 
   template <typename LeafCombine>
   inline void intersect(LeafCombine&& leaf_combine,
-                        const PatriciaTreeCore& other) {
+                        const PatriciaTreeCore& other,
+                        OperationCache* cache = nullptr) {
     m_tree = pt_core::intersect_trees(std::forward<LeafCombine>(leaf_combine),
-                                      m_tree, other.m_tree);
+                                      m_tree, other.m_tree, cache);
   }
 
   template <typename LeafCombine>
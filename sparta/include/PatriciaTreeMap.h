@@ -58,6 +58,10 @@ namespace sparta {
  *     // must be implemented. Additionally, value::type must be an
  *     // implementation of an AbstractDomain.
  *     static bool leq(const type& x, const type& y);
+ *
+ *     // Optional: intern the nodes of the map (see PatriciaTreeCore.h).
+ *     static constexpr bool hash_consed = true;
+ *     static size_t hash(const type& x);
  *   }
  *
  * Patricia trees can only handle unsigned integers. Arbitrary objects can be
@@ -86,6 +90,8 @@ class PatriciaTreeMap final {
 
   using IntegerType = typename Codec::IntegerType;
 
+  using OperationCache = typename Core::OperationCache;
+
   static_assert(std::is_same_v<ValueType, mapped_type>,
                 "ValueType must be equal to Value::type");
 
@@ -179,10 +185,13 @@ class PatriciaTreeMap final {
     return *this;
   }
 
+  // If a cache is given, it memoizes the intersections of subtrees. It must
+  // only be used with the same combining function.
   template <typename CombiningFunction>
   PatriciaTreeMap& intersection_with(const CombiningFunction& combine,
-                                     const PatriciaTreeMap& other) {
-    m_core.intersect(apply_leafs(combine), other.m_core);
+                                     const PatriciaTreeMap& other,
+                                     OperationCache* cache = nullptr) {
+    m_core.intersect(apply_leafs(combine), other.m_core, cache);
     return *this;
   }
 
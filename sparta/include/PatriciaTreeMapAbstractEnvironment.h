@@ -22,7 +22,7 @@ namespace sparta {
 
 namespace ptmae_impl {
 
-template <typename Variable, typename Domain>
+template <typename Variable, typename Domain, typename DomainHash>
 class MapValue;
 
 class value_is_bottom {};
@@ -37,14 +37,20 @@ class value_is_bottom {};
  *
  * See HashedAbstractEnvironment.h for more details about abstract
  * environments.
+ *
+ * If a DomainHash is given, the underlying trees are hash-consed (see
+ * PatriciaTreeCore.h): equal environments share their representation, so
+ * that equality is a pointer comparison, and joins and widenings of subtrees
+ * are memoized in a per-thread cache. This pays off in fixpoint iterations
+ * over large environments that mostly stay the same.
  */
-template <typename Variable, typename Domain>
+template <typename Variable, typename Domain, typename DomainHash = void>
 class PatriciaTreeMapAbstractEnvironment final
     : public AbstractDomainScaffolding<
-          ptmae_impl::MapValue<Variable, Domain>,
-          PatriciaTreeMapAbstractEnvironment<Variable, Domain>> {
+          ptmae_impl::MapValue<Variable, Domain, DomainHash>,
+          PatriciaTreeMapAbstractEnvironment<Variable, Domain, DomainHash>> {
  public:
-  using Value = ptmae_impl::MapValue<Variable, Domain>;
+  using Value = ptmae_impl::MapValue<Variable, Domain, DomainHash>;
 
   using MapType =
       PatriciaTreeMap<Variable, Domain, typename Value::ValueInterface>;
@@ -182,13 +188,19 @@ class PatriciaTreeMapAbstractEnvironment final
   }
 };
 
+template <typename Variable,
+          typename Domain,
+          typename DomainHash = std::hash<Domain>>
+using HashConsedPatriciaTreeMapAbstractEnvironment =
+    PatriciaTreeMapAbstractEnvironment<Variable, Domain, DomainHash>;
+
 } // namespace sparta
 
-template <typename Variable, typename Domain>
+template <typename Variable, typename Domain, typename DomainHash>
 inline std::ostream& operator<<(
     std::ostream& o,
-    const typename sparta::PatriciaTreeMapAbstractEnvironment<Variable, Domain>&
-        e) {
+    const typename sparta::
+        PatriciaTreeMapAbstractEnvironment<Variable, Domain, DomainHash>& e) {
   using namespace sparta;
   switch (e.kind()) {
   case AbstractValueKind::Bottom: {
@@ -222,12 +234,15 @@ namespace ptmae_impl {
  * return AbstractValueKind::Bottom whenever a binding with Bottom is about to
  * be created.
  */
-template <typename Variable, typename Domain>
-class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
+template <typename Variable, typename Domain, typename DomainHash>
+class MapValue final
+    : public AbstractValue<MapValue<Variable, Domain, DomainHash>> {
  public:
   struct ValueInterface {
     using type = Domain;
 
+    static constexpr bool hash_consed = !std::is_void_v<DomainHash>;
+
     static type default_value() { return type::top(); }
 
     static bool is_default_value(const type& x) { return x.is_top(); }
@@ -235,8 +250,18 @@ class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
     static bool equals(const type& x, const type& y) { return x.equals(y); }
 
     static bool leq(const type& x, const type& y) { return x.leq(y); }
+
+    static size_t hash(const type& x) {
+      if constexpr (hash_consed) {
+        return DomainHash()(x);
+      } else {
+        return 0;
+      }
+    }
   };
 
+  using MapType = PatriciaTreeMap<Variable, Domain, ValueInterface>;
+
   MapValue() = default;
 
   MapValue(const Variable& variable, Domain value) {
@@ -261,12 +286,14 @@ class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
 
   AbstractValueKind join_with(const MapValue& other) override {
     return join_like_operation(
-        other, [](const Domain& x, const Domain& y) { return x.join(y); });
+        other, [](const Domain& x, const Domain& y) { return x.join(y); },
+        get_cache</* is_join */ true>());
   }
 
   AbstractValueKind widen_with(const MapValue& other) override {
     return join_like_operation(
-        other, [](const Domain& x, const Domain& y) { return x.widening(y); });
+        other, [](const Domain& x, const Domain& y) { return x.widening(y); },
+        get_cache</* is_join */ false>());
   }
 
   AbstractValueKind meet_with(const MapValue& other) override {
@@ -295,10 +322,23 @@ class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
     return m_map.erase_all_matching(variable_mask);
   }
 
+  // One cache per thread for each of join and widening, when hash-consed.
+  template <bool is_join>
+  static typename MapType::OperationCache* get_cache() {
+    if constexpr (ValueInterface::hash_consed) {
+      thread_local typename MapType::OperationCache cache;
+      return &cache;
+    } else {
+      return nullptr;
+    }
+  }
+
   template <typename Operation> // Domain(const Domain&, const Domain&)
-  AbstractValueKind join_like_operation(const MapValue& other,
-                                        Operation&& operation) {
-    m_map.intersection_with(operation, other.m_map);
+  AbstractValueKind join_like_operation(
+      const MapValue& other,
+      Operation&& operation,
+      typename MapType::OperationCache* cache) {
+    m_map.intersection_with(operation, other.m_map, cache);
     return kind();
   }
 
@@ -322,9 +362,9 @@ class MapValue final : public AbstractValue<MapValue<Variable, Domain>> {
     }
   }
 
-  PatriciaTreeMap<Variable, Domain, ValueInterface> m_map;
+  MapType m_map;
 
-  template <typename T1, typename T2>
+  template <typename T1, typename T2, typename T3>
   friend class sparta::PatriciaTreeMapAbstractEnvironment;
 };
 
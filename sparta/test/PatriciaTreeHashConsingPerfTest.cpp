@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <gtest/gtest.h>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include "ConstantAbstractDomain.h"
+#include "PatriciaTreeMapAbstractEnvironment.h"
+
+/*
+ * Compares plain and hash-consed Patricia-tree environments on a workload
+ * that mimics a fixpoint iteration over a large method: many environments
+ * are built independently, differ in few bindings, and are repeatedly
+ * joined and compared.
+ */
+
+namespace {
+
+// Tracks the bytes currently allocated through operator new, so that we can
+// measure the memory held by the environments.
+std::atomic<int64_t> live_bytes{0};
+
+constexpr size_t kHeaderSize = alignof(std::max_align_t);
+
+} // namespace
+
+void* operator new(size_t size) {
+  auto* p = static_cast<char*>(std::malloc(size + kHeaderSize));
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  *reinterpret_cast<size_t*>(p) = size;
+  live_bytes += size;
+  return p + kHeaderSize;
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr == nullptr) {
+    return;
+  }
+  auto* p = static_cast<char*>(ptr) - kHeaderSize;
+  live_bytes -= *reinterpret_cast<size_t*>(p);
+  std::free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept { operator delete(ptr); }
+
+using namespace sparta;
+
+namespace {
+
+using Domain = ConstantAbstractDomain<uint32_t>;
+
+struct DomainHash {
+  size_t operator()(const Domain& d) const {
+    auto constant = d.get_constant();
+    return constant ? *constant : static_cast<size_t>(d.kind());
+  }
+};
+
+using Environment = PatriciaTreeMapAbstractEnvironment<uint32_t, Domain>;
+using HashConsedEnvironment =
+    HashConsedPatriciaTreeMapAbstractEnvironment<uint32_t, Domain, DomainHash>;
+
+constexpr uint32_t kNumVariables = 2000;
+constexpr uint32_t kNumStates = 100;
+constexpr uint32_t kNumRounds = 5;
+
+struct Measurement {
+  int64_t bytes;
+  double build_seconds;
+  double iterate_seconds;
+  size_t num_stable;
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+template <typename Env>
+Measurement measure() {
+  Measurement result;
+  auto bytes_before = live_bytes.load();
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Env> states;
+  states.reserve(kNumStates);
+  for (uint32_t i = 0; i < kNumStates; ++i) {
+    Env env;
+    for (uint32_t v = 0; v < kNumVariables; ++v) {
+      env.set(v, Domain(v % 16));
+    }
+    env.set((i * 7919) % kNumVariables, Domain(1000 + i % 3));
+    states.push_back(std::move(env));
+  }
+  result.build_seconds = seconds_since(start);
+  result.bytes = live_bytes.load() - bytes_before;
+
+  start = std::chrono::steady_clock::now();
+  result.num_stable = 0;
+  for (uint32_t round = 0; round < kNumRounds; ++round) {
+    for (uint32_t i = 0; i < kNumStates; ++i) {
+      auto joined = states[i].join(states[(i + 1) % kNumStates]);
+      if (joined.equals(states[i]) || joined.leq(states[i])) {
+        ++result.num_stable;
+      }
+    }
+  }
+  result.iterate_seconds = seconds_since(start);
+  return result;
+}
+
+void print(const char* name, const Measurement& m) {
+  std::cout << name << ": " << m.bytes / 1024 << " KiB, built in "
+            << m.build_seconds << "s, " << kNumRounds << " rounds of joins in "
+            << m.iterate_seconds << "s" << std::endl;
+}
+
+} // namespace
+
+TEST(PatriciaTreeHashConsingPerfTest, largeEnvironments) {
+  auto plain = measure<Environment>();
+  auto hash_consed = measure<HashConsedEnvironment>();
+  print("plain", plain);
+  print("hash-consed", hash_consed);
+
+  EXPECT_EQ(plain.num_stable, hash_consed.num_stable);
+  // The states share all but a few paths of their trees.
+  EXPECT_LT(hash_consed.bytes * 10, plain.bytes);
+}
@@ -13,6 +13,7 @@
 #include <limits>
 #include <random>
 #include <sstream>
+#include <thread>
 
 #include "HashedAbstractEnvironment.h"
 #include "HashedSetAbstractDomain.h"
@@ -22,6 +23,20 @@ using namespace sparta;
 using Domain = HashedSetAbstractDomain<std::string>;
 using Environment = PatriciaTreeMapAbstractEnvironment<uint32_t, Domain>;
 
+struct DomainHash {
+  size_t operator()(const Domain& d) const {
+    // Hash sets have no iteration order.
+    size_t hash = d.kind() == AbstractValueKind::Value ? 0 : 1;
+    for (const auto& element : d.elements()) {
+      hash += std::hash<std::string>()(element);
+    }
+    return hash;
+  }
+};
+
+using HashConsedEnvironment =
+    HashConsedPatriciaTreeMapAbstractEnvironment<uint32_t, Domain, DomainHash>;
+
 class PatriciaTreeMapAbstractEnvironmentTest : public ::testing::Test {
  protected:
   PatriciaTreeMapAbstractEnvironmentTest()
@@ -280,3 +295,73 @@ TEST_F(PatriciaTreeMapAbstractEnvironmentTest, prettyPrinting) {
   out << e.bindings();
   EXPECT_EQ("{a -> [#1]{A}}", out.str());
 }
+
+TEST_F(PatriciaTreeMapAbstractEnvironmentTest, hashConsing) {
+  auto to_hash_consed = [](const Environment& env) {
+    if (env.is_bottom()) {
+      return HashConsedEnvironment::bottom();
+    }
+    HashConsedEnvironment result;
+    if (env.is_value()) {
+      for (const auto& [variable, value] : env.bindings()) {
+        result.set(variable, value);
+      }
+    }
+    return result;
+  };
+
+  for (size_t k = 0; k < 10; ++k) {
+    Environment e1 = this->generate_random_environment();
+    Environment e2 = this->generate_random_environment();
+    auto h1 = to_hash_consed(e1);
+    auto h2 = to_hash_consed(e2);
+
+    // Environments built independently share their representation.
+    auto h1_copy = to_hash_consed(e1);
+    EXPECT_TRUE(h1.equals(h1_copy));
+    if (h1.is_value()) {
+      EXPECT_TRUE(h1.bindings().reference_equals(h1_copy.bindings()));
+    }
+
+    EXPECT_EQ(h1.leq(h2), e1.leq(e2));
+    EXPECT_EQ(h1.equals(h2), e1.equals(e2));
+    EXPECT_TRUE(h1.join(h2).equals(to_hash_consed(e1.join(e2))));
+    EXPECT_TRUE(h1.widening(h2).equals(to_hash_consed(e1.widening(e2))));
+    EXPECT_TRUE(h1.meet(h2).equals(to_hash_consed(e1.meet(e2))));
+    // A second join hits the cache.
+    EXPECT_TRUE(h1.join(h2).equals(to_hash_consed(e1.join(e2))));
+  }
+
+  HashConsedEnvironment e({{1, Domain({"a", "b"})}, {2, Domain("c")}});
+  e.set(1, Domain({"a"}));
+  EXPECT_FALSE(e.equals(HashConsedEnvironment(
+      {{1, Domain({"a", "b"})}, {2, Domain("c")}})));
+  e.set(1, Domain({"b", "a"}));
+  EXPECT_TRUE(e.bindings().reference_equals(
+      HashConsedEnvironment({{2, Domain("c")}, {1, Domain({"a", "b"})}})
+          .bindings()));
+}
+
+TEST_F(PatriciaTreeMapAbstractEnvironmentTest, hashConsingConcurrently) {
+  // Threads repeatedly create and drop the same environments, so that nodes
+  // get interned while others with the same content are being released.
+  std::vector<std::thread> threads;
+  std::vector<HashConsedEnvironment> results(4);
+  for (size_t t = 0; t < results.size(); ++t) {
+    threads.emplace_back([&results, t] {
+      for (uint32_t i = 0; i < 1000; ++i) {
+        HashConsedEnvironment env;
+        for (uint32_t v = 0; v < 32; ++v) {
+          env.set(v, Domain(std::to_string((v + i) % 4)));
+        }
+        results[t] = env;
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& result : results) {
+    EXPECT_TRUE(result.bindings().reference_equals(results[0].bindings()));
+  }
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "ConcurrentContainers.h"
+#include "DexClass.h"
+#include "RedexTest.h"
+#include "WorkQueue.h"
+
+//==========
+// Compares the node-based concurrent containers against their flat
+// open-addressing counterparts on key distributions Redex actually sees:
+// interned DexType pointers and class-name strings.
+//==========
+
+namespace {
+
+constexpr size_t kNumKeys = 500000;
+constexpr size_t kLookupRounds = 4;
+
+std::vector<const DexType*> make_type_keys() {
+  std::vector<const DexType*> keys;
+  keys.reserve(kNumKeys);
+  for (size_t i = 0; i < kNumKeys; ++i) {
+    keys.push_back(DexType::make_type("Lcom/facebook/perf/pkg" +
+                                      std::to_string(i % 97) + "/Cls" +
+                                      std::to_string(i) + ";"));
+  }
+  return keys;
+}
+
+std::vector<std::string> make_string_keys(
+    const std::vector<const DexType*>& types) {
+  std::vector<std::string> keys;
+  keys.reserve(types.size());
+  for (auto* type : types) {
+    keys.push_back(type->str_copy());
+  }
+  return keys;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+template <typename Map, typename Key>
+size_t profile_map(const char* name, const std::vector<Key>& keys) {
+  Map map;
+  auto start = std::chrono::steady_clock::now();
+  workqueue_run_for<size_t>(0, keys.size(), [&](size_t i) {
+    map.emplace(keys[i], static_cast<uint32_t>(i));
+  });
+  double insert_ms = elapsed_ms(start);
+
+  std::atomic<size_t> found{0};
+  start = std::chrono::steady_clock::now();
+  workqueue_run_for<size_t>(0, keys.size() * kLookupRounds, [&](size_t i) {
+    if (map.count(keys[i % keys.size()])) {
+      found.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  double lookup_ms = elapsed_ms(start);
+
+  printf("%-28s insert: %8.2f ms  lookup: %8.2f ms\n", name, insert_ms,
+         lookup_ms);
+  return found.load();
+}
+
+template <typename Set, typename Key>
+size_t profile_set(const char* name, const std::vector<Key>& keys) {
+  Set set;
+  auto start = std::chrono::steady_clock::now();
+  workqueue_run_for<size_t>(0, keys.size(),
+                            [&](size_t i) { set.insert(keys[i]); });
+  double insert_ms = elapsed_ms(start);
+
+  std::atomic<size_t> found{0};
+  start = std::chrono::steady_clock::now();
+  workqueue_run_for<size_t>(0, keys.size() * kLookupRounds, [&](size_t i) {
+    if (set.count(keys[i % keys.size()])) {
+      found.fetch_add(1, std::memory_order_relaxed);
+    }
+  });
+  double lookup_ms = elapsed_ms(start);
+
+  printf("%-28s insert: %8.2f ms  lookup: %8.2f ms\n", name, insert_ms,
+         lookup_ms);
+  return found.load();
+}
+
+} // namespace
+
+class ConcurrentContainersPerfTest : public RedexTest {};
+
+TEST_F(ConcurrentContainersPerfTest, typeKeys) {
+  auto keys = make_type_keys();
+  size_t expected = keys.size() * kLookupRounds;
+  EXPECT_EQ(expected,
+            (profile_map<ConcurrentMap<const DexType*, uint32_t>>(
+                "ConcurrentMap<DexType*>", keys)));
+  EXPECT_EQ(expected,
+            (profile_map<ConcurrentFlatMap<const DexType*, uint32_t>>(
+                "ConcurrentFlatMap<DexType*>", keys)));
+  EXPECT_EQ(expected,
+            (profile_set<ConcurrentSet<const DexType*>>(
+                "ConcurrentSet<DexType*>", keys)));
+  EXPECT_EQ(expected,
+            (profile_set<ConcurrentFlatSet<const DexType*>>(
+                "ConcurrentFlatSet<DexType*>", keys)));
+}
+
+TEST_F(ConcurrentContainersPerfTest, stringKeys) {
+  auto keys = make_string_keys(make_type_keys());
+  size_t expected = keys.size() * kLookupRounds;
+  EXPECT_EQ(expected,
+            (profile_map<ConcurrentMap<std::string, uint32_t>>(
+                "ConcurrentMap<string>", keys)));
+  EXPECT_EQ(expected,
+            (profile_map<ConcurrentFlatMap<std::string, uint32_t>>(
+                "ConcurrentFlatMap<string>", keys)));
+  EXPECT_EQ(expected,
+            (profile_set<ConcurrentSet<std::string>>("ConcurrentSet<string>",
+                                                     keys)));
+  EXPECT_EQ(expected,
+            (profile_set<ConcurrentFlatSet<std::string>>(
+                "ConcurrentFlatSet<string>", keys)));
+}
@@ -93,10 +93,17 @@ class ConcurrentContainersTest : public ::testing::Test {
   std::unordered_set<uint32_t> m_subset_data_set;
   std::vector<uint32_t> m_samples[kThreads];
   std::vector<uint32_t> m_subset_samples[kThreads];
+
+  template <typename Set>
+  void check_concurrent_set();
+
+  template <typename Map>
+  void check_concurrent_map();
 };
 
-TEST_F(ConcurrentContainersTest, concurrentSetTest) {
-  ConcurrentSet<uint32_t> set;
+template <typename Set>
+void ConcurrentContainersTest::check_concurrent_set() {
+  Set set;
 
   run_on_samples([&set](const std::vector<uint32_t>& sample) {
     for (size_t i = 0; i < sample.size(); ++i) {
@@ -105,7 +112,7 @@ TEST_F(ConcurrentContainersTest, concurrentSetTest) {
     }
   });
   EXPECT_EQ(m_data_set.size(), set.size());
-  auto check_initial_values = [&](const ConcurrentSet<uint32_t>& set) {
+  auto check_initial_values = [&](const Set& set) {
     for (uint32_t x : m_data) {
       EXPECT_EQ(1, set.count(x));
       EXPECT_NE(set.end(), set.find(x));
@@ -155,6 +162,14 @@ TEST_F(ConcurrentContainersTest, concurrentSetTest) {
   EXPECT_EQ(0, set.size());
 }
 
+TEST_F(ConcurrentContainersTest, concurrentSetTest) {
+  check_concurrent_set<ConcurrentSet<uint32_t>>();
+}
+
+TEST_F(ConcurrentContainersTest, concurrentFlatSetTest) {
+  check_concurrent_set<ConcurrentFlatSet<uint32_t>>();
+}
+
 TEST_F(ConcurrentContainersTest, insertOnlyConcurrentSetTest) {
   InsertOnlyConcurrentSet<uint32_t> set;
 
@@ -225,8 +240,9 @@ TEST_F(ConcurrentContainersTest, insertOnlyConcurrentSetTest) {
   }
 }
 
-TEST_F(ConcurrentContainersTest, concurrentMapTest) {
-  ConcurrentMap<std::string, uint32_t> map;
+template <typename Map>
+void ConcurrentContainersTest::check_concurrent_map() {
+  Map map;
 
   run_on_samples([&map](const std::vector<uint32_t>& sample) {
     for (size_t i = 0; i < sample.size(); ++i) {
@@ -261,17 +277,16 @@ TEST_F(ConcurrentContainersTest, concurrentMapTest) {
     }
   });
   EXPECT_EQ(m_data_set.size(), map.size());
-  auto check_initial_values =
-      [&](const ConcurrentMap<std::string, uint32_t>& map) {
-        for (uint32_t x : m_data) {
-          std::string s = std::to_string(x);
-          EXPECT_EQ(1, map.count(s));
-          auto it = map.find(s);
-          EXPECT_NE(map.end(), it);
-          EXPECT_EQ(s, it->first);
-          EXPECT_EQ(x + occurrences[x], it->second);
-        }
-      };
+  auto check_initial_values = [&](const Map& map) {
+    for (uint32_t x : m_data) {
+      std::string s = std::to_string(x);
+      EXPECT_EQ(1, map.count(s));
+      auto it = map.find(s);
+      EXPECT_NE(map.end(), it);
+      EXPECT_EQ(s, it->first);
+      EXPECT_EQ(x + occurrences[x], it->second);
+    }
+  };
   check_initial_values(map);
 
   auto copy = map;
@@ -311,3 +326,11 @@ TEST_F(ConcurrentContainersTest, concurrentMapTest) {
   map.clear();
   EXPECT_EQ(0, map.size());
 }
+
+TEST_F(ConcurrentContainersTest, concurrentMapTest) {
+  check_concurrent_map<ConcurrentMap<std::string, uint32_t>>();
+}
+
+TEST_F(ConcurrentContainersTest, concurrentFlatMapTest) {
+  check_concurrent_map<ConcurrentFlatMap<std::string, uint32_t>>();
+}
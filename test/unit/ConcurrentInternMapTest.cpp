@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ConcurrentInternMap.h"
+
+#include <gtest/gtest.h>
+#include <map>
+#include <thread>
+#include <vector>
+
+constexpr size_t kThreads = 8;
+constexpr size_t kElementsPerThread = 20000;
+
+TEST(ConcurrentInternMapTest, insertFindErase) {
+  ConcurrentInternMap<uint32_t, uint32_t> map;
+  EXPECT_EQ(map.get(1, 0), 0);
+  EXPECT_TRUE(map.emplace(1, 10));
+  EXPECT_FALSE(map.emplace(1, 11));
+  EXPECT_EQ(map.get(1, 0), 10);
+  EXPECT_EQ(map.at(1), 10);
+  EXPECT_EQ(map.count(1), 1);
+  EXPECT_EQ(map.count(2), 0);
+
+  EXPECT_EQ(map.erase(2), 0);
+  EXPECT_EQ(map.erase(1), 1);
+  EXPECT_EQ(map.count(1), 0);
+  EXPECT_TRUE(map.emplace(1, 12));
+  EXPECT_EQ(map.get(1, 0), 12);
+  EXPECT_EQ(map.size(), 1);
+}
+
+TEST(ConcurrentInternMapTest, growsAndIterates) {
+  ConcurrentInternMap<uint32_t, uint32_t> map;
+  for (uint32_t i = 0; i < 100000; i++) {
+    EXPECT_TRUE(map.emplace(i, i * 2));
+  }
+  for (uint32_t i = 0; i < 100000; i += 2) {
+    EXPECT_EQ(map.erase(i), 1);
+  }
+  EXPECT_EQ(map.size(), 50000);
+
+  // Freeing the removed nodes and the replaced bucket arrays leaves the
+  // elements intact.
+  map.reclaim();
+  for (uint32_t i = 0; i < 100000; i++) {
+    EXPECT_EQ(map.get(i, 0), i % 2 == 0 ? 0 : i * 2);
+  }
+  map.reclaim();
+
+  std::map<uint32_t, uint32_t> elements;
+  map.for_each([&](uint32_t key, uint32_t value) { elements[key] = value; });
+  ASSERT_EQ(elements.size(), 50000);
+  for (const auto& [key, value] : elements) {
+    EXPECT_EQ(key % 2, 1);
+    EXPECT_EQ(value, key * 2);
+  }
+
+  map.clear();
+  EXPECT_EQ(map.size(), 0);
+  EXPECT_EQ(map.count(1), 0);
+}
+
+TEST(ConcurrentInternMapTest, concurrentAccesses) {
+  ConcurrentInternMap<uint32_t, uint32_t> map;
+  // Keys that are present throughout, and must always be found.
+  for (uint32_t i = 0; i < kElementsPerThread; i++) {
+    map.emplace(i, i);
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<size_t> missed{0};
+  for (uint32_t t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      uint32_t base = (t + 1) * kElementsPerThread;
+      for (uint32_t i = 0; i < kElementsPerThread; i++) {
+        // Each thread inserts and removes its own keys, while all of them
+        // look up the stable ones.
+        map.emplace(base + i, i);
+        if (i % 3 == 0) {
+          map.erase(base + i);
+        }
+        if (map.get(i, kElementsPerThread) != i) {
+          missed++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(missed, 0);
+  for (uint32_t t = 0; t < kThreads; t++) {
+    uint32_t base = (t + 1) * kElementsPerThread;
+    for (uint32_t i = 0; i < kElementsPerThread; i++) {
+      EXPECT_EQ(map.count(base + i), i % 3 != 0);
+    }
+  }
+  EXPECT_EQ(map.size(),
+            kElementsPerThread +
+                kThreads * (kElementsPerThread - (kElementsPerThread + 2) / 3));
+}
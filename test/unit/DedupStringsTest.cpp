@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "ABExperimentContext.h"
+#include "DedupStrings.h"
+#include "DexClass.h"
+#include "DexStore.h"
+#include "IRAssembler.h"
+#include "MethodProfiles.h"
+#include "RedexTest.h"
+
+namespace {
+
+constexpr const char* kLongString =
+    "a string that is long enough to be worth deduplicating";
+
+// A class with a static method that loads the long string `loads` times, and
+// the short string "x" once.
+DexClass* make_class(const std::string& name, size_t loads) {
+  std::string body;
+  for (size_t i = 0; i < loads; i++) {
+    body += "(const-string \"" + std::string(kLongString) +
+            "\") (move-result-pseudo-object v0) ";
+  }
+  body += "(const-string \"x\") (move-result-pseudo-object v0) ";
+  auto* method = assembler::method_from_string(
+      "(method (public static) \"" + name + ".f:()Ljava/lang/String;\" (" +
+      body + "(return-object v0)))");
+  return assembler::class_with_methods(name, {method});
+}
+
+IRCode* code_of(const std::string& class_name) {
+  auto* cls = type_class(DexType::get_type(class_name));
+  return cls->get_dmethods()[0]->get_code();
+}
+
+DexStoresVector make_stores(const std::vector<size_t>& loads_by_dex) {
+  DexStore store("classes");
+  for (size_t dexnr = 0; dexnr < loads_by_dex.size(); dexnr++) {
+    auto name = "LDex" + std::to_string(dexnr) + ";";
+    store.add_classes({make_class(name, loads_by_dex[dexnr])});
+  }
+  return DexStoresVector{store};
+}
+
+DedupStrings::Stats run_dedup_strings(DexStoresVector& stores) {
+  method_profiles::MethodProfiles method_profiles;
+  DedupStrings dedup_strings(/* max_factory_methods */ 4,
+                             /* method_profiles_appear_percent_threshold */ 1,
+                             method_profiles);
+  auto ab_experiment_context =
+      ab_test::ABExperimentContext::create("dedup_strings");
+  dedup_strings.run(stores, ab_experiment_context);
+  ab_experiment_context->flush();
+  return dedup_strings.get_stats();
+}
+
+// The long string is loaded through the lookup method of the given host.
+std::unique_ptr<IRCode> rewritten_code(size_t hosting_dexnr) {
+  return assembler::ircode_from_string(R"(
+    (
+      (const v1 0)
+      (invoke-static (v1) "Lcom/redex/Strings$)" +
+                                       std::to_string(hosting_dexnr) +
+                                       R"(;.lookup:(I)Ljava/lang/String;")
+      (move-result-object v0)
+      (const-string "x")
+      (move-result-pseudo-object v0)
+      (return-object v0)
+    )
+  )");
+}
+
+size_t count_long_string_loads(size_t dexnr) {
+  size_t loads = 0;
+  for (const auto& mie :
+       InstructionIterable(code_of("LDex" + std::to_string(dexnr) + ";"))) {
+    EXPECT_NE(mie.insn->opcode(), OPCODE_INVOKE_STATIC);
+    if (mie.insn->opcode() == OPCODE_CONST_STRING &&
+        mie.insn->get_string()->str() == kLongString) {
+      loads++;
+    }
+  }
+  return loads;
+}
+
+void expect_rewritten(size_t dexnr, size_t hosting_dexnr) {
+  auto* code = code_of("LDex" + std::to_string(dexnr) + ";");
+  code->clear_cfg();
+  auto expected_code = rewritten_code(hosting_dexnr);
+  EXPECT_CODE_EQ(code, expected_code.get());
+}
+
+} // namespace
+
+class DedupStringsTest : public RedexTest {};
+
+TEST_F(DedupStringsTest, hostsInDexWithMostLoads) {
+  auto stores = make_stores({0, 1, 3, 1});
+  auto stats = run_dedup_strings(stores);
+  EXPECT_EQ(stats.factory_methods, 1);
+  EXPECT_EQ(stats.duplicate_strings, 2);
+  EXPECT_EQ(stats.duplicate_string_loads, 2);
+
+  // The host class comes first in its dex.
+  const auto& dexen = stores[0].get_dexen();
+  ASSERT_EQ(dexen[2].size(), 2);
+  EXPECT_EQ(dexen[2][0]->get_name()->str(), "Lcom/redex/Strings$2;");
+  EXPECT_EQ(dexen[0].size(), 1);
+  EXPECT_EQ(dexen[1].size(), 1);
+  EXPECT_EQ(dexen[3].size(), 1);
+
+  // The other dexes load the long string through the host, while the short
+  // string is not worth it.
+  expect_rewritten(1, 2);
+  expect_rewritten(3, 2);
+  EXPECT_EQ(count_long_string_loads(2), 3);
+}
+
+TEST_F(DedupStringsTest, primaryDexHostsStringsItLoadsAnyway) {
+  // The loads of the primary dex are never rewritten, so it keeps the string
+  // anyway, and hosting it there is free.
+  auto stores = make_stores({1, 1, 3, 1});
+  auto stats = run_dedup_strings(stores);
+  EXPECT_EQ(stats.factory_methods, 1);
+  EXPECT_EQ(stats.duplicate_strings, 3);
+  EXPECT_EQ(stats.duplicate_string_loads, 5);
+
+  const auto& dexen = stores[0].get_dexen();
+  ASSERT_EQ(dexen[0].size(), 2);
+  EXPECT_EQ(dexen[0][0]->get_name()->str(), "Lcom/redex/Strings$0;");
+  EXPECT_EQ(count_long_string_loads(0), 1);
+  expect_rewritten(1, 0);
+  expect_rewritten(3, 0);
+  auto* code = code_of("LDex2;");
+  code->clear_cfg();
+  size_t invokes = 0;
+  for (const auto& mie : InstructionIterable(code)) {
+    invokes += mie.insn->opcode() == OPCODE_INVOKE_STATIC;
+  }
+  EXPECT_EQ(invokes, 3);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "DexHasher.h"
+#include "IRAssembler.h"
+#include "RedexTest.h"
+
+class DexHasherTest : public RedexTest {
+ protected:
+  DexClass* create_class(const std::string& name, const std::string& code) {
+    auto* type = DexType::make_type(name);
+    ClassCreator creator(type);
+    creator.set_super(type::java_lang_Object());
+    auto* method = DexMethod::make_method(name + ".get:()I")
+                       ->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+    method->set_code(assembler::ircode_from_string(code));
+    creator.add_method(method);
+    return creator.create();
+  }
+};
+
+TEST_F(DexHasherTest, scopeHashIsStable) {
+  Scope scope;
+  for (int i = 0; i < 10; i++) {
+    scope.push_back(create_class("LFoo" + std::to_string(i) + ";",
+                                 "((const v0 " + std::to_string(i) +
+                                     ") (return v0))"));
+  }
+  auto hash = hashing::DexScopeHasher(scope).run();
+  auto again = hashing::DexScopeHasher(scope).run();
+  EXPECT_EQ(hash.positions_hash, again.positions_hash);
+  EXPECT_EQ(hash.registers_hash, again.registers_hash);
+  EXPECT_EQ(hash.code_hash, again.code_hash);
+  EXPECT_EQ(hash.signature_hash, again.signature_hash);
+
+  std::swap(scope.front(), scope.back());
+  auto swapped = hashing::DexScopeHasher(scope).run();
+  EXPECT_NE(hash.signature_hash, swapped.signature_hash);
+
+  scope.pop_back();
+  auto smaller = hashing::DexScopeHasher(scope).run();
+  EXPECT_NE(swapped.signature_hash, smaller.signature_hash);
+}
+
+TEST_F(DexHasherTest, codeChangesOnlyAffectCodeHash) {
+  auto* cls = create_class("LBar;", "((const v0 1) (return v0))");
+  Scope scope{cls};
+  auto before = hashing::DexScopeHasher(scope).run();
+
+  auto* method = cls->get_dmethods().front();
+  method->set_code(assembler::ircode_from_string("((const v0 2) (return v0))"));
+  auto after = hashing::DexScopeHasher(scope).run();
+  EXPECT_NE(before.code_hash, after.code_hash);
+  EXPECT_EQ(before.signature_hash, after.signature_hash);
+}
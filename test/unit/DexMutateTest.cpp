@@ -11,6 +11,7 @@
 #include "DexClass.h"
 #include "RedexContext.h"
 #include "RedexTest.h"
+#include "TypeUtil.h"
 
 DexFieldRef* make_field_ref(DexType* cls, const char* name, DexType* type) {
   return DexField::make_field(cls, DexString::make_string(name), type);
@@ -65,3 +66,66 @@ TEST_F(RenameMembersTest, rename) {
   std::string name_after = field->get_name()->c_str();
   ASSERT_EQ("numbat", name_after);
 }
+
+TEST_F(RenameMembersTest, changeAllSwapsSignatures) {
+  auto a = DexType::make_type("LA;");
+  auto proto =
+      DexProto::make_proto(type::_void(), DexTypeList::make_type_list({}));
+  auto foo = DexMethod::make_method(a, DexString::make_string("foo"), proto);
+  auto bar = DexMethod::make_method(a, DexString::make_string("bar"), proto);
+
+  DexMethodSpec to_bar;
+  to_bar.name = DexString::make_string("bar");
+  DexMethodSpec to_foo;
+  to_foo.name = DexString::make_string("foo");
+  DexMethodRef::change_all({{foo, to_bar}, {bar, to_foo}},
+                           false /* rename on collision */);
+
+  EXPECT_EQ(foo->str(), "bar");
+  EXPECT_EQ(bar->str(), "foo");
+  EXPECT_EQ(DexMethod::get_method(a, DexString::make_string("bar"), proto),
+            foo);
+  EXPECT_EQ(DexMethod::get_method(a, DexString::make_string("foo"), proto),
+            bar);
+}
+
+TEST_F(RenameMembersTest, changeAllRenamesOnCollisionInOrder) {
+  auto a = DexType::make_type("LA;");
+  auto proto =
+      DexProto::make_proto(type::_void(), DexTypeList::make_type_list({}));
+  auto existing =
+      DexMethod::make_method(a, DexString::make_string("foo"), proto);
+  auto m1 = DexMethod::make_method(a, DexString::make_string("m1"), proto);
+  auto m2 = DexMethod::make_method(a, DexString::make_string("m2"), proto);
+
+  DexMethodSpec spec;
+  spec.name = DexString::make_string("foo");
+  DexMethodRef::change_all({{m1, spec}, {m2, spec}},
+                           true /* rename on collision */);
+
+  EXPECT_EQ(existing->str(), "foo");
+  EXPECT_EQ(m1->str(), "foo$0");
+  EXPECT_EQ(m2->str(), "foo$1");
+  EXPECT_EQ(DexMethod::get_method(a, DexString::make_string("m1"), proto),
+            nullptr);
+  EXPECT_EQ(DexMethod::get_method(a, DexString::make_string("foo$1"), proto),
+            m2);
+}
+
+TEST_F(RenameMembersTest, fieldRenameOnCollision) {
+  auto int_t = DexType::make_type("I");
+  auto a = DexType::make_type("LA;");
+  auto existing = make_field_ref(a, "f$0", int_t);
+  auto field = make_field_ref(a, "wombat", int_t);
+  auto other = make_field_ref(a, "numbat", int_t);
+
+  DexFieldSpec spec;
+  spec.name = DexString::make_string("numbat");
+  field->change(spec, true /* rename on collision */);
+
+  EXPECT_EQ(existing->str(), "f$0");
+  EXPECT_EQ(other->str(), "numbat");
+  EXPECT_EQ(field->str(), "f$1");
+  EXPECT_EQ(DexField::get_field(a, DexString::make_string("f$1"), int_t),
+            field);
+}
@@ -6,8 +6,11 @@
  */
 
 #include "DexOutput.h"
+#include <fstream>
 #include <gtest/gtest.h>
 #include <json/json.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 TEST(DexOutput, checkMethodInstructionSizeLimit) {
 
@@ -24,3 +27,41 @@ TEST(DexOutput, checkMethodInstructionSizeLimit) {
       DexOutput::check_method_instruction_size_limit(conf, 65537, "method"),
       RedexException);
 }
+
+TEST(DexOutput, outputBufferIsZeroed) {
+  // A buffer larger than any dex only costs the pages that are touched.
+  DexOutputBuffer buffer(size_t(1) << 30, size_t(1) << 20);
+  ASSERT_NE(buffer.get(), nullptr);
+  EXPECT_EQ(buffer.size(), size_t(1) << 30);
+  for (size_t offset = 0; offset < buffer.size(); offset += 1 << 24) {
+    EXPECT_EQ(buffer.get()[offset], 0);
+    buffer.get()[offset] = 1;
+  }
+  EXPECT_EQ(buffer.get()[buffer.size() - 1], 0);
+}
+
+namespace {
+
+// Exits with 0 if the buffer falls back to a bounded heap allocation.
+void allocate_without_address_space() {
+  long pages = 0;
+  std::ifstream("/proc/self/statm") >> pages;
+  rlim_t available = pages * getpagesize() + (size_t(256) << 20);
+  struct rlimit limit = {available, available};
+  if (setrlimit(RLIMIT_AS, &limit) != 0) {
+    exit(2);
+  }
+  DexOutputBuffer buffer(size_t(1) << 30, size_t(32) << 20);
+  bool bounded = buffer.size() == (size_t(32) << 20) &&
+                 buffer.get()[buffer.size() - 1] == 0;
+  exit(bounded ? 0 : 1);
+}
+
+} // namespace
+
+TEST(DexOutput, heapOutputBufferIsBounded) {
+  // Without the address space for the reservation, the buffer falls back to
+  // the heap, and must not try to commit the whole reservation there.
+  EXPECT_EXIT(allocate_without_address_space(), ::testing::ExitedWithCode(0),
+              "");
+}
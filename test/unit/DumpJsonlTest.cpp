@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "PrintUtil.h"
+#include "RedexDump.h"
+
+namespace {
+
+// Dumps the string section of a dex holding just the given string data
+// items, and returns the lines after the header.
+std::vector<std::string> dump_strings_jsonl(
+    const std::vector<std::string>& string_data) {
+  std::vector<dex_string_id> ids;
+  std::string data(sizeof(dex_header), '\0');
+  for (const auto& item : string_data) {
+    ids.push_back({static_cast<uint32_t>(data.size())});
+    data += item;
+    data.push_back('\0');
+  }
+  dex_header header{};
+  header.string_ids_size = ids.size();
+  memcpy(&data[0], &header, sizeof(header));
+
+  ddump_data rd{};
+  rd.dexmmap = &data[0];
+  rd.dexh = reinterpret_cast<dex_header*>(&data[0]);
+  rd.dex_string_ids = ids.data();
+  rd.dex_filename = "classes.dex";
+
+  std::string out;
+  redump_buffer = &out;
+  dump_sections sections;
+  sections.string = true;
+  dump_jsonl(&rd, sections);
+  redump_buffer = nullptr;
+
+  std::vector<std::string> lines;
+  size_t start = out.find('\n') + 1;
+  for (size_t end; (end = out.find('\n', start)) != std::string::npos;
+       start = end + 1) {
+    lines.push_back(out.substr(start, end - start));
+  }
+  return lines;
+}
+
+} // namespace
+
+TEST(DumpJsonlTest, escapesStrings) {
+  // Each item starts with its length in UTF-16 code units.
+  auto lines = dump_strings_jsonl({
+      "\x03"
+      "a\"\\",
+      "\x02"
+      "\t\xc3\xa9",
+      "\x02"
+      "\xed\xa0\xbd\xed\xb8\x80",
+  });
+  ASSERT_EQ(lines.size(), 3);
+  EXPECT_EQ(lines[0],
+            "{\"file\":\"classes.dex\",\"section\":\"string\",\"idx\":0,"
+            "\"value\":\"a\\\"\\\\\"}");
+  EXPECT_EQ(lines[1],
+            "{\"file\":\"classes.dex\",\"section\":\"string\",\"idx\":1,"
+            "\"value\":\"\\u0009\xc3\xa9\"}");
+  EXPECT_EQ(lines[2],
+            "{\"file\":\"classes.dex\",\"section\":\"string\",\"idx\":2,"
+            "\"value\":\"\\ud83d\\ude00\"}");
+}
+
+TEST(DumpJsonlTest, keepsEmbeddedNul) {
+  // MUTF-8 encodes U+0000 as C0 80, so the string goes on after it.
+  auto lines = dump_strings_jsonl({
+      "\x03"
+      "a\xc0\x80"
+      "b",
+  });
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(lines[0],
+            "{\"file\":\"classes.dex\",\"section\":\"string\",\"idx\":0,"
+            "\"value\":\"a\\u0000b\"}");
+}
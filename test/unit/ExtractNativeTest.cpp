@@ -7,6 +7,7 @@
 
 #include <gtest/gtest.h>
 #include <string>
+#include <unordered_set>
 
 #include "RedexResources.h"
 
@@ -15,3 +16,83 @@ TEST(ExtractNativeTest, empty) {
   auto overset = extract_classes_from_native_lib(over);
   EXPECT_EQ(overset.size(), 2);
 }
+
+namespace {
+
+template <typename UInt>
+void put_le(std::string* out, size_t offset, UInt value) {
+  for (size_t i = 0; i < sizeof(UInt); i++) {
+    (*out)[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+// Builds a minimal little-endian ELF64 file with a .rodata, a .text and a
+// section name table.
+std::string make_elf(const std::string& rodata, const std::string& text) {
+  const std::string shstrtab = std::string("\0.rodata\0.text\0.shstrtab\0", 25);
+  std::string elf(64, '\0');
+  elf[0] = 0x7f;
+  elf[1] = 'E';
+  elf[2] = 'L';
+  elf[3] = 'F';
+  elf[4] = 2; // ELFCLASS64
+  elf[5] = 1; // ELFDATA2LSB
+  size_t rodata_off = elf.size();
+  elf += rodata;
+  size_t text_off = elf.size();
+  elf += text;
+  size_t shstrtab_off = elf.size();
+  elf += shstrtab;
+  size_t shoff = elf.size();
+  elf.resize(shoff + 4 * 64, '\0');
+  auto put_section = [&](size_t index, uint32_t name, uint32_t type,
+                         uint64_t flags, uint64_t offset, uint64_t size) {
+    size_t sh = shoff + index * 64;
+    put_le<uint32_t>(&elf, sh, name);
+    put_le<uint32_t>(&elf, sh + 4, type);
+    put_le<uint64_t>(&elf, sh + 8, flags);
+    put_le<uint64_t>(&elf, sh + 24, offset);
+    put_le<uint64_t>(&elf, sh + 32, size);
+  };
+  put_section(1, 1, /* SHT_PROGBITS */ 1, /* SHF_ALLOC */ 0x2, rodata_off,
+              rodata.size());
+  put_section(2, 9, /* SHT_PROGBITS */ 1, /* SHF_ALLOC|SHF_EXECINSTR */ 0x6,
+              text_off, text.size());
+  put_section(3, 15, /* SHT_STRTAB */ 3, 0, shstrtab_off, shstrtab.size());
+  put_le<uint64_t>(&elf, 0x28, shoff);
+  put_le<uint16_t>(&elf, 0x3A, 64);
+  put_le<uint16_t>(&elf, 0x3C, 4);
+  put_le<uint16_t>(&elf, 0x3E, 3);
+  return elf;
+}
+
+} // namespace
+
+TEST(ExtractNativeTest, non_elf_scans_everything) {
+  std::string lib = std::string("\x01\x02", 2) + "com/foo/Bar" +
+                    std::string("\0", 1) + "Lcom/foo/Baz;";
+  auto classes = extract_classes_from_native_lib(lib);
+  EXPECT_EQ(classes,
+            std::unordered_set<std::string>({"Lcom/foo/Bar;", "Lcom/foo/Baz;"}));
+}
+
+TEST(ExtractNativeTest, elf_only_scans_string_sections) {
+  auto lib = make_elf(std::string("Lcom/foo/Bar;\0", 14),
+                      std::string("Lcom/foo/Baz;\0", 14));
+  auto classes = extract_classes_from_native_lib(lib);
+  EXPECT_EQ(classes, std::unordered_set<std::string>({"Lcom/foo/Bar;"}));
+}
+
+TEST(ExtractNativeTest, large_input_is_split_on_boundaries) {
+  // Place a class name across the nominal chunk boundary and check that it is
+  // still found in one piece.
+  std::string lib((1u << 20) + 4096, '\0');
+  const std::string name = "com/facebook/SomeLongClassName";
+  lib.replace((1u << 20) - 10, name.size(), name);
+  lib.replace(1000, name.size() - 1, name.substr(0, name.size() - 1));
+  auto classes = extract_classes_from_native_lib(lib);
+  EXPECT_EQ(classes,
+            std::unordered_set<std::string>(
+                {"L" + name + ";",
+                 "L" + name.substr(0, name.size() - 1) + ";"}));
+}
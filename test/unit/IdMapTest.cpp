@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <unordered_set>
+
+#include "Creators.h"
+#include "DexClass.h"
+#include "IdMap.h"
+#include "RedexTest.h"
+#include "WorkQueue.h"
+
+class IdMapTest : public RedexTest {
+ protected:
+  // Enough types to span several chunks.
+  void SetUp() override {
+    for (size_t i = 0; i < 5000; i++) {
+      m_types.push_back(DexType::make_type("LFoo" + std::to_string(i) + ";"));
+    }
+  }
+
+  std::vector<DexType*> m_types;
+};
+
+TEST_F(IdMapTest, idsAreDenseAndStable) {
+  std::unordered_set<uint32_t> ids;
+  for (auto* type : m_types) {
+    EXPECT_TRUE(ids.insert(type->get_id()).second);
+    EXPECT_EQ(DexType::get_by_id(type->get_id()), type);
+  }
+  EXPECT_EQ(DexType::make_type("LFoo42;")->get_id(), m_types[42]->get_id());
+
+  auto* method = DexMethod::make_method("LFoo0;.bar:()V");
+  auto* field = DexField::make_field("LFoo0;.baz:I");
+  EXPECT_EQ(DexMethodRef::get_by_id(method->get_id()), method);
+  EXPECT_EQ(DexFieldRef::get_by_id(field->get_id()), field);
+}
+
+TEST_F(IdMapTest, map) {
+  IdMap<DexType, size_t> map;
+  EXPECT_EQ(map.get(m_types[0]), 0);
+  EXPECT_EQ(map.get(m_types.back()), 0);
+  workqueue_run_for<size_t>(0, m_types.size(),
+                            [&](size_t i) { map[m_types[i]] = i + 1; });
+  for (size_t i = 0; i < m_types.size(); i++) {
+    EXPECT_EQ(map.get(m_types[i]), i + 1);
+  }
+}
+
+TEST_F(IdMapTest, set) {
+  IdSet<DexType> set;
+  EXPECT_TRUE(set.empty());
+  workqueue_run_for<size_t>(0, m_types.size(), [&](size_t i) {
+    if (i % 3 == 0) {
+      set.insert(m_types[i]);
+    }
+  });
+  EXPECT_FALSE(set.insert(m_types[0]));
+  EXPECT_EQ(set.size(), (m_types.size() + 2) / 3);
+  EXPECT_TRUE(set.contains(m_types[3]));
+  EXPECT_FALSE(set.contains(m_types[4]));
+  EXPECT_TRUE(set.erase(m_types[3]));
+  EXPECT_FALSE(set.erase(m_types[3]));
+  EXPECT_FALSE(set.contains(m_types[3]));
+
+  std::vector<DexType*> elements;
+  set.for_each([&](DexType* type) { elements.push_back(type); });
+  ASSERT_EQ(elements.size(), set.size());
+  for (size_t i = 1; i < elements.size(); i++) {
+    EXPECT_LT(elements[i - 1]->get_id(), elements[i]->get_id());
+    EXPECT_TRUE(set.contains(elements[i]));
+  }
+}
+
+TEST_F(IdMapTest, setSkipsDeletedElements) {
+  auto* kept = DexMethod::make_method("LFoo0;.kept:()V");
+  auto* deleted =
+      static_cast<DexMethod*>(DexMethod::make_method("LFoo0;.deleted:()V"));
+  IdSet<DexMethodRef> set;
+  set.insert(kept);
+  set.insert(deleted);
+  DexMethod::erase_method(deleted);
+  DexMethod::delete_method_DO_NOT_USE(deleted);
+
+  std::vector<DexMethodRef*> elements;
+  set.for_each([&](DexMethodRef* method) { elements.push_back(method); });
+  EXPECT_EQ(elements, std::vector<DexMethodRef*>{kept});
+}
+
+TEST_F(IdMapTest, typeClass) {
+  EXPECT_EQ(type_class(m_types[7]), nullptr);
+  ClassCreator creator(m_types[7]);
+  creator.set_super(type::java_lang_Object());
+  auto* cls = creator.create();
+  EXPECT_EQ(type_class(m_types[7]), cls);
+  EXPECT_EQ(type_class(m_types[8]), nullptr);
+  EXPECT_EQ(type_class(nullptr), nullptr);
+}
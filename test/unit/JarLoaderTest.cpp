@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "DexClass.h"
+#include "JarLoader.h"
+#include "RedexTest.h"
+#include "Show.h"
+
+namespace {
+
+void put16(std::string& out, uint16_t value) {
+  out.push_back(static_cast<char>(value >> 8));
+  out.push_back(static_cast<char>(value));
+}
+
+void put32(std::string& out, uint32_t value) {
+  put16(out, value >> 16);
+  put16(out, value);
+}
+
+void put16le(std::string& out, uint16_t value) {
+  out.push_back(static_cast<char>(value));
+  out.push_back(static_cast<char>(value >> 8));
+}
+
+void put32le(std::string& out, uint32_t value) {
+  put16le(out, value);
+  put16le(out, value >> 16);
+}
+
+/*
+ * A minimal class file for `public class <name> extends java/lang/Object`
+ * with a private int field `x`, a constructor and a method
+ * `long run(int, String)`.
+ */
+std::string make_class_file(const std::string& name) {
+  std::string out;
+  put32(out, 0xcafebabe);
+  put16(out, 0);
+  put16(out, 52);
+  std::vector<std::string> utf8s = {name,
+                                    "java/lang/Object",
+                                    "x",
+                                    "I",
+                                    "<init>",
+                                    "()V",
+                                    "run",
+                                    "(ILjava/lang/String;)J"};
+  // Entries 1-8 are the strings above, 9 and 10 are the classes.
+  put16(out, utf8s.size() + 3);
+  for (const auto& utf8 : utf8s) {
+    out.push_back(1);
+    put16(out, utf8.size());
+    out += utf8;
+  }
+  out.push_back(7);
+  put16(out, 1);
+  out.push_back(7);
+  put16(out, 2);
+  put16(out, ACC_PUBLIC);
+  put16(out, 9);
+  put16(out, 10);
+  put16(out, 0); // interfaces
+  put16(out, 1); // fields
+  put16(out, ACC_PRIVATE);
+  put16(out, 3);
+  put16(out, 4);
+  put16(out, 0);
+  put16(out, 2); // methods
+  put16(out, ACC_PUBLIC);
+  put16(out, 5);
+  put16(out, 6);
+  put16(out, 0);
+  put16(out, ACC_PUBLIC);
+  put16(out, 7);
+  put16(out, 8);
+  put16(out, 0);
+  put16(out, 0); // class attributes
+  return out;
+}
+
+// Writes a jar that stores the given entries uncompressed.
+void write_jar(const std::string& path,
+               const std::vector<std::pair<std::string, std::string>>& files) {
+  std::string out;
+  std::string central_directory;
+  for (const auto& [name, data] : files) {
+    uint32_t offset = out.size();
+    uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(data.data()),
+                         data.size());
+    put32le(out, 0x04034b50);
+    put16le(out, 10); // version needed
+    put16le(out, 0); // flags
+    put16le(out, 0); // stored
+    put16le(out, 0); // time
+    put16le(out, 0); // date
+    put32le(out, crc);
+    put32le(out, data.size());
+    put32le(out, data.size());
+    put16le(out, name.size());
+    put16le(out, 0); // extra
+    out += name;
+    out += data;
+
+    put32le(central_directory, 0x02014b50);
+    put16le(central_directory, 10); // version made by
+    put16le(central_directory, 10); // version needed
+    put16le(central_directory, 0); // flags
+    put16le(central_directory, 0); // stored
+    put16le(central_directory, 0); // time
+    put16le(central_directory, 0); // date
+    put32le(central_directory, crc);
+    put32le(central_directory, data.size());
+    put32le(central_directory, data.size());
+    put16le(central_directory, name.size());
+    put16le(central_directory, 0); // extra
+    put16le(central_directory, 0); // comment
+    put16le(central_directory, 0); // disk
+    put16le(central_directory, 0); // internal attributes
+    put32le(central_directory, 0); // external attributes
+    put32le(central_directory, offset);
+    central_directory += name;
+  }
+  uint32_t cd_offset = out.size();
+  out += central_directory;
+  put32le(out, 0x06054b50);
+  put16le(out, 0);
+  put16le(out, 0);
+  put16le(out, files.size());
+  put16le(out, files.size());
+  put32le(out, central_directory.size());
+  put32le(out, cd_offset);
+  put16le(out, 0);
+
+  std::ofstream ofs(path, std::ios::binary);
+  ofs << out;
+}
+
+// Jar caches are written in host byte order.
+template <typename T>
+void put_host(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void put_host_string(std::string& out, const std::string& str) {
+  put_host<uint16_t>(out, str.size());
+  out += str;
+}
+
+} // namespace
+
+class JarLoaderTest : public RedexTest {
+ protected:
+  JarLoaderTest() {
+    m_dir = boost::filesystem::temp_directory_path() /
+            boost::filesystem::unique_path();
+    boost::filesystem::create_directories(m_dir);
+    m_first_jar = (m_dir / "first.jar").string();
+    m_second_jar = (m_dir / "second.jar").string();
+    m_cache_dir = (m_dir / "cache").string();
+    write_jar(m_first_jar, {{"com/foo/A.class", make_class_file("com/foo/A")},
+                            {"META-INF/MANIFEST.MF", "Manifest-Version: 1.0"},
+                            {"com/foo/B.class", make_class_file("com/foo/B")}});
+    write_jar(m_second_jar,
+              {{"com/foo/B.class", make_class_file("com/foo/B")},
+               {"com/foo/C.class", make_class_file("com/foo/C")}});
+  }
+
+  ~JarLoaderTest() { boost::filesystem::remove_all(m_dir); }
+
+  void load_and_check(const std::string& cache_dir) {
+    Scope first;
+    Scope second;
+    ASSERT_TRUE(load_jar_files(
+        {{DexLocation::make_location("", m_first_jar), &first},
+         {DexLocation::make_location("", m_second_jar), &second}},
+        cache_dir));
+
+    ASSERT_EQ(first.size(), 2);
+    EXPECT_EQ(show(first[0]), "Lcom/foo/A;");
+    EXPECT_EQ(show(first[1]), "Lcom/foo/B;");
+    // The duplicate B in the second jar is ignored.
+    ASSERT_EQ(second.size(), 1);
+    EXPECT_EQ(show(second[0]), "Lcom/foo/C;");
+    EXPECT_EQ(type_class(DexType::get_type("Lcom/foo/B;"))
+                  ->get_location()
+                  ->get_file_name(),
+              m_first_jar);
+
+    const DexClass* cls = first[0];
+    EXPECT_TRUE(cls->is_external());
+    EXPECT_EQ(show(cls->get_super_class()), "Ljava/lang/Object;");
+    ASSERT_EQ(cls->get_ifields().size(), 1);
+    EXPECT_EQ(show(cls->get_ifields()[0]), "Lcom/foo/A;.x:I");
+    ASSERT_EQ(cls->get_dmethods().size(), 1);
+    EXPECT_EQ(show(cls->get_dmethods()[0]), "Lcom/foo/A;.<init>:()V");
+    EXPECT_TRUE(is_constructor(cls->get_dmethods()[0]));
+    ASSERT_EQ(cls->get_vmethods().size(), 1);
+    EXPECT_EQ(show(cls->get_vmethods()[0]),
+              "Lcom/foo/A;.run:(ILjava/lang/String;)J");
+  }
+
+  boost::filesystem::path m_dir;
+  std::string m_first_jar;
+  std::string m_second_jar;
+  std::string m_cache_dir;
+};
+
+TEST_F(JarLoaderTest, loadJarFile) {
+  Scope classes;
+  ASSERT_TRUE(
+      load_jar_file(DexLocation::make_location("", m_first_jar), &classes));
+  ASSERT_EQ(classes.size(), 2);
+  EXPECT_EQ(show(classes[0]), "Lcom/foo/A;");
+  EXPECT_EQ(show(classes[1]), "Lcom/foo/B;");
+}
+
+TEST_F(JarLoaderTest, loadJarFilesInOrder) { load_and_check(""); }
+
+TEST_F(JarLoaderTest, loadJarFilesFromCache) {
+  load_and_check(m_cache_dir);
+  size_t cache_files = 0;
+  for (const auto& entry :
+       boost::filesystem::directory_iterator(m_cache_dir)) {
+    EXPECT_EQ(entry.path().extension(), ".jarcache");
+    // Backdate the cache so that we can tell whether it gets rewritten.
+    boost::filesystem::last_write_time(entry.path(), 0);
+    ++cache_files;
+  }
+  EXPECT_EQ(cache_files, 2);
+
+  delete g_redex;
+  g_redex = new RedexContext();
+  load_and_check(m_cache_dir);
+  for (const auto& entry :
+       boost::filesystem::directory_iterator(m_cache_dir)) {
+    EXPECT_EQ(boost::filesystem::last_write_time(entry.path()), 0);
+  }
+}
+
+TEST_F(JarLoaderTest, corruptCacheIsIgnored) {
+  load_and_check(m_cache_dir);
+  for (const auto& entry :
+       boost::filesystem::directory_iterator(m_cache_dir)) {
+    std::ofstream ofs(entry.path().string(),
+                      std::ios::binary | std::ios::trunc);
+    ofs << "RDXJAR01garbage";
+  }
+
+  delete g_redex;
+  g_redex = new RedexContext();
+  load_and_check(m_cache_dir);
+}
+
+TEST_F(JarLoaderTest, oversizedCacheStringIsIgnored) {
+  load_and_check(m_cache_dir);
+  // A well-formed cache whose only class name does not fit into the buffers
+  // used for interning.
+  std::string oversized_name(9000, 'a');
+  std::string cache("RDXJAR01");
+  put_host<uint32_t>(cache, 1);
+  put_host<uint8_t>(cache, 0);
+  put_host<uint16_t>(cache, 0x0001);
+  put_host_string(cache, oversized_name);
+  put_host_string(cache, "java/lang/Object");
+  put_host<uint16_t>(cache, 0); // interfaces
+  put_host<uint16_t>(cache, 0); // fields
+  put_host<uint16_t>(cache, 0); // methods
+  for (const auto& entry :
+       boost::filesystem::directory_iterator(m_cache_dir)) {
+    std::ofstream ofs(entry.path().string(),
+                      std::ios::binary | std::ios::trunc);
+    ofs << cache;
+  }
+
+  delete g_redex;
+  g_redex = new RedexContext();
+  load_and_check(m_cache_dir);
+  EXPECT_EQ(DexType::get_type("L" + oversized_name + ";"), nullptr);
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gtest/gtest.h>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "DexClass.h"
+#include "DexInstruction.h"
+#include "MethodSimilarityOrderer.h"
+#include "RedexTest.h"
+
+constexpr size_t NUM_FAMILIES = 40;
+constexpr size_t FAMILY_SIZE = 10;
+constexpr size_t NUM_INSNS = 12;
+
+class MethodSimilarityOrdererTest : public RedexTest {
+ protected:
+  /*
+   * Methods come in families that share most of their instructions, and are
+   * interleaved in the original order so that no family is together.
+   */
+  void SetUp() override {
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<uint16_t> reg(0, 15);
+    std::vector<std::vector<std::pair<uint16_t, uint16_t>>> families(
+        NUM_FAMILIES);
+    for (auto& family : families) {
+      for (size_t i = 0; i < NUM_INSNS; i++) {
+        family.emplace_back(reg(rng), reg(rng));
+      }
+    }
+    auto* callee = DexMethod::make_method("LCallee;.callee:()V");
+    for (size_t i = 0; i < NUM_FAMILIES * FAMILY_SIZE; i++) {
+      auto family_id = i % NUM_FAMILIES;
+      auto moves = families[family_id];
+      moves[reg(rng) % NUM_INSNS] = {reg(rng), reg(rng)};
+
+      std::vector<DexInstruction*> insns;
+      for (auto [dest, src] : moves) {
+        insns.push_back(
+            (new DexInstruction(DOPCODE_MOVE))->set_dest(dest)->set_src(0, src));
+      }
+      insns.push_back(new DexOpcodeMethod(DOPCODE_INVOKE_STATIC, callee));
+      insns.push_back(new DexInstruction(DOPCODE_RETURN_VOID));
+      auto code = std::make_unique<DexCode>();
+      code->set_instructions(std::move(insns));
+
+      auto* method =
+          DexMethod::make_method("LFoo;.m" + std::to_string(i) + ":()V")
+              ->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+      method->set_dex_code(std::move(code));
+      m_methods.push_back(method);
+      m_family[method] = family_id;
+    }
+  }
+
+  // The number of neighbouring methods in the given order that belong to the
+  // same family.
+  size_t count_adjacent_family_members(const std::vector<DexMethod*>& order) {
+    size_t count = 0;
+    for (size_t i = 1; i < order.size(); i++) {
+      if (m_family.at(order[i - 1]) == m_family.at(order[i])) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  std::vector<DexMethod*> m_methods;
+  std::unordered_map<DexMethod*, size_t> m_family;
+};
+
+TEST_F(MethodSimilarityOrdererTest, exact) {
+  auto methods = m_methods;
+  MethodSimilarityOrderer().order(methods);
+  ASSERT_EQ(methods.size(), m_methods.size());
+  EXPECT_EQ(count_adjacent_family_members(m_methods), 0);
+  EXPECT_GE(count_adjacent_family_members(methods),
+            NUM_FAMILIES * (FAMILY_SIZE - 1) * 9 / 10);
+}
+
+TEST_F(MethodSimilarityOrdererTest, minhashMatchesExactWithinTolerance) {
+  auto exact = m_methods;
+  MethodSimilarityOrderer().order(exact);
+
+  MethodSimilarityOrderer::MinHashOptions options;
+  options.error_tolerance = 0.1f;
+  auto approximate = m_methods;
+  MethodSimilarityOrderer(options).order(approximate);
+
+  ASSERT_EQ(approximate.size(), m_methods.size());
+  std::unordered_set<DexMethod*> unique(approximate.begin(), approximate.end());
+  EXPECT_EQ(unique.size(), m_methods.size());
+
+  auto exact_count = count_adjacent_family_members(exact);
+  auto approximate_count = count_adjacent_family_members(approximate);
+  EXPECT_GE(approximate_count,
+            exact_count * (1 - options.error_tolerance) - 1);
+}
+
+TEST_F(MethodSimilarityOrdererTest, minhashIsDeterministic) {
+  MethodSimilarityOrderer::MinHashOptions options;
+  options.error_tolerance = 0.2f;
+  options.max_candidates_per_bucket = 2;
+  auto first = m_methods;
+  MethodSimilarityOrderer(options).order(first);
+  auto second = m_methods;
+  MethodSimilarityOrderer(options).order(second);
+  EXPECT_EQ(first, second);
+}
+
+TEST_F(MethodSimilarityOrdererTest, minhashFunctionsHaveNoFavourite) {
+  // Among 100 code hash ids, each should be the minimum of about 1% of the
+  // hash functions. In particular, id 0 must not win row 0 or most rows.
+  constexpr uint32_t kNumIds = 100;
+  constexpr uint32_t kNumHashes = 1000;
+  std::vector<uint32_t> wins(kNumIds);
+  for (uint32_t k = 0; k < kNumHashes; k++) {
+    uint32_t winner = 0;
+    for (uint32_t id = 1; id < kNumIds; id++) {
+      if (MethodSimilarityOrderer::minhash_value(id, k) <
+          MethodSimilarityOrderer::minhash_value(winner, k)) {
+        winner = id;
+      }
+    }
+    if (k == 0) {
+      EXPECT_NE(winner, 0);
+    }
+    wins[winner]++;
+  }
+  for (uint32_t id = 0; id < kNumIds; id++) {
+    EXPECT_LT(wins[id], 5 * kNumHashes / kNumIds) << id;
+  }
+}
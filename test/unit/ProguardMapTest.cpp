@@ -13,6 +13,7 @@
 
 #include "IRAssembler.h"
 #include "RedexTest.h"
+#include "RedexTestUtils.h"
 
 using ::testing::AllOf;
 using ::testing::Pointee;
@@ -77,6 +78,66 @@ TEST_F(ProguardMapTest, empty) {
   EXPECT_EQ(false, pm.is_special_interface("Lcom/not/Found;"));
 }
 
+TEST_F(ProguardMapTest, ParsesLargeFile) {
+  auto tmp_dir = redex::make_tmp_dir("redex_proguard_map_test_%%%%%%%%");
+  auto filename = tmp_dir.path + "/mapping.txt";
+  {
+    std::ofstream out(filename);
+    // Refer to a class before its declaration.
+    out << "com.foo.Bar -> A:\n"
+        << "    com.foo.Last last -> a\n";
+    // Enough classes that the file gets mapped instead of read.
+    for (size_t i = 0; i < 10000; i++) {
+      out << "com.foo.Class" << i << " -> B" << i << ":\n"
+          << "    1:1:int get(com.foo.Bar) -> a\n";
+    }
+    // No line terminator on the last line.
+    out << "com.foo.Last -> Z:";
+  }
+
+  ProguardMap pm(filename);
+  EXPECT_EQ("LZ;", pm.translate_class("Lcom/foo/Last;"));
+  EXPECT_EQ("LA;.a:LZ;",
+            pm.translate_field("Lcom/foo/Bar;.last:Lcom/foo/Last;"));
+  EXPECT_EQ("LB9999;.a:(LA;)I",
+            pm.translate_method("Lcom/foo/Class9999;.get:(Lcom/foo/Bar;)I"));
+  EXPECT_EQ("Lcom/foo/Class42;.get:(Lcom/foo/Bar;)I",
+            pm.deobfuscate_method("LB42;.a:(LA;)I"));
+}
+
+TEST_F(ProguardMapTest, NamesSurviveMoves) {
+  std::stringstream ss;
+  // Enough names to fill several blocks, and one bigger than a block.
+  for (size_t i = 0; i < 30000; i++) {
+    ss << "com.foo.SomeRatherLongClassName" << i << " -> B" << i << ":\n"
+       << "    1:1:java.lang.String someRatherLongMethodName(java.lang.Object)"
+       << ":10:10 -> a\n";
+  }
+  std::string huge(2 << 20, 'x');
+  ss << "com.foo." << huge << " -> C:\n"
+     << "    int field -> a\n";
+
+  ProguardMap pm(ss);
+  auto moved = std::make_unique<ProguardMap>(std::move(pm));
+  EXPECT_EQ("LB0;",
+            moved->translate_class("Lcom/foo/SomeRatherLongClassName0;"));
+  EXPECT_EQ("Lcom/foo/SomeRatherLongClassName29999;.someRatherLongMethodName:"
+            "(Ljava/lang/Object;)Ljava/lang/String;",
+            moved->deobfuscate_method(
+                "LB29999;.a:(Ljava/lang/Object;)Ljava/lang/String;"));
+  EXPECT_EQ("Lcom/foo/" + huge + ";.field:I",
+            moved->deobfuscate_field("LC;.a:I"));
+
+  auto frames = moved->deobfuscate_frame(
+      DexString::make_string("LB123;.a:(Ljava/lang/Object;)Ljava/lang/String;"),
+      1);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].method->str(),
+            "Lcom/foo/SomeRatherLongClassName123;.someRatherLongMethodName:"
+            "(Ljava/lang/Object;)Ljava/lang/String;");
+  EXPECT_EQ(frames[0].line, 10);
+}
+
 TEST_F(ProguardMapTest, HandlesGeneratedComments) {
   std::stringstream ss(
       "# compiler: R8\n"
@@ -8,11 +8,13 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <fstream>
 #include <istream>
 #include <vector>
 
 #include "ProguardConfiguration.h"
 #include "ProguardParser.h"
+#include "RedexTestUtils.h"
 
 using namespace keep_rules;
 
@@ -60,6 +62,55 @@ TEST(ProguardParserTest, include) {
   ASSERT_EQ(config.includes[2], "gamma.txt");
 }
 
+// Parse included files, which are visited breadth-first and only once
+TEST(ProguardParserTest, include_files) {
+  auto tmp_dir = redex::make_tmp_dir("proguard_parser_test_%%%%%%%%");
+  auto write = [&](const std::string& name, const std::string& contents) {
+    auto path = tmp_dir.path + "/" + name;
+    std::ofstream(path) << contents;
+    return path;
+  };
+  auto c = write("c.pro", "-keep class C\n-keep class A\n");
+  auto b = write("b.pro", "-dontshrink\n-keep class B\n");
+  auto a = write("a.pro",
+                 "-include " + c + "\n-include " + b + "\n-keep class A\n");
+  auto top = write("top.pro",
+                   "-include " + a + "\n-include " + b + "\n-keep class Top\n");
+
+  ProguardConfiguration config;
+  auto stats = proguard_parser::parse_file(top, &config);
+  ASSERT_TRUE(config.ok);
+  EXPECT_EQ(stats.parse_errors, 0);
+  EXPECT_FALSE(config.shrink);
+  EXPECT_THAT(config.includes, ::testing::ElementsAre(a, b, c, b));
+
+  std::vector<std::string> kept;
+  for (const auto* keep : config.keep_rules) {
+    kept.push_back(keep->class_spec.class_names_str());
+  }
+  EXPECT_THAT(kept, ::testing::ElementsAre("Top", "A", "B", "C"));
+}
+
+// Identical rules are only kept once, but different keep commands are not
+// merged
+TEST(ProguardParserTest, duplicate_rules) {
+  ProguardConfiguration config;
+  std::istringstream ss(R"(
+    -keep class Foo { *; }
+    -keepclassmembers class Foo { *; }
+    -keep class Foo { *; }
+    -keepnames class Foo { *; }
+)");
+  proguard_parser::parse(ss, &config);
+  ASSERT_TRUE(config.ok);
+  ASSERT_EQ(config.keep_rules.size(), 3);
+  auto it = config.keep_rules.begin();
+  EXPECT_TRUE((*it)->mark_classes);
+  EXPECT_EQ((*it)->source_line, 2);
+  EXPECT_FALSE((*++it)->mark_classes);
+  EXPECT_TRUE((*++it)->allowshrinking);
+}
+
 // Parse basedirectory
 TEST(ProguardParserTest, basedirectory) {
   ProguardConfiguration config;
@@ -877,7 +928,8 @@ TEST(ProguardParserTest, assumenosideeffects_with_value) {
 )");
     proguard_parser::parse(ss, &config);
     ASSERT_TRUE(config.ok);
-    EXPECT_EQ(config.assumenosideeffects_rules.size(), 4);
+    // The last rule is the same as the first one.
+    EXPECT_EQ(config.assumenosideeffects_rules.size(), 3);
     auto it = config.assumenosideeffects_rules.elements().begin();
 
     const auto& k1 = *it++;
@@ -918,12 +970,6 @@ TEST(ProguardParserTest, assumenosideeffects_with_value) {
     EXPECT_THAT(k3->class_spec.classNames,
                 ::testing::ElementsAre(
                     ClassSpecification::ClassNameSpec("Foo", false)));
-    const auto& k4 = *it++;
-    EXPECT_EQ(k4->class_spec.methodSpecifications[0].return_value.value_type,
-              keep_rules::AssumeReturnValue::ValueNone);
-    EXPECT_THAT(k4->class_spec.classNames,
-                ::testing::ElementsAre(
-                    ClassSpecification::ClassNameSpec("Foo", false)));
   }
 }
 
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "Creators.h"
+#include "Reachability.h"
+#include "RedexTest.h"
+
+using namespace reachability;
+
+class ReachableObjectGraphTest : public RedexTest {};
+
+TEST_F(ReachableObjectGraphTest, retainers) {
+  ClassCreator cc(DexType::make_type("LFoo;"));
+  cc.set_super(type::java_lang_Object());
+  auto cls = ReachableObject(cc.create());
+  auto field = ReachableObject(DexField::make_field("LFoo;.field1:I"));
+  auto method = ReachableObject(DexMethod::make_method("LFoo;.method1:()I"));
+  auto other = ReachableObject(DexMethod::make_method("LFoo;.method2:()I"));
+  auto seed = ReachableObject();
+
+  ReachableObjectGraph graph(
+      {{field, method}, {cls, seed}, {field, other}, {field, method}},
+      {other});
+
+  EXPECT_EQ(graph.size(), 3);
+  EXPECT_EQ(graph.count(field), 1);
+  EXPECT_EQ(graph.count(cls), 1);
+  EXPECT_EQ(graph.count(other), 1);
+  EXPECT_EQ(graph.count(method), 0);
+
+  EXPECT_THAT(graph.at(field), ::testing::UnorderedElementsAre(method, other));
+  EXPECT_THAT(graph.at(cls), ::testing::ElementsAre(seed));
+  EXPECT_TRUE(graph.at(other).empty());
+  EXPECT_THAT(graph.objects(),
+              ::testing::UnorderedElementsAre(field, cls, other));
+}
+
+TEST_F(ReachableObjectGraphTest, empty) {
+  ReachableObjectGraph graph;
+  EXPECT_EQ(graph.size(), 0);
+  EXPECT_EQ(graph.count(ReachableObject()), 0);
+}
@@ -260,6 +260,74 @@ TEST_F(RegAllocTest, CombineAdjacentNodes) {
   EXPECT_FALSE(ig.get_node(2).is_active());
 }
 
+TEST_F(RegAllocTest, BuildInterferenceGraphInParallel) {
+  auto code = assembler::ircode_from_string(R"(
+    (
+     (load-param-object v0)
+     (load-param v1)
+     (const-wide v2 0)
+     (if-eqz v1 :else)
+     (move-wide v4 v2)
+     (add-long v2 v4 v2)
+     (check-cast v0 "LFoo;")
+     (move-result-pseudo-object v6)
+     (goto :join)
+     (:else)
+     (const v7 1)
+     (add-int v1 v1 v7)
+     (move v8 v1)
+     (move-object v6 v0)
+     (:join)
+     (invoke-static (v6 v1) "LFoo;.bar:(LFoo;I)V")
+     (long-to-double v4 v2)
+     (return-wide v4)
+    )
+)");
+  code->set_registers_size(9);
+
+  code->build_cfg();
+  auto& cfg = code->cfg();
+  cfg.calculate_exit_block();
+  LivenessFixpointIterator fixpoint_iter(cfg);
+  fixpoint_iter.run(LivenessDomain());
+
+  RangeSet range_set;
+  auto ig = interference::build_graph(fixpoint_iter, cfg,
+                                      code->get_registers_size(), range_set);
+  auto parallel_ig = interference::impl::GraphBuilder::build_in_parallel(
+      fixpoint_iter, cfg, code->get_registers_size(), range_set);
+
+  ASSERT_EQ(ig.nodes().size(), parallel_ig.nodes().size());
+  for (const auto& [reg, node] : ig.nodes()) {
+    const auto& parallel_node = parallel_ig.get_node(reg);
+    EXPECT_EQ(node.adjacent(), parallel_node.adjacent());
+    EXPECT_EQ(node.weight(), parallel_node.weight());
+    EXPECT_EQ(node.spill_cost(), parallel_node.spill_cost());
+    EXPECT_EQ(node.max_vreg(), parallel_node.max_vreg());
+    for (const auto& other : ig.nodes()) {
+      EXPECT_EQ(ig.is_coalesceable(reg, other.first),
+                parallel_ig.is_coalesceable(reg, other.first));
+      EXPECT_EQ(ig.has_containment_edge(reg, other.first),
+                parallel_ig.has_containment_edge(reg, other.first));
+    }
+  }
+  EXPECT_TRUE(ig.is_adjacent(2, 4));
+  EXPECT_TRUE(ig.is_coalesceable(2, 4));
+}
+
+TEST_F(RegAllocTest, ParallelInterferenceBuildThreads) {
+  using interference::impl::build_threads;
+  // Small methods are always built sequentially.
+  EXPECT_EQ(build_threads(9999, 1000, 8), 1);
+  // Each thread gets enough blocks to be worth starting.
+  EXPECT_EQ(build_threads(10000, 1000, 8), 8);
+  EXPECT_EQ(build_threads(10000, 40, 8), 2);
+  EXPECT_EQ(build_threads(10000, 20, 8), 1);
+  // Threads that other builds use are not available.
+  EXPECT_EQ(build_threads(10000, 1000, 3), 3);
+  EXPECT_EQ(build_threads(10000, 1000, 0), 1);
+}
+
 TEST_F(RegAllocTest, Coalesce) {
   auto code = assembler::ircode_from_string(R"(
     (
@@ -611,3 +611,74 @@ TEST_F(RenamerTest, Interface3IntfOverEscape) {
       DexString::get_string("h"));
   print_scope(scope);
 }
+
+namespace {
+
+/**
+ * Many independent hierarchies below java.lang.Object, which are renamed in
+ * parallel:
+ *
+ * class <prefix><i> { void f() {} void g() {} }
+ *   class <prefix><i>Sub extends <prefix><i> { void f() {} void h() {} }
+ */
+std::vector<DexClass*> create_parallel_scope(const std::string& prefix) {
+  std::vector<DexClass*> scope = create_empty_scope();
+  auto obj_t = type::java_lang_Object();
+  auto void_void =
+      DexProto::make_proto(type::_void(), DexTypeList::make_type_list({}));
+  for (int i = 0; i < 64; i++) {
+    auto name = "L" + prefix + std::to_string(i);
+    auto base_cls = create_internal_class(DexType::make_type(name + ";"),
+                                          obj_t, {});
+    create_empty_method(base_cls, "f", void_void);
+    create_empty_method(base_cls, "g", void_void);
+    auto sub_cls = create_internal_class(DexType::make_type(name + "Sub;"),
+                                         base_cls->get_type(), {});
+    create_empty_method(sub_cls, "f", void_void);
+    create_empty_method(sub_cls, "h", void_void);
+    scope.push_back(base_cls);
+    scope.push_back(sub_cls);
+  }
+  return scope;
+}
+
+std::vector<std::string> method_names(const Scope& scope) {
+  std::vector<std::string> names;
+  for (const auto& cls : scope) {
+    auto vmethods = cls->get_vmethods();
+    std::sort(vmethods.begin(), vmethods.end(), compare_dexmethods);
+    for (const auto& vmeth : vmethods) {
+      names.emplace_back(vmeth->str());
+    }
+  }
+  return names;
+}
+
+} // namespace
+
+/**
+ * Hierarchies of the same shape get the same names, whichever thread renames
+ * them, and the names stay unique in stack traces.
+ */
+TEST_F(RenamerTest, ParallelRenamingIsDeterministic) {
+  auto first_scope = create_parallel_scope("P");
+  auto second_scope = create_parallel_scope("Q");
+  EXPECT_EQ(256, rename_virtuals(first_scope,
+                                 /* avoid_stack_trace_collision */ true));
+  EXPECT_EQ(256, rename_virtuals(second_scope,
+                                 /* avoid_stack_trace_collision */ true));
+
+  auto first_names = method_names(first_scope);
+  EXPECT_EQ(first_names, method_names(second_scope));
+  for (const auto& cls : first_scope) {
+    std::unordered_set<const DexString*> names;
+    for (const auto& vmeth : cls->get_vmethods()) {
+      EXPECT_TRUE(names.insert(vmeth->get_name()).second) << SHOW(vmeth);
+    }
+  }
+  for (const auto& name : first_names) {
+    EXPECT_NE(name, "f");
+    EXPECT_NE(name, "g");
+    EXPECT_NE(name, "h");
+  }
+}
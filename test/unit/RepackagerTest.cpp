@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+#include "Repackager.h"
+
+namespace fs = boost::filesystem;
+
+namespace {
+
+void put16le(std::string& out, uint16_t value) {
+  out.push_back(static_cast<char>(value));
+  out.push_back(static_cast<char>(value >> 8));
+}
+
+void put32le(std::string& out, uint32_t value) {
+  put16le(out, value);
+  put16le(out, value >> 16);
+}
+
+uint16_t get16le(const std::string& in, size_t offset) {
+  return static_cast<uint8_t>(in[offset]) |
+         (static_cast<uint8_t>(in[offset + 1]) << 8);
+}
+
+uint32_t get32le(const std::string& in, size_t offset) {
+  return get16le(in, offset) |
+         (static_cast<uint32_t>(get16le(in, offset + 2)) << 16);
+}
+
+uint32_t crc_of(const std::string& data) {
+  return crc32(0, reinterpret_cast<const Bytef*>(data.data()), data.size());
+}
+
+std::string deflate_raw(const std::string& data) {
+  z_stream stream{};
+  deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&stream, data.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = out.size();
+  EXPECT_EQ(deflate(&stream, Z_FINISH), Z_STREAM_END);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+
+std::string inflate_raw(const std::string& data, size_t size) {
+  z_stream stream{};
+  inflateInit2(&stream, -MAX_WBITS);
+  std::string out(size, '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = data.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = out.size();
+  EXPECT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+  EXPECT_EQ(stream.total_out, size);
+  inflateEnd(&stream);
+  return out;
+}
+
+struct ZipEntry {
+  std::string name;
+  uint16_t method;
+  std::string content;
+};
+
+// Writes an archive with the given entries, in the given order.
+void write_zip(const std::string& path, const std::vector<ZipEntry>& entries) {
+  std::string out;
+  std::string central_directory;
+  for (const auto& entry : entries) {
+    uint32_t offset = out.size();
+    auto data =
+        entry.method == 0 ? entry.content : deflate_raw(entry.content);
+    for (auto* header : {&out, &central_directory}) {
+      if (header == &out) {
+        put32le(*header, 0x04034b50);
+      } else {
+        put32le(*header, 0x02014b50);
+        put16le(*header, 20); // version made by
+      }
+      put16le(*header, 20); // version needed
+      put16le(*header, 0); // flags
+      put16le(*header, entry.method);
+      put16le(*header, 0); // time
+      put16le(*header, 0); // date
+      put32le(*header, crc_of(entry.content));
+      put32le(*header, data.size());
+      put32le(*header, entry.content.size());
+      put16le(*header, entry.name.size());
+      put16le(*header, 0); // extra
+      if (header == &central_directory) {
+        put16le(*header, 0); // comment
+        put16le(*header, 0); // disk
+        put16le(*header, 0); // internal attributes
+        put32le(*header, 0); // external attributes
+        put32le(*header, offset);
+      }
+      *header += entry.name;
+    }
+    out += data;
+  }
+  uint32_t cd_offset = out.size();
+  out += central_directory;
+  put32le(out, 0x06054b50);
+  put16le(out, 0);
+  put16le(out, 0);
+  put16le(out, entries.size());
+  put16le(out, entries.size());
+  put32le(out, central_directory.size());
+  put32le(out, cd_offset);
+  put16le(out, 0);
+
+  std::ofstream ofs(path, std::ios::binary);
+  ofs << out;
+}
+
+// Reads the archive through its central directory and checks that every
+// entry agrees with its local header and its CRC.
+std::vector<ZipEntry> read_zip(const std::string& path,
+                               bool page_align = false) {
+  std::ifstream ifs(path, std::ios::binary);
+  std::string in((std::istreambuf_iterator<char>(ifs)),
+                 std::istreambuf_iterator<char>());
+  size_t eocd = in.size() - 22;
+  EXPECT_EQ(get32le(in, eocd), 0x06054b50);
+  uint16_t num_entries = get16le(in, eocd + 10);
+  size_t p = get32le(in, eocd + 16);
+
+  std::vector<ZipEntry> entries;
+  size_t expected_offset = 0;
+  for (uint16_t i = 0; i < num_entries; i++) {
+    EXPECT_EQ(get32le(in, p), 0x02014b50);
+    ZipEntry entry;
+    entry.method = get16le(in, p + 10);
+    uint32_t crc = get32le(in, p + 16);
+    uint32_t compressed_size = get32le(in, p + 20);
+    uint32_t size = get32le(in, p + 24);
+    uint16_t name_len = get16le(in, p + 28);
+    size_t local = get32le(in, p + 42);
+    entry.name = in.substr(p + 46, name_len);
+    p += 46 + name_len + get16le(in, p + 30) + get16le(in, p + 32);
+
+    // Entries are laid out back to back in central directory order.
+    EXPECT_EQ(local, expected_offset) << entry.name;
+    EXPECT_EQ(get32le(in, local), 0x04034b50);
+    EXPECT_EQ(get16le(in, local + 8), entry.method) << entry.name;
+    EXPECT_EQ(get32le(in, local + 14), crc) << entry.name;
+    EXPECT_EQ(get32le(in, local + 18), compressed_size) << entry.name;
+    EXPECT_EQ(get32le(in, local + 22), size) << entry.name;
+    EXPECT_EQ(in.substr(local + 30, name_len), entry.name);
+    size_t data = local + 30 + name_len + get16le(in, local + 28);
+    if (entry.method == 0) {
+      bool is_so = entry.name.size() > 3 &&
+                   entry.name.compare(entry.name.size() - 3, 3, ".so") == 0;
+      EXPECT_EQ(data % (page_align && is_so ? 4096 : 4), 0) << entry.name;
+      entry.content = in.substr(data, compressed_size);
+    } else {
+      EXPECT_EQ(entry.method, 8) << entry.name;
+      entry.content = inflate_raw(in.substr(data, compressed_size), size);
+    }
+    EXPECT_EQ(entry.content.size(), size) << entry.name;
+    EXPECT_EQ(crc_of(entry.content), crc) << entry.name;
+    expected_offset = data + compressed_size;
+    entries.push_back(std::move(entry));
+  }
+  EXPECT_EQ(expected_offset, get32le(in, eocd + 16));
+  return entries;
+}
+
+// Content that does not compress away, so that it spans several chunks.
+std::string make_content(size_t size, uint32_t seed) {
+  std::string out(size, '\0');
+  for (auto& c : out) {
+    seed = seed * 1103515245 + 12345;
+    c = "abcdefghijklmnop"[(seed >> 16) % 16];
+  }
+  return out;
+}
+
+void write_file(const fs::path& path, const std::string& content) {
+  fs::create_directories(path.parent_path());
+  std::ofstream ofs(path.string(), std::ios::binary);
+  ofs << content;
+}
+
+} // namespace
+
+class RepackagerTest : public ::testing::Test {
+ protected:
+  RepackagerTest() {
+    m_dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(m_dir / "extracted");
+  }
+
+  ~RepackagerTest() { fs::remove_all(m_dir); }
+
+  fs::path m_dir;
+};
+
+TEST_F(RepackagerTest, roundTrip) {
+  auto large = make_content(3 * 1024 * 1024 + 17, 1);
+  std::vector<ZipEntry> original_entries = {
+      {"AndroidManifest.xml", 8, "<manifest/>"},
+      {"classes.dex", 8, "old dex"},
+      {"lib/arm64-v8a/libfoo.so", 0, make_content(5000, 2)},
+      {"lib/arm64-v8a/libbar.so", 0, "old library"},
+      {"res/a.png", 0, "png"},
+      {"res/old_name.xml", 8, "<renamed/>"},
+  };
+  auto input = (m_dir / "input.apk").string();
+  write_zip(input, original_entries);
+
+  auto extracted = m_dir / "extracted";
+  write_file(extracted / "AndroidManifest.xml", "<manifest/>");
+  write_file(extracted / "classes.dex", large);
+  write_file(extracted / "classes2.dex", make_content(100, 3));
+  write_file(extracted / "empty.txt", "");
+  write_file(extracted / "lib/arm64-v8a/libbar.so", "new library");
+  write_file(extracted / "lib/arm64-v8a/libfoo.so", make_content(5000, 2));
+  write_file(extracted / "res/a.png", "png");
+  write_file(extracted / "res/b.xml", "<renamed/>");
+
+  repackager::Options options;
+  options.input = input;
+  options.dir = extracted.string();
+  options.output = (m_dir / "output.apk").string();
+  options.renamed_to_original = {{"res/b.xml", "res/old_name.xml"}};
+  options.page_align = true;
+  options.jobs = 4;
+  repackager::repackage(options);
+
+  auto entries = read_zip(options.output, /* page_align */ true);
+  // The files of a directory come before those of its subdirectories, and
+  // entries keep their original compression method.
+  std::vector<ZipEntry> expected = {
+      {"AndroidManifest.xml", 8, "<manifest/>"},
+      {"classes.dex", 8, large},
+      {"classes2.dex", 8, make_content(100, 3)},
+      {"empty.txt", 8, ""},
+      {"lib/arm64-v8a/libbar.so", 0, "new library"},
+      {"lib/arm64-v8a/libfoo.so", 0, make_content(5000, 2)},
+      {"res/a.png", 0, "png"},
+      {"res/b.xml", 8, "<renamed/>"},
+  };
+  ASSERT_EQ(entries.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(entries[i].name, expected[i].name);
+    EXPECT_EQ(entries[i].method, expected[i].method) << expected[i].name;
+    EXPECT_TRUE(entries[i].content == expected[i].content)
+        << expected[i].name;
+  }
+
+  // Repackaging the output with its own extraction reproduces it exactly,
+  // since every entry is copied.
+  options.input = options.output;
+  options.output = (m_dir / "output2.apk").string();
+  options.renamed_to_original.clear();
+  repackager::repackage(options);
+  std::ifstream first(options.input, std::ios::binary);
+  std::ifstream second(options.output, std::ios::binary);
+  EXPECT_TRUE(std::equal(std::istreambuf_iterator<char>(first),
+                         std::istreambuf_iterator<char>(),
+                         std::istreambuf_iterator<char>(second),
+                         std::istreambuf_iterator<char>()));
+}
+
+TEST_F(RepackagerTest, alignsStoredEntries) {
+  auto input = (m_dir / "input.apk").string();
+  std::vector<ZipEntry> original_entries;
+  auto extracted = m_dir / "extracted";
+  // Names of all lengths shift the data offsets through every residue.
+  for (size_t i = 1; i <= 8; i++) {
+    auto name = std::string(i, 'a') + ".so";
+    original_entries.push_back({name, 0, ""});
+    write_file(extracted / name, make_content(i * 7, i));
+  }
+  write_zip(input, original_entries);
+
+  for (bool page_align : {false, true}) {
+    repackager::Options options;
+    options.input = input;
+    options.dir = extracted.string();
+    options.output = (m_dir / "output.apk").string();
+    options.page_align = page_align;
+    repackager::repackage(options);
+    auto entries = read_zip(options.output, page_align);
+    ASSERT_EQ(entries.size(), 8);
+    for (size_t i = 0; i < entries.size(); i++) {
+      EXPECT_EQ(entries[i].method, 0);
+      EXPECT_EQ(entries[i].content, make_content((i + 1) * 7, i + 1));
+    }
+  }
+}
+
+TEST_F(RepackagerTest, rejectsZip64Input) {
+  auto input = (m_dir / "input.apk").string();
+  write_zip(input, {{"a.txt", 8, "a"}});
+  std::ifstream ifs(input, std::ios::binary);
+  std::string archive((std::istreambuf_iterator<char>(ifs)),
+                      std::istreambuf_iterator<char>());
+  // A Zip64 end of central directory locator comes right before the end of
+  // central directory record.
+  std::string locator;
+  put32le(locator, 0x07064b50);
+  locator.resize(20, '\0');
+  archive.insert(archive.size() - 22, locator);
+  std::ofstream(input, std::ios::binary) << archive;
+  write_file(m_dir / "extracted" / "a.txt", "a");
+
+  repackager::Options options;
+  options.input = input;
+  options.dir = (m_dir / "extracted").string();
+  options.output = (m_dir / "output.apk").string();
+  EXPECT_THROW(repackager::repackage(options), repackager::Zip64Required);
+}
+
+TEST_F(RepackagerTest, needsZip64BeyondMaxEntries) {
+  auto input = (m_dir / "input.apk").string();
+  write_zip(input, {});
+  auto extracted = m_dir / "extracted";
+  for (size_t i = 0; i < 0xffff; i++) {
+    std::ofstream((extracted / std::to_string(i)).string());
+  }
+
+  repackager::Options options;
+  options.input = input;
+  options.dir = extracted.string();
+  options.output = (m_dir / "output.apk").string();
+  options.jobs = 4;
+  repackager::repackage(options);
+  EXPECT_EQ(read_zip(options.output).size(), 0xffff);
+
+  std::ofstream((extracted / "one-too-many").string());
+  EXPECT_THROW(repackager::repackage(options), repackager::Zip64Required);
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <json/json.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ServeSocket.h"
+
+namespace fs = boost::filesystem;
+
+class ServeSocketTest : public ::testing::Test {
+ protected:
+  ServeSocketTest() {
+    m_dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(m_dir);
+    m_path = (m_dir / "socket").string();
+  }
+
+  ~ServeSocketTest() { fs::remove_all(m_dir); }
+
+  fs::path m_dir;
+  std::string m_path;
+};
+
+TEST_F(ServeSocketTest, socketIsPrivate) {
+  // Even a permissive umask does not open the socket up.
+  mode_t old_umask = umask(0);
+  int listener = serve_socket::listen_on(m_path);
+  umask(old_umask);
+  ASSERT_GE(listener, 0) << strerror(errno);
+  struct stat st;
+  ASSERT_EQ(lstat(m_path.c_str(), &st), 0);
+  EXPECT_TRUE(S_ISSOCK(st.st_mode));
+  EXPECT_EQ(st.st_mode & 0777, 0600);
+  close(listener);
+
+  // A stale socket is replaced.
+  listener = serve_socket::listen_on(m_path);
+  EXPECT_GE(listener, 0) << strerror(errno);
+  close(listener);
+}
+
+TEST_F(ServeSocketTest, leavesOtherFilesAlone) {
+  std::ofstream(m_path) << "data";
+  EXPECT_EQ(serve_socket::listen_on(m_path), -1);
+  EXPECT_EQ(errno, EEXIST);
+  EXPECT_TRUE(fs::is_regular_file(m_path));
+}
+
+TEST_F(ServeSocketTest, exchangesLines) {
+  int listener = serve_socket::listen_on(m_path);
+  ASSERT_GE(listener, 0) << strerror(errno);
+  int client = serve_socket::connect_to(m_path);
+  ASSERT_GE(client, 0) << strerror(errno);
+  int server = accept(listener, nullptr, nullptr);
+  ASSERT_GE(server, 0);
+
+  ASSERT_TRUE(serve_socket::write_all(client, "{\"passes\": []}\nrest"));
+  std::string line;
+  EXPECT_TRUE(serve_socket::read_line(server, 1000, &line));
+  EXPECT_EQ(line, "{\"passes\": []}");
+
+  ASSERT_TRUE(serve_socket::write_all(server, "{\"status\": \"ok\"}\n"));
+  EXPECT_TRUE(serve_socket::read_line(client, -1, &line));
+  EXPECT_EQ(line, "{\"status\": \"ok\"}");
+
+  // A line the peer never finishes is an error.
+  ASSERT_TRUE(serve_socket::write_all(client, "incomplete"));
+  close(client);
+  EXPECT_FALSE(serve_socket::read_line(server, 1000, &line));
+  close(server);
+  close(listener);
+}
+
+TEST_F(ServeSocketTest, silentPeerTimesOut) {
+  int listener = serve_socket::listen_on(m_path);
+  ASSERT_GE(listener, 0) << strerror(errno);
+  int client = serve_socket::connect_to(m_path);
+  ASSERT_GE(client, 0) << strerror(errno);
+  int server = accept(listener, nullptr, nullptr);
+  ASSERT_GE(server, 0);
+
+  // The deadline covers the whole line, not each read.
+  ASSERT_TRUE(serve_socket::write_all(client, "partial"));
+  auto start = std::chrono::steady_clock::now();
+  std::string line;
+  EXPECT_FALSE(serve_socket::read_line(server, 100, &line));
+  EXPECT_EQ(errno, ETIMEDOUT);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_GE(elapsed, std::chrono::milliseconds(100));
+  EXPECT_LT(elapsed, std::chrono::seconds(10));
+
+  close(client);
+  close(server);
+  close(listener);
+}
+
+TEST_F(ServeSocketTest, rejectsOverlongLines) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  // More than fits in the socket buffer, so write in a separate process.
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    close(fds[0]);
+    serve_socket::write_all(
+        fds[1], std::string(serve_socket::kMaxLineLength + 1, 'a'));
+    _exit(0);
+  }
+  close(fds[1]);
+  std::string line;
+  EXPECT_FALSE(serve_socket::read_line(fds[0], 10000, &line));
+  EXPECT_EQ(errno, EMSGSIZE);
+  close(fds[0]);
+  waitpid(pid, nullptr, 0);
+}
+
+TEST_F(ServeSocketTest, rejectsMalformedRequests) {
+  // None of these may throw, since the server owns the loaded program.
+  for (const char* line :
+       {"", "{", "[1]", "\"x\"", "3", "null", "{\"command\": [1]}"}) {
+    Json::Value request;
+    std::string error;
+    EXPECT_FALSE(serve_socket::parse_request(line, &request, &error)) << line;
+    EXPECT_FALSE(error.empty()) << line;
+  }
+
+  Json::Value request;
+  std::string error;
+  ASSERT_TRUE(serve_socket::parse_request(
+      "{\"command\": \"shutdown\", \"passes\": []}", &request, &error));
+  EXPECT_EQ(request["command"].asString(), "shutdown");
+}
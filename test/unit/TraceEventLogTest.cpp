@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "DexClass.h"
+#include "RedexTest.h"
+#include "TraceEventLog.h"
+
+constexpr size_t NUM_THREADS = 10;
+constexpr size_t NUM_ITERS = 5'000;
+
+class TraceEventLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    m_path = (boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path())
+                 .string();
+  }
+
+  void TearDown() override { boost::filesystem::remove(m_path); }
+
+  std::string m_path;
+};
+
+size_t count_events(const trace_event_log::Log& log, const char* name) {
+  size_t count = 0;
+  for (const auto& event : log.events) {
+    if (log.strings.at(event.name) == name) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+TEST_F(TraceEventLogTest, disabledModulesAreNotRecorded) {
+  std::array<uint32_t, N_TRACE_MODULES> rates{};
+  rates[INL] = 1;
+  trace_event_log::open(m_path, rates);
+  TRACE_EVENT(INL, "inlined", 1);
+  TRACE_EVENT(CSE, "eliminated", 1);
+  trace_event_log::close();
+
+  auto log = trace_event_log::read(m_path);
+  ASSERT_EQ(log.events.size(), 1);
+  EXPECT_EQ(log.modules.at(log.events[0].module), "INL");
+  EXPECT_EQ(log.strings.at(log.events[0].name), "inlined");
+  EXPECT_EQ(log.events[0].payload, 1);
+}
+
+TEST_F(TraceEventLogTest, multipleThreads) {
+  std::array<uint32_t, N_TRACE_MODULES> rates{};
+  rates[INL] = 1;
+  trace_event_log::open(m_path, rates);
+  trace_event_log::set_current_pass("TestPass");
+  std::vector<boost::thread> threads;
+  for (size_t idx = 0; idx < NUM_THREADS; ++idx) {
+    threads.emplace_back(boost::thread([]() {
+      for (size_t j = 0; j < NUM_ITERS; ++j) {
+        TRACE_EVENT(INL, "iteration", j);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  trace_event_log::set_current_pass({});
+  trace_event_log::close();
+
+  auto log = trace_event_log::read(m_path);
+  ASSERT_EQ(count_events(log, "iteration"), NUM_THREADS * NUM_ITERS);
+  int64_t sum = 0;
+  for (const auto& event : log.events) {
+    EXPECT_EQ(log.strings.at(event.pass), "TestPass");
+    sum += event.payload;
+  }
+  EXPECT_EQ(sum, NUM_THREADS * (NUM_ITERS * (NUM_ITERS - 1) / 2));
+}
+
+TEST_F(TraceEventLogTest, sampling) {
+  std::array<uint32_t, N_TRACE_MODULES> rates{};
+  rates[CSE] = 4;
+  trace_event_log::open(m_path, rates);
+  for (size_t j = 0; j < 4 * NUM_ITERS; ++j) {
+    TRACE_EVENT(CSE, "sampled", j);
+  }
+  trace_event_log::close();
+
+  auto log = trace_event_log::read(m_path);
+  EXPECT_EQ(count_events(log, "sampled"), NUM_ITERS);
+}
+
+TEST_F(TraceEventLogTest, stringsSurviveReopening) {
+  std::array<uint32_t, N_TRACE_MODULES> rates{};
+  rates[INL] = 1;
+  for (size_t i = 0; i < 2; ++i) {
+    trace_event_log::open(m_path, rates);
+    TRACE_EVENT(INL, "reopened", i);
+    trace_event_log::close();
+  }
+
+  auto log = trace_event_log::read(m_path);
+  ASSERT_EQ(log.events.size(), 1);
+  EXPECT_EQ(log.strings.at(log.events[0].name), "reopened");
+  EXPECT_EQ(log.events[0].payload, 1);
+}
+
+TEST_F(TraceEventLogTest, traceIsNotRecorded) {
+  // Only deliberate call sites record events, so that TRACE stays free in
+  // release builds.
+  std::array<uint32_t, N_TRACE_MODULES> rates{};
+  rates[PM] = 1;
+  trace_event_log::open(m_path, rates);
+  TRACE(PM, 3, "ran %s", "pass");
+  TRACE_EVENT(PM, "ran", 3);
+  trace_event_log::close();
+
+  auto log = trace_event_log::read(m_path);
+  ASSERT_EQ(log.events.size(), 1);
+  EXPECT_EQ(log.strings.at(log.events[0].name), "ran");
+}
+
+class TraceEventLogMethodTest : public RedexTest {
+ protected:
+  void SetUp() override {
+    m_path = (boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path())
+                 .string();
+  }
+
+  void TearDown() override { boost::filesystem::remove(m_path); }
+
+  std::string m_path;
+};
+
+TEST_F(TraceEventLogMethodTest, eventsAreAttributedToTheTraceContext) {
+  auto* method = DexMethod::make_method("LFoo;.bar:()V");
+  std::array<uint32_t, N_TRACE_MODULES> rates{};
+  rates[INL] = 1;
+  trace_event_log::open(m_path, rates);
+  TRACE_EVENT(INL, "outside", 0);
+  {
+    TraceContext context(method);
+    for (int i = 0; i < 3; ++i) {
+      TRACE_EVENT(INL, "inside", i);
+    }
+  }
+  trace_event_log::close();
+
+  auto log = trace_event_log::read(m_path);
+  ASSERT_EQ(log.events.size(), 4);
+  EXPECT_EQ(log.events[0].method, trace_event_log::kNoString);
+  for (size_t i = 1; i < log.events.size(); ++i) {
+    EXPECT_EQ(log.strings.at(log.events[i].method), "LFoo;.bar:()V");
+  }
+}
@@ -9,6 +9,7 @@
 
 #include "IRAssembler.h"
 #include "RedexTest.h"
+#include "Show.h"
 #include "TypeInference.h"
 
 using namespace testing;
@@ -45,3 +46,67 @@ TEST_F(TypeInferenceTest, const0) {
     }
   }
 }
+
+TEST_F(TypeInferenceTest, lazyTypeEnvironments) {
+  auto method = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.bar:(ILjava/lang/String;)Ljava/lang/Object;"
+     (
+      (load-param v0)
+      (load-param-object v1)
+      (if-eqz v0 :else)
+      (const-string "hello")
+      (move-result-pseudo-object v1)
+      (goto :end)
+      (:else)
+      (const v0 0)
+      (const-wide v2 1)
+      (:end)
+      (return-object v1)
+     )
+    )
+  )");
+  auto code = method->get_code();
+  code->build_cfg(/* editable */ false);
+  auto& cfg = code->cfg();
+  type_inference::TypeInference eager(cfg);
+  eager.run(method);
+  type_inference::TypeInference lazy(cfg,
+                                     /* skip_check_cast_to_intf */ false,
+                                     /* lazy_type_environments */ true);
+  lazy.run(method);
+
+  const auto& envs = eager.get_type_environments();
+  // Query the instructions backwards, so that blocks get evicted from the
+  // cache and are recomputed.
+  std::vector<IRInstruction*> insns;
+  for (auto& mie : InstructionIterable(*code)) {
+    insns.push_back(mie.insn);
+  }
+  auto check = [&](IRInstruction* insn) {
+    auto* env = lazy.get_type_environment(insn);
+    ASSERT_NE(env, nullptr);
+    EXPECT_TRUE(env->equals(envs.at(insn))) << show(insn);
+    EXPECT_EQ(eager.get_type_environment(insn), &envs.at(insn));
+  };
+  for (size_t round = 0; round < 2; round++) {
+    for (auto it = insns.rbegin(); it != insns.rend(); ++it) {
+      check(*it);
+    }
+  }
+  // Forwards, and each instruction twice in a row.
+  for (auto* insn : insns) {
+    check(insn);
+    check(insn);
+  }
+
+  IRInstruction unrelated(OPCODE_NOP);
+  EXPECT_EQ(lazy.get_type_environment(&unrelated), nullptr);
+  EXPECT_EQ(eager.get_type_environment(&unrelated), nullptr);
+
+  // Materializing all environments still works in lazy mode.
+  const auto& lazy_envs = lazy.get_type_environments();
+  EXPECT_EQ(lazy_envs.size(), envs.size());
+  for (auto* insn : insns) {
+    EXPECT_TRUE(lazy_envs.at(insn).equals(envs.at(insn)));
+  }
+}
@@ -10,6 +10,7 @@
 #include <gmock/gmock.h>
 
 #include "DexUtil.h"
+#include "IRAssembler.h"
 #include "RedexTest.h"
 #include "Show.h"
 
@@ -37,3 +38,87 @@ TEST_F(WalkersTest, accumlate) {
       ::testing::UnorderedElementsAre(
           "LFoo;.bar:()V", "LFoo;.baz:()V", "LFoo;.qux:()V", "LFoo;.quux:()V"));
 }
+
+namespace {
+
+// Creates a class with one static method per entry of `sizes`, each of which
+// has that many instructions.
+DexClass* create_class(const std::string& name,
+                       const std::vector<size_t>& sizes) {
+  ClassCreator cc(DexType::make_type(name));
+  cc.set_super(type::java_lang_Object());
+  for (size_t i = 0; i < sizes.size(); i++) {
+    auto m = DexMethod::make_method(name + ".m" + std::to_string(i) + ":()V")
+                 ->make_concrete(ACC_PUBLIC | ACC_STATIC, false);
+    std::string body = "(";
+    for (size_t j = 1; j < sizes[i]; j++) {
+      body += "(const v0 0)";
+    }
+    body += "(return-void))";
+    m->set_code(assembler::ircode_from_string(body));
+    cc.add_method(m);
+  }
+  return cc.create();
+}
+
+} // namespace
+
+TEST_F(WalkersTest, scheduleLargestFirst) {
+  auto small = create_class("LSmall;", {2});
+  auto large = create_class("LLarge;", {20, 10});
+  auto medium = create_class("LMedium;", {12});
+
+  auto units = walker_costs::schedule({small, large, medium}, 2);
+  ASSERT_EQ(units.size(), 3);
+  EXPECT_EQ(units[0].cls, large);
+  EXPECT_EQ(units[0].method, nullptr);
+  EXPECT_EQ(units[1].cls, medium);
+  EXPECT_EQ(units[2].cls, small);
+}
+
+TEST_F(WalkersTest, scheduleSplitsLargeClasses) {
+  auto small = create_class("LSmall;", {2});
+  auto large = create_class("LLarge;", {20, 10});
+  auto medium = create_class("LMedium;", {12});
+
+  walker_costs::SplitLargeClasses split_large_classes;
+  auto units = walker_costs::schedule({small, large, medium}, 2);
+  ASSERT_EQ(units.size(), 4);
+  EXPECT_EQ(units[0].cls, large);
+  EXPECT_EQ(units[0].method, large->get_dmethods()[0]);
+  EXPECT_EQ(units[1].cls, medium);
+  EXPECT_EQ(units[1].method, nullptr);
+  EXPECT_EQ(units[2].cls, large);
+  EXPECT_EQ(units[2].method, large->get_dmethods()[1]);
+  EXPECT_EQ(units[3].cls, small);
+
+  // Every method is still walked exactly once.
+  using StringSet = std::unordered_set<std::string>;
+  Scope scope{small, large, medium};
+  auto strings = walk::parallel::methods<StringSet, MergeContainers<StringSet>>(
+      scope, [&](DexMethod* m) { return StringSet{show(m)}; }, 2);
+  EXPECT_THAT(strings,
+              ::testing::UnorderedElementsAre(
+                  "LSmall;.m0:()V", "LLarge;.m0:()V", "LLarge;.m1:()V",
+                  "LMedium;.m0:()V"));
+}
+
+TEST_F(WalkersTest, cheapWalksDoNotLowerCosts) {
+  auto cls = create_class("LFoo;", {1000});
+  auto* method = cls->get_dmethods()[0];
+  EXPECT_EQ(walker_costs::estimate(method),
+            1001 * walker_costs::kNanosPerUntimedInstruction);
+
+  auto record = [&](std::chrono::milliseconds time) {
+    walker_costs::WalkRecorder recorder(1);
+    recorder.add(0, method, time);
+    recorder.commit();
+  };
+  // Measured costs replace the estimate, and only grow afterwards.
+  record(std::chrono::milliseconds(20));
+  EXPECT_EQ(walker_costs::estimate(method), 20 * 1000 * 1000);
+  record(std::chrono::milliseconds(50));
+  EXPECT_EQ(walker_costs::estimate(method), 50 * 1000 * 1000);
+  record(std::chrono::milliseconds(11));
+  EXPECT_EQ(walker_costs::estimate(method), 50 * 1000 * 1000);
+}
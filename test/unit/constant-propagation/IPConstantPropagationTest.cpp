@@ -1676,6 +1676,75 @@ TEST_F(InterproceduralConstantPropagationTest, whiteBoxReturnValues) {
   EXPECT_EQ(wps.get_return_value(returns_constant), SignedConstantDomain(1));
 }
 
+TEST_F(InterproceduralConstantPropagationTest, incrementalHeapAnalysis) {
+  auto cls_ty = DexType::make_type("LFoo;");
+  ClassCreator creator(cls_ty);
+  creator.set_super(type::java_lang_Object());
+
+  // Each return value only becomes known one heap analysis iteration after
+  // the one of the method it calls.
+  auto returns_one = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.returnsOne:()I"
+     (
+      (const v0 1)
+      (return v0)
+     )
+    )
+  )");
+  creator.add_method(returns_one);
+
+  auto calls_one = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.callsOne:()I"
+     (
+      (invoke-static () "LFoo;.returnsOne:()I")
+      (move-result v0)
+      (return v0)
+     )
+    )
+  )");
+  creator.add_method(calls_one);
+
+  auto calls_calls_one = assembler::method_from_string(R"(
+    (method (public static) "LFoo;.callsCallsOne:()I"
+     (
+      (invoke-static () "LFoo;.callsOne:()I")
+      (move-result v0)
+      (return v0)
+     )
+    )
+  )");
+  creator.add_method(calls_calls_one);
+
+  Scope scope{creator.create()};
+  walk::code(scope, [](DexMethod*, IRCode& code) {
+    code.build_cfg(/* editable */ false);
+  });
+
+  for (bool incremental : {false, true}) {
+    InterproceduralConstantPropagationPass::Config config;
+    config.max_heap_analysis_iterations = 3;
+    config.incremental_heap_analysis = incremental;
+    auto fp_iter = InterproceduralConstantPropagationPass(config).analyze(
+        scope, &m_immut_analyzer_state, &m_api_level_analyzer_state);
+    auto& wps = fp_iter->get_whole_program_state();
+
+    EXPECT_EQ(wps.get_return_value(returns_one), SignedConstantDomain(1));
+    EXPECT_EQ(wps.get_return_value(calls_one), SignedConstantDomain(1));
+    EXPECT_EQ(wps.get_return_value(calls_calls_one), SignedConstantDomain(1));
+
+    const auto& stats = fp_iter->get_stats();
+    if (incremental) {
+      // Only the method whose callee's return value changed in the previous
+      // iteration needs to be re-analyzed.
+      EXPECT_EQ(stats.wps_contribution_cache_misses, 3 + 1 + 1);
+      EXPECT_EQ(stats.wps_contribution_cache_hits, 2 + 2);
+    } else {
+      EXPECT_EQ(stats.wps_contribution_cache_misses, 0);
+      EXPECT_EQ(stats.wps_contribution_cache_hits, 0);
+    }
+  }
+}
+
 TEST_F(InterproceduralConstantPropagationTest, min_sdk) {
   auto cls_ty = DexType::make_type("LFoo;");
   ClassCreator creator(cls_ty);
@@ -83,6 +83,12 @@ void open_dex_file(const char* filename, ddump_data* rd) {
   rd->dex_proto_ids = (dex_proto_id*)(rd->dexmmap + rd->dexh->proto_ids_off);
 }
 
+void close_dex_file(ddump_data* rd) {
+  munmap(rd->dexmmap, rd->dex_size);
+  rd->dexmmap = nullptr;
+  rd->dexh = nullptr;
+}
+
 void get_type_extent(ddump_data* rd,
                      uint16_t type,
                      uint32_t& start,
@@ -19,7 +19,6 @@
 using namespace reachability;
 
 std::unique_ptr<ReachableObjectGraph> generate_graph() {
-  auto graph = std::make_unique<ReachableObjectGraph>();
   auto seed = ReachableObject();
 
   ClassCreator cc(DexType::make_type("LFoo;"));
@@ -31,11 +30,9 @@ std::unique_ptr<ReachableObjectGraph> generate_graph() {
   auto anno = ReachableObject(
       new DexAnnotation(DexType::make_type("LAnno;"), DAV_RUNTIME));
 
-  graph->emplace(cls, ReachableObjectSet{seed});
-  graph->emplace(anno, ReachableObjectSet{cls});
-  graph->emplace(method, ReachableObjectSet{cls});
-  graph->emplace(field, ReachableObjectSet{method});
-  return graph;
+  return std::make_unique<ReachableObjectGraph>(
+      std::vector<ReachableObjectGraph::Edge>{
+          {cls, seed}, {anno, cls}, {method, cls}, {field, method}});
 }
 
 int main(int argc, char** argv) {
@@ -979,23 +979,27 @@ void redex_frontend(ConfigFiles& conf, /* input */
   if (!library_jars.empty()) {
     Timer t("Load library jars");
 
+    std::vector<std::pair<const DexLocation*, Scope*>> jars;
     for (const auto& library_jar : library_jars) {
       TRACE(MAIN, 1, "LIBRARY JAR: %s", library_jar.c_str());
-      if (!load_jar_file(DexLocation::make_location("", library_jar),
-                         &external_classes)) {
+      if (boost::filesystem::exists(library_jar)) {
+        jars.emplace_back(DexLocation::make_location("", library_jar),
+                          &external_classes);
+        auto abs_path = boost::filesystem::absolute(library_jar);
+        args.entry_data["jars"].append(abs_path.string());
+      } else {
         // Try again with the basedir
         std::string basedir_path = pg_config.basedirectory + "/" + library_jar;
-        if (!load_jar_file(DexLocation::make_location("", basedir_path))) {
-          std::cerr << "error: library jar could not be loaded: " << library_jar
-                    << std::endl;
-          exit(EXIT_FAILURE);
-        }
+        jars.emplace_back(DexLocation::make_location("", basedir_path),
+                          nullptr);
         args.entry_data["jars"].append(basedir_path);
-      } else {
-        auto abs_path = boost::filesystem::absolute(library_jar);
-        args.entry_data["jars"].append(abs_path.string());
       }
     }
+    if (!load_jar_files(
+            jars, json_config.get("library_jar_cache_dir", std::string()))) {
+      std::cerr << "error: library jars could not be loaded" << std::endl;
+      exit(EXIT_FAILURE);
+    }
   }
 
   {
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "ServeSocket.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <json/json.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace serve_socket {
+
+namespace {
+
+bool make_socket_address(const std::string& path, sockaddr_un* addr) {
+  *addr = sockaddr_un{};
+  addr->sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1);
+  return true;
+}
+
+// Closes fd without clobbering the errno of the failure that led here.
+int fail(int fd) {
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return -1;
+}
+
+} // namespace
+
+int listen_on(const std::string& path) {
+  sockaddr_un addr;
+  if (!make_socket_address(path, &addr)) {
+    return -1;
+  }
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      errno = EEXIST;
+      return -1;
+    }
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  // The socket is created with the permissions left by the umask, and
+  // anyone who can connect can make the server write files.
+  mode_t old_umask = umask(077);
+  int bound = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  umask(old_umask);
+  if (bound != 0) {
+    return fail(fd);
+  }
+  if (chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(fd, 16) != 0) {
+    unlink(path.c_str());
+    return fail(fd);
+  }
+  return fd;
+}
+
+int connect_to(const std::string& path) {
+  sockaddr_un addr;
+  if (!make_socket_address(path, &addr)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    return fail(fd);
+  }
+  return fd;
+}
+
+bool write_all(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+bool read_line(int fd, int timeout_ms, std::string* line) {
+  using Clock = std::chrono::steady_clock;
+  auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+  line->clear();
+  char buffer[4096];
+  while (true) {
+    int wait_ms = -1;
+    if (timeout_ms >= 0) {
+      auto left =
+          std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now());
+      if (left.count() <= 0) {
+        errno = ETIMEDOUT;
+        return false;
+      }
+      wait_ms = static_cast<int>(left.count());
+    }
+    pollfd pfd{fd, POLLIN, 0};
+    int ready = poll(&pfd, 1, wait_ms);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready < 0) {
+      return false;
+    }
+    if (ready == 0) {
+      continue;
+    }
+    // One line per connection: whatever follows the newline is dropped.
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    const char* newline = static_cast<const char*>(memchr(buffer, '\n', n));
+    line->append(buffer, newline == nullptr ? n : newline - buffer);
+    if (line->size() > kMaxLineLength) {
+      errno = EMSGSIZE;
+      return false;
+    }
+    if (newline != nullptr) {
+      return true;
+    }
+  }
+}
+
+bool parse_request(const std::string& line,
+                   Json::Value* request,
+                   std::string* error) {
+  try {
+    std::istringstream stream(line);
+    stream >> *request;
+  } catch (const std::exception& e) {
+    *error = e.what();
+    return false;
+  }
+  if (!request->isObject()) {
+    *error = "The request is not a JSON object";
+    return false;
+  }
+  if (request->isMember("command") && !(*request)["command"].isString()) {
+    *error = "The command of the request is not a string";
+    return false;
+  }
+  return true;
+}
+
+} // namespace serve_socket
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace Json {
+class Value;
+} // namespace Json
+
+/*
+ * The Unix socket plumbing of `redex-opt --serve` and `--connect`. Requests
+ * and responses are single lines. The functions that return a file descriptor
+ * return -1 on failure, with errno set.
+ */
+namespace serve_socket {
+
+// Requests are small; anything longer is not a request.
+constexpr size_t kMaxLineLength = 1 << 20;
+
+/*
+ * Listens on a socket at the given path that only the current user can
+ * connect to. A stale socket at the path is replaced, but any other kind of
+ * file is left alone and fails with EEXIST.
+ */
+int listen_on(const std::string& path);
+
+int connect_to(const std::string& path);
+
+bool write_all(int fd, const std::string& data);
+
+/*
+ * Reads up to the next newline, which is not included in the line. Fails if
+ * the line is not complete within timeout_ms milliseconds (a negative timeout
+ * waits indefinitely), if it is longer than kMaxLineLength, or if the peer
+ * closes the connection first.
+ */
+bool read_line(int fd, int timeout_ms, std::string* line);
+
+/*
+ * Parses a request line. Fails with a message in `error` unless the line is
+ * a JSON object whose "command", if any, is a string, so that looking at a
+ * request cannot throw in the server.
+ */
+bool parse_request(const std::string& line,
+                   Json::Value* request,
+                   std::string* error);
+
+} // namespace serve_socket
@@ -7,13 +7,20 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
+#include <csignal>
+#include <cstring>
 #include <iostream>
 #include <json/json.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "DexClass.h"
 #include "DexLoader.h"
+#include "PassManager.h"
 #include "PassRegistry.h"
 #include "RedexContext.h"
+#include "ServeSocket.h"
 #include "Timer.h"
 #include "ToolsCommon.h"
 
@@ -27,8 +34,23 @@ struct Arguments {
   std::string config_file;
   std::vector<std::string> s_args;
   std::vector<std::string> j_args;
+  std::string serve_socket;
+  std::string connect_socket;
 };
 
+void prepare_output_dir(const std::string& output_ir_dir) {
+  if (output_ir_dir.empty()) {
+    std::cerr << "output-dir is empty\n";
+    exit(EXIT_FAILURE);
+  }
+  std::string meta_dir = output_ir_dir + "/meta";
+  boost::filesystem::create_directories(meta_dir);
+  if (!boost::filesystem::is_directory(meta_dir)) {
+    std::cerr << "Could not create " << meta_dir << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
 Arguments parse_args(int argc, char* argv[]) {
   namespace po = boost::program_options;
   po::options_description desc(
@@ -68,6 +90,15 @@ Arguments parse_args(int argc, char* argv[]) {
       "    \te.g. -JMyPass.config=[1, 2, 3]\n"
       "Note: Be careful to properly escape JSON parameters, e.g., strings must "
       "be quoted.");
+  desc.add_options()(
+      "serve",
+      po::value<std::string>(),
+      "Load the input once, then run the requests received on this Unix "
+      "socket, each in a forked copy of the loaded program");
+  desc.add_options()("connect",
+                     po::value<std::string>(),
+                     "Send the passes, config and output directory of this "
+                     "invocation to a redex-opt started with --serve");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -87,15 +118,15 @@ Arguments parse_args(int argc, char* argv[]) {
   if (vm.count("output-ir")) {
     args.output_ir_dir = vm["output-ir"].as<std::string>();
   }
-  if (args.output_ir_dir.empty()) {
-    std::cerr << "output-dir is empty\n";
-    exit(EXIT_FAILURE);
+  if (vm.count("serve")) {
+    args.serve_socket = vm["serve"].as<std::string>();
   }
-  std::string meta_dir = args.output_ir_dir + "/meta";
-  boost::filesystem::create_directories(meta_dir);
-  if (!boost::filesystem::is_directory(meta_dir)) {
-    std::cerr << "Could not create " << meta_dir << std::endl;
-    exit(EXIT_FAILURE);
+  if (vm.count("connect")) {
+    args.connect_socket = vm["connect"].as<std::string>();
+  }
+  // A server gets the output directory with each request.
+  if (args.serve_socket.empty()) {
+    prepare_output_dir(args.output_ir_dir);
   }
 
   if (vm.count("pass-name")) {
@@ -198,12 +229,222 @@ Json::Value process_entry_data(const Json::Value& entry_data,
 
   return config_data;
 }
+
+Json::Value get_pass_metrics(const PassManager& manager) {
+  Json::Value all(Json::ValueType::objectValue);
+  for (const auto& pass_info : manager.get_pass_info()) {
+    Json::Value pass(Json::ValueType::objectValue);
+    for (const auto& pass_metric : pass_info.metrics) {
+      pass[pass_metric.first] = (Json::Int64)pass_metric.second;
+    }
+    all[pass_info.name] = pass;
+  }
+  return all;
+}
+
+/*
+ * Runs the passes given in args over the loaded program, and writes the
+ * result to args.output_ir_dir. Returns the metrics of the passes.
+ */
+Json::Value run_passes(Arguments& args,
+                       DexStoresVector& stores,
+                       Json::Value entry_data) {
+  if (!args.config_file.empty()) {
+    entry_data["config"] = args.config_file;
+  }
+
+  args.redex_options.deserialize(entry_data);
+
+  Json::Value config_data = process_entry_data(entry_data, args);
+  ConfigFiles conf(config_data, args.output_ir_dir);
+
+  const auto& passes = PassRegistry::get().get_passes();
+  PassManager manager(passes, conf, args.redex_options);
+  manager.set_testing_mode();
+  manager.run_passes(stores, conf);
+
+  redex::write_all_intermediate(conf, args.output_ir_dir, args.redex_options,
+                                stores, entry_data);
+  return get_pass_metrics(manager);
+}
+
+constexpr int kRequestTimeoutMs = 10 * 1000;
+
+/*
+ * The requests and responses of the server are JSON objects on a single
+ * line. A request has the fields "output_ir", "passes", and optionally
+ * "config", "S" and "J", which have the meaning of the command line options
+ * of the same names. A response has a "status", which is "ok", "error" or
+ * "crashed", and either the "metrics" of the passes or a "message".
+ */
+std::string to_line(const Json::Value& value) {
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  return Json::writeString(builder, value) + "\n";
+}
+
+Json::Value to_request(const Arguments& args) {
+  namespace fs = boost::filesystem;
+  Json::Value request;
+  // The server may run in another working directory.
+  request["output_ir"] = fs::absolute(args.output_ir_dir).string();
+  if (!args.config_file.empty()) {
+    request["config"] = fs::absolute(args.config_file).string();
+  }
+  for (const auto& [key, values] :
+       {std::make_pair("passes", &args.pass_names),
+        std::make_pair("S", &args.s_args), std::make_pair("J", &args.j_args)}) {
+    request[key] = Json::arrayValue;
+    for (const auto& value : *values) {
+      request[key].append(value);
+    }
+  }
+  return request;
+}
+
+Arguments from_request(const Json::Value& request, const Arguments& base) {
+  Arguments args;
+  args.redex_options = base.redex_options;
+  args.output_ir_dir = request["output_ir"].asString();
+  args.config_file = request.get("config", base.config_file).asString();
+  for (const auto& [key, values] :
+       {std::make_pair("passes", &args.pass_names),
+        std::make_pair("S", &args.s_args), std::make_pair("J", &args.j_args)}) {
+    for (const auto& value : request[key]) {
+      values->push_back(value.asString());
+    }
+  }
+  return args;
+}
+
+/*
+ * Serves requests one at a time. Each one runs in a forked child, which
+ * shares the loaded program with the server copy-on-write, so that the
+ * passes of one request do not affect the next one.
+ */
+int serve(const Arguments& base_args,
+          DexStoresVector& stores,
+          const Json::Value& entry_data) {
+  // A client going away must not bring the server down.
+  signal(SIGPIPE, SIG_IGN);
+
+  int listener = serve_socket::listen_on(base_args.serve_socket);
+  if (listener < 0) {
+    perror("Could not listen on the socket");
+    return EXIT_FAILURE;
+  }
+  std::cerr << "Serving on " << base_args.serve_socket << std::endl;
+
+  while (true) {
+    int conn = accept(listener, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("accept");
+      break;
+    }
+    // A client that never finishes its request must not block the others.
+    std::string line;
+    if (!serve_socket::read_line(conn, kRequestTimeoutMs, &line)) {
+      Json::Value response;
+      response["status"] = "error";
+      response["message"] =
+          std::string("Could not read the request: ") + strerror(errno);
+      serve_socket::write_all(conn, to_line(response));
+      close(conn);
+      continue;
+    }
+    Json::Value request;
+    std::string error;
+    if (!serve_socket::parse_request(line, &request, &error)) {
+      Json::Value response;
+      response["status"] = "error";
+      response["message"] = error;
+      serve_socket::write_all(conn, to_line(response));
+      close(conn);
+      continue;
+    }
+    if (request.get("command", "").asString() == "shutdown") {
+      close(conn);
+      break;
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(listener);
+      Json::Value response;
+      try {
+        Arguments args = from_request(request, base_args);
+        prepare_output_dir(args.output_ir_dir);
+        response["metrics"] = run_passes(args, stores, entry_data);
+        response["output_ir"] = args.output_ir_dir;
+        response["status"] = "ok";
+      } catch (const std::exception& e) {
+        response["status"] = "error";
+        response["message"] = e.what();
+      }
+      serve_socket::write_all(conn, to_line(response));
+      // Skip the destruction of the program, which the server still owns.
+      std::cout.flush();
+      std::cerr.flush();
+      _exit(EXIT_SUCCESS);
+    }
+
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != EXIT_SUCCESS) {
+      Json::Value response;
+      response["status"] = "crashed";
+      response["message"] =
+          pid < 0 ? std::string("fork failed: ") + strerror(errno)
+          : WIFSIGNALED(status)
+              ? std::string("killed by ") + strsignal(WTERMSIG(status))
+              : "exit code " + std::to_string(WEXITSTATUS(status));
+      serve_socket::write_all(conn, to_line(response));
+    }
+    close(conn);
+  }
+
+  close(listener);
+  unlink(base_args.serve_socket.c_str());
+  return EXIT_SUCCESS;
+}
+
+int connect_and_send(const Arguments& args) {
+  int fd = serve_socket::connect_to(args.connect_socket);
+  if (fd < 0) {
+    perror("Could not connect to the socket");
+    return EXIT_FAILURE;
+  }
+  if (!serve_socket::write_all(fd, to_line(to_request(args)))) {
+    perror("Could not send the request");
+    return EXIT_FAILURE;
+  }
+  // Running the passes takes as long as it takes.
+  std::string response;
+  if (!serve_socket::read_line(fd, /* timeout_ms */ -1, &response)) {
+    perror("Could not read the response");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  std::cout << response << std::endl;
+  return parse_json_value(response)["status"].asString() == "ok"
+             ? EXIT_SUCCESS
+             : EXIT_FAILURE;
+}
 } // namespace
 
 int main(int argc, char* argv[]) {
   Timer opt_timer("Redex-opt");
   Arguments args = parse_args(argc, argv);
 
+  if (!args.connect_socket.empty()) {
+    return connect_and_send(args);
+  }
+
   g_redex = new RedexContext();
 
   Json::Value entry_data;
@@ -220,22 +461,13 @@ int main(int argc, char* argv[]) {
     stores[0].set_dex_magic(load_dex_magic_from_dex(location));
   }
 
-  if (!args.config_file.empty()) {
-    entry_data["config"] = args.config_file;
+  if (!args.serve_socket.empty()) {
+    int status = serve(args, stores, entry_data);
+    delete g_redex;
+    return status;
   }
 
-  args.redex_options.deserialize(entry_data);
-
-  Json::Value config_data = process_entry_data(entry_data, args);
-  ConfigFiles conf(config_data, args.output_ir_dir);
-
-  const auto& passes = PassRegistry::get().get_passes();
-  PassManager manager(passes, conf, args.redex_options);
-  manager.set_testing_mode();
-  manager.run_passes(stores, conf);
-
-  redex::write_all_intermediate(conf, args.output_ir_dir, args.redex_options,
-                                stores, entry_data);
+  run_passes(args, stores, entry_data);
 
   delete g_redex;
   return 0;
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <iostream>
+
+#include "Repackager.h"
+#include "Tool.h"
+#include "WorkQueue.h"
+
+namespace {
+
+// Tells pyredex's ZipManager to fall back to zipfile, which supports Zip64.
+constexpr int kZip64RequiredExitCode = 3;
+
+class Repackage : public Tool {
+ public:
+  Repackage()
+      : Tool("repackage",
+             "zip an extracted apk or aab directory, keeping the compression "
+             "of the original archive") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()(
+        "input,i",
+        po::value<std::string>()->value_name("input.apk")->required(),
+        "the original archive")(
+        "dir,d",
+        po::value<std::string>()->value_name("extracted")->required(),
+        "the extracted directory to zip")(
+        "output,o",
+        po::value<std::string>()->value_name("output.apk")->required(),
+        "the archive to write")(
+        "renamed-files",
+        po::value<std::string>()->value_name("resource-mapping.txt"),
+        "JSON map from original to new names of renamed entries")(
+        "page-align", po::bool_switch(),
+        "align uncompressed native libraries to 4 KiB")(
+        "level", po::value<int>()->default_value(Z_DEFAULT_COMPRESSION),
+        "deflate level")(
+        "jobs,j",
+        po::value<unsigned>()->default_value(
+            redex_parallel::default_num_threads()),
+        "number of threads");
+  }
+
+  void run(const po::variables_map& options) override {
+    repackager::Options repackager_options;
+    repackager_options.input = options["input"].as<std::string>();
+    repackager_options.dir = options["dir"].as<std::string>();
+    repackager_options.output = options["output"].as<std::string>();
+    if (options.count("renamed-files")) {
+      repackager_options.renamed_to_original = repackager::read_renamed_files(
+          options["renamed-files"].as<std::string>());
+    }
+    repackager_options.page_align = options["page-align"].as<bool>();
+    repackager_options.level = options["level"].as<int>();
+    repackager_options.jobs = options["jobs"].as<unsigned>();
+    try {
+      repackager::repackage(repackager_options);
+    } catch (const repackager::Zip64Required& e) {
+      std::cerr << e.what() << std::endl;
+      exit(kZip64RequiredExitCode);
+    }
+  }
+};
+
+static Repackage s_tool;
+
+} // namespace
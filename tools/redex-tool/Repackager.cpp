@@ -0,0 +1,557 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "Repackager.h"
+
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <json/json.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Debug.h"
+#include "WorkQueue.h"
+
+namespace repackager {
+
+namespace {
+
+namespace fs = boost::filesystem;
+
+constexpr uint16_t kStored = 0;
+constexpr uint16_t kDeflated = 8;
+constexpr uint32_t kLocalFileSignature = 0x04034b50;
+constexpr uint32_t kCentralFileSignature = 0x02014b50;
+constexpr uint32_t kEndOfCentralDirSignature = 0x06054b50;
+constexpr uint32_t kZip64EndOfCentralDirLocatorSignature = 0x07064b50;
+constexpr size_t kZip64EndOfCentralDirLocatorSize = 20;
+// The largest number of entries without Zip64.
+constexpr size_t kMaxEntries = 0xffff;
+constexpr size_t kLocalFileHeaderSize = 30;
+constexpr size_t kCentralFileHeaderSize = 46;
+constexpr size_t kEndOfCentralDirSize = 22;
+// The extra field that zipalign uses to pad entries.
+constexpr uint16_t kAlignmentExtraId = 0xd935;
+constexpr size_t kAlignmentExtraMinSize = 6;
+constexpr size_t kChunkSize = 1 << 20;
+constexpr size_t kDictionarySize = 32 * 1024;
+constexpr size_t kCopyBufferSize = 64 * 1024;
+
+uint16_t read16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t read32(const uint8_t* p) {
+  return static_cast<uint32_t>(read16(p)) |
+         (static_cast<uint32_t>(read16(p + 2)) << 16);
+}
+
+void write16(std::string& out, uint16_t v) {
+  out.push_back(static_cast<char>(v & 0xff));
+  out.push_back(static_cast<char>(v >> 8));
+}
+
+void write32(std::string& out, uint32_t v) {
+  write16(out, v & 0xffff);
+  write16(out, v >> 16);
+}
+
+struct OriginalEntry {
+  uint16_t method;
+  uint32_t crc;
+  uint32_t compressed_size;
+  uint32_t size;
+  // The compressed data in the original archive.
+  const uint8_t* data;
+};
+
+std::unordered_map<std::string, OriginalEntry> read_central_directory(
+    const boost::iostreams::mapped_file_source& apk) {
+  const auto* begin = reinterpret_cast<const uint8_t*>(apk.data());
+  const auto* end = begin + apk.size();
+  always_assert_log(apk.size() >= kEndOfCentralDirSize, "Archive too small");
+  // The end of central directory record is followed by a comment of at most
+  // 64 KiB.
+  const uint8_t* eocd = end - kEndOfCentralDirSize;
+  while (read32(eocd) != kEndOfCentralDirSignature) {
+    always_assert_log(eocd > begin && end - eocd < 0x10000 + 22,
+                      "End of central directory record not found");
+    eocd--;
+  }
+  // Zip64 archives have a locator right before the end of central directory
+  // record, and 0xffffffff in the fields whose values only fit there.
+  if (eocd - begin >= static_cast<ptrdiff_t>(kZip64EndOfCentralDirLocatorSize) &&
+      read32(eocd - kZip64EndOfCentralDirLocatorSize) ==
+          kZip64EndOfCentralDirLocatorSignature) {
+    throw Zip64Required("The input archive uses Zip64");
+  }
+  uint16_t num_entries = read16(eocd + 10);
+  const uint8_t* p = begin + read32(eocd + 16);
+
+  std::unordered_map<std::string, OriginalEntry> entries;
+  for (uint16_t i = 0; i < num_entries; i++) {
+    always_assert_log(p + kCentralFileHeaderSize <= end &&
+                          read32(p) == kCentralFileSignature,
+                      "Corrupt central directory");
+    uint16_t name_len = read16(p + 28);
+    std::string name(reinterpret_cast<const char*>(p) + kCentralFileHeaderSize,
+                     name_len);
+    if (read32(p + 20) == UINT32_MAX || read32(p + 24) == UINT32_MAX ||
+        read32(p + 42) == UINT32_MAX) {
+      throw Zip64Required("The input archive uses Zip64 for " + name);
+    }
+    const uint8_t* local = begin + read32(p + 42);
+    always_assert_log(local + kLocalFileHeaderSize <= end &&
+                          read32(local) == kLocalFileSignature,
+                      "Corrupt local header for %s", name.c_str());
+    OriginalEntry entry;
+    entry.method = read16(p + 10);
+    entry.crc = read32(p + 16);
+    entry.compressed_size = read32(p + 20);
+    entry.size = read32(p + 24);
+    entry.data =
+        local + kLocalFileHeaderSize + read16(local + 26) + read16(local + 28);
+    always_assert_log(entry.data + entry.compressed_size <= end,
+                      "Truncated entry %s", name.c_str());
+    entries.emplace(std::move(name), entry);
+    p += kCentralFileHeaderSize + name_len + read16(p + 30) + read16(p + 32);
+  }
+  return entries;
+}
+
+// The files below dir in the order in which os.walk() visits them with
+// sorted directory and file names: the files of a directory come before the
+// files of its subdirectories.
+void list_files(const fs::path& dir, std::vector<fs::path>& files) {
+  std::vector<fs::path> subdirs;
+  std::vector<fs::path> dir_files;
+  for (const auto& entry : fs::directory_iterator(dir)) {
+    if (fs::is_directory(entry.path())) {
+      subdirs.push_back(entry.path());
+    } else {
+      dir_files.push_back(entry.path());
+    }
+  }
+  std::sort(dir_files.begin(), dir_files.end());
+  std::sort(subdirs.begin(), subdirs.end());
+  files.insert(files.end(), dir_files.begin(), dir_files.end());
+  for (const auto& subdir : subdirs) {
+    list_files(subdir, files);
+  }
+}
+
+// A part of the scratch file.
+struct ScratchRange {
+  uint64_t offset{0};
+  size_t size{0};
+};
+
+/*
+ * Holds the deflated chunks until they are written to the archive. The file
+ * is unlinked right away, so that it never outlives the process.
+ */
+class ScratchFile {
+ public:
+  explicit ScratchFile(const std::string& dir) {
+    auto path = (fs::path(dir) / fs::unique_path(".repackage-%%%%-%%%%-%%%%"))
+                    .string();
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    always_assert_log(m_fd >= 0, "Cannot create %s", path.c_str());
+    unlink(path.c_str());
+  }
+
+  ~ScratchFile() { close(m_fd); }
+
+  ScratchFile(const ScratchFile&) = delete;
+  ScratchFile& operator=(const ScratchFile&) = delete;
+
+  // Thread-safe.
+  ScratchRange append(const std::string& data) {
+    ScratchRange range;
+    range.offset = m_size.fetch_add(data.size());
+    range.size = data.size();
+    size_t written = 0;
+    while (written < data.size()) {
+      auto n = pwrite(m_fd, data.data() + written, data.size() - written,
+                      range.offset + written);
+      always_assert_log(n > 0, "Cannot write scratch file");
+      written += n;
+    }
+    return range;
+  }
+
+  void copy_to(const ScratchRange& range,
+               std::ostream& out,
+               std::vector<char>& buffer) const {
+    size_t copied = 0;
+    while (copied < range.size) {
+      auto n = pread(m_fd, buffer.data(),
+                     std::min(buffer.size(), range.size - copied),
+                     range.offset + copied);
+      always_assert_log(n > 0, "Cannot read scratch file");
+      out.write(buffer.data(), n);
+      copied += n;
+    }
+  }
+
+ private:
+  int m_fd{-1};
+  std::atomic<uint64_t> m_size{0};
+};
+
+struct Entry {
+  std::string name;
+  fs::path path;
+  uint16_t method{kDeflated};
+  uint16_t dos_time{0};
+  uint16_t dos_date{0};
+  uint32_t external_attr{0};
+  uint32_t crc{0};
+  // May exceed 32 bits until it is checked, see repackage().
+  uint64_t size{0};
+  // Set when the compressed data is copied from the original archive.
+  const OriginalEntry* original{nullptr};
+  // The deflated chunks of the content in the scratch file.
+  std::vector<ScratchRange> chunks;
+
+  size_t num_chunks() const {
+    return std::max<size_t>(1, (size + kChunkSize - 1) / kChunkSize);
+  }
+
+  size_t compressed_size() const {
+    if (original != nullptr) {
+      return original->compressed_size;
+    }
+    if (method == kStored) {
+      return size;
+    }
+    size_t compressed = 0;
+    for (const auto& chunk : chunks) {
+      compressed += chunk.size;
+    }
+    return compressed;
+  }
+};
+
+// Computes the CRC and size of the file with a small buffer, and records its
+// modification time and mode.
+void scan_entry(Entry& entry) {
+  std::ifstream in(entry.path.string(), std::ios::binary);
+  always_assert_log(in, "Cannot read %s", entry.path.string().c_str());
+  std::vector<char> buffer(kCopyBufferSize);
+  uLong crc = crc32(0L, Z_NULL, 0);
+  uint64_t size = 0;
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    auto n = in.gcount();
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(buffer.data()), n);
+    size += n;
+  }
+  entry.crc = crc;
+  entry.size = size;
+
+  struct stat st;
+  always_assert(stat(entry.path.string().c_str(), &st) == 0);
+  // Like zipfile, record the local modification time and the unix mode.
+  struct tm tm;
+  localtime_r(&st.st_mtime, &tm);
+  if (tm.tm_year < 80) {
+    tm = {};
+    tm.tm_year = 80;
+    tm.tm_mday = 1;
+  }
+  entry.dos_time = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+  entry.dos_date =
+      ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+  entry.external_attr = (st.st_mode & 0xffff) << 16;
+}
+
+// Reads length bytes at offset of the entry's file into buffer.
+void read_range(const Entry& entry,
+                size_t offset,
+                size_t length,
+                std::vector<char>& buffer) {
+  std::ifstream in(entry.path.string(), std::ios::binary);
+  buffer.resize(length);
+  in.seekg(offset);
+  in.read(buffer.data(), length);
+  always_assert_log(in && static_cast<size_t>(in.gcount()) == length,
+                    "%s changed while repackaging",
+                    entry.path.string().c_str());
+}
+
+ScratchRange deflate_chunk(const Entry& entry,
+                           size_t index,
+                           int level,
+                           ScratchFile& scratch) {
+  size_t begin = index * kChunkSize;
+  size_t end = std::min<size_t>(entry.size, begin + kChunkSize);
+  bool last = end == entry.size;
+  size_t dict_size = std::min(begin, kDictionarySize);
+  std::vector<char> input;
+  read_range(entry, begin - dict_size, dict_size + end - begin, input);
+  const auto* content = reinterpret_cast<const Bytef*>(input.data());
+
+  z_stream stream{};
+  always_assert(deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8,
+                             Z_DEFAULT_STRATEGY) == Z_OK);
+  if (dict_size > 0) {
+    deflateSetDictionary(&stream, content, dict_size);
+  }
+  std::string out;
+  // A sync flush leaves the stream at a byte boundary, so that the next
+  // chunk can be appended.
+  out.resize(deflateBound(&stream, end - begin) + 16);
+  stream.next_in = const_cast<Bytef*>(content + dict_size);
+  stream.avail_in = end - begin;
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = out.size();
+  int err = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+  always_assert_log(err == (last ? Z_STREAM_END : Z_OK) && stream.avail_in == 0,
+                    "Cannot deflate %s", entry.name.c_str());
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return scratch.append(out);
+}
+
+// Copies the stored content of the entry's file to out.
+void copy_stored(const Entry& entry,
+                 std::ostream& out,
+                 std::vector<char>& buffer) {
+  std::ifstream in(entry.path.string(), std::ios::binary);
+  uint64_t copied = 0;
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    out.write(buffer.data(), in.gcount());
+    copied += in.gcount();
+  }
+  always_assert_log(copied == entry.size, "%s changed while repackaging",
+                    entry.path.string().c_str());
+}
+
+bool is_native_library(const std::string& name) {
+  return name.size() > 3 && name.compare(name.size() - 3, 3, ".so") == 0;
+}
+
+// The extra field that aligns the data of a stored entry that starts at
+// offset.
+std::string alignment_extra(const Entry& entry,
+                            size_t offset,
+                            bool page_align) {
+  if (entry.method != kStored) {
+    return "";
+  }
+  size_t alignment = page_align && is_native_library(entry.name) ? 4096 : 4;
+  size_t data_offset = offset + kLocalFileHeaderSize + entry.name.size();
+  size_t padding = (alignment - data_offset % alignment) % alignment;
+  while (padding != 0 && padding < kAlignmentExtraMinSize) {
+    padding += alignment;
+  }
+  if (padding == 0) {
+    return "";
+  }
+  std::string extra;
+  write16(extra, kAlignmentExtraId);
+  write16(extra, padding - 4);
+  write16(extra, alignment);
+  extra.resize(padding, '\0');
+  return extra;
+}
+
+void write_archive(const std::vector<Entry>& entries,
+                   const ScratchFile& scratch,
+                   const std::string& output,
+                   bool page_align) {
+  std::ofstream out(output, std::ios::binary | std::ios::trunc);
+  always_assert_log(out, "Cannot write %s", output.c_str());
+
+  std::vector<char> buffer(kCopyBufferSize);
+  std::string central_directory;
+  uint64_t offset = 0;
+  for (const auto& entry : entries) {
+    size_t compressed_size = entry.compressed_size();
+    uint16_t flags = 0;
+    for (char c : entry.name) {
+      if (static_cast<unsigned char>(c) >= 0x80) {
+        flags |= 0x800; // UTF-8 name
+        break;
+      }
+    }
+    if (offset > UINT32_MAX || compressed_size > UINT32_MAX) {
+      throw Zip64Required("The output archive needs Zip64 for " + entry.name);
+    }
+    auto extra = alignment_extra(entry, offset, page_align);
+
+    std::string header;
+    write32(header, kLocalFileSignature);
+    write16(header, 20); // version needed to extract
+    write16(header, flags);
+    write16(header, entry.method);
+    write16(header, entry.dos_time);
+    write16(header, entry.dos_date);
+    write32(header, entry.crc);
+    write32(header, compressed_size);
+    write32(header, entry.size);
+    write16(header, entry.name.size());
+    write16(header, extra.size());
+    header += entry.name;
+    header += extra;
+    out << header;
+    if (entry.original != nullptr) {
+      out.write(reinterpret_cast<const char*>(entry.original->data),
+                compressed_size);
+    } else if (entry.method == kStored) {
+      copy_stored(entry, out, buffer);
+    } else {
+      for (const auto& chunk : entry.chunks) {
+        scratch.copy_to(chunk, out, buffer);
+      }
+    }
+
+    write32(central_directory, kCentralFileSignature);
+    write16(central_directory, (3 << 8) | 20); // made by unix
+    write16(central_directory, 20);
+    write16(central_directory, flags);
+    write16(central_directory, entry.method);
+    write16(central_directory, entry.dos_time);
+    write16(central_directory, entry.dos_date);
+    write32(central_directory, entry.crc);
+    write32(central_directory, compressed_size);
+    write32(central_directory, entry.size);
+    write16(central_directory, entry.name.size());
+    write16(central_directory, 0); // extra
+    write16(central_directory, 0); // comment
+    write16(central_directory, 0); // disk
+    write16(central_directory, 0); // internal attributes
+    write32(central_directory, entry.external_attr);
+    write32(central_directory, offset);
+    central_directory += entry.name;
+
+    offset += header.size() + compressed_size;
+  }
+
+  if (entries.size() > kMaxEntries || offset > UINT32_MAX ||
+      central_directory.size() > UINT32_MAX) {
+    throw Zip64Required("The output archive needs Zip64");
+  }
+  std::string end;
+  write32(end, kEndOfCentralDirSignature);
+  write16(end, 0);
+  write16(end, 0);
+  write16(end, entries.size());
+  write16(end, entries.size());
+  write32(end, central_directory.size());
+  write32(end, offset);
+  write16(end, 0);
+  out << central_directory << end;
+  out.close();
+  always_assert_log(!out.fail(), "Cannot write %s", output.c_str());
+}
+
+} // namespace
+
+std::unordered_map<std::string, std::string> read_renamed_files(
+    const std::string& path) {
+  std::unordered_map<std::string, std::string> renamed_to_original;
+  std::ifstream in(path);
+  always_assert_log(in, "Cannot read %s", path.c_str());
+  Json::Value mapping;
+  in >> mapping;
+  for (const auto& original : mapping.getMemberNames()) {
+    renamed_to_original[mapping[original].asString()] = original;
+  }
+  return renamed_to_original;
+}
+
+void repackage(const Options& options) {
+  boost::iostreams::mapped_file_source apk(options.input);
+  auto originals = read_central_directory(apk);
+  const auto& renamed_to_original = options.renamed_to_original;
+
+  fs::path dir(options.dir);
+  std::vector<fs::path> files;
+  list_files(dir, files);
+  if (files.size() > kMaxEntries) {
+    throw Zip64Required("The output archive needs Zip64 for " +
+                        std::to_string(files.size()) + " entries");
+  }
+
+  std::vector<Entry> entries(files.size());
+  size_t prefix = dir.string().size() + 1;
+  for (size_t i = 0; i < files.size(); i++) {
+    entries[i].name = files[i].string().substr(prefix);
+    entries[i].path = files[i];
+  }
+  workqueue_run_for<size_t>(
+      0,
+      entries.size(),
+      [&](size_t i) {
+        auto& entry = entries[i];
+        scan_entry(entry);
+        auto renamed = renamed_to_original.find(entry.name);
+        auto original = originals.find(renamed == renamed_to_original.end()
+                                           ? entry.name
+                                           : renamed->second);
+        if (original == originals.end()) {
+          return;
+        }
+        const auto& orig = original->second;
+        entry.method = orig.method;
+        if (orig.crc == entry.crc && orig.size == entry.size &&
+            (orig.method == kStored || orig.method == kDeflated)) {
+          entry.original = &orig;
+        }
+      },
+      options.jobs);
+  for (const auto& entry : entries) {
+    if (entry.size > UINT32_MAX) {
+      throw Zip64Required("The output archive needs Zip64 for " + entry.name);
+    }
+  }
+
+  // Deflate the changed and new entries chunk by chunk.
+  std::vector<std::pair<size_t, size_t>> chunks;
+  for (size_t i = 0; i < entries.size(); i++) {
+    auto& entry = entries[i];
+    if (entry.original != nullptr) {
+      continue;
+    }
+    always_assert_log(entry.method == kStored || entry.method == kDeflated,
+                      "Unsupported compression method %d for %s",
+                      entry.method, entry.name.c_str());
+    if (entry.method == kDeflated) {
+      entry.chunks.resize(entry.num_chunks());
+      for (size_t c = 0; c < entry.chunks.size(); c++) {
+        chunks.emplace_back(i, c);
+      }
+    }
+  }
+  // Big entries first, so that they do not end up last on one thread.
+  std::stable_sort(chunks.begin(), chunks.end(), [&](auto& a, auto& b) {
+    return entries[a.first].size > entries[b.first].size;
+  });
+  auto output_dir = fs::absolute(options.output).parent_path().string();
+  ScratchFile scratch(output_dir);
+  workqueue_run_for<size_t>(
+      0,
+      chunks.size(),
+      [&](size_t i) {
+        auto [entry, chunk] = chunks[i];
+        entries[entry].chunks[chunk] =
+            deflate_chunk(entries[entry], chunk, options.level, scratch);
+      },
+      options.jobs);
+
+  write_archive(entries, scratch, options.output, options.page_align);
+}
+
+} // namespace repackager
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <zlib.h>
+
+namespace repackager {
+
+struct Options {
+  // The original archive.
+  std::string input;
+  // The extracted directory to zip.
+  std::string dir;
+  // The archive to write.
+  std::string output;
+  // Maps the new names of renamed entries to their original names.
+  std::unordered_map<std::string, std::string> renamed_to_original;
+  // Align uncompressed native libraries to 4 KiB.
+  bool page_align{false};
+  int level{Z_DEFAULT_COMPRESSION};
+  unsigned jobs{1};
+};
+
+class Zip64Required : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+/*
+ * Zips an extracted APK or AAB directory back into an archive, which is what
+ * pyredex's ZipManager does with Python's zipfile followed by zipalign, in a
+ * single pass:
+ *
+ * - Entries are written in the order of os.walk() with sorted directories
+ *   and files, and keep the compression method they had in the original
+ *   archive (renamed resources are looked up by their original name).
+ * - Entries whose content did not change are copied from the original
+ *   archive without recompressing them.
+ * - The remaining entries are deflated in parallel. Large entries are split
+ *   into chunks that are deflated independently, each primed with the tail
+ *   of the previous chunk as dictionary, and concatenated at sync-flush
+ *   boundaries.
+ * - Stored entries are aligned to 4 bytes, and uncompressed native libraries
+ *   to 4 KiB with page_align, as zipalign -p does.
+ *
+ * Files are streamed and never held in memory as a whole: deflated chunks go
+ * to an unlinked scratch file next to the output until they are written.
+ *
+ * Zip64 archives are not supported, and throw Zip64Required, whether the
+ * input uses Zip64 or the output would need it.
+ */
+void repackage(const Options& options);
+
+// The renamed files of a resource-mapping.txt, which maps original to new
+// names, as a map from new to original names.
+std::unordered_map<std::string, std::string> read_renamed_files(
+    const std::string& path);
+
+} // namespace repackager
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include "Tool.h"
+#include "TraceEventLog.h"
+
+/*
+ * This tool decodes a binary trace event log written by Redex when run with
+ * TRACE_EVENT_FILE and TRACE_EVENTS set (see libredex/TraceEventLog.h).
+ *
+ *   redex-tool trace-events --log events.bin
+ *   redex-tool trace-events --log events.bin --by-method
+ *   redex-tool trace-events --log events.bin --by-pass
+ */
+namespace {
+
+using namespace trace_event_log;
+
+struct Aggregate {
+  uint64_t count{0};
+  int64_t sum{0};
+  int64_t min{std::numeric_limits<int64_t>::max()};
+  int64_t max{std::numeric_limits<int64_t>::min()};
+
+  void add(int64_t value) {
+    ++count;
+    sum += value;
+    min = std::min(min, value);
+    max = std::max(max, value);
+  }
+};
+
+const char* string_at(const Log& log, StringId id) {
+  return id < log.strings.size() ? log.strings[id].c_str() : "<unknown>";
+}
+
+const char* module_at(const Log& log, uint16_t module) {
+  return module < log.modules.size() ? log.modules[module].c_str()
+                                     : "<unknown>";
+}
+
+void print_events(const Log& log) {
+  // Events are sorted by timestamp.
+  uint64_t start = log.events.empty() ? 0 : log.events.front().timestamp_ns;
+  for (const auto& event : log.events) {
+    printf("%12" PRIu64 "us [%u] %s %s %s %s %" PRId64 "\n",
+           (event.timestamp_ns - start) / 1000, event.thread,
+           module_at(log, event.module), string_at(log, event.pass),
+           string_at(log, event.method), string_at(log, event.name),
+           event.payload);
+  }
+}
+
+// Keyed by (group, module, name), where group is a method or a pass.
+using AggregateMap =
+    std::map<std::tuple<std::string, std::string, std::string>, Aggregate>;
+
+void print_aggregates(const AggregateMap& aggregates) {
+  printf("group,module,name,count,sum,min,max\n");
+  for (const auto& [key, agg] : aggregates) {
+    const auto& [group, module, name] = key;
+    printf("%s,%s,%s,%" PRIu64 ",%" PRId64 ",%" PRId64 ",%" PRId64 "\n",
+           group.c_str(), module.c_str(), name.c_str(), agg.count, agg.sum,
+           agg.min, agg.max);
+  }
+}
+
+AggregateMap aggregate(const Log& log, StringId Event::*group) {
+  AggregateMap aggregates;
+  for (const auto& event : log.events) {
+    aggregates[std::make_tuple(string_at(log, event.*group),
+                               module_at(log, event.module),
+                               string_at(log, event.name))]
+        .add(event.payload);
+  }
+  return aggregates;
+}
+
+class TraceEvents : public Tool {
+ public:
+  TraceEvents() : Tool("trace-events", "decode a binary trace event log") {}
+
+  void add_options(po::options_description& options) const override {
+    options.add_options()(
+        "log,l",
+        po::value<std::string>()->value_name("events.bin")->required(),
+        "path to the trace event log")(
+        "by-method", "print per-method aggregates as csv")(
+        "by-pass", "print per-pass aggregates as csv");
+  }
+
+  void run(const po::variables_map& options) override {
+    auto log = read(options["log"].as<std::string>());
+    std::stable_sort(log.events.begin(), log.events.end(),
+                     [](const Event& a, const Event& b) {
+                       return a.timestamp_ns < b.timestamp_ns;
+                     });
+    if (options.count("by-method")) {
+      print_aggregates(aggregate(log, &Event::method));
+    } else if (options.count("by-pass")) {
+      print_aggregates(aggregate(log, &Event::pass));
+    } else {
+      print_events(log);
+    }
+  }
+};
+
+static TraceEvents s_tool;
+
+} // namespace
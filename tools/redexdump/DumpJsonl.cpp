@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "DexEncoding.h"
+#include "PrintUtil.h"
+#include "RedexDump.h"
+
+#include <string>
+
+/*
+ * A JSON-lines rendering of the dex tables: one object per item, with the
+ * file and section it belongs to, so that dumps can be diffed and queried
+ * without parsing the human-readable format. Only the requested sections are
+ * decoded.
+ */
+namespace {
+
+void append_utf8(std::string& out, uint32_t cp) {
+  if (cp < 0x80) {
+    out.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  } else {
+    out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+  }
+}
+
+// MUTF-8 encodes supplementary characters as surrogate pairs, which JSON
+// spells as \u escapes. It also encodes U+0000 as two bytes, so a zero byte
+// only ever terminates the string.
+void append_json_string(std::string& out, const char* mutf8) {
+  out.push_back('"');
+  while (*mutf8 != '\0') {
+    uint32_t cp = mutf8_next_code_point(mutf8);
+    if (cp == '"' || cp == '\\') {
+      out.push_back('\\');
+      out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x20 || (cp >= 0xd800 && cp <= 0xdfff)) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", cp);
+      out.append(buf);
+    } else {
+      append_utf8(out, cp);
+    }
+  }
+  out.push_back('"');
+}
+
+class JsonLine {
+ public:
+  JsonLine(const ddump_data* rd, const char* section) {
+    m_line = "{\"file\":";
+    append_json_string(m_line, rd->dex_filename);
+    m_line += ",\"section\":\"";
+    m_line += section;
+    m_line += '"';
+  }
+
+  JsonLine& add(const char* key, uint64_t value) {
+    add_key(key);
+    m_line += std::to_string(value);
+    return *this;
+  }
+
+  JsonLine& add(const char* key, const char* mutf8) {
+    add_key(key);
+    append_json_string(m_line, mutf8);
+    return *this;
+  }
+
+  JsonLine& add(const char* key, const std::vector<const char*>& values) {
+    add_key(key);
+    m_line.push_back('[');
+    for (size_t i = 0; i < values.size(); i++) {
+      if (i != 0) m_line.push_back(',');
+      append_json_string(m_line, values[i]);
+    }
+    m_line.push_back(']');
+    return *this;
+  }
+
+  ~JsonLine() { redump("%s}\n", m_line.c_str()); }
+
+ private:
+  void add_key(const char* key) {
+    m_line += ",\"";
+    m_line += key;
+    m_line += "\":";
+  }
+
+  std::string m_line;
+};
+
+std::vector<const char*> get_type_list(ddump_data* rd, uint32_t offset) {
+  std::vector<const char*> types;
+  if (offset != 0) {
+    auto* tl = (uint32_t*)(rd->dexmmap + offset);
+    uint32_t count = *tl++;
+    auto* type_idxs = (uint16_t*)tl;
+    for (uint32_t i = 0; i < count; i++) {
+      types.push_back(dex_string_by_type_idx(rd, type_idxs[i]));
+    }
+  }
+  return types;
+}
+
+void dump_proto(JsonLine& line, ddump_data* rd, uint32_t idx) {
+  dex_proto_id* proto = rd->dex_proto_ids + idx;
+  line.add("return", dex_string_by_type_idx(rd, proto->rtypeidx))
+      .add("params", get_type_list(rd, proto->param_off));
+}
+
+void dump_method_ref(JsonLine& line, ddump_data* rd, uint32_t idx) {
+  dex_method_id* method = rd->dex_method_ids + idx;
+  line.add("class", dex_string_by_type_idx(rd, method->classidx))
+      .add("name", dex_string_by_idx(rd, method->nameidx));
+  dump_proto(line, rd, method->protoidx);
+}
+
+void dump_code_items(ddump_data* rd) {
+  for (uint32_t i = 0; i < rd->dexh->class_defs_size; i++) {
+    auto cls_off = rd->dex_class_defs[i].class_data_offset;
+    if (!cls_off) continue;
+    const auto* class_data = (const uint8_t*)(rd->dexmmap + cls_off);
+    uint32_t sfield_count = read_uleb128(&class_data);
+    uint32_t ifield_count = read_uleb128(&class_data);
+    uint32_t dmethod_count = read_uleb128(&class_data);
+    uint32_t vmethod_count = read_uleb128(&class_data);
+    for (uint32_t j = 0; j < sfield_count + ifield_count; j++) {
+      read_uleb128(&class_data);
+      read_uleb128(&class_data);
+    }
+    for (uint32_t count : {dmethod_count, vmethod_count}) {
+      uint32_t meth_idx = 0;
+      for (uint32_t j = 0; j < count; j++) {
+        meth_idx += read_uleb128(&class_data);
+        auto flags = read_uleb128(&class_data);
+        auto code_off = read_uleb128(&class_data);
+        if (!code_off) continue;
+        auto* code_item = (dex_code_item*)(rd->dexmmap + code_off);
+        JsonLine line(rd, "code");
+        line.add("off", code_off).add("method_idx", meth_idx);
+        dump_method_ref(line, rd, meth_idx);
+        line.add("access", flags)
+            .add("registers", code_item->registers_size)
+            .add("ins", code_item->ins_size)
+            .add("outs", code_item->outs_size)
+            .add("tries", code_item->tries_size)
+            .add("debug_info_off", code_item->debug_info_off)
+            .add("insns_size", code_item->insns_size);
+      }
+    }
+  }
+}
+
+} // namespace
+
+void dump_jsonl(ddump_data* rd, const dump_sections& sections) {
+  const auto* dexh = rd->dexh;
+  JsonLine(rd, "header")
+      .add("size", dexh->file_size)
+      .add("strings", dexh->string_ids_size)
+      .add("types", dexh->type_ids_size)
+      .add("protos", dexh->proto_ids_size)
+      .add("fields", dexh->field_ids_size)
+      .add("methods", dexh->method_ids_size)
+      .add("classes", dexh->class_defs_size);
+  if (sections.string) {
+    for (uint32_t i = 0; i < dexh->string_ids_size; i++) {
+      JsonLine(rd, "string").add("idx", i).add("value",
+                                               dex_string_by_idx(rd, i));
+    }
+  }
+  if (sections.type) {
+    for (uint32_t i = 0; i < dexh->type_ids_size; i++) {
+      JsonLine(rd, "type").add("idx", i).add("name",
+                                             dex_string_by_type_idx(rd, i));
+    }
+  }
+  if (sections.proto) {
+    for (uint32_t i = 0; i < dexh->proto_ids_size; i++) {
+      JsonLine line(rd, "proto");
+      line.add("idx", i).add(
+          "shorty", dex_string_by_idx(rd, rd->dex_proto_ids[i].shortyidx));
+      dump_proto(line, rd, i);
+    }
+  }
+  if (sections.field) {
+    for (uint32_t i = 0; i < dexh->field_ids_size; i++) {
+      dex_field_id* field = rd->dex_field_ids + i;
+      JsonLine(rd, "field")
+          .add("idx", i)
+          .add("class", dex_string_by_type_idx(rd, field->classidx))
+          .add("name", dex_string_by_idx(rd, field->nameidx))
+          .add("type", dex_string_by_type_idx(rd, field->typeidx));
+    }
+  }
+  if (sections.meth) {
+    for (uint32_t i = 0; i < dexh->method_ids_size; i++) {
+      JsonLine line(rd, "method");
+      line.add("idx", i);
+      dump_method_ref(line, rd, i);
+    }
+  }
+  if (sections.clsdef) {
+    for (uint32_t i = 0; i < dexh->class_defs_size; i++) {
+      dex_class_def* cls_def = rd->dex_class_defs + i;
+      JsonLine line(rd, "clsdef");
+      line.add("idx", i)
+          .add("class", dex_string_by_type_idx(rd, cls_def->typeidx))
+          .add("access", cls_def->access_flags);
+      if (cls_def->super_idx != DEX_NO_INDEX) {
+        line.add("super", dex_string_by_type_idx(rd, cls_def->super_idx));
+      }
+      line.add("interfaces", get_type_list(rd, cls_def->interfaces_off));
+      if (cls_def->source_file_idx != DEX_NO_INDEX) {
+        line.add("source_file",
+                 dex_string_by_idx(rd, cls_def->source_file_idx));
+      }
+      line.add("annotations_off", cls_def->annotations_off)
+          .add("class_data_off", cls_def->class_data_offset)
+          .add("static_values_off", cls_def->static_values_off);
+    }
+  }
+  if (sections.code) {
+    dump_code_items(rd);
+  }
+}
@@ -8,11 +8,16 @@
 #pragma once
 
 #include <stdint.h>
+#include <string>
 
 extern bool clean;
 extern bool raw;
 extern bool escape;
 
+// When set, redump appends to this string instead of printing to stdout, so
+// that several files can be dumped concurrently.
+extern thread_local std::string* redump_buffer;
+
 void redump(const char* format, ...);
 void redump(uint32_t off, const char* format, ...);
 void redump(uint32_t pos, uint32_t off, const char* format, ...);
@@ -6,13 +6,17 @@
  */
 
 #include "RedexDump.h"
+#include <algorithm>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <vector>
 
 #include "Formatters.h"
 #include "PrintUtil.h"
+#include "WorkQueue.h"
 
 static const char ddump_usage_string[] =
     "ReDex, DEX Dump tool\n"
@@ -47,10 +51,18 @@ static const char ddump_usage_string[] =
     "printing options:\n"
     "--clean: suppress indices and offsets\n"
     "--no-headers: suppress headers\n"
-    "--raw: print all bytes, even control characters\n";
+    "--raw: print all bytes, even control characters\n"
+    "--jsonl: print one JSON object per item of the string, type, proto, "
+    "field,\n"
+    "         method, class def and code sections instead\n"
+    "\n"
+    "batch options:\n"
+    "-j, --jobs=<n>: dump up to n dex files in parallel; the output is still\n"
+    "                in the order of the files\n";
 
-int main(int argc, char* argv[]) {
+namespace {
 
+struct dump_options {
   bool all = false;
   bool string = false;
   bool stringdata = false;
@@ -68,6 +80,86 @@ int main(int argc, char* argv[]) {
   bool redexdump_debug = false;
   uint32_t ddebug_offset = 0;
   int no_headers = 0;
+  int jsonl = 0;
+};
+
+void dump_file(const char* dexfile, const dump_options& opts) {
+  const bool all = opts.all;
+  const int no_headers = opts.no_headers;
+  ddump_data rd;
+  open_dex_file(dexfile, &rd);
+  if (opts.jsonl) {
+    dump_sections sections;
+    sections.string = opts.string || all;
+    sections.type = opts.type || all;
+    sections.proto = opts.proto || all;
+    sections.field = opts.field || all;
+    sections.meth = opts.meth || all;
+    sections.clsdef = opts.clsdef || all;
+    sections.code = opts.code || all;
+    dump_jsonl(&rd, sections);
+    close_dex_file(&rd);
+    return;
+  }
+  if (!no_headers) {
+    redump(format_map(&rd).c_str());
+  }
+  if (opts.string || all) {
+    dump_strings(&rd, !no_headers);
+  }
+  if (opts.stringdata || all) {
+    dump_stringdata(&rd, !no_headers);
+  }
+  if (opts.type || all) {
+    dump_types(&rd);
+  }
+  if (opts.proto || all) {
+    dump_protos(&rd, !no_headers);
+  }
+  if (opts.field || all) {
+    dump_fields(&rd, !no_headers);
+  }
+  if (opts.meth || all) {
+    dump_methods(&rd, !no_headers);
+  }
+  if (opts.methodhandle || all) {
+    dump_methodhandles(&rd, !no_headers);
+  }
+  if (opts.callsite || all) {
+    dump_callsites(&rd, !no_headers);
+  }
+  if (opts.clsdef || all) {
+    dump_clsdefs(&rd, !no_headers);
+  }
+  if (opts.clsdata || all) {
+    dump_clsdata(&rd, !no_headers);
+  }
+  if (opts.code || all) {
+    dump_code(&rd);
+  }
+  if (opts.enarr || all) {
+    dump_enarr(&rd);
+  }
+  if (opts.anno || all) {
+    dump_anno(&rd);
+  }
+
+  if (opts.redexdump_debug || all) {
+    dump_debug(&rd);
+  }
+  if (opts.ddebug_offset != 0) {
+    disassemble_debug(&rd, opts.ddebug_offset);
+  }
+  redump("\n");
+  close_dex_file(&rd);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+
+  dump_options opts;
+  unsigned int jobs = 1;
 
   char c;
   static const struct option options[] = {
@@ -90,61 +182,66 @@ int main(int argc, char* argv[]) {
       {"clean", no_argument, (int*)&clean, 1},
       {"raw", no_argument, (int*)&raw, 1},
       {"escape", no_argument, (int*)&escape, 1},
-      {"no-headers", no_argument, &no_headers, 1},
+      {"no-headers", no_argument, &opts.no_headers, 1},
+      {"jsonl", no_argument, &opts.jsonl, 1},
+      {"jobs", required_argument, nullptr, 'j'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, 0, nullptr, 0},
   };
 
-  while ((c = getopt_long(argc, argv, "asStpfmcCxeAdD:h", &options[0],
+  while ((c = getopt_long(argc, argv, "asStpfmcCxeAdD:hj:", &options[0],
                           nullptr)) != -1) {
     switch (c) {
     case 'a':
-      all = true;
+      opts.all = true;
       break;
     case 's':
-      string = true;
+      opts.string = true;
       break;
     case 'S':
-      stringdata = true;
+      opts.stringdata = true;
       break;
     case 't':
-      type = true;
+      opts.type = true;
       break;
     case 'p':
-      proto = true;
+      opts.proto = true;
       break;
     case 'f':
-      field = true;
+      opts.field = true;
       break;
     case 'm':
-      meth = true;
+      opts.meth = true;
       break;
     case 'H':
-      methodhandle = true;
+      opts.methodhandle = true;
       break;
     case 'k':
-      callsite = true;
+      opts.callsite = true;
       break;
     case 'c':
-      clsdef = true;
+      opts.clsdef = true;
       break;
     case 'C':
-      clsdata = true;
+      opts.clsdata = true;
       break;
     case 'x':
-      code = true;
+      opts.code = true;
       break;
     case 'e':
-      enarr = true;
+      opts.enarr = true;
       break;
     case 'A':
-      anno = true;
+      opts.anno = true;
       break;
     case 'd':
-      redexdump_debug = true;
+      opts.redexdump_debug = true;
       break;
     case 'D':
-      sscanf(optarg, "%x", &ddebug_offset);
+      sscanf(optarg, "%x", &opts.ddebug_offset);
+      break;
+    case 'j':
+      jobs = std::max(1, atoi(optarg));
       break;
     case 'h':
       puts(ddump_usage_string);
@@ -164,60 +261,32 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  while (optind < argc) {
-    const char* dexfile = argv[optind++];
-    ddump_data rd;
-    open_dex_file(dexfile, &rd);
-    if (!no_headers) {
-      redump(format_map(&rd).c_str());
-    }
-    if (string || all) {
-      dump_strings(&rd, !no_headers);
-    }
-    if (stringdata || all) {
-      dump_stringdata(&rd, !no_headers);
-    }
-    if (type || all) {
-      dump_types(&rd);
-    }
-    if (proto || all) {
-      dump_protos(&rd, !no_headers);
-    }
-    if (field || all) {
-      dump_fields(&rd, !no_headers);
-    }
-    if (meth || all) {
-      dump_methods(&rd, !no_headers);
-    }
-    if (methodhandle || all) {
-      dump_methodhandles(&rd, !no_headers);
-    }
-    if (callsite || all) {
-      dump_callsites(&rd, !no_headers);
-    }
-    if (clsdef || all) {
-      dump_clsdefs(&rd, !no_headers);
-    }
-    if (clsdata || all) {
-      dump_clsdata(&rd, !no_headers);
-    }
-    if (code || all) {
-      dump_code(&rd);
-    }
-    if (enarr || all) {
-      dump_enarr(&rd);
-    }
-    if (anno || all) {
-      dump_anno(&rd);
+  std::vector<const char*> dexfiles(argv + optind, argv + argc);
+  if (jobs == 1) {
+    for (const char* dexfile : dexfiles) {
+      dump_file(dexfile, opts);
+      fflush(stdout);
     }
+    return 0;
+  }
 
-    if (redexdump_debug || all) {
-      dump_debug(&rd);
-    }
-    if (ddebug_offset != 0) {
-      disassemble_debug(&rd, ddebug_offset);
+  // Files are dumped in parallel into buffers, a batch at a time so that
+  // memory stays bounded, and printed in order.
+  const size_t batch_size = jobs * 4;
+  for (size_t start = 0; start < dexfiles.size(); start += batch_size) {
+    size_t end = std::min(dexfiles.size(), start + batch_size);
+    std::vector<std::string> outputs(end - start);
+    workqueue_run_for<size_t>(
+        start, end,
+        [&](size_t i) {
+          redump_buffer = &outputs[i - start];
+          dump_file(dexfiles[i], opts);
+          redump_buffer = nullptr;
+        },
+        jobs);
+    for (const auto& output : outputs) {
+      fwrite(output.data(), 1, output.size(), stdout);
     }
-    fprintf(stdout, "\n");
     fflush(stdout);
   }
 
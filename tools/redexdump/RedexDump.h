@@ -24,3 +24,16 @@ void dump_enarr(ddump_data* rd);
 void dump_anno(ddump_data* rd);
 void dump_debug(ddump_data* rd);
 void disassemble_debug(ddump_data* rd, uint32_t offset);
+
+struct dump_sections {
+  bool string{false};
+  bool type{false};
+  bool proto{false};
+  bool field{false};
+  bool meth{false};
+  bool clsdef{false};
+  bool code{false};
+};
+
+// Prints one JSON object per line for each item of the given sections.
+void dump_jsonl(ddump_data* rd, const dump_sections& sections);